@@ -0,0 +1,3 @@
+// Generated by build.c
+#define BOOKSTORE_IMPLEMENTATION
+#include "bookstore.h"
@@ -0,0 +1,18 @@
+// Generated by build.c
+#include "../../bookstore/test.h"
+#include "../../bookstore/aatree.h"
+#include "../../bookstore/ahocorasick.h"
+#include "../../bookstore/arena.h"
+#include "../../bookstore/array.h"
+#include "../../bookstore/basic.h"
+#include "../../bookstore/build.h"
+#include "../../bookstore/command.h"
+#include "../../bookstore/flag.h"
+#include "../../bookstore/glob.h"
+#include "../../bookstore/hash.h"
+#include "../../bookstore/random.h"
+#include "../../bookstore/regex.h"
+#include "../../bookstore/slice.h"
+#include "../../bookstore/string.h"
+#include "../../bookstore/system.h"
+#include "../../bookstore/thread.h"
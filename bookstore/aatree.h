@@ -357,16 +357,19 @@
         return true;                                                           \
     }
 
-#ifdef BOOKSTORE_IMPLEMENTATION
-
 typedef struct {
     i32 *index;
     bool visited;
 } AATree__StackFrame;
 ARRAY_TYPEDEF(AATree__StackFrame, AATree__Stack);
-ARRAY_DEFINE_PREFIX(AATree__StackFrame, AATree__Stack, aatree__stack)
+ARRAY_DECLARE_PREFIX(AATree__StackFrame, AATree__Stack, aatree__stack);
 
 ARRAY_TYPEDEF(i32, AATree__WalkStack);
+ARRAY_DECLARE_PREFIX(i32, AATree__WalkStack, aatree__walk_stack);
+
+#ifdef BOOKSTORE_IMPLEMENTATION
+
+ARRAY_DEFINE_PREFIX(AATree__StackFrame, AATree__Stack, aatree__stack)
 ARRAY_DEFINE_PREFIX(i32, AATree__WalkStack, aatree__walk_stack)
 
 #endif // BOOKSTORE_IMPLEMENTATION
@@ -0,0 +1,238 @@
+/* ahocorasick.h */
+/* Multi-pattern string matching (Aho-Corasick) */
+
+#ifndef AHOCORASICK_H_
+#define AHOCORASICK_H_
+
+#include "./arena.h"
+#include "./basic.h"
+#include "./string.h"
+
+// An automaton which finds every occurrence of a set of patterns in a single
+// pass over the text.
+//
+// Every state has a transition for every byte class, so scanning a byte is a
+// single table lookup; bytes which don't appear in any pattern share a class,
+// keeping the rows of the table short.
+typedef struct {
+    // The amount of states in the automaton; state `0` is the initial state.
+    i32 state_count;
+    // The amount of byte classes, which is the length of each row in
+    // `transitions`.
+    i32 class_count;
+    // The byte class of each byte.
+    u8 classes[256];
+    // The next state for each state and byte class, at
+    // `state * class_count + class`.
+    i32 *transitions;
+    // The first state to report matches from when reaching each state - either
+    // the state itself, or the longest proper suffix of it which ends a
+    // pattern - or `-1` if no pattern ends at the state.
+    i32 *reports;
+    // The next state to report matches from after each state with matches, or
+    // `-1`.
+    i32 *report_links;
+    // The first pattern which ends at each state, or `-1`.
+    i32 *patterns;
+    // The next pattern which is equal to each pattern, or `-1`.
+    i32 *pattern_links;
+    // The length of each pattern.
+    i32 *pattern_lengths;
+} AhoCorasick;
+
+// A match passed to the callback of `aho_corasick_search`.
+typedef struct {
+    // The `user_data` passed to `aho_corasick_search`.
+    void *user_data;
+    // The index of the matching pattern.
+    i32 pattern;
+    // The offset where the match starts, from the start of the stream.
+    i64 start;
+    // The offset where the match ends (exclusive), from the start of the
+    // stream.
+    i64 end;
+} AhoCorasickMatch;
+
+// The type of the callback passed to `aho_corasick_search`, which returns
+// whether the search should continue.
+typedef bool (*AhoCorasickMatchCallback)(AhoCorasickMatch match);
+
+// The state of a search over a stream of chunks, which allows matches to
+// straddle the boundary between chunks. Should be zero-initialized before the
+// first chunk.
+typedef struct {
+    // The current state of the automaton.
+    i32 state;
+    // The amount of bytes which were searched so far.
+    i64 offset;
+} AhoCorasickStream;
+
+// Compile `patterns` into an automaton, using `arena` to allocate its memory.
+// Empty patterns never match.
+//
+// The transition table takes up at most `(1 + L) * C * sizeof(i32)` bytes,
+// where `L` is the total length of the patterns and `C` is the amount of
+// distinct bytes in them (plus one).
+AhoCorasick aho_corasick_new(Arena *arena, StringViews patterns);
+// Search `text` for the patterns of `self`, calling `callback` for every match
+// in order of their end; matches with the same end are reported from the
+// longest to the shortest, and equal patterns in the order they were given.
+//
+// Returns `false` if the callback stopped the search, and `true` otherwise.
+bool aho_corasick_search(AhoCorasick self, StringView text,
+                         AhoCorasickMatchCallback callback, void *user_data);
+// Search the next `chunk` of a stream for the patterns of `self` like
+// `aho_corasick_search`, continuing from (and updating) `stream`.
+//
+// If the callback stops the search, `stream` is left right after the match
+// which stopped it.
+bool aho_corasick_search_stream(AhoCorasick self, AhoCorasickStream *stream,
+                                StringView chunk,
+                                AhoCorasickMatchCallback callback,
+                                void *user_data);
+
+#ifdef BOOKSTORE_IMPLEMENTATION
+
+#include <string.h>
+
+AhoCorasick aho_corasick_new(Arena *arena, StringViews patterns) {
+    AhoCorasick self = {0};
+
+    // Give every byte used in a pattern its own class, and the rest a shared
+    // class that always leads back to the initial state
+    bool used[256] = {0};
+    i32 max_states = 1;
+    for (i32 i = 0; i < patterns.count; i++) {
+        StringView pattern = patterns.items[i];
+        for (i32 j = 0; j < pattern.count; j++) {
+            used[(u8)pattern.data[j]] = true;
+        }
+        max_states += pattern.count;
+    }
+    for (i32 c = 0; c < 256; c++) {
+        if (used[c]) self.classes[c] = self.class_count++;
+    }
+    if (self.class_count < 256) {
+        for (i32 c = 0; c < 256; c++) {
+            if (!used[c]) self.classes[c] = self.class_count;
+        }
+        self.class_count++;
+    }
+
+    i32 row = self.class_count;
+    self.reports = arena_alloc(arena, max_states * sizeof(i32));
+    self.report_links = arena_alloc(arena, max_states * sizeof(i32));
+    self.patterns = arena_alloc(arena, max_states * sizeof(i32));
+    self.pattern_links = arena_alloc(arena, patterns.count * sizeof(i32));
+    self.pattern_lengths = arena_alloc(arena, patterns.count * sizeof(i32));
+    self.transitions = arena_alloc(arena, max_states * row * sizeof(i32));
+    memset(self.transitions, -1, max_states * row * sizeof(i32));
+    memset(self.patterns, -1, max_states * sizeof(i32));
+
+    // Build a trie of the patterns
+    self.state_count = 1;
+    for (i32 i = 0; i < patterns.count; i++) {
+        StringView pattern = patterns.items[i];
+        self.pattern_lengths[i] = pattern.count;
+        self.pattern_links[i] = -1;
+        if (!pattern.count) continue;
+
+        i32 state = 0;
+        for (i32 j = 0; j < pattern.count; j++) {
+            i32 *next = &self.transitions[state * row +
+                                          self.classes[(u8)pattern.data[j]]];
+            if (*next < 0) *next = self.state_count++;
+            state = *next;
+        }
+
+        // Keep equal patterns in the order they were given
+        i32 *last = &self.patterns[state];
+        while (*last >= 0) last = &self.pattern_links[*last];
+        *last = i;
+    }
+
+    // Fill in the missing transitions in breadth-first order, so the failure
+    // link of every state is complete before it's needed
+    Lifetime lt = lifetime_begin(arena);
+    i32 *failures = arena_alloc(arena, self.state_count * sizeof(i32));
+    i32 *queue = arena_alloc(arena, self.state_count * sizeof(i32));
+    i32 head = 0, tail = 0;
+
+    failures[0] = 0;
+    self.reports[0] = -1;
+    self.report_links[0] = -1;
+    queue[tail++] = 0;
+    while (head < tail) {
+        i32 state = queue[head++];
+        i32 failure = failures[state];
+        for (i32 c = 0; c < row; c++) {
+            i32 *next = &self.transitions[state * row + c];
+            if (*next < 0) {
+                *next = state ? self.transitions[failure * row + c] : 0;
+                continue;
+            }
+
+            i32 child = *next;
+            i32 child_failure =
+                state ? self.transitions[failure * row + c] : 0;
+            failures[child] = child_failure;
+            self.report_links[child] = self.reports[child_failure];
+            self.reports[child] = self.patterns[child] >= 0
+                ? child
+                : self.report_links[child];
+            queue[tail++] = child;
+        }
+    }
+    lifetime_end(lt);
+
+    return self;
+}
+
+bool aho_corasick_search(AhoCorasick self, StringView text,
+                         AhoCorasickMatchCallback callback, void *user_data) {
+    AhoCorasickStream stream = {0};
+    return aho_corasick_search_stream(self, &stream, text, callback,
+                                      user_data);
+}
+
+bool aho_corasick_search_stream(AhoCorasick self, AhoCorasickStream *stream,
+                                StringView chunk,
+                                AhoCorasickMatchCallback callback,
+                                void *user_data) {
+    const i32 *transitions = self.transitions;
+    const i32 *reports = self.reports;
+    i32 row = self.class_count;
+
+    i32 state = stream->state;
+    for (i32 i = 0; i < chunk.count; i++) {
+        state = transitions[state * row + self.classes[(u8)chunk.data[i]]];
+        if (reports[state] < 0) continue;
+
+        i64 end = stream->offset + i + 1;
+        for (i32 report = reports[state]; report >= 0;
+             report = self.report_links[report]) {
+            for (i32 pattern = self.patterns[report]; pattern >= 0;
+                 pattern = self.pattern_links[pattern]) {
+                AhoCorasickMatch match = {
+                    .user_data = user_data,
+                    .pattern = pattern,
+                    .start = end - self.pattern_lengths[pattern],
+                    .end = end,
+                };
+                if (!callback(match)) {
+                    stream->state = state;
+                    stream->offset = end;
+                    return false;
+                }
+            }
+        }
+    }
+
+    stream->state = state;
+    stream->offset += chunk.count;
+    return true;
+}
+
+#endif // BOOKSTORE_IMPLEMENTATION
+
+#endif // AHOCORASICK_H_
@@ -32,7 +32,15 @@ char *arena_clone_cstr(Arena *self, const char *cstr);
 // Format `fmt` like `printf`, returning a C-string (NUL-terminated list of
 // characters) with the result. Uses the arena to allocate the underlying
 // memory.
+//
+// The result is formatted straight into the top of the arena, so `fmt` is only
+// formatted once.
 char *arena_sprintf(Arena *arena, const char *fmt, ...) PRINTF_FORMAT(2, 3);
+// Format `fmt` like `vprintf`, returning a C-string (NUL-terminated list of
+// characters) with the result and storing its length (without the NUL
+// character) in `count`, if it isn't `NULL`. Uses the arena to allocate the
+// underlying memory.
+char *arena_vsprintf(Arena *arena, i32 *count, const char *fmt, va_list args);
 
 // A temporary lifetime, associated with an arena allocator, which provides the
 // ability to allocate memory for a temporary while and then reset the arena
@@ -62,7 +70,7 @@ Arena *arena_new(i32 capacity) {
 }
 
 void arena_destroy(Arena *self) {
-    free(self);
+    FREE(self);
 }
 
 void *arena_alloc(Arena *self, i32 size) {
@@ -86,16 +94,22 @@ char *arena_clone_cstr(Arena *self, const char *cstr) {
 
 char *arena_sprintf(Arena *arena, const char *fmt, ...) {
     va_list args;
-
     va_start(args, fmt);
-    i32 n = vsnprintf(NULL, 0, fmt, args);
+    char *dest = arena_vsprintf(arena, NULL, fmt, args);
     va_end(args);
+    return dest;
+}
 
-    char *dest = arena_alloc(arena, n + 1);
-    va_start(args, fmt);
-    vsnprintf(dest, n + 1, fmt, args);
-    va_end(args);
+char *arena_vsprintf(Arena *arena, i32 *count, const char *fmt, va_list args) {
+    // Format into whatever is left at the top of the arena, and then claim the
+    // memory that was used, which fails like any other allocation if the
+    // result didn't fit.
+    char *dest = (char *)ARENA_MEMORY(arena) + arena->allocated;
+    i32 available = arena->capacity - arena->allocated;
+    i32 n = vsnprintf(dest, available, fmt, args);
+    arena_alloc(arena, n + 1);
 
+    if (count) *count = n;
     return dest;
 }
 
@@ -187,6 +187,12 @@ typedef enum {
 #define REALLOC realloc
 #endif // REALLOC
 
+// FREE - standard library `free`
+#ifndef FREE
+#include <stdlib.h>
+#define FREE free
+#endif // FREE
+
 #ifndef MEMCPY
 #include <string.h>
 #define MEMCPY memcpy
@@ -204,7 +210,7 @@ typedef enum LogLevel {
 } LogLevel;
 
 // The minimum level to do logging to standard error
-global LogLevel min_log_level = LOG_INFO;
+extern LogLevel min_log_level;
 
 // Log a message at some `LogLevel`, with `printf` formatting using a `va_list`.
 void vlog_with_level(LogLevel level, const char *fmt, va_list args);
@@ -225,6 +231,8 @@ void log_error(const char *fmt, ...) PRINTF_FORMAT(1, 2);
 
 #include <stdlib.h>
 
+LogLevel min_log_level = LOG_INFO;
+
 void vlog_with_level(LogLevel level, const char *fmt, va_list args) {
     if (level < min_log_level) return;
 
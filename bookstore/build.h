@@ -4,11 +4,10 @@
 #include "./arena.h"
 #include "./command.h"
 #include "./flag.h"
+#include "./hash.h"
 #include "./string.h"
 #include "./system.h"
 
-#ifdef BOOKSTORE_IMPLEMENTATION
-
 #ifndef COMMAND_CC
 #if _WIN32
 #if defined(__GNUC__)
@@ -60,6 +59,15 @@
 #endif // defined(_MSC_VER) && !defined(__clang__)
 #endif // COMMAND_CC_ADDRESS_SANITIZE
 
+// Have the compiler link with the threads library, which `thread.h` uses.
+#ifndef COMMAND_CC_THREADS
+#if defined(_WIN32)
+#define COMMAND_CC_THREADS(command) ((void)(command))
+#else
+#define COMMAND_CC_THREADS(command) COMMAND_APPEND(command, "-pthread")
+#endif // defined(_WIN32)
+#endif // COMMAND_CC_THREADS
+
 #ifndef COMMAND_CC_DEFINE
 #if defined(_MSC_VER) && !defined(__clang__)
 #define COMMAND_CC_DEFINE(arena, command, macro)                               \
@@ -95,6 +103,118 @@
 #define COMMAND_CC_INPUTS(command, ...) COMMAND_APPEND(command, __VA_ARGS__)
 #endif // COMMAND_CC_INPUTS
 
+// Have the compiler write the files included by the source into the depfile
+// `path`, to be read by `build_read_depfile`.
+#ifndef COMMAND_CC_DEPFILE
+#if defined(_MSC_VER) && !defined(__clang__)
+#define COMMAND_CC_DEPFILE(command, path)                                      \
+    COMMAND_APPEND(command, "/showIncludes")
+#else
+#define COMMAND_CC_DEPFILE(command, path)                                      \
+    COMMAND_APPEND(command, "-MMD", "-MF", (path))
+#endif // defined(_MSC_VER) && !defined(__clang__)
+#endif // COMMAND_CC_DEPFILE
+
+// The `stdout_path` to run the compiler with alongside `COMMAND_CC_DEPFILE`;
+// MSVC prints the included files with the rest of its output instead of
+// writing them to the depfile, so the rest has to be printed from the depfile
+// with `build_print_depfile_output`.
+#ifndef COMMAND_CC_DEPFILE_STDOUT
+#if defined(_MSC_VER) && !defined(__clang__)
+#define COMMAND_CC_DEPFILE_STDOUT(path) (path)
+#else
+#define COMMAND_CC_DEPFILE_STDOUT(path) NULL
+#endif // defined(_MSC_VER) && !defined(__clang__)
+#endif // COMMAND_CC_DEPFILE_STDOUT
+
+// The prefix of the lines MSVC prints for the included files, which depends on
+// the language it's installed in.
+#ifndef COMMAND_CC_SHOW_INCLUDES_PREFIX
+#define COMMAND_CC_SHOW_INCLUDES_PREFIX "Note: including file:"
+#endif // COMMAND_CC_SHOW_INCLUDES_PREFIX
+
+// Have the compiler only compile the sources into object files, without
+// linking them.
+#ifndef COMMAND_CC_COMPILE_ONLY
+#if defined(_MSC_VER) && !defined(__clang__)
+#define COMMAND_CC_COMPILE_ONLY(command) COMMAND_APPEND(command, "/c")
+#else
+#define COMMAND_CC_COMPILE_ONLY(command) COMMAND_APPEND(command, "-c")
+#endif // defined(_MSC_VER) && !defined(__clang__)
+#endif // COMMAND_CC_COMPILE_ONLY
+
+// The extension of the object files written with `COMMAND_CC_COMPILE_ONLY`.
+#ifndef COMMAND_CC_OBJECT_EXTENSION
+#if defined(_MSC_VER) && !defined(__clang__)
+#define COMMAND_CC_OBJECT_EXTENSION ".obj"
+#else
+#define COMMAND_CC_OBJECT_EXTENSION ".o"
+#endif // defined(_MSC_VER) && !defined(__clang__)
+#endif // COMMAND_CC_OBJECT_EXTENSION
+
+// Have the compiler write the object file compiled with
+// `COMMAND_CC_COMPILE_ONLY`, or the header precompiled with `COMMAND_CC_PCH`,
+// to `output_path`.
+#ifndef COMMAND_CC_OBJECT_OUTPUT
+#if defined(_MSC_VER) && !defined(__clang__)
+#define COMMAND_CC_OBJECT_OUTPUT(arena, command, output_path)                  \
+    COMMAND_APPEND(command, arena_sprintf(arena, "/Fo:%s", (output_path)))
+#else
+#define COMMAND_CC_OBJECT_OUTPUT(arena, command, output_path)                  \
+    COMMAND_APPEND(command, "-o", (output_path))
+#endif // defined(_MSC_VER) && !defined(__clang__)
+#endif // COMMAND_CC_OBJECT_OUTPUT
+
+// Have the compiler include the header at `path` before the rest of the
+// source. Compilers which support `COMMAND_CC_PCH` use the precompiled version
+// of the header instead, if it's next to it.
+#ifndef COMMAND_CC_INCLUDE
+#if defined(_MSC_VER) && !defined(__clang__)
+#define COMMAND_CC_INCLUDE(arena, command, path)                               \
+    COMMAND_APPEND(command, arena_sprintf(arena, "/FI%s", (path)))
+#else
+#define COMMAND_CC_INCLUDE(arena, command, path)                               \
+    COMMAND_APPEND(command, "-include", (path))
+#endif // defined(_MSC_VER) && !defined(__clang__)
+#endif // COMMAND_CC_INCLUDE
+
+// Have the compiler precompile the header at `path`, into a file with
+// `COMMAND_CC_PCH_EXTENSION` appended to `path`. Only defined for GCC and
+// Clang, since MSVC can only precompile headers through a source file.
+#ifndef COMMAND_CC_PCH
+#if !defined(_MSC_VER) || defined(__clang__)
+#define COMMAND_CC_PCH(command, path)                                          \
+    COMMAND_APPEND(command, "-x", "c-header", (path))
+#endif // !defined(_MSC_VER) || defined(__clang__)
+#endif // COMMAND_CC_PCH
+
+#ifndef COMMAND_CC_PCH_EXTENSION
+#if defined(__clang__)
+#define COMMAND_CC_PCH_EXTENSION ".pch"
+#else
+#define COMMAND_CC_PCH_EXTENSION ".gch"
+#endif // defined(__clang__)
+#endif // COMMAND_CC_PCH_EXTENSION
+
+// Have the compiler only preprocess the source, writing it to standard output.
+#ifndef COMMAND_CC_PREPROCESS
+#if defined(_MSC_VER) && !defined(__clang__)
+#define COMMAND_CC_PREPROCESS(command) COMMAND_APPEND(command, "/E")
+#else
+#define COMMAND_CC_PREPROCESS(command) COMMAND_APPEND(command, "-E")
+#endif // defined(_MSC_VER) && !defined(__clang__)
+#endif // COMMAND_CC_PREPROCESS
+
+// Have the compiler print its version; MSVC prints it in the banner it shows
+// when run without any arguments.
+#ifndef COMMAND_CC_VERSION
+#if defined(_MSC_VER) && !defined(__clang__)
+#define COMMAND_CC_VERSION(command) ((void)(command))
+#else
+#define COMMAND_CC_VERSION(command) COMMAND_APPEND(command, "--version")
+#endif // defined(_MSC_VER) && !defined(__clang__)
+#endif // COMMAND_CC_VERSION
+
 typedef struct {
     const char *dir;
 } CommandCompileFlagsTxtOpt;
@@ -104,7 +224,128 @@ bool command_compile_flags_txt_opt(Arena *arena, Command *command,
     command_compile_flags_txt_opt(arena, command,                              \
                                   (CommandCompileFlagsTxtOpt){__VA_ARGS__})
 
-i8 build_needs_rebuild(const char *output_path, FilePaths input_paths);
+i8 build_needs_rebuild(StatCache *cache, const char *output_path,
+                       FilePaths input_paths);
+i8 build_needs_rebuild_depfile(Arena *arena, StatCache *cache,
+                               const char *output_path,
+                               const char *depfile_path, FilePaths input_paths);
+void build_parse_depfile(Arena *arena, StringView contents, FilePaths *out);
+i8 build_read_depfile(Arena *arena, const char *path, FilePaths *out);
+bool build_print_depfile_output(Arena *arena, const char *path, FILE *stream);
+bool build_parse_shard(StringView sv, i32 *shard, i32 *shard_count);
+
+// The version of the build database format; databases of other versions are
+// discarded, which rebuilds everything once.
+#define BUILD_DB_VERSION 1
+
+// A file known to a `BuildDb`, as either an output or an input.
+typedef struct {
+    // The path of the file, allocated using `MALLOC`.
+    char *path;
+    // The metadata the file had when `hash` was computed, used to skip hashing
+    // it again while it stays the same.
+    i64 mtime_ns;
+    i64 size;
+    Hash hash;
+    // The index of the record of the output at this path, or `-1`.
+    i32 record;
+    // Whether `hash` was checked against the file since the database was
+    // opened, and whether it existed then.
+    bool fresh;
+    bool exists;
+} Build__DbFile;
+
+ARRAY_TYPEDEF(Build__DbFile, Build__DbFiles);
+ARRAY_DECLARE_PREFIX(Build__DbFile, Build__DbFiles, build__db_files);
+
+// An input of a `Build__DbRecord`, with the hash it had when the output was
+// built.
+typedef struct {
+    i32 file;
+    Hash hash;
+} Build__DbInput;
+
+ARRAY_TYPEDEF(Build__DbInput, Build__DbInputs);
+ARRAY_DECLARE_PREFIX(Build__DbInput, Build__DbInputs, build__db_inputs);
+
+// How an output was last built.
+typedef struct {
+    i32 output;
+    Hash output_hash;
+    Hash command;
+    // The inputs, allocated using `MALLOC`.
+    Build__DbInputs inputs;
+} Build__DbRecord;
+
+ARRAY_TYPEDEF(Build__DbRecord, Build__DbRecords);
+ARRAY_DECLARE_PREFIX(Build__DbRecord, Build__DbRecords, build__db_records);
+
+// A persistent database of how each output was built, so an output is only
+// rebuilt once the contents of its inputs or its command actually change,
+// rather than their modification times. To be opened with `build_db_open` and
+// closed with `build_db_close`.
+typedef struct {
+    const char *path;
+    Build__DbFiles files;
+    Build__DbRecords records;
+    // An open-addressing index from the hashes of file paths to their index in
+    // `files` plus one, with `0` for empty slots; its size is a power of two.
+    i32 *slots;
+    i32 slot_count;
+    // Whether anything changed since the database was opened.
+    bool dirty;
+} BuildDb;
+
+bool build_db_open(Arena *arena, const char *path, BuildDb *self);
+bool build_db_save(Arena *arena, BuildDb *self);
+void build_db_close(BuildDb *self);
+void build_db_invalidate(BuildDb *self);
+Hash build_command_hash(Command command);
+i8 build_db_needs_rebuild(BuildDb *self, Arena *arena, StatCache *cache,
+                          const char *output_path, Hash command,
+                          FilePaths input_paths);
+bool build_db_record(BuildDb *self, Arena *arena, StatCache *cache,
+                     const char *output_path, Hash command,
+                     FilePaths input_paths);
+
+// The total size of the artifacts a `CompileCache` keeps by default, in bytes;
+// the least recently used ones are evicted past it.
+#ifndef COMPILE_CACHE_MAX_SIZE
+#define COMPILE_CACHE_MAX_SIZE GiB((i64)1)
+#endif // COMPILE_CACHE_MAX_SIZE
+
+// A local cache of compiled outputs, keyed by the hash of the compiler's
+// version, the compile command, the preprocessed source and the contents of
+// any other inputs the command reads, so sources which were already compiled
+// the same way aren't compiled again, even across clean builds and checkouts.
+// To be opened with `compile_cache_open` and closed with `compile_cache_close`.
+//
+// Cached outputs are restored as copies, which share their blocks with the
+// cache where the filesystem supports reflinks, so compilers which rewrite
+// their outputs in place, like GCC does with precompiled headers, can't change
+// the cached ones. Outputs can be restored from multiple threads at once.
+typedef struct {
+    const char *dir;
+    i64 max_size;
+    // The compiler whose version was hashed last, allocated using `MALLOC`, and
+    // the hash of its version, both guarded by `lock`.
+    char *compiler;
+    Hash compiler_hash;
+    Mutex lock;
+    // Whether anything was stored since the cache was opened, and so whether
+    // it may need trimming.
+    bool stored;
+} CompileCache;
+
+bool compile_cache_open(Arena *arena, const char *dir, i64 max_size,
+                        CompileCache *self);
+bool compile_cache_close(Arena *arena, CompileCache *self);
+i8 compile_cache_restore(CompileCache *self, Arena *arena, Command command,
+                         FilePaths input_paths, const char *output_path,
+                         const char *depfile_path, Hash *key);
+bool compile_cache_store(CompileCache *self, Arena *arena, Hash key,
+                         const char *output_path, const char *depfile_path);
+bool compile_cache_trim(CompileCache *self, Arena *arena);
 void build__self_rebuild(Arena *arena, int argc, const char **argv,
                          const char *self_path, FilePaths dependencies);
 #define SELF_REBUILD(arena, argc, argv)                                        \
@@ -112,7 +353,7 @@ void build__self_rebuild(Arena *arena, int argc, const char **argv,
 #define SELF_REBUILD_DEPENDENCIES(arena, argc, argv, paths)                    \
     build__self_rebuild(arena, argc, argv, __FILE__, paths)
 
-#endif // BOOKSTORE_IMPLEMENTATION
+#ifdef BOOKSTORE_IMPLEMENTATION
 
 bool command_compile_flags_txt_opt(Arena *arena, Command *command,
                                    CommandCompileFlagsTxtOpt opt) {
@@ -145,87 +386,866 @@ bool command_compile_flags_txt_opt(Arena *arena, Command *command,
     return true;
 }
 
-i8 build_needs_rebuild(const char *output_path, FilePaths input_paths) {
-#ifdef _WIN32
-    BOOL bSuccess;
-
-    HANDLE output_path_fd =
-        CreateFile(output_path, GENERIC_READ, 0, NULL, OPEN_EXISTING,
-                   FILE_ATTRIBUTE_READONLY, NULL);
-    if (output_path_fd == INVALID_HANDLE_VALUE) {
-        // NOTE: if output does not exist it 100% must be rebuilt
-        if (GetLastError() == ERROR_FILE_NOT_FOUND) return 1;
-        log_error("Failed to open '%s': %s", output_path,
-                  system__win32_error_message(GetLastError()));
-        return -1;
-    }
-    FILETIME output_path_time;
-    bSuccess = GetFileTime(output_path_fd, NULL, NULL, &output_path_time);
-    CloseHandle(output_path_fd);
-    if (!bSuccess) {
-        log_error("Failed to get time of '%s': %s", output_path,
-                  system__win32_error_message(GetLastError()));
-        return -1;
-    }
-
-    for (size_t i = 0; i < input_paths.count; ++i) {
-        const char *input_path = input_paths.items[i];
-        HANDLE input_path_fd =
-            CreateFile(input_path, GENERIC_READ, 0, NULL, OPEN_EXISTING,
-                       FILE_ATTRIBUTE_READONLY, NULL);
-        if (input_path_fd == INVALID_HANDLE_VALUE) {
+// Stat `path` through `cache`, or directly if it's `NULL`.
+i8 build__file_stat(StatCache *cache, const char *path, FileStat *out) {
+    if (cache) return stat_cache_get(cache, path, out);
+    return get_file_stat(path, out);
+}
+
+// Check whether any of `input_paths` was modified after `output`. Inputs which
+// don't exist are an error, unless `missing_rebuilds` is set.
+i8 build__inputs_changed(StatCache *cache, FileStat output,
+                         FilePaths input_paths, bool missing_rebuilds) {
+    for (i32 i = 0; i < input_paths.count; ++i) {
+        FilePath input_path = input_paths.items[i];
+        FileStat input;
+        i8 exists = build__file_stat(cache, input_path, &input);
+        if (exists < 0) return -1;
+        if (!exists) {
+            if (missing_rebuilds) return 1;
             // NOTE: non-existing input is an error cause it is needed for
             // building in the first place
-            log_error("Failed to open file '%s': %s", input_path,
-                      system__win32_error_message(GetLastError()));
+            log_error("Failed to stat '%s': %s", input_path, strerror(ENOENT));
             return -1;
         }
-        FILETIME input_path_time;
-        bSuccess = GetFileTime(input_path_fd, NULL, NULL, &input_path_time);
-        CloseHandle(input_path_fd);
-        if (!bSuccess) {
-            log_error("Failed to get time of '%s': %s", input_path,
-                      system__win32_error_message(GetLastError()));
-            return -1;
-        }
-
         // NOTE: if even a single input_path is fresher than output_path that's
         // 100% rebuild
-        if (CompareFileTime(&input_path_time, &output_path_time) == 1) return 1;
+        if (input.mtime_ns > output.mtime_ns) return 1;
     }
 
     return 0;
-#else
-    struct stat statbuf = {0};
+}
 
-    if (stat(output_path, &statbuf) < 0) {
-        // NOTE: if output does not exist it 100% must be rebuilt
-        if (errno == ENOENT) {
-            errno = 0;
-            return 1;
+i8 build_needs_rebuild(StatCache *cache, const char *output_path,
+                       FilePaths input_paths) {
+    FileStat output;
+    i8 exists = build__file_stat(cache, output_path, &output);
+    if (exists < 0) return -1;
+    // NOTE: if output does not exist it 100% must be rebuilt
+    if (!exists) return 1;
+
+    return build__inputs_changed(cache, output, input_paths, false);
+}
+
+i8 build_needs_rebuild_depfile(Arena *arena, StatCache *cache,
+                               const char *output_path,
+                               const char *depfile_path,
+                               FilePaths input_paths) {
+    DEFER_SETUP(i8, 0);
+
+    Lifetime lt = lifetime_begin(arena);
+    FilePaths dependencies = {0};
+
+    FileStat output;
+    i8 exists = build__file_stat(cache, output_path, &output);
+    if (exists <= 0) DEFER_RETURN(exists < 0 ? -1 : 1);
+
+    i8 changed = build__inputs_changed(cache, output, input_paths, false);
+    if (changed) DEFER_RETURN(changed);
+
+    dependencies = file_paths_new(NULL, 64);
+    exists = build_read_depfile(lt.arena, depfile_path, &dependencies);
+    if (exists <= 0) DEFER_RETURN(exists < 0 ? -1 : 1);
+
+    // A dependency which was removed is only an error if it's still included,
+    // which the compiler reports better
+    DEFER_RETURN(build__inputs_changed(cache, output, dependencies, true));
+
+    DEFER_LABEL({
+        FREE(dependencies.items);
+        lifetime_end(lt);
+    });
+}
+
+// Copy the path `raw` out of a Makefile-format depfile, unescaping the spaces,
+// `#` and `$` characters in it.
+const char *build__unescape_depfile_path(Arena *arena, StringView raw) {
+    char *path = arena_alloc(arena, raw.count + 1);
+    i32 count = 0;
+    for (i32 i = 0; i < raw.count; i++) {
+        char next = i + 1 < raw.count ? raw.data[i + 1] : '\0';
+        if (raw.data[i] == '\\' && (next == ' ' || next == '#')) i++;
+        else if (raw.data[i] == '$' && next == '$') i++;
+        path[count++] = raw.data[i];
+    }
+    path[count] = '\0';
+    return path;
+}
+
+void build_parse_depfile(Arena *arena, StringView contents, FilePaths *out) {
+    StringView show_includes = sv_from_cstr(COMMAND_CC_SHOW_INCLUDES_PREFIX);
+    if (sv_find(contents, show_includes) >= 0) {
+        while (contents.count) {
+            StringView line = sv_cut_delimiter(&contents, '\n');
+            if (!sv_strip_prefix(&line, show_includes)) continue;
+            sv_trim(&line);
+            file_paths_push(out, sv_to_cstr(arena, line));
         }
-        log_error("Failed to stat '%s': %s", output_path, strerror(errno));
-        return -1;
+        return;
     }
-    time_t output_path_time = statbuf.st_mtime;
-    for (i32 i = 0; i < input_paths.count; ++i) {
-        FilePath input_path = input_paths.items[i];
-        if (stat(input_path, &statbuf) < 0) {
-            log_info("HERE");
-            // NOTE: non-existing input is an error cause it is needed for
-            // building in the first place
-            log_error("Failed to stat '%s': %s", input_path, strerror(errno));
-            return -1;
+
+    // Whether the tokens are the prerequisites of a rule, rather than its
+    // targets
+    bool prerequisites = false;
+    const char *data = contents.data;
+    i32 i = 0;
+    while (i < contents.count) {
+        char c = data[i];
+        char next = i + 1 < contents.count ? data[i + 1] : '\0';
+        if (c == '\\' && (next == '\n' || next == '\r')) {
+            // An escaped newline continues the rule on the next line
+            i += next == '\r' ? 3 : 2;
+            continue;
+        }
+        if (c == '\n') prerequisites = false;
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            i++;
+            continue;
+        }
+
+        bool is_prerequisite = prerequisites;
+        i32 start = i;
+        for (; i < contents.count; i++) {
+            c = data[i];
+            next = i + 1 < contents.count ? data[i + 1] : '\0';
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n') break;
+            if (c == '\\') {
+                if (next == '\n' || next == '\r') break;
+                i++;
+                continue;
+            }
+            // The colons of Windows drive letters aren't followed by spaces
+            if (c == ':' && !prerequisites &&
+                (next == ' ' || next == '\t' || next == '\r' ||
+                 next == '\n' || next == '\0')) {
+                prerequisites = true;
+                break;
+            }
+        }
+
+        StringView raw = sv_from_parts(data + start, i - start);
+        if (i < contents.count && data[i] == ':') i++;
+        if (is_prerequisite && raw.count) {
+            file_paths_push(out, build__unescape_depfile_path(arena, raw));
+        }
+    }
+}
+
+i8 build_read_depfile(Arena *arena, const char *path, FilePaths *out) {
+    // The depfile is rewritten on every build, so it's never cached
+    FileStat depfile;
+    i8 exists = get_file_stat(path, &depfile);
+    if (exists <= 0) return exists;
+
+    StringView contents = read_entire_file(arena, path);
+    if (contents.count < 0) return -1;
+
+    build_parse_depfile(arena, contents, out);
+    return 1;
+}
+
+// Print the lines of the compiler's output captured into the depfile at `path`
+// with `COMMAND_CC_DEPFILE_STDOUT` to `stream`, besides those which list the
+// included files.
+bool build_print_depfile_output(Arena *arena, const char *path,
+                                FILE *stream) {
+    FileStat stat;
+    i8 exists = get_file_stat(path, &stat);
+    if (exists <= 0) return exists == 0;
+
+    Lifetime lt = lifetime_begin(arena);
+    StringView contents = read_entire_file(lt.arena, path);
+    bool result = contents.count >= 0;
+    StringView show_includes = sv_from_cstr(COMMAND_CC_SHOW_INCLUDES_PREFIX);
+    while (contents.count > 0) {
+        StringView line = sv_cut_delimiter(&contents, '\n');
+        if (sv_strip_prefix(&line, show_includes)) continue;
+        if (line.count && line.data[line.count - 1] == '\r') line.count--;
+        fprintf(stream, SV_FMT "\n", SV_ARG(line));
+    }
+    fflush(stream);
+    lifetime_end(lt);
+    return result;
+}
+
+// Parse which shard of the work to do from `sv`, given as `i/n` where `i`
+// counts from 1, like `--shard` takes it. Returns `false` if it's invalid.
+bool build_parse_shard(StringView sv, i32 *shard, i32 *shard_count) {
+    i32 count = sv.count;
+    u32 index = sv_parse_u32(&sv, 10);
+    if (sv.count <= 0 || sv.count == count || sv_get(sv, 0) != '/') {
+        return false;
+    }
+    sv_shift(&sv);
+    if (sv.count == 0) return false;
+
+    u32 total = sv_parse_u32(&sv, 10);
+    if (sv.count != 0) return false;
+    if (index < 1 || index > total || total > INT32_MAX) return false;
+
+    *shard = index;
+    *shard_count = total;
+    return true;
+}
+
+ARRAY_DEFINE_PREFIX(Build__DbFile, Build__DbFiles, build__db_files)
+ARRAY_DEFINE_PREFIX(Build__DbInput, Build__DbInputs, build__db_inputs)
+ARRAY_DEFINE_PREFIX(Build__DbRecord, Build__DbRecords, build__db_records)
+
+#define BUILD__DB_MAGIC     "BKDB"
+#define BUILD__DB_HASH_SIZE 16
+
+// Find the slot of `path` in the index of `self`, or the empty slot where it
+// belongs.
+i32 *build__db_slot(BuildDb *self, const char *path) {
+    u32 mask = self->slot_count - 1;
+    for (u32 i = system__hash_path(path) & mask;; i = (i + 1) & mask) {
+        i32 *slot = &self->slots[i];
+        if (*slot == 0 || strcmp(self->files.items[*slot - 1].path, path) == 0)
+            return slot;
+    }
+}
+
+void build__db_reindex(BuildDb *self, i32 slot_count) {
+    FREE(self->slots);
+    self->slot_count = slot_count;
+    self->slots = MALLOC(slot_count * sizeof(*self->slots));
+    ASSERT(self->slots != NULL, "unable to allocate memory for build database");
+    memset(self->slots, 0, slot_count * sizeof(*self->slots));
+    for (i32 i = 0; i < self->files.count; i++) {
+        *build__db_slot(self, self->files.items[i].path) = i + 1;
+    }
+}
+
+// Get the index of the file at `path`, or `-1` if it isn't known.
+i32 build__db_find(BuildDb *self, const char *path) {
+    return *build__db_slot(self, path) - 1;
+}
+
+// Get the index of the file at `path`, adding it if it isn't known yet.
+i32 build__db_intern(BuildDb *self, const char *path) {
+    i32 *slot = build__db_slot(self, path);
+    if (*slot) return *slot - 1;
+
+    i32 count = strlen(path) + 1;
+    Build__DbFile file = {.path = MALLOC(count), .record = -1};
+    ASSERT(file.path != NULL, "unable to allocate memory for path");
+    MEMCPY(file.path, path, count);
+    build__db_files_push(&self->files, file);
+    *slot = self->files.count;
+
+    // Keep the index at most half full, so probes stay short
+    if (self->files.count * 2 > self->slot_count) {
+        build__db_reindex(self, self->slot_count * 2);
+    }
+    return self->files.count - 1;
+}
+
+// Get the current hash of the file at index `i` into `out`, only hashing its
+// contents if its metadata changed since they were last hashed. Each file is
+// only checked once, until `build_db_invalidate`.
+//
+// Returns `1` if the file exists, `0` if it doesn't, or logs an error and
+// returns `-1` if some error occurs.
+i8 build__db_current(BuildDb *self, Arena *arena, StatCache *cache, i32 i,
+                     Hash *out) {
+    Build__DbFile *file = &self->files.items[i];
+    if (!file->fresh) {
+        FileStat stat;
+        i8 exists = build__file_stat(cache, file->path, &stat);
+        if (exists < 0) return -1;
+
+        if (exists && (!file->exists || stat.mtime_ns != file->mtime_ns ||
+                       stat.size != file->size)) {
+            Hash hash;
+            if (!HASH_FILE(arena, file->path, &hash)) return -1;
+            file->hash = hash;
+            file->mtime_ns = stat.mtime_ns;
+            file->size = stat.size;
+            self->dirty = true;
+        }
+        if (file->exists != exists) self->dirty = true;
+        file->exists = exists;
+        file->fresh = true;
+    }
+
+    *out = file->hash;
+    return file->exists;
+}
+
+// Read `count` bytes from the front of `data` into `out`.
+bool build__db_read(StringView *data, void *out, i32 count) {
+    if (data->count < count) return false;
+    MEMCPY(out, data->data, count);
+    data->data += count;
+    data->count -= count;
+    return true;
+}
+
+bool build__db_read_hash(StringView *data, Hash *out) {
+    *out = (Hash){.count = BUILD__DB_HASH_SIZE};
+    return build__db_read(data, out->bytes, BUILD__DB_HASH_SIZE);
+}
+
+// Load the files and records of the database from `data`, returning `false`
+// if it's malformed.
+bool build__db_load(BuildDb *self, StringView data) {
+    char magic[4];
+    u32 version, file_count, record_count;
+    if (!build__db_read(&data, magic, sizeof(magic)) ||
+        memcmp(magic, BUILD__DB_MAGIC, sizeof(magic)) != 0 ||
+        !build__db_read(&data, &version, sizeof(version)) ||
+        version != BUILD_DB_VERSION ||
+        !build__db_read(&data, &file_count, sizeof(file_count)) ||
+        !build__db_read(&data, &record_count, sizeof(record_count)))
+        return false;
+
+    for (u32 i = 0; i < file_count; i++) {
+        char path[SYSTEM_PATH_MAX];
+        u32 count;
+        if (!build__db_read(&data, &count, sizeof(count)) ||
+            count >= SYSTEM_PATH_MAX || !build__db_read(&data, path, count))
+            return false;
+        path[count] = '\0';
+
+        // Paths are unique, so every one of them should be new
+        if (build__db_intern(self, path) != (i32)i) return false;
+        Build__DbFile *file = &self->files.items[i];
+        u8 exists;
+        if (!build__db_read(&data, &file->mtime_ns, sizeof(file->mtime_ns)) ||
+            !build__db_read(&data, &file->size, sizeof(file->size)) ||
+            !build__db_read(&data, &exists, sizeof(exists)) ||
+            !build__db_read_hash(&data, &file->hash))
+            return false;
+        file->exists = exists;
+    }
+
+    for (u32 i = 0; i < record_count; i++) {
+        Build__DbRecord record = {0};
+        u32 output, input_count;
+        if (!build__db_read(&data, &output, sizeof(output)) ||
+            output >= file_count || self->files.items[output].record >= 0 ||
+            !build__db_read_hash(&data, &record.output_hash) ||
+            !build__db_read_hash(&data, &record.command) ||
+            !build__db_read(&data, &input_count, sizeof(input_count)) ||
+            input_count > (u32)data.count)
+            return false;
+        record.output = output;
+        record.inputs = build__db_inputs_new(NULL, input_count);
+        build__db_records_push(&self->records, record);
+        self->files.items[output].record = i;
+        Build__DbRecord *r = &self->records.items[i];
+
+        for (u32 j = 0; j < input_count; j++) {
+            u32 file;
+            Build__DbInput input;
+            if (!build__db_read(&data, &file, sizeof(file)) ||
+                file >= file_count || !build__db_read_hash(&data, &input.hash))
+                return false;
+            input.file = file;
+            build__db_inputs_push(&r->inputs, input);
+        }
+    }
+
+    return data.count == 0;
+}
+
+// Forget every file and record of the database.
+void build__db_reset(BuildDb *self) {
+    for (i32 i = 0; i < self->files.count; i++) {
+        FREE(self->files.items[i].path);
+    }
+    for (i32 i = 0; i < self->records.count; i++) {
+        FREE(self->records.items[i].inputs.items);
+    }
+    self->files.count = 0;
+    self->records.count = 0;
+    memset(self->slots, 0, self->slot_count * sizeof(*self->slots));
+}
+
+bool build_db_open(Arena *arena, const char *path, BuildDb *self) {
+    *self = (BuildDb){
+        .path = path,
+        .files = build__db_files_new(NULL, 0),
+        .records = build__db_records_new(NULL, 0),
+    };
+    build__db_reindex(self, 256);
+
+    FileStat stat;
+    i8 exists = get_file_stat(path, &stat);
+    if (exists < 0) return false;
+    if (!exists) return true;
+
+    Lifetime lt = lifetime_begin(arena);
+    MappedFile mapping;
+    StringView data = map_entire_file(lt.arena, path, &mapping);
+    bool result = data.count >= 0;
+    if (result && !build__db_load(self, data)) {
+        log_warn("Discarding malformed build database '%s'", path);
+        build__db_reset(self);
+        self->dirty = true;
+    }
+    if (result) unmap_file(&mapping);
+    lifetime_end(lt);
+    return result;
+}
+
+bool build__db_write(FileWriter *writer, const void *data, i32 count) {
+    return file_writer_write(writer, sv_from_parts((const char *)data, count));
+}
+
+bool build__db_write_hash(FileWriter *writer, Hash hash) {
+    return build__db_write(writer, hash.bytes, BUILD__DB_HASH_SIZE);
+}
+
+bool build_db_save(Arena *arena, BuildDb *self) {
+    if (!self->dirty) return true;
+
+    Lifetime lt = lifetime_begin(arena);
+    FileWriter writer;
+    if (!FILE_WRITER_OPEN(lt.arena, self->path, &writer, .atomic = true)) {
+        lifetime_end(lt);
+        return false;
+    }
+
+    u32 version = BUILD_DB_VERSION;
+    u32 file_count = self->files.count;
+    u32 record_count = self->records.count;
+    build__db_write(&writer, BUILD__DB_MAGIC, 4);
+    build__db_write(&writer, &version, sizeof(version));
+    build__db_write(&writer, &file_count, sizeof(file_count));
+    build__db_write(&writer, &record_count, sizeof(record_count));
+
+    for (i32 i = 0; i < self->files.count; i++) {
+        Build__DbFile file = self->files.items[i];
+        u32 count = strlen(file.path);
+        u8 exists = file.exists;
+        build__db_write(&writer, &count, sizeof(count));
+        build__db_write(&writer, file.path, count);
+        build__db_write(&writer, &file.mtime_ns, sizeof(file.mtime_ns));
+        build__db_write(&writer, &file.size, sizeof(file.size));
+        build__db_write(&writer, &exists, sizeof(exists));
+        build__db_write_hash(&writer, file.hash);
+    }
+
+    for (i32 i = 0; i < self->records.count; i++) {
+        Build__DbRecord record = self->records.items[i];
+        u32 output = record.output;
+        u32 input_count = record.inputs.count;
+        build__db_write(&writer, &output, sizeof(output));
+        build__db_write_hash(&writer, record.output_hash);
+        build__db_write_hash(&writer, record.command);
+        build__db_write(&writer, &input_count, sizeof(input_count));
+        for (i32 j = 0; j < record.inputs.count; j++) {
+            u32 file = record.inputs.items[j].file;
+            build__db_write(&writer, &file, sizeof(file));
+            build__db_write_hash(&writer, record.inputs.items[j].hash);
+        }
+    }
+
+    // Writing stops at the first failure, which closing reports
+    bool result = file_writer_close(&writer);
+    if (result) self->dirty = false;
+    lifetime_end(lt);
+    return result;
+}
+
+void build_db_close(BuildDb *self) {
+    build__db_reset(self);
+    FREE(self->files.items);
+    FREE(self->records.items);
+    FREE(self->slots);
+}
+
+void build_db_invalidate(BuildDb *self) {
+    for (i32 i = 0; i < self->files.count; i++) {
+        self->files.items[i].fresh = false;
+    }
+}
+
+Hash build_command_hash(Command command) {
+    StringBuilder sb = sb_new(NULL, 256);
+    for (i32 i = 0; i < command.count; i++) {
+        // Separate the arguments, so `a b` and `ab` hash differently
+        sb_append_cstr(&sb, command.items[i]);
+        sb_push_null(&sb);
+    }
+    Hash hash = HASH_SV(sb_to_sv(sb));
+    FREE(sb.items);
+    return hash;
+}
+
+i8 build_db_needs_rebuild(BuildDb *self, Arena *arena, StatCache *cache,
+                          const char *output_path, Hash command,
+                          FilePaths input_paths) {
+    i32 output = build__db_find(self, output_path);
+    if (output < 0 || self->files.items[output].record < 0) return 1;
+    Build__DbRecord *record =
+        &self->records.items[self->files.items[output].record];
+    if (!hash_eq(record->command, command)) {
+        log_debug("Command of '%s' changed", output_path);
+        return 1;
+    }
+
+    Hash hash;
+    i8 exists = build__db_current(self, arena, cache, output, &hash);
+    if (exists <= 0) return exists < 0 ? -1 : 1;
+    if (!hash_eq(hash, record->output_hash)) {
+        log_debug("'%s' was modified since it was built", output_path);
+        return 1;
+    }
+
+    // Every input must have been there when the output was built
+    for (i32 i = 0; i < input_paths.count; i++) {
+        i32 file = build__db_find(self, input_paths.items[i]);
+        bool found = false;
+        for (i32 j = 0; j < record->inputs.count && !found; j++) {
+            found = record->inputs.items[j].file == file;
+        }
+        if (!found) return 1;
+    }
+
+    for (i32 i = 0; i < record->inputs.count; i++) {
+        Build__DbInput input = record->inputs.items[i];
+        exists = build__db_current(self, arena, cache, input.file, &hash);
+        if (exists < 0) return -1;
+        if (!exists || !hash_eq(hash, input.hash)) {
+            log_debug("'%s' changed since '%s' was built",
+                      self->files.items[input.file].path, output_path);
+            return 1;
         }
-        time_t input_path_time = statbuf.st_mtime;
-        // NOTE: if even a single input_path is fresher than output_path that's
-        // 100% rebuild
-        if (input_path_time > output_path_time) return 1;
     }
 
     return 0;
+}
 
-#endif // _WIN32
+bool build_db_record(BuildDb *self, Arena *arena, StatCache *cache,
+                     const char *output_path, Hash command,
+                     FilePaths input_paths) {
+    i32 output = build__db_intern(self, output_path);
+
+    // The output was just built, so whatever was known about it is stale
+    FileStat stat;
+    i8 exists = get_file_stat(output_path, &stat);
+    if (exists < 0) return false;
+    if (!exists) {
+        log_error("Failed to record '%s': %s", output_path, strerror(ENOENT));
+        return false;
+    }
+    if (cache) stat_cache_put(cache, output_path, stat);
+    self->files.items[output].fresh = false;
+
+    Hash output_hash;
+    if (build__db_current(self, arena, cache, output, &output_hash) < 0) {
+        return false;
+    }
+
+    Build__DbInputs inputs = build__db_inputs_new(NULL, input_paths.count);
+    for (i32 i = 0; i < input_paths.count; i++) {
+        Build__DbInput input = {0};
+        input.file = build__db_intern(self, input_paths.items[i]);
+        exists = build__db_current(self, arena, cache, input.file, &input.hash);
+        if (exists <= 0) {
+            if (!exists) {
+                log_error("Failed to record '%s': '%s' doesn't exist",
+                          output_path, input_paths.items[i]);
+            }
+            FREE(inputs.items);
+            return false;
+        }
+        build__db_inputs_push(&inputs, input);
+    }
+
+    Build__DbRecord record = {
+        .output = output,
+        .output_hash = output_hash,
+        .command = command,
+        .inputs = inputs,
+    };
+    i32 index = self->files.items[output].record;
+    if (index >= 0) {
+        FREE(self->records.items[index].inputs.items);
+        self->records.items[index] = record;
+    } else {
+        self->files.items[output].record = self->records.count;
+        build__db_records_push(&self->records, record);
+    }
+    self->dirty = true;
+    return true;
+}
+
+bool compile_cache_open(Arena *arena, const char *dir, i64 max_size,
+                        CompileCache *self) {
+    *self = (CompileCache){.dir = dir, .max_size = max_size};
+    mutex_init(&self->lock);
+    return make_directory_recursively(arena, dir);
+}
+
+bool compile_cache_close(Arena *arena, CompileCache *self) {
+    bool result = !self->stored || compile_cache_trim(self, arena);
+    FREE(self->compiler);
+    self->compiler = NULL;
+    mutex_destroy(&self->lock);
+    return result;
+}
+
+// Run `command`, appending the hashes of what it writes to standard output and
+// standard error to `key`. The output is captured in temporary files next to
+// `path`.
+//
+// Returns `1` if the command succeeded, `0` if it failed, or logs an error and
+// returns `-1` if some other error occurs.
+i8 compile_cache__capture(Arena *arena, Command command, const char *path,
+                          StringBuilder *key) {
+    DEFER_SETUP(i8, 1);
+
+    Lifetime lt = lifetime_begin(arena);
+    const char *out = arena_sprintf(lt.arena, "%s.out", path);
+    const char *err = arena_sprintf(lt.arena, "%s.err", path);
+
+    if (!COMMAND_RUN(lt.arena, &command, .stdout_path = out,
+                     .stderr_path = err))
+        DEFER_RETURN(0);
+
+    Hash hash;
+    if (!HASH_FILE(lt.arena, out, &hash)) DEFER_RETURN(-1);
+    sb_append_sv(key, sv_from_parts((const char *)hash.bytes, hash.count));
+    if (!HASH_FILE(lt.arena, err, &hash)) DEFER_RETURN(-1);
+    sb_append_sv(key, sv_from_parts((const char *)hash.bytes, hash.count));
+
+    DEFER_LABEL({
+        FileStat stat;
+        if (get_file_stat(out, &stat) > 0) delete_file(out);
+        if (get_file_stat(err, &stat) > 0) delete_file(err);
+        lifetime_end(lt);
+    });
+}
+
+// Append the hash of the version of the compiler of `command` to `key`, only
+// running the compiler for it when the compiler changes.
+i8 compile_cache__compiler(CompileCache *self, Arena *arena, Command command,
+                           const char *path, StringBuilder *key) {
+    const char *compiler = command.items[0];
+    i8 captured = 1;
+    mutex_lock(&self->lock);
+    if (self->compiler == NULL || strcmp(self->compiler, compiler) != 0) {
+        Lifetime lt = lifetime_begin(arena);
+        Command version = command_new(lt.arena, 2);
+        command_push(&version, compiler);
+        COMMAND_CC_VERSION(&version);
+
+        StringBuilder hashes = sb_new(lt.arena, 2 * HASH_MAX_SIZE);
+        captured = compile_cache__capture(lt.arena, version, path, &hashes);
+        if (captured > 0) {
+            FREE(self->compiler);
+            self->compiler = MALLOC(strlen(compiler) + 1);
+            ASSERT(self->compiler != NULL,
+                   "unable to allocate memory for compiler");
+            strcpy(self->compiler, compiler);
+            self->compiler_hash = HASH_SV(sb_to_sv(hashes));
+        }
+        lifetime_end(lt);
+    }
+    Hash hash = self->compiler_hash;
+    mutex_unlock(&self->lock);
+    if (captured <= 0) return captured;
+
+    sb_append_sv(key, sv_from_parts((const char *)hash.bytes, hash.count));
+    return 1;
+}
+
+// Get the path of the entry for `key` in the cache, with `suffix` appended.
+// Entries are spread across subdirectories by the first byte of their key.
+const char *compile_cache__entry(CompileCache *self, Arena *arena, Hash key,
+                                 const char *suffix) {
+    char *hex = hash_to_hex(arena, key);
+    return arena_sprintf(arena, "%s" SYSTEM_PATH_DELIMITER_STRING
+                                "%.2s" SYSTEM_PATH_DELIMITER_STRING "%s%s",
+                         self->dir, hex, hex + 2, suffix);
+}
+
+// Restore the cached file `src` to `dest` as a copy, never as a hard link,
+// since the compiler may write into `dest` in place the next time it builds it.
+bool compile_cache__restore_file(Arena *arena, const char *src,
+                                 const char *dest) {
+    // `dest` may still be a hard link to an entry, restored by an older build,
+    // so it's replaced instead of written into
+    FileStat stat;
+    i8 exists = get_file_stat(dest, &stat);
+    if (exists < 0 || (exists && !delete_file(dest))) return false;
+    return copy_file(arena, src, dest);
+}
+
+i8 compile_cache_restore(CompileCache *self, Arena *arena, Command command,
+                         FilePaths input_paths, const char *output_path,
+                         const char *depfile_path, Hash *key) {
+    StringBuilder sb = sb_new(NULL, 1024);
+    DEFER_SETUP(i8, 1);
+
+    Lifetime lt = lifetime_begin(arena);
+
+    i8 captured =
+        compile_cache__compiler(self, lt.arena, command, output_path, &sb);
+    if (captured <= 0) DEFER_RETURN(captured);
+
+    // The output and depfile paths aren't part of `command`, so the same
+    // source compiled into different places hits the same entry
+    for (i32 i = 0; i < command.count; i++) {
+        sb_append_cstr(&sb, command.items[i]);
+        sb_push_null(&sb);
+    }
+    sb_append_cstr(&sb, depfile_path ? "depfile" : "");
+    sb_push_null(&sb);
+
+    // A source which can't be preprocessed can't be compiled either, which
+    // the compiler reports better
+    Command preprocess = command_new(lt.arena, command.count + 1);
+    command_append(&preprocess, command.items, command.count);
+    COMMAND_CC_PREPROCESS(&preprocess);
+    captured = compile_cache__capture(lt.arena, preprocess, output_path, &sb);
+    if (captured <= 0) DEFER_RETURN(captured);
+
+    // Preprocessing leaves out inputs such as objects which are linked in, so
+    // their contents are hashed as they are
+    for (i32 i = 0; i < input_paths.count; i++) {
+        Hash hash;
+        if (!HASH_FILE(lt.arena, input_paths.items[i], &hash)) {
+            DEFER_RETURN(-1);
+        }
+        sb_append_sv(&sb, sv_from_parts((const char *)hash.bytes, hash.count));
+    }
+
+    *key = HASH_SV(sb_to_sv(sb));
+    const char *entry = compile_cache__entry(self, lt.arena, *key, "");
+    const char *entry_depfile =
+        compile_cache__entry(self, lt.arena, *key, ".d");
+
+    FileStat stat;
+    i8 exists = get_file_stat(entry, &stat);
+    if (exists > 0 && depfile_path) {
+        exists = get_file_stat(entry_depfile, &stat);
+    }
+    if (exists <= 0) DEFER_RETURN(exists);
+
+    // Restoring an entry makes it the most recently used one
+    if (!touch_file(entry)) DEFER_RETURN(-1);
+    if (!compile_cache__restore_file(lt.arena, entry, output_path)) {
+        DEFER_RETURN(-1);
+    }
+    if (depfile_path && !copy_file(lt.arena, entry_depfile, depfile_path)) {
+        DEFER_RETURN(-1);
+    }
+    log_info("Restored '%s' from the compile cache", output_path);
+
+    DEFER_LABEL({
+        lifetime_end(lt);
+        FREE(sb.items);
+    });
+}
+
+// Copy `src` into the cache at `dest` under a temporary name, and only then
+// rename it into place, so other builds sharing the cache never see it
+// half-written.
+bool compile_cache__store_file(Arena *arena, const char *src,
+                               const char *dest) {
+    Lifetime lt = lifetime_begin(arena);
+    const char *temporary = system__temporary_path(lt.arena, dest);
+    bool result = copy_file(lt.arena, src, temporary);
+    if (result) result = rename_file(temporary, dest);
+    if (!result) {
+        FileStat stat;
+        if (get_file_stat(temporary, &stat) > 0) delete_file(temporary);
+    }
+    lifetime_end(lt);
+    return result;
+}
+
+bool compile_cache_store(CompileCache *self, Arena *arena, Hash key,
+                         const char *output_path, const char *depfile_path) {
+    DEFER_SETUP(bool, true);
+
+    Lifetime lt = lifetime_begin(arena);
+    const char *entry = compile_cache__entry(self, lt.arena, key, "");
+    StringView dir = get_dirname(sv_from_cstr(entry));
+    if (!make_directory(arena_sprintf(lt.arena, SV_FMT, SV_ARG(dir)), false)) {
+        DEFER_RETURN(false);
+    }
+
+    // An entry is only complete once its output is there, so that goes last
+    if (depfile_path) {
+        const char *entry_depfile =
+            compile_cache__entry(self, lt.arena, key, ".d");
+        if (!compile_cache__store_file(lt.arena, depfile_path, entry_depfile))
+            DEFER_RETURN(false);
+    }
+    if (!compile_cache__store_file(lt.arena, output_path, entry)) {
+        DEFER_RETURN(false);
+    }
+    self->stored = true;
+
+    DEFER_LABEL({ lifetime_end(lt); });
+}
+
+// A file in a `CompileCache`, while it's being trimmed.
+typedef struct {
+    const char *path;
+    i64 mtime_ns;
+    i64 size;
+} CompileCache__File;
+
+ARRAY_TYPEDEF(CompileCache__File, CompileCache__Files);
+ARRAY_DEFINE_PREFIX(CompileCache__File, CompileCache__Files,
+                    compile_cache__files)
+
+bool compile_cache__collect(WalkEntry entry) {
+    if (entry.type != FILE_TYPE_REGULAR) return true;
+
+    FileStat stat;
+    if (get_file_stat(entry.path, &stat) < 0) return false;
+    CompileCache__File file = {
+        .path = arena_clone_cstr(entry.arena, entry.path),
+        .mtime_ns = stat.mtime_ns,
+        .size = stat.size,
+    };
+    compile_cache__files_push(entry.user_data, file);
+    return true;
+}
+
+int compile_cache__compare_files(const void *a, const void *b) {
+    i64 a_mtime = ((const CompileCache__File *)a)->mtime_ns;
+    i64 b_mtime = ((const CompileCache__File *)b)->mtime_ns;
+    return (a_mtime > b_mtime) - (a_mtime < b_mtime);
+}
+
+bool compile_cache_trim(CompileCache *self, Arena *arena) {
+    CompileCache__Files files = compile_cache__files_new(NULL, 0);
+    DEFER_SETUP(bool, true);
+
+    Lifetime lt = lifetime_begin(arena);
+    if (!WALK_DIRECTORY(lt.arena, self->dir, compile_cache__collect,
+                        .user_data = &files))
+        DEFER_RETURN(false);
+
+    i64 size = 0;
+    for (i32 i = 0; i < files.count; i++) size += files.items[i].size;
+    if (size <= self->max_size) DEFER_RETURN(true);
+
+    // Evict the least recently used files down to 90% of the maximum, so the
+    // cache isn't trimmed again by every build
+    qsort(files.items, files.count, sizeof(*files.items),
+          compile_cache__compare_files);
+    i64 target = self->max_size / 10 * 9;
+    for (i32 i = 0; i < files.count && size > target; i++) {
+        if (!delete_file(files.items[i].path)) DEFER_RETURN(false);
+        size -= files.items[i].size;
+    }
+    log_info("Trimmed the compile cache '%s' to " I64_FMT " bytes", self->dir,
+             size);
+
+    DEFER_LABEL({
+        lifetime_end(lt);
+        FREE(files.items);
+    });
 }
 
 // This implementation idea is stolen from https://github.com/tsoding/nob.h,
@@ -248,7 +1268,7 @@ void build__self_rebuild(Arena *arena, int argc, const char **argv,
     file_paths_append_other(&paths, dependencies);
 
     i8 needs_rebuild =
-        build_needs_rebuild(sv_to_cstr(lt.arena, binary_path), paths);
+        build_needs_rebuild(NULL, sv_to_cstr(lt.arena, binary_path), paths);
     if (needs_rebuild < 0) exit(1);
     if (!needs_rebuild) {
         lifetime_end(lt);
@@ -261,6 +1281,7 @@ void build__self_rebuild(Arena *arena, int argc, const char **argv,
 
     COMMAND_CC(&command);
     COMMAND_CC_DEBUG_INFO(&command);
+    COMMAND_CC_THREADS(&command);
     COMMAND_CC_OUTPUT(arena, &command, output);
     COMMAND_CC_INPUTS(&command, self_path);
     if (!COMMAND_RUN(arena, &command)) {
@@ -276,4 +1297,6 @@ void build__self_rebuild(Arena *arena, int argc, const char **argv,
     exit(0);
 }
 
+#endif // BOOKSTORE_IMPLEMENTATION
+
 #endif // BUILD_H_
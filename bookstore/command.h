@@ -10,6 +10,7 @@
 #include "array.h"
 #include "basic.h"
 #include "string.h"
+#include "thread.h"
 #include <stdbool.h>
 #include <string.h>
 #include <time.h>
@@ -26,9 +27,14 @@
 #include <io.h>
 #include <shellapi.h>
 #else
+#include <signal.h>
 #include <sys/fcntl.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/syscall.h>
+#endif // __linux__
 #endif // _WIN32
 
 #ifdef _WIN32
@@ -52,6 +58,25 @@ ARRAY_DECLARE_PREFIX(Process, ProcessList, process_list);
 // Logs an error and returns `false` if the process exited with a non-success
 // exit code, or if something went wrong getting information about the process.
 bool process_wait(Process proc);
+// Check whether `proc` finished, waiting for about `ms` milliseconds if it
+// didn't. Returns 1 if it finished successfully, 0 if it's still running, and
+// -1 otherwise.
+//
+// Logs an error if the process exited with a non-success exit code, or if
+// something went wrong getting information about the process.
+i8 process_poll(Process proc, i32 ms);
+// Forcefully terminate `proc`, and wait until it finishes.
+//
+// Logs an error and returns `false` if the process couldn't be terminated.
+bool process_kill(Process proc);
+// Wait until any process in `procs` finishes, for about `ms` milliseconds, or
+// for as long as it takes if `ms` is negative. The process isn't reaped, so
+// `process_poll` then collects its result without waiting. On Windows, only
+// the first `MAXIMUM_WAIT_OBJECTS` processes are waited on.
+//
+// Returns `true` if a process finished, or if something went wrong so that
+// `process_poll` reports it, and `false` if none finished in time.
+bool process_list_wait_any(ProcessList procs, i32 ms);
 // Wait until every process in `procs` finishes.
 //
 // Logs an error and returns `false` if `process_wait` returned `false` for any
@@ -62,8 +87,6 @@ bool process_list_wait(ProcessList procs);
 // Logs an error and returns `false` if `process_wait` returned `false` for any
 // of the processes.
 bool process_list_flush(ProcessList *procs);
-// Return the number of processors available on the current machine.
-i32 processors_available(void);
 
 #ifdef _WIN32
 // A cross-platform file descriptor.
@@ -124,6 +147,10 @@ typedef struct {
     // The path to write standard error for this command to. If `NULL`, the
     // current process' standard error is used.
     const char *stderr_path;
+    // Whether to write standard error for this command into the same file as
+    // standard output, interleaved as it's written, instead of `stderr_path`.
+    // Only takes effect along with `stdout_path`.
+    bool merge_stderr;
     // Whether to keep the arguments which are currently in the command. By
     // default, the command is cleared so it can be reused for building the next
     // command.
@@ -319,6 +346,104 @@ internal i8 process__wait_async(Process proc, i32 ms) {
 #endif // _WIN32
 }
 
+i8 process_poll(Process proc, i32 ms) {
+    if (proc == PROCESS_INVALID) return -1;
+    return process__wait_async(proc, ms);
+}
+
+bool process_kill(Process proc) {
+    if (proc == PROCESS_INVALID) return false;
+
+#ifdef _WIN32
+    if (!TerminateProcess(proc, 1)) {
+        log_error("Failed to terminate child process: %s",
+                  system__win32_error_message(GetLastError()));
+        return false;
+    }
+
+    WaitForSingleObject(proc, INFINITE);
+    CloseHandle(proc);
+#else
+    if (kill(proc, SIGKILL) < 0) {
+        log_error("Failed to kill command (pid %d): %s", proc,
+                  strerror(errno));
+        return false;
+    }
+
+    // Reap the process, so it doesn't linger as a zombie
+    int wstatus;
+    while (waitpid(proc, &wstatus, 0) < 0) {
+        if (errno != EINTR) {
+            log_error("Failed to wait on command (pid %d): %s", proc,
+                      strerror(errno));
+            return false;
+        }
+    }
+#endif // _WIN32
+
+    return true;
+}
+
+#ifndef _WIN32
+// Check whether any process in `procs` finished, without reaping it.
+internal bool process__any_finished(ProcessList procs) {
+    for (i32 i = 0; i < procs.count; i++) {
+        siginfo_t info;
+        info.si_pid = 0;
+        if (waitid(P_PID, procs.items[i], &info,
+                   WEXITED | WNOHANG | WNOWAIT) < 0 ||
+            info.si_pid != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+#endif // _WIN32
+
+bool process_list_wait_any(ProcessList procs, i32 ms) {
+    if (procs.count == 0) return false;
+
+#ifdef _WIN32
+    DWORD count = MIN(procs.count, MAXIMUM_WAIT_OBJECTS);
+    DWORD result = WaitForMultipleObjects(count, procs.items, FALSE,
+                                          ms < 0 ? INFINITE : (DWORD)ms);
+    return result != WAIT_TIMEOUT;
+#else
+#ifdef SYS_pidfd_open
+    // A process' pidfd becomes readable once it finishes, so they can all be
+    // waited on at once
+    struct pollfd *fds = MALLOC(procs.count * sizeof(struct pollfd));
+    ASSERT(fds != NULL, "unable to allocate memory for waiting");
+    i32 count = 0;
+    for (; count < procs.count; count++) {
+        i32 fd = syscall(SYS_pidfd_open, procs.items[count], 0);
+        if (fd < 0) break;
+        fds[count] = (struct pollfd){.fd = fd, .events = POLLIN};
+    }
+
+    bool pollable = count == procs.count;
+    i32 ready = pollable ? poll(fds, count, ms < 0 ? -1 : ms) : 0;
+    for (i32 i = 0; i < count; i++) close(fds[i].fd);
+    FREE(fds);
+    if (pollable) return ready != 0;
+    // pidfds came in Linux 5.3, so older kernels check periodically instead
+#endif // SYS_pidfd_open
+
+    const i32 interval_ms = 10;
+    for (i32 waited = 0;; waited += interval_ms) {
+        if (process__any_finished(procs)) return true;
+        if (ms >= 0 && waited >= ms) return false;
+
+        i32 sleep_ms = ms < 0 ? interval_ms : MIN(interval_ms, ms - waited);
+        struct timespec duration = {
+            .tv_sec = 0,
+            .tv_nsec = (i64)sleep_ms * 1000000,
+        };
+        nanosleep(&duration, NULL);
+    }
+#endif // _WIN32
+}
+
 bool process_list_wait(ProcessList procs) {
     bool success = true;
     for (i32 i = 0; i < procs.count; i++)
@@ -332,16 +457,6 @@ bool process_list_flush(ProcessList *procs) {
     return success;
 }
 
-i32 processors_available(void) {
-#ifdef _WIN32
-    SYSTEM_INFO siSysInfo;
-    GetSystemInfo(&siSysInfo);
-    return siSysInfo.dwNumberOfProcessors;
-#else
-    return sysconf(_SC_NPROCESSORS_ONLN);
-#endif
-}
-
 FileDescriptor fd_open_for_read(const char *path) {
 #ifdef _WIN32
     // https://docs.microsoft.com/en-us/windows/win32/fileio/opening-a-file-for-reading-or-writing
@@ -634,7 +749,9 @@ bool command_run_opt(Arena *arena, Command *command, CommandRunOpt opt) {
         if (out == FILE_DESCRIPTOR_INVALID) DEFER_RETURN(false);
         opt_out = &out;
     }
-    if (opt.stderr_path) {
+    if (opt.merge_stderr && opt_out) {
+        opt_err = opt_out;
+    } else if (opt.stderr_path) {
         err = fd_open_for_write(opt.stderr_path);
         if (err == FILE_DESCRIPTOR_INVALID) DEFER_RETURN(false);
         opt_err = &err;
@@ -652,7 +769,7 @@ bool command_run_opt(Arena *arena, Command *command, CommandRunOpt opt) {
     DEFER_LABEL({
         if (opt_in) fd_close(*opt_in);
         if (opt_out) fd_close(*opt_out);
-        if (opt_err) fd_close(*opt_err);
+        if (opt_err && opt_err != opt_out) fd_close(*opt_err);
         if (!opt.keep_arguments) command->count = 0;
     });
 }
@@ -0,0 +1,516 @@
+/* glob.h */
+/* Glob patterns for matching file paths, compiled once and matched often */
+
+/*
+ * Supported syntax, matched byte by byte against paths whose segments are
+ * separated by `/` (or `\` on Windows):
+ *
+ * - `*` for any amount of bytes within a single segment
+ * - `?` for any single byte within a segment
+ * - `[abc]`, `[a-z]` and `[!abc]` (or `[^abc]`) for classes of bytes; use
+ *   `[*]`, `[?]`, `[[]`, `[{]` and `[}]` to match those bytes literally
+ * - `**` as a whole segment, for any amount of segments (including none)
+ * - `{a,b,c}` for alternatives, which may be nested and contain any of the
+ *   above
+ *
+ * Wildcards match leading dots too, so `*` matches hidden files.
+ */
+
+#ifndef GLOB_H_
+#define GLOB_H_
+
+#include "./arena.h"
+#include "./basic.h"
+#include "./string.h"
+
+// The maximum amount of alternatives a pattern can expand to, which bounds
+// how much memory the brace alternation of a `GlobPattern` can take.
+#ifndef GLOB_MAX_ALTERNATIVES
+#define GLOB_MAX_ALTERNATIVES 1024
+#endif // GLOB_MAX_ALTERNATIVES
+
+// The kinds of tokens in a segment of a `GlobPattern`.
+typedef enum {
+    // Match the byte `byte`.
+    GLOB__TOKEN_BYTE,
+    // Match any byte.
+    GLOB__TOKEN_ANY,
+    // Match any byte in the byte set `set`.
+    GLOB__TOKEN_CLASS,
+    // Match any amount of bytes.
+    GLOB__TOKEN_STAR,
+} Glob__TokenKind;
+
+// A set of bytes, as a bitmap.
+typedef struct {
+    u32 bits[8];
+} Glob__ByteSet;
+
+// A token in a segment of a `GlobPattern`.
+typedef struct {
+    Glob__TokenKind kind;
+    u8 byte;
+    Glob__ByteSet *set;
+} Glob__Token;
+
+// The kinds of segments in a `GlobPattern`.
+typedef enum {
+    // A segment without wildcards, compared as a whole.
+    GLOB__SEGMENT_LITERAL,
+    // A segment with wildcards, matched with its tokens.
+    GLOB__SEGMENT_WILDCARD,
+    // A `**` segment, which matches any amount of segments.
+    GLOB__SEGMENT_ANY_DEPTH,
+} Glob__SegmentKind;
+
+// A segment of a `GlobPattern`, matching a single segment of a path.
+typedef struct {
+    Glob__SegmentKind kind;
+    // The text of `GLOB__SEGMENT_LITERAL`.
+    StringView literal;
+    // The tokens of `GLOB__SEGMENT_WILDCARD`.
+    Glob__Token *tokens;
+    i32 count;
+} Glob__Segment;
+
+// One of the alternatives of a `GlobPattern`, after expanding its braces.
+typedef struct {
+    Glob__Segment *segments;
+    i32 count;
+} Glob__Alternative;
+
+// A compiled glob pattern; a path matches it if it matches any of its
+// alternatives.
+typedef struct {
+    Glob__Alternative *alternatives;
+    i32 count;
+} GlobPattern;
+
+// Compile `pattern` into `self`, using `arena` to allocate the memory for it.
+//
+// Returns `false` (and logs the error) if `pattern` isn't a valid glob.
+bool glob_compile(Arena *arena, StringView pattern, GlobPattern *self);
+// Check whether all of `path` matches `self`. Empty segments of `path` (from
+// repeated or trailing separators) are ignored.
+bool glob_match(const GlobPattern *self, StringView path);
+// Check whether some path inside the directory `path` could match `self`, so
+// directories which can't contain any match can be skipped without reading
+// them.
+bool glob_could_match_inside(const GlobPattern *self, StringView path);
+
+#ifdef BOOKSTORE_IMPLEMENTATION
+
+#include <string.h>
+
+typedef struct {
+    Arena *arena;
+    StringView pattern;
+    // The alternative which is currently being expanded.
+    char *buffer;
+    // The pattern to compile the alternatives into, or `NULL` if they're only
+    // being counted.
+    GlobPattern *self;
+    i32 count;
+    const char *error;
+} Glob__Compiler;
+
+internal bool glob__is_separator(char c) {
+#ifdef _WIN32
+    return c == '/' || c == '\\';
+#else
+    return c == '/';
+#endif // _WIN32
+}
+
+// Find the next non-empty segment of `path` at or after `*position`, and move
+// `*position` to where it ends.
+internal bool glob__next_segment(StringView path, i32 *position,
+                                 StringView *segment) {
+    i32 i = *position;
+    while (i < path.count && glob__is_separator(path.data[i])) i++;
+    if (i >= path.count) return false;
+
+    i32 start = i;
+    while (i < path.count && !glob__is_separator(path.data[i])) i++;
+    *segment = sv_from_parts(path.data + start, i - start);
+    *position = i;
+    return true;
+}
+
+// Find the end of the class starting with the `[` at `i`, or return `-1` if it
+// isn't closed within its segment.
+internal i32 glob__class_end(StringView pattern, i32 i) {
+    i++;
+    if (i < pattern.count && (pattern.data[i] == '!' || pattern.data[i] == '^'))
+        i++;
+    // A `]` right at the start is part of the class
+    if (i < pattern.count && pattern.data[i] == ']') i++;
+    for (; i < pattern.count && !glob__is_separator(pattern.data[i]); i++) {
+        if (pattern.data[i] == ']') return i + 1;
+    }
+    return -1;
+}
+
+// Find the `,` or `}` which ends the brace alternative starting at `i`.
+internal i32 glob__option_end(StringView pattern, i32 i) {
+    i32 depth = 0;
+    for (; i < pattern.count; i++) {
+        char c = pattern.data[i];
+        if (c == '[') {
+            i = glob__class_end(pattern, i) - 1;
+        } else if (c == '{') {
+            depth++;
+        } else if (c == '}') {
+            if (depth-- == 0) return i;
+        } else if (c == ',' && depth == 0) {
+            return i;
+        }
+    }
+    return i;
+}
+
+internal bool glob__validate(Glob__Compiler *c) {
+    i32 depth = 0;
+    for (i32 i = 0; i < c->pattern.count; i++) {
+        char ch = c->pattern.data[i];
+        if (ch == '[') {
+            i32 end = glob__class_end(c->pattern, i);
+            if (end < 0) {
+                c->error = "unclosed character class";
+                return false;
+            }
+            i = end - 1;
+        } else if (ch == '{') {
+            depth++;
+        } else if (ch == '}') {
+            if (depth == 0) {
+                c->error = "unmatched '}'";
+                return false;
+            }
+            depth--;
+        }
+    }
+    if (depth > 0) {
+        c->error = "unclosed '{'";
+        return false;
+    }
+    return true;
+}
+
+internal void glob__set_add(Glob__ByteSet *set, u8 byte) {
+    set->bits[byte >> 5] |= 1u << (byte & 31);
+}
+
+internal bool glob__set_has(const Glob__ByteSet *set, u8 byte) {
+    return set->bits[byte >> 5] & (1u << (byte & 31));
+}
+
+// Compile the class starting with the `[` at `i` of `text`, returning where it
+// ends.
+internal i32 glob__compile_class(Arena *arena, StringView text, i32 i,
+                                 Glob__Token *token) {
+    i32 end = glob__class_end(text, i);
+    Glob__ByteSet *set = arena_alloc(arena, sizeof(Glob__ByteSet));
+    memset(set, 0, sizeof(*set));
+
+    i++;
+    bool negate = text.data[i] == '!' || text.data[i] == '^';
+    if (negate) i++;
+    // The first byte can't end the class, even if it's `]`
+    for (i32 first = i; i == first || text.data[i] != ']';) {
+        u8 lo = text.data[i];
+        u8 hi = lo;
+        if (text.data[i + 1] == '-' && text.data[i + 2] != ']') {
+            hi = text.data[i + 2];
+            i += 3;
+        } else {
+            i++;
+        }
+        for (i32 byte = lo; byte <= hi; byte++) glob__set_add(set, byte);
+    }
+
+    if (negate) {
+        for (i32 j = 0; j < 8; j++) set->bits[j] = ~set->bits[j];
+        // Negated classes still don't match separators
+        for (i32 byte = 0; byte < 256; byte++) {
+            if (glob__is_separator(byte)) {
+                set->bits[byte >> 5] &= ~(1u << (byte & 31));
+            }
+        }
+    }
+
+    token->kind = GLOB__TOKEN_CLASS;
+    token->set = set;
+    return end;
+}
+
+internal void glob__compile_segment(Arena *arena, StringView text,
+                                    Glob__Segment *segment) {
+    if (sv_eq(text, sv_from_cstr("**"))) {
+        segment->kind = GLOB__SEGMENT_ANY_DEPTH;
+        return;
+    }
+
+    bool is_literal = true;
+    for (i32 i = 0; i < text.count && is_literal; i++) {
+        char c = text.data[i];
+        is_literal = c != '*' && c != '?' && c != '[';
+    }
+    if (is_literal) {
+        char *literal = arena_alloc(arena, text.count);
+        memcpy(literal, text.data, text.count);
+        segment->kind = GLOB__SEGMENT_LITERAL;
+        segment->literal = sv_from_parts(literal, text.count);
+        return;
+    }
+
+    segment->kind = GLOB__SEGMENT_WILDCARD;
+    segment->tokens = arena_alloc(arena, text.count * sizeof(Glob__Token));
+    segment->count = 0;
+    for (i32 i = 0; i < text.count;) {
+        Glob__Token *token = &segment->tokens[segment->count];
+        char c = text.data[i];
+        if (c == '*') {
+            // Consecutive stars match the same as a single one
+            if (segment->count == 0 ||
+                segment->tokens[segment->count - 1].kind != GLOB__TOKEN_STAR) {
+                token->kind = GLOB__TOKEN_STAR;
+                segment->count++;
+            }
+            i++;
+            continue;
+        }
+
+        if (c == '?') {
+            token->kind = GLOB__TOKEN_ANY;
+            i++;
+        } else if (c == '[') {
+            i = glob__compile_class(arena, text, i, token);
+        } else {
+            token->kind = GLOB__TOKEN_BYTE;
+            token->byte = c;
+            i++;
+        }
+        segment->count++;
+    }
+}
+
+internal void glob__emit(Glob__Compiler *c, i32 length) {
+    if (c->count >= GLOB_MAX_ALTERNATIVES) {
+        c->error = "too many alternatives";
+        return;
+    }
+
+    if (c->self) {
+        StringView text = sv_from_parts(c->buffer, length);
+        Glob__Alternative *alternative = &c->self->alternatives[c->count];
+
+        i32 max_segments = 1;
+        for (i32 i = 0; i < length; i++) {
+            if (glob__is_separator(text.data[i])) max_segments++;
+        }
+        alternative->segments =
+            arena_alloc(c->arena, max_segments * sizeof(Glob__Segment));
+        alternative->count = 0;
+
+        i32 position = 0;
+        StringView segment;
+        while (glob__next_segment(text, &position, &segment)) {
+            glob__compile_segment(
+                c->arena, segment,
+                &alternative->segments[alternative->count++]);
+        }
+    }
+    c->count++;
+}
+
+// Where to continue once a brace group being expanded ends, and then once the
+// groups around it end in turn.
+//
+// Every alternative links its own entry onto those of the groups around it,
+// so groups which come after it can't overwrite where its siblings continue.
+typedef struct Glob__Resume {
+    i32 at;
+    const struct Glob__Resume *outer;
+} Glob__Resume;
+
+// Expand the braces of the pattern from `i` onwards into `c->buffer`, after the
+// first `length` bytes which were already expanded, inside the brace groups of
+// `resume`.
+internal void glob__expand(Glob__Compiler *c, i32 i, i32 length,
+                           const Glob__Resume *resume) {
+    StringView pattern = c->pattern;
+    while (i < pattern.count) {
+        char ch = pattern.data[i];
+        if (ch == '{') {
+            i32 end = i;
+            while (pattern.data[end] != '}') {
+                end = glob__option_end(pattern, end + 1);
+            }
+
+            // Each alternative continues after the end of the group
+            Glob__Resume inner = {.at = end + 1, .outer = resume};
+            i32 j = i;
+            do {
+                glob__expand(c, j + 1, length, &inner);
+                if (c->error) return;
+                j = glob__option_end(pattern, j + 1);
+            } while (j < end);
+            return;
+        }
+
+        if (resume && (ch == ',' || ch == '}')) {
+            // The alternative ended, so continue after its group
+            i = resume->at;
+            resume = resume->outer;
+        } else if (ch == '[') {
+            i32 end = glob__class_end(pattern, i);
+            memcpy(c->buffer + length, pattern.data + i, end - i);
+            length += end - i;
+            i = end;
+        } else {
+            c->buffer[length++] = ch;
+            i++;
+        }
+    }
+    glob__emit(c, length);
+}
+
+internal bool glob__match_segment(const Glob__Segment *segment,
+                                  StringView name) {
+    if (segment->kind == GLOB__SEGMENT_LITERAL) {
+        return sv_eq(segment->literal, name);
+    }
+
+    // On a mismatch, let the last star match one more byte and try again; the
+    // stars before it can't be the problem, since everything between the last
+    // two stars already matched
+    i32 t = 0, n = 0, star = -1, star_n = 0;
+    while (n < name.count) {
+        if (t < segment->count) {
+            const Glob__Token *token = &segment->tokens[t];
+            u8 byte = name.data[n];
+            bool matches = false;
+            switch (token->kind) {
+            case GLOB__TOKEN_BYTE: matches = token->byte == byte; break;
+            case GLOB__TOKEN_ANY: matches = true; break;
+            case GLOB__TOKEN_CLASS:
+                matches = glob__set_has(token->set, byte);
+                break;
+            case GLOB__TOKEN_STAR:
+                star = ++t;
+                star_n = n;
+                continue;
+            }
+            if (matches) {
+                t++;
+                n++;
+                continue;
+            }
+        }
+        if (star < 0) return false;
+        t = star;
+        n = ++star_n;
+    }
+
+    while (t < segment->count && segment->tokens[t].kind == GLOB__TOKEN_STAR) {
+        t++;
+    }
+    return t == segment->count;
+}
+
+internal bool glob__match_alternative(const Glob__Alternative *alternative,
+                                      StringView path) {
+    // The same as `glob__match_segment`, with `**` as the star and segments as
+    // the bytes
+    i32 s = 0, position = 0, star = -1, star_position = 0;
+    StringView name;
+    for (;;) {
+        i32 next = position;
+        if (!glob__next_segment(path, &next, &name)) break;
+
+        if (s < alternative->count) {
+            const Glob__Segment *segment = &alternative->segments[s];
+            if (segment->kind == GLOB__SEGMENT_ANY_DEPTH) {
+                star = ++s;
+                star_position = position;
+                continue;
+            }
+            if (glob__match_segment(segment, name)) {
+                s++;
+                position = next;
+                continue;
+            }
+        }
+        if (star < 0) return false;
+        s = star;
+        glob__next_segment(path, &star_position, &name);
+        position = star_position;
+    }
+
+    while (s < alternative->count &&
+           alternative->segments[s].kind == GLOB__SEGMENT_ANY_DEPTH) {
+        s++;
+    }
+    return s == alternative->count;
+}
+
+bool glob_compile(Arena *arena, StringView pattern, GlobPattern *self) {
+    memset(self, 0, sizeof(*self));
+
+    Glob__Compiler compiler = {
+        .arena = arena,
+        .pattern = pattern,
+    };
+    if (!glob__validate(&compiler)) {
+        log_error("Failed to compile glob: %s", compiler.error);
+        return false;
+    }
+
+    // Expand once to count the alternatives, and then again to compile them;
+    // an alternative is never longer than the pattern itself
+    compiler.buffer = arena_alloc(arena, pattern.count);
+    glob__expand(&compiler, 0, 0, NULL);
+    if (compiler.error) {
+        log_error("Failed to compile glob: more than %d alternatives",
+                  GLOB_MAX_ALTERNATIVES);
+        return false;
+    }
+
+    self->alternatives =
+        arena_alloc(arena, compiler.count * sizeof(Glob__Alternative));
+    compiler.self = self;
+    compiler.count = 0;
+    glob__expand(&compiler, 0, 0, NULL);
+    self->count = compiler.count;
+
+    return true;
+}
+
+bool glob_match(const GlobPattern *self, StringView path) {
+    for (i32 i = 0; i < self->count; i++) {
+        if (glob__match_alternative(&self->alternatives[i], path)) return true;
+    }
+    return false;
+}
+
+bool glob_could_match_inside(const GlobPattern *self, StringView path) {
+    for (i32 i = 0; i < self->count; i++) {
+        const Glob__Alternative *alternative = &self->alternatives[i];
+        i32 position = 0;
+        StringView name;
+        for (i32 s = 0; s < alternative->count; s++) {
+            const Glob__Segment *segment = &alternative->segments[s];
+            // Once the directory's segments run out, or a `**` is reached, the
+            // rest of the alternative can match its children
+            if (segment->kind == GLOB__SEGMENT_ANY_DEPTH) return true;
+            if (!glob__next_segment(path, &position, &name)) return true;
+            if (!glob__match_segment(segment, name)) break;
+        }
+    }
+    return false;
+}
+
+#endif // BOOKSTORE_IMPLEMENTATION
+
+#endif // GLOB_H_
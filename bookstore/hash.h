@@ -0,0 +1,784 @@
+/* hash.h */
+/* Content hashing of strings and files (XXH3 and BLAKE3) */
+
+/*
+ * The hashes are implemented from the specifications and reference
+ * implementations of their authors:
+ *
+ * - XXH3, from xxHash (https://github.com/Cyan4973/xxHash), which is
+ *   Copyright (C) 2012-2021 Yann Collet, under the BSD 2-Clause License.
+ * - BLAKE3 (https://github.com/BLAKE3-team/BLAKE3), by Jack O'Connor,
+ *   Jean-Philippe Aumasson, Samuel Neves and Zooko Wilcox-O'Hearn, released
+ *   into the public domain under CC0 1.0.
+ *
+ * Both produce the exact same hashes as the reference implementations.
+ */
+
+#ifndef HASH_H_
+#define HASH_H_
+
+#include "./arena.h"
+#include "./basic.h"
+#include "./string.h"
+#include "./system.h"
+#include "./thread.h"
+#include <stdbool.h>
+#include <string.h>
+
+// The size of the largest hash, in bytes.
+#define HASH_MAX_SIZE 32
+
+// The minimum amount of bytes a subtree of a `HASH_SECURE` hash must have for
+// it to be hashed on a thread of its own.
+#ifndef HASH_PARALLEL_MIN_SIZE
+#define HASH_PARALLEL_MIN_SIZE MiB(1)
+#endif // HASH_PARALLEL_MIN_SIZE
+
+// The kind of hash to compute.
+typedef enum {
+    // XXH3's 128-bit hash, which is very fast but not cryptographic; good for
+    // detecting changes to contents nobody is trying to forge.
+    HASH_FAST,
+    // BLAKE3's 256-bit hash, which is cryptographic. It hashes its input as a
+    // tree, so large inputs can be spread across threads.
+    HASH_SECURE,
+} HashMode;
+
+// A hash of some contents.
+typedef struct {
+    // The bytes of the hash, in the order the reference implementations print
+    // them in.
+    u8 bytes[HASH_MAX_SIZE];
+    // The amount of bytes the hash has: 16 for `HASH_FAST`, and 32 for
+    // `HASH_SECURE`.
+    i32 count;
+} Hash;
+
+// Options for computing a `Hash`.
+typedef struct {
+    // The kind of hash to compute, `HASH_FAST` by default.
+    HashMode mode;
+    // The amount of threads to spread a `HASH_SECURE` hash across; inputs are
+    // hashed on the calling thread alone when it's `0` or `1`.
+    i32 threads;
+} HashOpt;
+
+// Hash the contents of `sv`, explicitly specifying the options for
+// initialization as a struct.
+//
+// You may be looking for `HASH_SV`, which allows you to specify only the
+// options you need as named optional arguments.
+Hash hash_sv_opt(StringView sv, HashOpt opt);
+// Hash the contents of `sv`.
+//
+// You can pass the `mode` named optional argument to choose which hash to
+// compute, and the `threads` named optional argument to spread a `HASH_SECURE`
+// hash across that many threads.
+#define HASH_SV(sv, ...) hash_sv_opt(sv, (HashOpt){__VA_ARGS__})
+// Hash the contents of the file at `path` into `out`, explicitly specifying
+// the options for initialization as a struct. The file is mapped into memory
+// with `map_entire_file`, and `arena` is used to create a `Lifetime` for when
+// it has to be read instead.
+//
+// Logs an error and returns `false` if some error occurs.
+//
+// You may be looking for `HASH_FILE`, which allows you to specify only the
+// options you need as named optional arguments.
+bool hash_file_opt(Arena *arena, const char *path, Hash *out, HashOpt opt);
+// Hash the contents of the file at `path` into `out`, taking the same named
+// optional arguments as `HASH_SV`.
+//
+// Logs an error and returns `false` if some error occurs.
+#define HASH_FILE(arena, path, out, ...)                                       \
+    hash_file_opt(arena, path, out, (HashOpt){__VA_ARGS__})
+// Check whether two hashes are the same.
+bool hash_eq(Hash a, Hash b);
+// Format a hash as a C-string (NUL-terminated list of characters) of lowercase
+// hexadecimal digits. Uses `arena` to allocate the memory for the string.
+char *hash_to_hex(Arena *arena, Hash self);
+
+#ifdef BOOKSTORE_IMPLEMENTATION
+
+internal u32 hash__swap32(u32 x) {
+    return (x >> 24) | ((x >> 8) & 0xFF00) | ((x << 8) & 0xFF0000) | (x << 24);
+}
+
+internal u64 hash__swap64(u64 x) {
+    return ((u64)hash__swap32(x) << 32) | hash__swap32(x >> 32);
+}
+
+// Read little-endian integers, with a single load wherever possible.
+internal u32 hash__read32(const u8 *p) {
+    u32 x;
+    MEMCPY(&x, p, sizeof(x));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    x = hash__swap32(x);
+#endif // __BYTE_ORDER__
+    return x;
+}
+
+internal u64 hash__read64(const u8 *p) {
+    u64 x;
+    MEMCPY(&x, p, sizeof(x));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    x = hash__swap64(x);
+#endif // __BYTE_ORDER__
+    return x;
+}
+
+internal u32 hash__rotl32(u32 x, i32 n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+typedef struct {
+    u64 low;
+    u64 high;
+} Hash__U128;
+
+internal Hash__U128 hash__mul128(u64 a, u64 b) {
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 product = (unsigned __int128)a * b;
+    return (Hash__U128){(u64)product, (u64)(product >> 64)};
+#else
+    u64 lo_lo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+    u64 hi_lo = (a >> 32) * (b & 0xFFFFFFFF);
+    u64 lo_hi = (a & 0xFFFFFFFF) * (b >> 32);
+    u64 hi_hi = (a >> 32) * (b >> 32);
+    u64 cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+    u64 high = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+    u64 low = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+    return (Hash__U128){low, high};
+#endif // __SIZEOF_INT128__
+}
+
+internal u64 hash__mul128_fold64(u64 a, u64 b) {
+    Hash__U128 product = hash__mul128(a, b);
+    return product.low ^ product.high;
+}
+
+// ---------------------------------------------------------------------------
+// XXH3
+// ---------------------------------------------------------------------------
+
+#define HASH__PRIME32_1 0x9E3779B1U
+#define HASH__PRIME32_2 0x85EBCA77U
+#define HASH__PRIME32_3 0xC2B2AE3DU
+#define HASH__PRIME64_1 0x9E3779B185EBCA87ULL
+#define HASH__PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define HASH__PRIME64_3 0x165667B19E3779F9ULL
+#define HASH__PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define HASH__PRIME64_5 0x27D4EB2F165667C5ULL
+#define HASH__PRIME_MX1 0x165667919E3779F9ULL
+#define HASH__PRIME_MX2 0x9FB21C651E98DF25ULL
+
+#define HASH__XXH3_SECRET_SIZE 192
+#define HASH__XXH3_STRIPE_LEN 64
+#define HASH__XXH3_STRIPES_PER_BLOCK                                           \
+    ((HASH__XXH3_SECRET_SIZE - HASH__XXH3_STRIPE_LEN) / 8)
+#define HASH__XXH3_BLOCK_LEN                                                   \
+    (HASH__XXH3_STRIPE_LEN * HASH__XXH3_STRIPES_PER_BLOCK)
+
+internal const u8 hash__xxh3_secret[HASH__XXH3_SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c,
+    0xf7, 0x21, 0xad, 0x1c, 0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+    0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f, 0xcb, 0x79, 0xe6, 0x4e,
+    0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6,
+    0x81, 0x3a, 0x26, 0x4c, 0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+    0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3, 0x71, 0x64, 0x48, 0x97,
+    0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7,
+    0xc7, 0x0b, 0x4f, 0x1d, 0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+    0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64, 0xea, 0xc5, 0xac, 0x83,
+    0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26,
+    0x29, 0xd4, 0x68, 0x9e, 0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+    0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce, 0x45, 0xcb, 0x3a, 0x8f,
+    0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+internal u64 hash__xxh64_avalanche(u64 h) {
+    h ^= h >> 33;
+    h *= HASH__PRIME64_2;
+    h ^= h >> 29;
+    h *= HASH__PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+internal u64 hash__xxh3_avalanche(u64 h) {
+    h ^= h >> 37;
+    h *= HASH__PRIME_MX1;
+    h ^= h >> 32;
+    return h;
+}
+
+internal u64 hash__xxh3_mix16(const u8 *input, const u8 *secret) {
+    return hash__mul128_fold64(hash__read64(input) ^ hash__read64(secret),
+                               hash__read64(input + 8) ^
+                                   hash__read64(secret + 8));
+}
+
+internal Hash__U128 hash__xxh3_mix32(Hash__U128 acc, const u8 *input_1,
+                                     const u8 *input_2, const u8 *secret) {
+    acc.low += hash__xxh3_mix16(input_1, secret);
+    acc.low ^= hash__read64(input_2) + hash__read64(input_2 + 8);
+    acc.high += hash__xxh3_mix16(input_2, secret + 16);
+    acc.high ^= hash__read64(input_1) + hash__read64(input_1 + 8);
+    return acc;
+}
+
+internal Hash__U128 hash__xxh3_0to16(const u8 *input, u64 count) {
+    const u8 *secret = hash__xxh3_secret;
+    Hash__U128 h;
+
+    if (count > 8) {
+        u64 bitflip_low = hash__read64(secret + 32) ^ hash__read64(secret + 40);
+        u64 bitflip_high =
+            hash__read64(secret + 48) ^ hash__read64(secret + 56);
+        u64 input_low = hash__read64(input);
+        u64 input_high = hash__read64(input + count - 8);
+        Hash__U128 m = hash__mul128(input_low ^ input_high ^ bitflip_low,
+                                    HASH__PRIME64_1);
+        m.low += (count - 1) << 54;
+        input_high ^= bitflip_high;
+        m.high += input_high +
+                  (u64)(u32)input_high * (u64)(HASH__PRIME32_2 - 1);
+        m.low ^= hash__swap64(m.high);
+
+        h = hash__mul128(m.low, HASH__PRIME64_2);
+        h.high += m.high * HASH__PRIME64_2;
+        h.low = hash__xxh3_avalanche(h.low);
+        h.high = hash__xxh3_avalanche(h.high);
+    } else if (count >= 4) {
+        u64 input_low = hash__read32(input);
+        u64 input_high = hash__read32(input + count - 4);
+        u64 bitflip = hash__read64(secret + 16) ^ hash__read64(secret + 24);
+        u64 keyed = (input_low + (input_high << 32)) ^ bitflip;
+
+        h = hash__mul128(keyed, HASH__PRIME64_1 + (count << 2));
+        h.high += h.low << 1;
+        h.low ^= h.high >> 3;
+        h.low ^= h.low >> 35;
+        h.low *= HASH__PRIME_MX2;
+        h.low ^= h.low >> 28;
+        h.high = hash__xxh3_avalanche(h.high);
+    } else if (count > 0) {
+        u32 combined_low = ((u32)input[0] << 16) |
+                           ((u32)input[count >> 1] << 24) |
+                           (u32)input[count - 1] | ((u32)count << 8);
+        u32 combined_high = hash__rotl32(hash__swap32(combined_low), 13);
+        u64 bitflip_low = hash__read32(secret) ^ hash__read32(secret + 4);
+        u64 bitflip_high = hash__read32(secret + 8) ^ hash__read32(secret + 12);
+        h.low = hash__xxh64_avalanche(combined_low ^ bitflip_low);
+        h.high = hash__xxh64_avalanche(combined_high ^ bitflip_high);
+    } else {
+        h.low = hash__xxh64_avalanche(hash__read64(secret + 64) ^
+                                      hash__read64(secret + 72));
+        h.high = hash__xxh64_avalanche(hash__read64(secret + 80) ^
+                                       hash__read64(secret + 88));
+    }
+    return h;
+}
+
+internal Hash__U128 hash__xxh3_finish(Hash__U128 acc, u64 count) {
+    Hash__U128 h;
+    h.low = hash__xxh3_avalanche(acc.low + acc.high);
+    h.high = 0 - hash__xxh3_avalanche(acc.low * HASH__PRIME64_1 +
+                                      acc.high * HASH__PRIME64_4 +
+                                      count * HASH__PRIME64_2);
+    return h;
+}
+
+internal Hash__U128 hash__xxh3_17to128(const u8 *input, u64 count) {
+    const u8 *secret = hash__xxh3_secret;
+    Hash__U128 acc = {count * HASH__PRIME64_1, 0};
+
+    if (count > 32) {
+        if (count > 64) {
+            if (count > 96) {
+                acc = hash__xxh3_mix32(acc, input + 48, input + count - 64,
+                                       secret + 96);
+            }
+            acc = hash__xxh3_mix32(acc, input + 32, input + count - 48,
+                                   secret + 64);
+        }
+        acc = hash__xxh3_mix32(acc, input + 16, input + count - 32,
+                               secret + 32);
+    }
+    acc = hash__xxh3_mix32(acc, input, input + count - 16, secret);
+    return hash__xxh3_finish(acc, count);
+}
+
+internal Hash__U128 hash__xxh3_129to240(const u8 *input, u64 count) {
+    const u8 *secret = hash__xxh3_secret;
+    Hash__U128 acc = {count * HASH__PRIME64_1, 0};
+
+    u64 i = 32;
+    for (; i < 160; i += 32) {
+        acc = hash__xxh3_mix32(acc, input + i - 32, input + i - 16,
+                               secret + i - 32);
+    }
+    acc.low = hash__xxh3_avalanche(acc.low);
+    acc.high = hash__xxh3_avalanche(acc.high);
+    for (; i <= count; i += 32) {
+        acc = hash__xxh3_mix32(acc, input + i - 32, input + i - 16,
+                               secret + 3 + i - 160);
+    }
+    acc = hash__xxh3_mix32(acc, input + count - 16, input + count - 32,
+                           secret + 136 - 17 - 16);
+    return hash__xxh3_finish(acc, count);
+}
+
+#if (defined(__GNUC__) || defined(__clang__)) &&                               \
+    (!defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+// Two lanes of the accumulator, which compilers turn into SIMD instructions.
+typedef u64 Hash__Xxh3Vector __attribute__((vector_size(16)));
+
+internal void hash__xxh3_accumulate(u64 acc[8], const u8 *input,
+                                    const u8 *secret, u64 stripes) {
+    Hash__Xxh3Vector lanes[4];
+    MEMCPY(lanes, acc, sizeof(lanes));
+    for (u64 n = 0; n < stripes; n++) {
+        const u8 *stripe = input + n * HASH__XXH3_STRIPE_LEN;
+        const u8 *key = secret + n * 8;
+        for (i32 i = 0; i < 4; i++) {
+            Hash__Xxh3Vector data, keyed;
+            MEMCPY(&data, stripe + 16 * i, sizeof(data));
+            MEMCPY(&keyed, key + 16 * i, sizeof(keyed));
+            keyed ^= data;
+            Hash__Xxh3Vector swapped = {data[1], data[0]};
+            lanes[i] += swapped + (keyed & 0xFFFFFFFF) * (keyed >> 32);
+        }
+    }
+    MEMCPY(acc, lanes, sizeof(lanes));
+}
+#else
+internal void hash__xxh3_accumulate(u64 acc[8], const u8 *input,
+                                    const u8 *secret, u64 stripes) {
+    for (u64 n = 0; n < stripes; n++) {
+        const u8 *stripe = input + n * HASH__XXH3_STRIPE_LEN;
+        const u8 *key = secret + n * 8;
+        for (i32 i = 0; i < 8; i++) {
+            u64 data = hash__read64(stripe + 8 * i);
+            u64 keyed = data ^ hash__read64(key + 8 * i);
+            acc[i ^ 1] += data;
+            acc[i] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+        }
+    }
+}
+#endif // __GNUC__ || __clang__
+
+internal void hash__xxh3_scramble(u64 acc[8], const u8 *secret) {
+    for (i32 i = 0; i < 8; i++) {
+        u64 a = acc[i];
+        a ^= a >> 47;
+        a ^= hash__read64(secret + 8 * i);
+        a *= HASH__PRIME32_1;
+        acc[i] = a;
+    }
+}
+
+internal u64 hash__xxh3_merge(const u64 acc[8], const u8 *secret, u64 start) {
+    u64 result = start;
+    for (i32 i = 0; i < 4; i++) {
+        result += hash__mul128_fold64(
+            acc[2 * i] ^ hash__read64(secret + 16 * i),
+            acc[2 * i + 1] ^ hash__read64(secret + 16 * i + 8));
+    }
+    return hash__xxh3_avalanche(result);
+}
+
+internal Hash__U128 hash__xxh3_long(const u8 *input, u64 count) {
+    const u8 *secret = hash__xxh3_secret;
+    u64 acc[8] = {
+        HASH__PRIME32_3, HASH__PRIME64_1, HASH__PRIME64_2, HASH__PRIME64_3,
+        HASH__PRIME64_4, HASH__PRIME32_2, HASH__PRIME64_5, HASH__PRIME32_1,
+    };
+
+    u64 blocks = (count - 1) / HASH__XXH3_BLOCK_LEN;
+    for (u64 n = 0; n < blocks; n++) {
+        hash__xxh3_accumulate(acc, input + n * HASH__XXH3_BLOCK_LEN, secret,
+                              HASH__XXH3_STRIPES_PER_BLOCK);
+        hash__xxh3_scramble(acc, secret + HASH__XXH3_SECRET_SIZE -
+                                     HASH__XXH3_STRIPE_LEN);
+    }
+
+    u64 stripes = ((count - 1) - HASH__XXH3_BLOCK_LEN * blocks) /
+                  HASH__XXH3_STRIPE_LEN;
+    hash__xxh3_accumulate(acc, input + blocks * HASH__XXH3_BLOCK_LEN, secret,
+                          stripes);
+    // The last stripe always ends at the end of the input, overlapping the
+    // previous one
+    hash__xxh3_accumulate(acc, input + count - HASH__XXH3_STRIPE_LEN,
+                          secret + HASH__XXH3_SECRET_SIZE -
+                              HASH__XXH3_STRIPE_LEN - 7,
+                          1);
+
+    Hash__U128 h;
+    h.low = hash__xxh3_merge(acc, secret + 11, count * HASH__PRIME64_1);
+    h.high = hash__xxh3_merge(
+        acc, secret + HASH__XXH3_SECRET_SIZE - HASH__XXH3_STRIPE_LEN - 11,
+        ~(count * HASH__PRIME64_2));
+    return h;
+}
+
+internal Hash hash__xxh3_128(const u8 *input, u64 count) {
+    Hash__U128 h;
+    if (count <= 16) {
+        h = hash__xxh3_0to16(input, count);
+    } else if (count <= 128) {
+        h = hash__xxh3_17to128(input, count);
+    } else if (count <= 240) {
+        h = hash__xxh3_129to240(input, count);
+    } else {
+        h = hash__xxh3_long(input, count);
+    }
+
+    Hash result = {.count = 16};
+    for (i32 i = 0; i < 8; i++) {
+        result.bytes[i] = h.high >> (56 - 8 * i);
+        result.bytes[8 + i] = h.low >> (56 - 8 * i);
+    }
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// BLAKE3
+// ---------------------------------------------------------------------------
+
+#define HASH__BLAKE3_BLOCK_LEN 64
+#define HASH__BLAKE3_CHUNK_LEN 1024
+
+enum {
+    HASH__BLAKE3_CHUNK_START = 1 << 0,
+    HASH__BLAKE3_CHUNK_END = 1 << 1,
+    HASH__BLAKE3_PARENT = 1 << 2,
+    HASH__BLAKE3_ROOT = 1 << 3,
+};
+
+internal const u32 hash__blake3_iv[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+    0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+internal const u8 hash__blake3_schedule[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+// The last block of a chunk or a parent node, which is only compressed once
+// it's known whether it's the root of the tree.
+typedef struct {
+    u32 cv[8];
+    u32 block[16];
+    u64 counter;
+    u32 block_len;
+    u32 flags;
+} Hash__Blake3Output;
+
+// Rotate left, on plain integers and on vectors alike.
+#define HASH__ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define HASH__BLAKE3_G(s, a, b, c, d, x, y)                                    \
+    do {                                                                       \
+        s[a] = s[a] + s[b] + (x);                                              \
+        s[d] = HASH__ROTL32(s[d] ^ s[a], 16);                                  \
+        s[c] = s[c] + s[d];                                                    \
+        s[b] = HASH__ROTL32(s[b] ^ s[c], 20);                                  \
+        s[a] = s[a] + s[b] + (y);                                              \
+        s[d] = HASH__ROTL32(s[d] ^ s[a], 24);                                  \
+        s[c] = s[c] + s[d];                                                    \
+        s[b] = HASH__ROTL32(s[b] ^ s[c], 25);                                  \
+    } while (0)
+
+#define HASH__BLAKE3_ROUND(s, block, round)                                    \
+    do {                                                                       \
+        const u8 *m = hash__blake3_schedule[round];                            \
+        HASH__BLAKE3_G(s, 0, 4, 8, 12, block[m[0]], block[m[1]]);             \
+        HASH__BLAKE3_G(s, 1, 5, 9, 13, block[m[2]], block[m[3]]);             \
+        HASH__BLAKE3_G(s, 2, 6, 10, 14, block[m[4]], block[m[5]]);            \
+        HASH__BLAKE3_G(s, 3, 7, 11, 15, block[m[6]], block[m[7]]);            \
+        HASH__BLAKE3_G(s, 0, 5, 10, 15, block[m[8]], block[m[9]]);            \
+        HASH__BLAKE3_G(s, 1, 6, 11, 12, block[m[10]], block[m[11]]);          \
+        HASH__BLAKE3_G(s, 2, 7, 8, 13, block[m[12]], block[m[13]]);           \
+        HASH__BLAKE3_G(s, 3, 4, 9, 14, block[m[14]], block[m[15]]);           \
+    } while (0)
+
+internal void hash__blake3_compress(const u32 cv[8], const u32 block[16],
+                                    u64 counter, u32 block_len, u32 flags,
+                                    u32 out[16]) {
+    u32 s[16] = {0};
+    MEMCPY(s, cv, 8 * sizeof(u32));
+    MEMCPY(s + 8, hash__blake3_iv, 4 * sizeof(u32));
+    s[12] = (u32)counter;
+    s[13] = (u32)(counter >> 32);
+    s[14] = block_len;
+    s[15] = flags;
+
+    // Spelled out, so the schedule is constant and the whole state and block
+    // can be kept in registers
+    HASH__BLAKE3_ROUND(s, block, 0);
+    HASH__BLAKE3_ROUND(s, block, 1);
+    HASH__BLAKE3_ROUND(s, block, 2);
+    HASH__BLAKE3_ROUND(s, block, 3);
+    HASH__BLAKE3_ROUND(s, block, 4);
+    HASH__BLAKE3_ROUND(s, block, 5);
+    HASH__BLAKE3_ROUND(s, block, 6);
+
+    for (i32 i = 0; i < 8; i++) {
+        out[i] = s[i] ^ s[i + 8];
+        out[i + 8] = s[i + 8] ^ cv[i];
+    }
+}
+
+internal void hash__blake3_load_block(const u8 *input, u32 block[16]) {
+    for (i32 i = 0; i < 16; i++) block[i] = hash__read32(input + 4 * i);
+}
+
+// Get the chaining value of a chunk or parent node which isn't the root.
+internal void hash__blake3_output_cv(const Hash__Blake3Output *self,
+                                     u32 cv[8]) {
+    u32 out[16];
+    hash__blake3_compress(self->cv, self->block, self->counter,
+                          self->block_len, self->flags, out);
+    MEMCPY(cv, out, 8 * sizeof(u32));
+}
+
+// Compress all the blocks of a chunk of up to `HASH__BLAKE3_CHUNK_LEN` bytes
+// but the last.
+internal Hash__Blake3Output hash__blake3_chunk(const u8 *input, i64 count,
+                                               u64 counter) {
+    Hash__Blake3Output self;
+    MEMCPY(self.cv, hash__blake3_iv, sizeof(self.cv));
+    self.counter = counter;
+
+    u32 flags = HASH__BLAKE3_CHUNK_START;
+    while (count > HASH__BLAKE3_BLOCK_LEN) {
+        u32 out[16];
+        hash__blake3_load_block(input, self.block);
+        hash__blake3_compress(self.cv, self.block, counter,
+                              HASH__BLAKE3_BLOCK_LEN, flags, out);
+        MEMCPY(self.cv, out, sizeof(self.cv));
+        flags = 0;
+        input += HASH__BLAKE3_BLOCK_LEN;
+        count -= HASH__BLAKE3_BLOCK_LEN;
+    }
+
+    u8 last[HASH__BLAKE3_BLOCK_LEN] = {0};
+    if (count > 0) MEMCPY(last, input, count);
+    hash__blake3_load_block(last, self.block);
+    self.block_len = count;
+    self.flags = flags | HASH__BLAKE3_CHUNK_END;
+    return self;
+}
+
+// Get the output of the parent node of two chaining values.
+internal Hash__Blake3Output hash__blake3_parent(const u32 left[8],
+                                                const u32 right[8]) {
+    Hash__Blake3Output self;
+    MEMCPY(self.cv, hash__blake3_iv, sizeof(self.cv));
+    MEMCPY(self.block, left, 8 * sizeof(u32));
+    MEMCPY(self.block + 8, right, 8 * sizeof(u32));
+    self.counter = 0;
+    self.block_len = HASH__BLAKE3_BLOCK_LEN;
+    self.flags = HASH__BLAKE3_PARENT;
+    return self;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+// The amount of whole chunks which are compressed at once, one in each lane of
+// a vector, which compilers turn into SIMD instructions.
+#ifdef __AVX2__
+#define HASH__BLAKE3_LANES 8
+#else
+#define HASH__BLAKE3_LANES 4
+#endif // __AVX2__
+
+typedef u32 Hash__Blake3Vector
+    __attribute__((vector_size(4 * HASH__BLAKE3_LANES)));
+
+// Get the chaining values of `HASH__BLAKE3_LANES` consecutive whole chunks,
+// the first of which has the index `counter`.
+internal void hash__blake3_chunks(const u8 *input, u64 counter,
+                                  u32 cvs[HASH__BLAKE3_LANES][8]) {
+    Hash__Blake3Vector zero = {0};
+    Hash__Blake3Vector cv[8];
+    for (i32 i = 0; i < 8; i++) cv[i] = zero + hash__blake3_iv[i];
+    Hash__Blake3Vector counter_low, counter_high;
+    for (i32 lane = 0; lane < HASH__BLAKE3_LANES; lane++) {
+        counter_low[lane] = (u32)(counter + lane);
+        counter_high[lane] = (u32)((counter + lane) >> 32);
+    }
+
+    for (i32 b = 0; b < HASH__BLAKE3_CHUNK_LEN / HASH__BLAKE3_BLOCK_LEN; b++) {
+        Hash__Blake3Vector block[16];
+        for (i32 lane = 0; lane < HASH__BLAKE3_LANES; lane++) {
+            const u8 *p = input + lane * HASH__BLAKE3_CHUNK_LEN +
+                          b * HASH__BLAKE3_BLOCK_LEN;
+            for (i32 w = 0; w < 16; w++) {
+                block[w][lane] = hash__read32(p + 4 * w);
+            }
+        }
+
+        u32 flags = 0;
+        if (b == 0) flags |= HASH__BLAKE3_CHUNK_START;
+        if (b == HASH__BLAKE3_CHUNK_LEN / HASH__BLAKE3_BLOCK_LEN - 1) {
+            flags |= HASH__BLAKE3_CHUNK_END;
+        }
+
+        Hash__Blake3Vector s[16];
+        for (i32 i = 0; i < 8; i++) s[i] = cv[i];
+        for (i32 i = 0; i < 4; i++) s[8 + i] = zero + hash__blake3_iv[i];
+        s[12] = counter_low;
+        s[13] = counter_high;
+        s[14] = zero + HASH__BLAKE3_BLOCK_LEN;
+        s[15] = zero + flags;
+
+        HASH__BLAKE3_ROUND(s, block, 0);
+        HASH__BLAKE3_ROUND(s, block, 1);
+        HASH__BLAKE3_ROUND(s, block, 2);
+        HASH__BLAKE3_ROUND(s, block, 3);
+        HASH__BLAKE3_ROUND(s, block, 4);
+        HASH__BLAKE3_ROUND(s, block, 5);
+        HASH__BLAKE3_ROUND(s, block, 6);
+        for (i32 i = 0; i < 8; i++) cv[i] = s[i] ^ s[i + 8];
+    }
+
+    for (i32 lane = 0; lane < HASH__BLAKE3_LANES; lane++) {
+        for (i32 i = 0; i < 8; i++) cvs[lane][i] = cv[i][lane];
+    }
+}
+#endif // __GNUC__ || __clang__
+
+// A subtree of a BLAKE3 hash, which may be hashed on a thread of its own.
+typedef struct {
+    const u8 *input;
+    i64 count;
+    // The index of the first chunk of the subtree.
+    u64 counter;
+    i32 threads;
+    Hash__Blake3Output output;
+} Hash__Blake3Subtree;
+
+internal void hash__blake3_subtree(void *data) {
+    Hash__Blake3Subtree *self = data;
+    if (self->count <= HASH__BLAKE3_CHUNK_LEN) {
+        self->output =
+            hash__blake3_chunk(self->input, self->count, self->counter);
+        return;
+    }
+
+#ifdef HASH__BLAKE3_LANES
+    // Subtrees are split into powers of two of chunks, so this is where the
+    // bulk of any large input ends up
+    if (self->count == HASH__BLAKE3_LANES * HASH__BLAKE3_CHUNK_LEN) {
+        u32 cvs[HASH__BLAKE3_LANES][8];
+        hash__blake3_chunks(self->input, self->counter, cvs);
+        for (i32 n = HASH__BLAKE3_LANES; n > 2; n /= 2) {
+            for (i32 i = 0; i < n / 2; i++) {
+                Hash__Blake3Output parent =
+                    hash__blake3_parent(cvs[2 * i], cvs[2 * i + 1]);
+                hash__blake3_output_cv(&parent, cvs[i]);
+            }
+        }
+        self->output = hash__blake3_parent(cvs[0], cvs[1]);
+        return;
+    }
+#endif // HASH__BLAKE3_LANES
+
+    // The left subtree gets the largest power of two amount of chunks which
+    // still leaves something for the right one
+    i64 full_chunks = (self->count - 1) / HASH__BLAKE3_CHUNK_LEN;
+    i64 left_chunks = 1;
+    while (left_chunks * 2 <= full_chunks) left_chunks *= 2;
+    i64 left_count = left_chunks * HASH__BLAKE3_CHUNK_LEN;
+
+    Hash__Blake3Subtree left = {
+        .input = self->input,
+        .count = left_count,
+        .counter = self->counter,
+        .threads = self->threads / 2,
+    };
+    Hash__Blake3Subtree right = {
+        .input = self->input + left_count,
+        .count = self->count - left_count,
+        .counter = self->counter + left_chunks,
+        .threads = self->threads - self->threads / 2,
+    };
+
+    Thread thread;
+    bool spawned = self->threads > 1 && left_count >= HASH_PARALLEL_MIN_SIZE &&
+                   thread_start(&thread, hash__blake3_subtree, &left);
+    if (!spawned) hash__blake3_subtree(&left);
+    hash__blake3_subtree(&right);
+    if (spawned) thread_join(thread);
+
+    u32 left_cv[8], right_cv[8];
+    hash__blake3_output_cv(&left.output, left_cv);
+    hash__blake3_output_cv(&right.output, right_cv);
+    self->output = hash__blake3_parent(left_cv, right_cv);
+}
+
+internal Hash hash__blake3(const u8 *input, i64 count, i32 threads) {
+    Hash__Blake3Subtree root = {
+        .input = input,
+        .count = count,
+        .threads = threads,
+    };
+    hash__blake3_subtree(&root);
+
+    u32 out[16];
+    hash__blake3_compress(root.output.cv, root.output.block, 0,
+                          root.output.block_len,
+                          root.output.flags | HASH__BLAKE3_ROOT, out);
+
+    Hash result = {.count = 32};
+    for (i32 i = 0; i < 32; i++) result.bytes[i] = out[i / 4] >> (8 * (i % 4));
+    return result;
+}
+
+Hash hash_sv_opt(StringView sv, HashOpt opt) {
+    const u8 *input = (const u8 *)sv.data;
+    switch (opt.mode) {
+    case HASH_FAST: return hash__xxh3_128(input, sv.count);
+    case HASH_SECURE: return hash__blake3(input, sv.count, opt.threads);
+    }
+    UNREACHABLE("HashMode");
+}
+
+bool hash_file_opt(Arena *arena, const char *path, Hash *out, HashOpt opt) {
+    Lifetime lt = lifetime_begin(arena);
+    MappedFile mapping;
+    StringView contents = map_entire_file(lt.arena, path, &mapping);
+    if (contents.count >= 0) {
+        *out = hash_sv_opt(contents, opt);
+        unmap_file(&mapping);
+    }
+    lifetime_end(lt);
+    return contents.count >= 0;
+}
+
+bool hash_eq(Hash a, Hash b) {
+    return a.count == b.count && memcmp(a.bytes, b.bytes, a.count) == 0;
+}
+
+char *hash_to_hex(Arena *arena, Hash self) {
+    static const char digits[] = "0123456789abcdef";
+    char *hex = arena_alloc(arena, 2 * self.count + 1);
+    for (i32 i = 0; i < self.count; i++) {
+        hex[2 * i] = digits[self.bytes[i] >> 4];
+        hex[2 * i + 1] = digits[self.bytes[i] & 0xF];
+    }
+    hex[2 * self.count] = '\0';
+    return hex;
+}
+
+#endif // BOOKSTORE_IMPLEMENTATION
+
+#endif // HASH_H_
@@ -0,0 +1,1028 @@
+/* regex.h */
+/* Regular expressions, matched in linear time with a lazily built DFA */
+
+/*
+ * Supported syntax, matched byte by byte (so `.` and classes match single
+ * bytes, not UTF-8 code points):
+ *
+ * - Literal bytes, and `\` before any punctuation to match it literally
+ * - `.` for any byte except `\n`
+ * - `[abc]`, `[a-z]` and `[^abc]` for classes of bytes
+ * - `\d`, `\w`, `\s` and their negations `\D`, `\W`, `\S`, inside classes too
+ * - `\n`, `\r`, `\t`, `\f`, `\v` and `\0` for control characters
+ * - `^` and `$` for the start and end of the text
+ * - `(...)` and `(?:...)` for grouping, `|` for alternation
+ * - `*`, `+`, `?`, `{n}`, `{n,}` and `{n,m}` for repetition
+ *
+ * Searches find the leftmost-longest match, like POSIX.
+ */
+
+#ifndef REGEX_H_
+#define REGEX_H_
+
+#include "./arena.h"
+#include "./basic.h"
+#include "./string.h"
+
+// The amount of memory, in bytes, used to cache the states of each DFA of a
+// `Regex` - when it fills up, the cache is cleared and states are built again
+// as they're needed. Patterns whose largest states wouldn't fit get a larger
+// cache instead.
+#ifndef REGEX_CACHE_SIZE
+#define REGEX_CACHE_SIZE KiB(64)
+#endif // REGEX_CACHE_SIZE
+
+// The maximum amount of instructions in a compiled NFA, which bounds how far
+// counted repetitions (`{n,m}`) can be expanded.
+#ifndef REGEX_MAX_INSTRUCTIONS
+#define REGEX_MAX_INSTRUCTIONS 8192
+#endif // REGEX_MAX_INSTRUCTIONS
+
+// The kinds of instructions in the NFA of a `Regex`.
+typedef enum {
+    // Consume a byte in the byte set `arg`, then go to `next`.
+    REGEX__OP_BYTES,
+    // Go to both `next` and `arg`.
+    REGEX__OP_SPLIT,
+    // Go to `next` only at the start of the text.
+    REGEX__OP_BEGIN,
+    // Go to `next` only at the end of the text.
+    REGEX__OP_END,
+    // The regex matched.
+    REGEX__OP_MATCH,
+} Regex__Op;
+
+// An instruction in the NFA of a `Regex`.
+typedef struct {
+    Regex__Op op;
+    i32 next;
+    i32 arg;
+} Regex__Inst;
+
+// A set of bytes, as a bitmap.
+typedef struct {
+    u32 bits[8];
+} Regex__ByteSet;
+
+// A state of a lazily built DFA, defined in the implementation.
+typedef struct Regex__DfaState Regex__DfaState;
+
+// An NFA, along with the states of the DFA built from it so far.
+typedef struct {
+    // The instructions of the NFA.
+    Regex__Inst *insts;
+    // The amount of instructions in `insts`.
+    i32 count;
+    // The instruction the NFA starts at.
+    i32 start;
+    // Whether a match can start after the start of the text, so unanchored
+    // searches need to keep trying new starting positions.
+    bool can_restart;
+    // The arena which holds the DFA states, cleared when it fills up.
+    Arena *cache;
+    // A hash table of the DFA states in `cache`.
+    Regex__DfaState **table;
+    // The amount of states in `table`.
+    i32 state_count;
+    // The amount of times `cache` was cleared.
+    i32 resets;
+    // The state of an unanchored search when no match is in progress.
+    Regex__DfaState *search_start;
+} Regex__Dfa;
+
+// A compiled regular expression.
+//
+// Matching builds and caches DFA states inside the `Regex`, so a single `Regex`
+// must not be used by multiple threads at once.
+typedef struct {
+    // The byte sets used by the instructions of the NFAs.
+    Regex__ByteSet *sets;
+    // The class of each byte; bytes in the same class are in exactly the same
+    // byte sets, so they always lead to the same DFA state.
+    u8 classes[256];
+    // The amount of byte classes.
+    i32 class_count;
+    // The DFA which runs forwards over the text, to find where a match ends.
+    Regex__Dfa forward;
+    // The DFA which runs backwards from where a match ends, to find where it
+    // starts.
+    Regex__Dfa reverse;
+    // The literal text every match starts with, which unanchored searches skip
+    // to with `sv_find`.
+    StringView prefix;
+    // Scratch memory for building DFA states.
+    i32 *list;
+    i32 *stack;
+    u32 *seen;
+    u32 generation;
+} Regex;
+
+// The location of a match found with `regex_search`.
+typedef struct {
+    // The index where the match starts.
+    i32 start;
+    // The index where the match ends (exclusive).
+    i32 end;
+} RegexMatch;
+
+// Compile `pattern` into `self`, using `arena` to allocate the memory for it,
+// including at least `REGEX_CACHE_SIZE` bytes for each of its two DFA caches.
+//
+// Returns `false` (and logs the error) if `pattern` isn't a valid regex.
+bool regex_compile(Arena *arena, StringView pattern, Regex *self);
+// Check whether all of `text` matches `self`.
+bool regex_match(Regex *self, StringView text);
+// Search `text` for the leftmost-longest match of `self`, storing its location
+// in `match` if it isn't `NULL`.
+//
+// Returns `false` if there is no match. When `match` is `NULL`, the search
+// stops as soon as any match is found.
+bool regex_search(Regex *self, StringView text, RegexMatch *match);
+
+#ifdef BOOKSTORE_IMPLEMENTATION
+
+#include <string.h>
+
+// The amount of slots in the hash table of DFA states; the cache is cleared
+// when it becomes three quarters full.
+#define REGEX__TABLE_SIZE 1024
+// The amount of the largest possible DFA states a cache always has room for,
+// so it isn't cleared on every step.
+#define REGEX__MIN_STATES 4
+// The maximum depth of nested groups.
+#define REGEX__MAX_DEPTH 256
+// The maximum count of a counted repetition.
+#define REGEX__MAX_REPEAT 1000
+
+// Flags of a DFA state.
+#define REGEX__STATE_MATCH   (1 << 0)
+#define REGEX__STATE_RESTART (1 << 1)
+#define REGEX__STATE_DEAD    (1 << 2)
+
+struct Regex__DfaState {
+    // The NFA instructions of the state, as groups of instructions reached
+    // from the same starting position, ordered by their starting position and
+    // separated by `-1`.
+    i32 *insts;
+    i32 count;
+    u32 hash;
+    u8 flags;
+    // Whether the state matches when the text ends, or `-1` if unknown.
+    i8 match_at_end;
+    // The next state for each byte class, or `NULL` if it wasn't built yet;
+    // kept inline so a transition is a single load.
+    Regex__DfaState *next[];
+};
+
+// Parsing
+
+typedef enum {
+    REGEX__NODE_EMPTY,
+    REGEX__NODE_BYTES,
+    REGEX__NODE_BEGIN,
+    REGEX__NODE_END,
+    REGEX__NODE_CONCAT,
+    REGEX__NODE_ALTERNATE,
+    REGEX__NODE_REPEAT,
+} Regex__NodeKind;
+
+typedef struct Regex__Node {
+    Regex__NodeKind kind;
+    // The byte set of `REGEX__NODE_BYTES`.
+    i32 set;
+    // The bounds of `REGEX__NODE_REPEAT`; `max` is `-1` if it's unbounded.
+    i32 min, max;
+    // The operands; `REGEX__NODE_REPEAT` only uses `left`.
+    struct Regex__Node *left, *right;
+} Regex__Node;
+
+typedef struct {
+    Arena *arena;
+    StringView pattern;
+    i32 position;
+    i32 depth;
+    Regex__ByteSet *sets;
+    i32 set_count;
+    const char *error;
+} Regex__Parser;
+
+internal void regex__set_add(Regex__ByteSet *set, u8 byte) {
+    set->bits[byte >> 5] |= 1u << (byte & 31);
+}
+
+internal bool regex__set_has(const Regex__ByteSet *set, u8 byte) {
+    return set->bits[byte >> 5] & (1u << (byte & 31));
+}
+
+internal void regex__set_add_range(Regex__ByteSet *set, u8 lo, u8 hi) {
+    for (i32 c = lo; c <= hi; c++) regex__set_add(set, c);
+}
+
+internal Regex__Node *regex__node(Regex__Parser *p, Regex__NodeKind kind,
+                                  Regex__Node *left, Regex__Node *right) {
+    Regex__Node *node = arena_alloc(p->arena, sizeof(Regex__Node));
+    memset(node, 0, sizeof(*node));
+    node->kind = kind;
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+internal Regex__Node *regex__bytes_node(Regex__Parser *p,
+                                        Regex__ByteSet **set) {
+    Regex__Node *node = regex__node(p, REGEX__NODE_BYTES, NULL, NULL);
+    node->set = p->set_count++;
+    *set = &p->sets[node->set];
+    memset(*set, 0, sizeof(**set));
+    return node;
+}
+
+internal Regex__Node *regex__fail(Regex__Parser *p, const char *error) {
+    p->error = error;
+    return NULL;
+}
+
+internal bool regex__at(Regex__Parser *p, char c) {
+    return p->position < p->pattern.count &&
+        p->pattern.data[p->position] == c;
+}
+
+// Add the bytes of the class escape `\c` into `set`, returning `false` if `c`
+// isn't a class escape.
+internal bool regex__add_class_escape(Regex__ByteSet *set, char c) {
+    Regex__ByteSet class = {0};
+    switch (c | 0x20) {
+    case 'd':
+        regex__set_add_range(&class, '0', '9');
+        break;
+    case 'w':
+        regex__set_add_range(&class, '0', '9');
+        regex__set_add_range(&class, 'a', 'z');
+        regex__set_add_range(&class, 'A', 'Z');
+        regex__set_add(&class, '_');
+        break;
+    case 's':
+        regex__set_add_range(&class, '\t', '\r');
+        regex__set_add(&class, ' ');
+        break;
+    default:
+        return false;
+    }
+
+    // Uppercase escapes are negated
+    bool negate = c >= 'A' && c <= 'Z';
+    for (i32 i = 0; i < 8; i++) {
+        set->bits[i] |= negate ? ~class.bits[i] : class.bits[i];
+    }
+    return true;
+}
+
+// Parse the escaped byte `\c`, which isn't a class escape, returning `-1` if
+// it isn't a valid escape.
+internal i32 regex__escaped_byte(char c) {
+    switch (c) {
+    case 'n':
+        return '\n';
+    case 'r':
+        return '\r';
+    case 't':
+        return '\t';
+    case 'f':
+        return '\f';
+    case 'v':
+        return '\v';
+    case '0':
+        return '\0';
+    }
+    bool alphanumeric = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9');
+    return alphanumeric ? -1 : (u8)c;
+}
+
+internal Regex__Node *regex__parse_class(Regex__Parser *p) {
+    Regex__ByteSet *set;
+    Regex__Node *node = regex__bytes_node(p, &set);
+
+    bool negate = regex__at(p, '^');
+    if (negate) p->position++;
+
+    bool first = true;
+    while (p->position < p->pattern.count) {
+        char c = p->pattern.data[p->position++];
+        if (c == ']' && !first) {
+            if (negate) {
+                for (i32 i = 0; i < 8; i++) set->bits[i] = ~set->bits[i];
+            }
+            return node;
+        }
+        first = false;
+
+        i32 lo = (u8)c;
+        if (c == '\\') {
+            if (p->position >= p->pattern.count) break;
+            char escaped = p->pattern.data[p->position++];
+            if (regex__add_class_escape(set, escaped)) continue;
+            lo = regex__escaped_byte(escaped);
+            if (lo < 0) return regex__fail(p, "unknown escape");
+        }
+
+        i32 hi = lo;
+        if (regex__at(p, '-') && p->position + 1 < p->pattern.count &&
+            p->pattern.data[p->position + 1] != ']') {
+            p->position++;
+            hi = (u8)p->pattern.data[p->position++];
+            if (hi == '\\') {
+                if (p->position >= p->pattern.count) break;
+                hi = regex__escaped_byte(p->pattern.data[p->position++]);
+                if (hi < 0) return regex__fail(p, "invalid range");
+            }
+            if (hi < lo) return regex__fail(p, "invalid range");
+        }
+        regex__set_add_range(set, lo, hi);
+    }
+    return regex__fail(p, "missing ]");
+}
+
+internal Regex__Node *regex__parse_alternate(Regex__Parser *p);
+
+internal Regex__Node *regex__parse_atom(Regex__Parser *p) {
+    char c = p->pattern.data[p->position++];
+    Regex__ByteSet *set;
+    switch (c) {
+    case '(': {
+        if (++p->depth > REGEX__MAX_DEPTH) {
+            return regex__fail(p, "groups nested too deeply");
+        }
+        if (regex__at(p, '?')) {
+            p->position++;
+            if (!regex__at(p, ':')) return regex__fail(p, "unknown group");
+            p->position++;
+        }
+        Regex__Node *node = regex__parse_alternate(p);
+        if (!node) return NULL;
+        if (!regex__at(p, ')')) return regex__fail(p, "missing )");
+        p->position++;
+        p->depth--;
+        return node;
+    }
+    case '[':
+        return regex__parse_class(p);
+    case '.': {
+        Regex__Node *node = regex__bytes_node(p, &set);
+        regex__set_add_range(set, 0, 255);
+        set->bits['\n' >> 5] &= ~(1u << ('\n' & 31));
+        return node;
+    }
+    case '^':
+        return regex__node(p, REGEX__NODE_BEGIN, NULL, NULL);
+    case '$':
+        return regex__node(p, REGEX__NODE_END, NULL, NULL);
+    case '*':
+    case '+':
+    case '?':
+        return regex__fail(p, "nothing to repeat");
+    case '\\': {
+        if (p->position >= p->pattern.count) {
+            return regex__fail(p, "trailing backslash");
+        }
+        char escaped = p->pattern.data[p->position++];
+        Regex__Node *node = regex__bytes_node(p, &set);
+        if (regex__add_class_escape(set, escaped)) return node;
+        i32 byte = regex__escaped_byte(escaped);
+        if (byte < 0) return regex__fail(p, "unknown escape");
+        regex__set_add(set, byte);
+        return node;
+    }
+    default: {
+        Regex__Node *node = regex__bytes_node(p, &set);
+        regex__set_add(set, c);
+        return node;
+    }
+    }
+}
+
+// Parse a decimal number for a counted repetition, returning `-1` if there
+// isn't one.
+internal i32 regex__parse_count(Regex__Parser *p) {
+    i32 start = p->position;
+    i32 value = 0;
+    while (p->position < p->pattern.count &&
+           (u8)(p->pattern.data[p->position] - '0') < 10) {
+        value = value * 10 + (p->pattern.data[p->position++] - '0');
+        if (value > REGEX__MAX_REPEAT) return -1;
+    }
+    return p->position > start ? value : -1;
+}
+
+internal Regex__Node *regex__parse_repeat(Regex__Parser *p) {
+    Regex__Node *node = regex__parse_atom(p);
+    while (node && p->position < p->pattern.count) {
+        i32 min, max;
+        switch (p->pattern.data[p->position]) {
+        case '*':
+            min = 0, max = -1;
+            break;
+        case '+':
+            min = 1, max = -1;
+            break;
+        case '?':
+            min = 0, max = 1;
+            break;
+        case '{':
+            p->position++;
+            min = max = regex__parse_count(p);
+            if (min < 0) return regex__fail(p, "invalid repetition");
+            if (regex__at(p, ',')) {
+                p->position++;
+                max = regex__at(p, '}') ? -1 : regex__parse_count(p);
+                if (max == -1 && !regex__at(p, '}')) {
+                    return regex__fail(p, "invalid repetition");
+                }
+                if (max >= 0 && max < min) {
+                    return regex__fail(p, "invalid repetition");
+                }
+            }
+            if (!regex__at(p, '}')) return regex__fail(p, "invalid repetition");
+            break;
+        default:
+            return node;
+        }
+        p->position++;
+
+        node = regex__node(p, REGEX__NODE_REPEAT, node, NULL);
+        node->min = min;
+        node->max = max;
+    }
+    return node;
+}
+
+internal Regex__Node *regex__parse_concat(Regex__Parser *p) {
+    Regex__Node *node = NULL;
+    while (p->position < p->pattern.count && !regex__at(p, '|') &&
+           !regex__at(p, ')')) {
+        Regex__Node *next = regex__parse_repeat(p);
+        if (!next) return NULL;
+        node = node ? regex__node(p, REGEX__NODE_CONCAT, node, next) : next;
+    }
+    return node ? node : regex__node(p, REGEX__NODE_EMPTY, NULL, NULL);
+}
+
+internal Regex__Node *regex__parse_alternate(Regex__Parser *p) {
+    Regex__Node *node = regex__parse_concat(p);
+    while (node && regex__at(p, '|')) {
+        p->position++;
+        Regex__Node *next = regex__parse_concat(p);
+        if (!next) return NULL;
+        node = regex__node(p, REGEX__NODE_ALTERNATE, node, next);
+    }
+    return node;
+}
+
+internal Regex__Node *regex__parse(Regex__Parser *p) {
+    Regex__Node *node = regex__parse_alternate(p);
+    if (node && p->position < p->pattern.count) {
+        return regex__fail(p, "unmatched )");
+    }
+    return node;
+}
+
+// Compiling
+
+// Get the amount of instructions needed to compile `node`, which is capped
+// just above `REGEX_MAX_INSTRUCTIONS`.
+internal i64 regex__node_size(Regex__Node *node) {
+    i64 size;
+    switch (node->kind) {
+    case REGEX__NODE_EMPTY:
+        return 0;
+    case REGEX__NODE_BYTES:
+    case REGEX__NODE_BEGIN:
+    case REGEX__NODE_END:
+        return 1;
+    case REGEX__NODE_CONCAT:
+        size = regex__node_size(node->left) + regex__node_size(node->right);
+        break;
+    case REGEX__NODE_ALTERNATE:
+        size =
+            regex__node_size(node->left) + regex__node_size(node->right) + 1;
+        break;
+    case REGEX__NODE_REPEAT: {
+        i64 child = regex__node_size(node->left);
+        i64 optional = node->max < 0 ? 1 : node->max - node->min;
+        size = child * node->min + (child + 1) * optional;
+        break;
+    }
+    }
+    return MIN(size, REGEX_MAX_INSTRUCTIONS + 1);
+}
+
+internal i32 regex__emit(Regex__Dfa *nfa, Regex__Op op, i32 next, i32 arg) {
+    Regex__Inst inst = {.op = op, .next = next, .arg = arg};
+    nfa->insts[nfa->count] = inst;
+    return nfa->count++;
+}
+
+// Compile `node` into `nfa`, continuing to `next` after it, and returning the
+// instruction to start it from. When `reverse` is set, the NFA matches the
+// reverse of the text.
+internal i32 regex__compile_node(Regex__Dfa *nfa, Regex__Node *node, i32 next,
+                                 bool reverse) {
+    switch (node->kind) {
+    case REGEX__NODE_EMPTY:
+        return next;
+    case REGEX__NODE_BYTES:
+        return regex__emit(nfa, REGEX__OP_BYTES, next, node->set);
+    case REGEX__NODE_BEGIN:
+        return regex__emit(nfa, reverse ? REGEX__OP_END : REGEX__OP_BEGIN,
+                           next, 0);
+    case REGEX__NODE_END:
+        return regex__emit(nfa, reverse ? REGEX__OP_BEGIN : REGEX__OP_END,
+                           next, 0);
+    case REGEX__NODE_CONCAT: {
+        Regex__Node *first = reverse ? node->right : node->left;
+        Regex__Node *second = reverse ? node->left : node->right;
+        next = regex__compile_node(nfa, second, next, reverse);
+        return regex__compile_node(nfa, first, next, reverse);
+    }
+    case REGEX__NODE_ALTERNATE: {
+        i32 left = regex__compile_node(nfa, node->left, next, reverse);
+        i32 right = regex__compile_node(nfa, node->right, next, reverse);
+        return regex__emit(nfa, REGEX__OP_SPLIT, left, right);
+    }
+    case REGEX__NODE_REPEAT: {
+        i32 rest = next;
+        if (node->max < 0) {
+            i32 loop = regex__emit(nfa, REGEX__OP_SPLIT, -1, next);
+            nfa->insts[loop].next =
+                regex__compile_node(nfa, node->left, loop, reverse);
+            rest = loop;
+        } else {
+            // Nest the optional copies, so `x{0,2}` is `(x(x)?)?`
+            for (i32 i = node->min; i < node->max; i++) {
+                i32 body = regex__compile_node(nfa, node->left, rest, reverse);
+                rest = regex__emit(nfa, REGEX__OP_SPLIT, body, next);
+            }
+        }
+        for (i32 i = 0; i < node->min; i++) {
+            rest = regex__compile_node(nfa, node->left, rest, reverse);
+        }
+        return rest;
+    }
+    }
+    return next;
+}
+
+// Append the literal bytes `node` starts with into `prefix` (if it isn't
+// `NULL`), returning whether all of `node` is a literal.
+internal bool regex__literal_prefix(Regex *self, Regex__Node *node,
+                                    char *prefix, i32 *count) {
+    switch (node->kind) {
+    case REGEX__NODE_EMPTY:
+        return true;
+    case REGEX__NODE_BYTES: {
+        const Regex__ByteSet *set = &self->sets[node->set];
+        i32 found = -1;
+        for (i32 c = 0; c < 256; c++) {
+            if (!regex__set_has(set, c)) continue;
+            if (found >= 0) return false;
+            found = c;
+        }
+        if (found < 0) return false;
+        if (prefix) prefix[*count] = (char)found;
+        (*count)++;
+        return true;
+    }
+    case REGEX__NODE_CONCAT:
+        return regex__literal_prefix(self, node->left, prefix, count) &&
+            regex__literal_prefix(self, node->right, prefix, count);
+    default:
+        return false;
+    }
+}
+
+// Split the bytes into classes, such that bytes in the same class are in
+// exactly the same byte sets.
+internal void regex__compute_classes(Regex *self, i32 set_count) {
+    memset(self->classes, 0, sizeof(self->classes));
+    self->class_count = 1;
+    for (i32 s = 0; s < set_count; s++) {
+        // Move the bytes in the set into a new class, and then renumber the
+        // classes so they stay dense
+        i32 split[256], renumber[512];
+        memset(split, -1, sizeof(split));
+        memset(renumber, -1, sizeof(renumber));
+
+        i32 ids[256];
+        i32 count = self->class_count;
+        for (i32 c = 0; c < 256; c++) {
+            ids[c] = self->classes[c];
+            if (!regex__set_has(&self->sets[s], c)) continue;
+            if (split[ids[c]] < 0) split[ids[c]] = count++;
+            ids[c] = split[ids[c]];
+        }
+
+        self->class_count = 0;
+        for (i32 c = 0; c < 256; c++) {
+            if (renumber[ids[c]] < 0) renumber[ids[c]] = self->class_count++;
+            self->classes[c] = renumber[ids[c]];
+        }
+    }
+}
+
+internal void regex__compile_nfa(Regex__Dfa *nfa, Regex__Node *root,
+                                 bool reverse) {
+    nfa->count = 0;
+    i32 match = regex__emit(nfa, REGEX__OP_MATCH, -1, 0);
+    nfa->start = regex__compile_node(nfa, root, match, reverse);
+}
+
+// Matching
+
+internal void *regex__cache_alloc(Arena *cache, i32 size) {
+    i32 padding =
+        (i32)(-(uintptr_t)(ARENA_MEMORY(cache) + cache->allocated) & 7);
+    if (cache->capacity - cache->allocated < padding + size) return NULL;
+    arena_alloc(cache, padding);
+    return arena_alloc(cache, size);
+}
+
+internal void regex__dfa_reset(Regex__Dfa *dfa) {
+    arena_clear(dfa->cache);
+    dfa->table = regex__cache_alloc(
+        dfa->cache, REGEX__TABLE_SIZE * sizeof(Regex__DfaState *));
+    ASSERT(dfa->table, "REGEX_CACHE_SIZE too small");
+    memset(dfa->table, 0, REGEX__TABLE_SIZE * sizeof(Regex__DfaState *));
+    dfa->state_count = 0;
+    dfa->search_start = NULL;
+    dfa->resets++;
+}
+
+// The list of instructions of a DFA state being built.
+typedef struct {
+    i32 count;
+    i32 group_start;
+    bool matched;
+} Regex__Builder;
+
+internal void regex__begin_build(Regex *self, Regex__Builder *builder) {
+    if (++self->generation == 0) {
+        // Start over when the generations wrap around
+        i32 count = MAX(self->forward.count, self->reverse.count);
+        memset(self->seen, 0, count * sizeof(u32));
+        self->generation = 1;
+    }
+    builder->count = 0;
+    builder->group_start = 0;
+    builder->matched = false;
+}
+
+// Add the instructions reachable from `pc` without consuming a byte into the
+// current group of `builder`.
+internal void regex__add_closure(Regex *self, Regex__Dfa *dfa,
+                                 Regex__Builder *builder, i32 pc,
+                                 bool at_start, bool at_end) {
+    i32 top = 0;
+    self->stack[top++] = pc;
+    while (top > 0) {
+        pc = self->stack[--top];
+        if (self->seen[pc] == self->generation) continue;
+        self->seen[pc] = self->generation;
+
+        Regex__Inst inst = dfa->insts[pc];
+        switch (inst.op) {
+        case REGEX__OP_SPLIT:
+            self->stack[top++] = inst.arg;
+            self->stack[top++] = inst.next;
+            break;
+        case REGEX__OP_BEGIN:
+            if (at_start) self->stack[top++] = inst.next;
+            break;
+        case REGEX__OP_END:
+            if (at_end) {
+                self->stack[top++] = inst.next;
+                break;
+            }
+            // Keep the assertion, in case the text ends here
+            self->list[builder->count++] = pc;
+            break;
+        case REGEX__OP_MATCH:
+            builder->matched = true;
+            self->list[builder->count++] = pc;
+            break;
+        case REGEX__OP_BYTES:
+            self->list[builder->count++] = pc;
+            break;
+        }
+    }
+}
+
+// Close the current group of `builder`, sorting it so equal groups are built
+// the same way.
+internal void regex__close_group(Regex *self, Regex__Builder *builder) {
+    if (builder->count == builder->group_start) return;
+
+    i32 *group = self->list + builder->group_start;
+    i32 count = builder->count - builder->group_start;
+    for (i32 i = 1; i < count; i++) {
+        i32 value = group[i];
+        i32 j = i;
+        for (; j > 0 && group[j - 1] > value; j--) group[j] = group[j - 1];
+        group[j] = value;
+    }
+
+    self->list[builder->count++] = -1;
+    builder->group_start = builder->count;
+}
+
+internal Regex__DfaState *regex__dfa_intern(Regex *self, Regex__Dfa *dfa,
+                                            i32 count, u8 flags) {
+    const i32 *list = self->list;
+    u32 hash = 2166136261u ^ flags;
+    for (i32 i = 0; i < count; i++) hash = (hash ^ (u32)list[i]) * 16777619u;
+
+    i32 slot = hash & (REGEX__TABLE_SIZE - 1);
+    for (Regex__DfaState *state; (state = dfa->table[slot]);
+         slot = (slot + 1) & (REGEX__TABLE_SIZE - 1)) {
+        if (state->hash == hash && state->flags == flags &&
+            state->count == count &&
+            !memcmp(state->insts, list, count * sizeof(i32))) {
+            return state;
+        }
+    }
+
+    if (dfa->state_count >= REGEX__TABLE_SIZE / 4 * 3) return NULL;
+    i32 next_size = self->class_count * sizeof(Regex__DfaState *);
+    Regex__DfaState *state = regex__cache_alloc(
+        dfa->cache, sizeof(Regex__DfaState) + next_size + count * sizeof(i32));
+    if (!state) return NULL;
+
+    state->insts = (i32 *)((u8 *)state->next + next_size);
+    state->count = count;
+    state->hash = hash;
+    state->flags = flags;
+    state->match_at_end = -1;
+    memset(state->next, 0, next_size);
+    MEMCPY(state->insts, list, count * sizeof(i32));
+
+    dfa->table[slot] = state;
+    dfa->state_count++;
+    return state;
+}
+
+// Turn the instructions of `builder` into a DFA state, clearing the cache if
+// it's full.
+internal Regex__DfaState *regex__dfa_state(Regex *self, Regex__Dfa *dfa,
+                                           Regex__Builder *builder, u8 flags) {
+    regex__close_group(self, builder);
+    i32 count = builder->count;
+    if (count > 0) count--; // Drop the separator after the last group
+
+    if (builder->matched) {
+        flags |= REGEX__STATE_MATCH;
+        flags &= ~REGEX__STATE_RESTART;
+    }
+    if (!dfa->can_restart) flags &= ~REGEX__STATE_RESTART;
+    if (!count && !(flags & REGEX__STATE_RESTART)) flags |= REGEX__STATE_DEAD;
+
+    Regex__DfaState *state = regex__dfa_intern(self, dfa, count, flags);
+    if (!state) {
+        regex__dfa_reset(dfa);
+        state = regex__dfa_intern(self, dfa, count, flags);
+        ASSERT(state, "REGEX_CACHE_SIZE too small");
+    }
+    return state;
+}
+
+internal Regex__DfaState *regex__dfa_start(Regex *self, Regex__Dfa *dfa,
+                                           bool at_start, bool restart) {
+    Regex__Builder builder;
+    regex__begin_build(self, &builder);
+    regex__add_closure(self, dfa, &builder, dfa->start, at_start, false);
+    return regex__dfa_state(self, dfa, &builder,
+                            restart ? REGEX__STATE_RESTART : 0);
+}
+
+internal Regex__DfaState *regex__dfa_next(Regex *self, Regex__Dfa *dfa,
+                                          Regex__DfaState *state, u8 byte) {
+    Regex__Builder builder;
+    regex__begin_build(self, &builder);
+
+    // Step every group in order, and stop at the first one that matches:
+    // every later group started after it, so it can't be leftmost
+    for (i32 i = 0; i < state->count; i++) {
+        i32 pc = state->insts[i];
+        if (pc < 0) {
+            if (builder.matched) break;
+            regex__close_group(self, &builder);
+            continue;
+        }
+        Regex__Inst inst = dfa->insts[pc];
+        if (inst.op == REGEX__OP_BYTES &&
+            regex__set_has(&self->sets[inst.arg], byte)) {
+            regex__add_closure(self, dfa, &builder, inst.next, false, false);
+        }
+    }
+
+    // Try to start a new match after this byte
+    if ((state->flags & REGEX__STATE_RESTART) && !builder.matched) {
+        regex__close_group(self, &builder);
+        regex__add_closure(self, dfa, &builder, dfa->start, false, false);
+    }
+
+    i32 resets = dfa->resets;
+    Regex__DfaState *next = regex__dfa_state(
+        self, dfa, &builder, state->flags & REGEX__STATE_RESTART);
+    // Clearing the cache frees `state` too
+    if (dfa->resets == resets) state->next[self->classes[byte]] = next;
+    return next;
+}
+
+internal bool regex__matches_at_end(Regex *self, Regex__Dfa *dfa,
+                                    Regex__DfaState *state, bool at_start) {
+    if (!at_start && state->match_at_end >= 0) return state->match_at_end;
+
+    Regex__Builder builder;
+    regex__begin_build(self, &builder);
+    for (i32 i = 0; i < state->count && !builder.matched; i++) {
+        i32 pc = state->insts[i];
+        if (pc >= 0 && dfa->insts[pc].op == REGEX__OP_END) {
+            regex__add_closure(self, dfa, &builder, dfa->insts[pc].next,
+                               at_start, true);
+        }
+    }
+
+    if (!at_start) state->match_at_end = builder.matched;
+    return builder.matched;
+}
+
+// Run `dfa` over `text` starting from `from`, backwards if `reverse` is set.
+// Unless `restart` is set, matches must start at `from`.
+//
+// Returns where the longest match ends (or the first match, if `first` is
+// set), or `-1` if there is no match.
+internal i32 regex__run(Regex *self, Regex__Dfa *dfa, StringView text,
+                        i32 from, bool reverse, bool restart, bool first) {
+    i32 boundary = reverse ? 0 : text.count;
+    bool at_start = from == (reverse ? text.count : 0);
+
+    // Remember the state of an unanchored search with nothing in progress,
+    // which only a match of the literal prefix can leave
+    bool skip = restart && self->prefix.count;
+    if (skip && !dfa->search_start) {
+        dfa->search_start = regex__dfa_start(self, dfa, false, true);
+    }
+
+    Regex__DfaState *state = regex__dfa_start(self, dfa, at_start, restart);
+    i32 last = -1;
+    if (state->flags & REGEX__STATE_MATCH) {
+        last = from;
+        if (first) return last;
+    }
+
+    const u8 *data = (const u8 *)text.data;
+    i32 i = from;
+    while (i != boundary) {
+        // Clearing the cache also clears `search_start`, so it's found again
+        // right after, while the cache has room for it besides `state`
+        if (skip && !dfa->search_start) {
+            dfa->search_start = regex__dfa_start(self, dfa, false, true);
+        }
+        if (skip && state == dfa->search_start) {
+            // Nothing is in progress, so skip to where the prefix appears
+            StringView rest = sv_from_parts(text.data + i, text.count - i);
+            i32 found = sv_find(rest, self->prefix);
+            if (found < 0) return last;
+            i += found;
+        }
+
+        u8 byte = reverse ? data[i - 1] : data[i];
+        Regex__DfaState *next = state->next[self->classes[byte]];
+        if (!next) next = regex__dfa_next(self, dfa, state, byte);
+        state = next;
+        i += reverse ? -1 : 1;
+
+        if (state->flags & (REGEX__STATE_MATCH | REGEX__STATE_DEAD)) {
+            if (state->flags & REGEX__STATE_DEAD) return last;
+            last = i;
+            if (first) return last;
+        }
+    }
+
+    if (regex__matches_at_end(self, dfa, state, at_start && i == from)) {
+        last = boundary;
+    }
+    return last;
+}
+
+bool regex_compile(Arena *arena, StringView pattern, Regex *self) {
+    memset(self, 0, sizeof(*self));
+
+    // Parse once to find out how much memory the regex needs, and then again
+    // to compile it into that memory
+    Lifetime lt = lifetime_begin(arena);
+    Regex__Parser parser = {
+        .arena = lt.arena,
+        .pattern = pattern,
+        .sets = arena_alloc(lt.arena,
+                            (pattern.count + 1) * sizeof(Regex__ByteSet)),
+    };
+    Regex__Node *root = regex__parse(&parser);
+    i64 size = root ? regex__node_size(root) + 1 : 0;
+    i32 set_count = parser.set_count;
+    i32 prefix_count = 0;
+    if (root) {
+        self->sets = parser.sets;
+        regex__literal_prefix(self, root, NULL, &prefix_count);
+    }
+    lifetime_end(lt);
+
+    if (!root) {
+        log_error("Failed to compile regex: %s at offset %d", parser.error,
+                  parser.position);
+        return false;
+    }
+    if (size > REGEX_MAX_INSTRUCTIONS) {
+        log_error("Failed to compile regex: more than %d instructions",
+                  REGEX_MAX_INSTRUCTIONS);
+        return false;
+    }
+
+    self->sets = arena_alloc(arena, MAX(set_count, 1) * sizeof(Regex__ByteSet));
+    self->list = arena_alloc(arena, (2 * size + 1) * sizeof(i32));
+    self->stack = arena_alloc(arena, (2 * size + 1) * sizeof(i32));
+    self->seen = arena_alloc(arena, size * sizeof(u32));
+    memset(self->seen, 0, size * sizeof(u32));
+
+    Regex__Dfa *dfas[] = {&self->forward, &self->reverse};
+    for (i32 i = 0; i < 2; i++) {
+        dfas[i]->insts = arena_alloc(arena, size * sizeof(Regex__Inst));
+    }
+
+    // Rounded up so that the caches allocated after it stay aligned
+    char *prefix = arena_alloc(arena, (prefix_count + 3) & ~3);
+    self->prefix = sv_from_parts(prefix, prefix_count);
+
+    lt = lifetime_begin(arena);
+    parser = (Regex__Parser){
+        .arena = lt.arena,
+        .pattern = pattern,
+        .sets = self->sets,
+    };
+    root = regex__parse(&parser);
+    regex__compile_nfa(&self->forward, root, false);
+    regex__compile_nfa(&self->reverse, root, true);
+    prefix_count = 0;
+    regex__literal_prefix(self, root, prefix, &prefix_count);
+    lifetime_end(lt);
+
+    regex__compute_classes(self, set_count);
+
+    // A state holds at most as many instructions as `list`, so the cache
+    // always fits the table and a few of the largest states, plus padding
+    i64 state_size = sizeof(Regex__DfaState) +
+                     self->class_count * sizeof(Regex__DfaState *) +
+                     (2 * size + 1) * sizeof(i32) + 8;
+    i64 cache_size =
+        MAX((i64)REGEX_CACHE_SIZE,
+            REGEX__TABLE_SIZE * (i64)sizeof(Regex__DfaState *) + 8 +
+                REGEX__MIN_STATES * state_size);
+
+    for (i32 i = 0; i < 2; i++) {
+        Arena *cache = arena_alloc(arena, sizeof(Arena) + cache_size);
+        cache->capacity = cache_size;
+        cache->allocated = 0;
+        dfas[i]->cache = cache;
+
+        regex__dfa_reset(dfas[i]);
+        dfas[i]->resets = 0;
+
+        // Check whether anything can match after the start of the text
+        Regex__Builder builder;
+        regex__begin_build(self, &builder);
+        regex__add_closure(self, dfas[i], &builder, dfas[i]->start, false,
+                           false);
+        dfas[i]->can_restart = builder.count > 0;
+    }
+
+    return true;
+}
+
+bool regex_match(Regex *self, StringView text) {
+    return regex__run(self, &self->forward, text, 0, false, false, false) ==
+        text.count;
+}
+
+bool regex_search(Regex *self, StringView text, RegexMatch *match) {
+    i32 end = regex__run(self, &self->forward, text, 0, false, true, !match);
+    if (end < 0) return false;
+    if (match) {
+        match->start =
+            regex__run(self, &self->reverse, text, end, true, false, false);
+        match->end = end;
+    }
+    return true;
+}
+
+#endif // BOOKSTORE_IMPLEMENTATION
+
+#endif // REGEX_H_
@@ -44,8 +44,31 @@ StringView sv_printf(Arena *arena, const char *fmt, ...) PRINTF_FORMAT(2, 3);
 // Check if a `StringView` is equal to a C-string (NUL-terminated list of
 // characters).
 bool sv_eq_cstr(StringView self, const char *cstr);
-// Compare two `StringView` instances using lexicographic order.
+// Compare two `StringView` instances using lexicographic order of their bytes,
+// as unsigned characters; a prefix of a string comes before the string.
 Order sv_compare(StringView a, StringView b);
+// Compare two `StringView` instances like `sv_compare`, ignoring the case of
+// ASCII letters.
+Order sv_compare_nocase(StringView a, StringView b);
+// Compare two `StringView` instances like `sv_compare`, except that runs of
+// digits are compared by their numeric value, so "file2" comes before
+// "file10". Strings which only differ by leading zeros are ordered like
+// `sv_compare`.
+Order sv_compare_natural(StringView a, StringView b);
+// Find the first occurrence of `needle` in `self`, returning its index, or `-1`
+// if there is none. Checks 16 positions at a time with SSE2 where available.
+i32 sv_find(StringView self, StringView needle);
+// Check whether `self` is valid UTF-8: no overlong encodings, surrogates, code
+// points above U+10FFFF or truncated sequences. Validates 16 bytes at a time
+// when the processor supports SSSE3.
+bool sv_utf8_validate(StringView self);
+// Count the code points in `self`, which should be valid UTF-8 (see
+// `sv_utf8_validate`); counts every byte which isn't a continuation byte.
+i32 sv_utf8_count(StringView self);
+// Get the `count` code points of `self` starting at code point `start`, which
+// are clamped to the end of `self`. Never splits a multi-byte sequence, even
+// if `self` isn't valid UTF-8.
+StringView sv_utf8_slice(StringView self, i32 start, i32 count);
 // Strip a `StringView` of whitespace characters.
 void sv_trim(StringView *self);
 // Strip the start of a `StringView` of whitespace characters.
@@ -108,7 +131,12 @@ STRING__SV_PARSE_INT_DECLARE(i32);
 // call, and check if `self->count > count` after.
 STRING__SV_PARSE_INT_DECLARE(i64);
 // Parse a `float` from `self`, consuming `self` so it points after where the
-// numeric string ends. Uses `sv_trim_start` before parsing.
+// numeric string ends. Skips leading whitespace before parsing.
+//
+// Accepts decimal notation (an optional sign, digits with an optional `.`, and
+// an optional exponent), as well as `inf`, `infinity` and `nan`, regardless of
+// the current locale. Never reads past `self->count`, so `self` doesn't need to
+// be NUL-terminated. The result is correctly rounded.
 //
 // If the number would overflow, `errno` is set to `ERANGE`.
 //
@@ -121,7 +149,12 @@ STRING__SV_PARSE_INT_DECLARE(i64);
 // call, and check if `self->count > count` after.
 STRING__SV_PARSE_FLOAT_DECLARE(float);
 // Parse a `double` from `self`, consuming `self` so it points after where the
-// numeric string ends. Uses `sv_trim_start` before parsing.
+// numeric string ends. Skips leading whitespace before parsing.
+//
+// Accepts decimal notation (an optional sign, digits with an optional `.`, and
+// an optional exponent), as well as `inf`, `infinity` and `nan`, regardless of
+// the current locale. Never reads past `self->count`, so `self` doesn't need to
+// be NUL-terminated. The result is correctly rounded.
 //
 // If the number would overflow, `errno` is set to `ERANGE`.
 //
@@ -134,6 +167,29 @@ STRING__SV_PARSE_FLOAT_DECLARE(float);
 // call, and check if `self->count > count` after.
 STRING__SV_PARSE_FLOAT_DECLARE(double);
 
+#define STRING__SV_PARSE_FLOATS_DECLARE(T)                                     \
+    i32 sv_parse_##T##s(StringView *self, char delimiter, T *out, i32 capacity)
+// Parse up to `capacity` `float` values separated by `delimiter` from `self`
+// into `out`, returning the amount of values parsed. Uses `sv_parse_float` for
+// each of the values, allowing spaces and tabs around them.
+//
+// `self` is consumed up to the first field which isn't a valid number, or
+// entirely if every field is valid - so a single column of numbers can be
+// parsed with `'\n'` as the delimiter, and a single row with `','`.
+STRING__SV_PARSE_FLOATS_DECLARE(float);
+// Parse up to `capacity` `double` values separated by `delimiter` from `self`
+// into `out`, returning the amount of values parsed. Uses `sv_parse_double` for
+// each of the values, allowing spaces and tabs around them.
+//
+// `self` is consumed up to the first field which isn't a valid number, or
+// entirely if every field is valid - so a single column of numbers can be
+// parsed with `'\n'` as the delimiter, and a single row with `','`.
+STRING__SV_PARSE_FLOATS_DECLARE(double);
+
+// A dynamic array of `StringView` instances.
+ARRAY_TYPEDEF(StringView, StringViews);
+ARRAY_DECLARE_PREFIX(StringView, StringViews, svs);
+
 // A sized string that owns its memory and can be increased in size.
 ARRAY_TYPEDEF(char, StringBuilder);
 ARRAY_DECLARE_PREFIX(char, StringBuilder, sb);
@@ -154,7 +210,9 @@ ARRAY_DECLARE_PREFIX(char, StringBuilder, sb);
 // ```
 #define SB_ARG(sb) (int)(sb).count, (sb).items
 // Format `fmt` like `printf`, appending the result to `self` and returning the
-// amount of characters appended.
+// amount of characters appended. The result is formatted straight into the
+// spare capacity of `self`, so `fmt` is only formatted a second time if it
+// doesn't fit.
 i32 sb_appendf(StringBuilder *self, const char *fmt, ...) PRINTF_FORMAT(2, 3);
 // Push the NUL-terminating character (`'\0'`) to the end of `self`, allowing
 // its underlying `items` to be used as a C-string.
@@ -167,11 +225,111 @@ void sb_append_cstr(StringBuilder *self, const char *cstr);
 void sb_append_sv(StringBuilder *self, StringView sv);
 // Convert a `StringBuilder` into a `StringView`.
 StringView sb_to_sv(StringBuilder self);
+// Transcode the UTF-8 in `utf8` into UTF-16 code units in native byte order,
+// appending them into `self` (two bytes per code unit).
+//
+// Returns `false` without appending anything if `utf8` isn't valid UTF-8.
+bool sb_append_utf8_as_utf16(StringBuilder *self, StringView utf8);
+// Transcode the `count` UTF-16 code units in `utf16` into UTF-8, appending
+// the result into `self`.
+//
+// Returns `false` without appending anything if `utf16` has unpaired
+// surrogates.
+bool sb_append_utf16_as_utf8(StringBuilder *self, const u16 *utf16, i32 count);
+// Append the decimal representation of `value` into `self`, without going
+// through `printf`-style formatting.
+void sb_append_u64(StringBuilder *self, u64 value);
+// Append the decimal representation of `value` into `self`, without going
+// through `printf`-style formatting.
+void sb_append_i64(StringBuilder *self, i64 value);
+// Append the lowercase hexadecimal representation of `value` into `self`,
+// without a `0x` prefix, padding it with zeros to at least `width` digits.
+void sb_append_hex(StringBuilder *self, u64 value, i32 width);
+
+// The notation to use when formatting a `double` with `sb_append_double`.
+typedef enum {
+    // Use fixed notation for numbers with a decimal exponent between -7 and
+    // 20, and scientific notation otherwise - the same as JavaScript does.
+    DOUBLE_FORMAT_GENERAL,
+    // Always use fixed notation (e.g. `0.00012`, `120000`).
+    DOUBLE_FORMAT_FIXED,
+    // Always use scientific notation (e.g. `1.2e-4`, `1.2e5`).
+    DOUBLE_FORMAT_SCIENTIFIC,
+} DoubleFormat;
+// The maximum amount of characters `sb_append_double` appends: a sign, `0.`,
+// and up to 324 digits after the decimal point for the smallest subnormals.
+#define DOUBLE_FORMAT_MAX_LENGTH 327
+// Append `value` into `self` using the Grisu2 algorithm, laid out in the
+// notation `format`. The digits always parse back into exactly the same
+// `double`, and are the shortest such digits for all but a tiny fraction of
+// values (where one extra digit may be appended).
+//
+// Infinities are appended as `inf` or `-inf`, and NaNs as `nan`.
+void sb_append_double(StringBuilder *self, double value, DoubleFormat format);
+
+// A cursor for writing into the spare capacity of a `StringBuilder` without
+// checking its capacity on every write. Reserve the memory up front with
+// `sw_begin`, write with the `sw_put` family, and then commit the written
+// length into the builder with `sw_end`.
+//
+// Example:
+//
+// ```
+// StringWriter w = sw_begin(&sb, 2 * sv.count + 2);
+// SW_PUT(&w, '"');
+// for (i32 i = 0; i < sv.count; i++) {
+//     if (sv.data[i] == '"') SW_PUT(&w, '\\');
+//     SW_PUT(&w, sv.data[i]);
+// }
+// SW_PUT(&w, '"');
+// sw_end(w);
+// ```
+typedef struct {
+    // The builder being written into.
+    StringBuilder *sb;
+    // Where the next character will be written.
+    char *cursor;
+    // The end of the memory available for writing; nothing checks that the
+    // cursor stays before it, so writing past it is undefined behavior.
+    char *end;
+} StringWriter;
+// Start writing into `self`, reserving room for `amount` more characters.
+StringWriter sw_begin(StringBuilder *self, i32 amount);
+// Commit everything written with `self` into its builder, increasing the
+// builder's count to where the cursor ends.
+void sw_end(StringWriter self);
+// Reserve room for `amount` more characters after the cursor of `self`, which
+// may move the builder's memory.
+void sw_reserve(StringWriter *self, i32 amount);
+// The amount of characters which can still be written into `writer`.
+#define SW_REMAINING(writer) ((i32)((writer)->end - (writer)->cursor))
+// Write the character `c` into `writer`, without checking the capacity.
+#define SW_PUT(writer, c) (*(writer)->cursor++ = (char)(c))
+// Write `count` characters from `data` into `self`, without checking the
+// capacity.
+void sw_put_bytes(StringWriter *self, const char *data, i32 count);
+// Write a `StringView` into `self`, without checking the capacity.
+void sw_put_sv(StringWriter *self, StringView sv);
+// Write the decimal representation of `value` into `self`, without checking
+// the capacity. Writes at most 20 characters.
+void sw_put_u64(StringWriter *self, u64 value);
+// Write the decimal representation of `value` into `self`, without checking
+// the capacity. Writes at most 20 characters.
+void sw_put_i64(StringWriter *self, i64 value);
+// Write the hexadecimal representation of `value` into `self` like
+// `sb_append_hex`, without checking the capacity. Writes at most
+// `MAX(16, width)` characters.
+void sw_put_hex(StringWriter *self, u64 value, i32 width);
+// Write `value` into `self` like `sb_append_double`, without checking the
+// capacity. Writes at most `DOUBLE_FORMAT_MAX_LENGTH` characters.
+void sw_put_double(StringWriter *self, double value, DoubleFormat format);
 
 #ifdef BOOKSTORE_IMPLEMENTATION
 
 #include <ctype.h>
+#include <math.h>
 #include <stdarg.h>
+#include <stdlib.h>
 
 SLICE_DEFINE_PREFIX(char, StringView, sv)
 
@@ -190,14 +348,9 @@ StringView sv_printf(Arena *arena, const char *fmt, ...) {
     if (!arena) TODO("dynamic sv_printf?");
 
     va_list args;
-
     va_start(args, fmt);
-    i32 n = vsnprintf(NULL, 0, fmt, args);
-    va_end(args);
-
-    char *dest = arena_alloc(arena, n * sizeof(char));
-    va_start(args, fmt);
-    vsnprintf(dest, n + 1, fmt, args);
+    i32 n;
+    const char *dest = arena_vsprintf(arena, &n, fmt, args);
     va_end(args);
 
     return sv_from_parts(dest, n);
@@ -207,16 +360,380 @@ bool sv_eq_cstr(StringView self, const char *cstr) {
     return sv_eq(self, sv_from_cstr(cstr));
 }
 
+internal bool string__is_digit(char c) {
+    return (u8)(c - '0') < 10;
+}
+
 Order sv_compare(StringView a, StringView b) {
-    i32 count = MAX(a.count, b.count);
+    i32 count = MIN(a.count, b.count);
+    i32 cmp = count ? memcmp(a.data, b.data, count) : 0;
+    if (cmp) return cmp < 0 ? ORDER_LT : ORDER_GT;
+    return COMPARE_BASIC(a.count, b.count);
+}
 
-    Order ord = ORDER_EQ;
-    for (i32 i = 0; i < count; i++) {
-        char ac = a.count > i ? a.data[i] : '\0';
-        char bc = b.count > i ? b.data[i] : '\0';
-        if ((ord = COMPARE_BASIC(ac, bc))) break;
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STRING__SSE2
+#include <emmintrin.h>
+
+// Fold the ASCII uppercase letters in `bytes` to lowercase.
+internal __m128i string__fold_case_sse2(__m128i bytes) {
+    // Bytes above 0x7F are negative, so they're never in range
+    __m128i is_upper =
+        _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('A' - 1)),
+                      _mm_cmplt_epi8(bytes, _mm_set1_epi8('Z' + 1)));
+    return _mm_add_epi8(bytes, _mm_and_si128(is_upper, _mm_set1_epi8(0x20)));
+}
+#endif // STRING__SSE2
+
+internal u8 string__fold_case(u8 c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+Order sv_compare_nocase(StringView a, StringView b) {
+    i32 count = MIN(a.count, b.count);
+    i32 i = 0;
+#ifdef STRING__SSE2
+    // Skip over blocks which are equal once folded, leaving the first one with
+    // a difference to the scalar loop
+    for (; i + 16 <= count; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a.data + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b.data + i));
+        __m128i eq = _mm_cmpeq_epi8(string__fold_case_sse2(x),
+                                    string__fold_case_sse2(y));
+        if (_mm_movemask_epi8(eq) != 0xFFFF) break;
+    }
+#endif // STRING__SSE2
+    for (; i < count; i++) {
+        u8 x = string__fold_case((u8)a.data[i]);
+        u8 y = string__fold_case((u8)b.data[i]);
+        if (x != y) return COMPARE_BASIC(x, y);
+    }
+    return COMPARE_BASIC(a.count, b.count);
+}
+
+Order sv_compare_natural(StringView a, StringView b) {
+    i32 i = 0, j = 0;
+    while (i < a.count && j < b.count) {
+        u8 x = a.data[i], y = b.data[j];
+        if (!string__is_digit(x) || !string__is_digit(y)) {
+            if (x != y) return COMPARE_BASIC(x, y);
+            i++, j++;
+            continue;
+        }
+
+        // Compare the runs of digits by their value: skip the leading zeros,
+        // then the longer run is larger, and runs of the same length compare
+        // like strings
+        while (i < a.count && a.data[i] == '0') i++;
+        while (j < b.count && b.data[j] == '0') j++;
+        i32 a_start = i, b_start = j;
+        while (i < a.count && string__is_digit(a.data[i])) i++;
+        while (j < b.count && string__is_digit(b.data[j])) j++;
+
+        Order ord = COMPARE_BASIC(i - a_start, j - b_start);
+        if (ord) return ord;
+        i32 cmp = memcmp(a.data + a_start, b.data + b_start, i - a_start);
+        if (cmp) return cmp < 0 ? ORDER_LT : ORDER_GT;
+    }
+
+    Order ord = COMPARE_BASIC(a.count - i, b.count - j);
+    return ord ? ord : sv_compare(a, b);
+}
+
+internal i32 string__trailing_zeros(u32 value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(value);
+#else
+    i32 n = 0;
+    for (; !(value & 1); value >>= 1) n++;
+    return n;
+#endif
+}
+
+i32 sv_find(StringView self, StringView needle) {
+    if (!needle.count) return 0;
+    i32 last = self.count - needle.count;
+    i32 i = 0;
+#ifdef STRING__SSE2
+    // Compare the first and last bytes of the needle at 16 positions at once,
+    // and only check the positions where both match
+    __m128i first = _mm_set1_epi8(needle.data[0]);
+    __m128i final = _mm_set1_epi8(needle.data[needle.count - 1]);
+    for (; i + 15 <= last; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(self.data + i));
+        __m128i b = _mm_loadu_si128(
+            (const __m128i *)(self.data + i + needle.count - 1));
+        u32 mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, final)));
+        for (; mask; mask &= mask - 1) {
+            i32 at = i + string__trailing_zeros(mask);
+            if (!memcmp(self.data + at, needle.data, needle.count)) return at;
+        }
+    }
+#endif // STRING__SSE2
+    for (; i <= last; i++) {
+        const char *found = memchr(self.data + i, needle.data[0], last - i + 1);
+        if (!found) break;
+        i = found - self.data;
+        if (!memcmp(self.data + i, needle.data, needle.count)) return i;
+    }
+    return -1;
+}
+
+// Decode the code point at the start of the `count` bytes in `data` into
+// `*code_point`, returning the length of its encoding, or `0` if it isn't valid
+// UTF-8.
+internal i32 string__utf8_decode(const u8 *data, i32 count, u32 *code_point) {
+    u8 c = data[0];
+    if (c < 0x80) {
+        *code_point = c;
+        return 1;
+    }
+
+    i32 length;
+    u32 value, min;
+    if ((c & 0xE0) == 0xC0) {
+        length = 2;
+        value = c & 0x1F;
+        min = 0x80;
+    } else if ((c & 0xF0) == 0xE0) {
+        length = 3;
+        value = c & 0x0F;
+        min = 0x800;
+    } else if ((c & 0xF8) == 0xF0) {
+        length = 4;
+        value = c & 0x07;
+        min = 0x10000;
+    } else {
+        return 0;
+    }
+    if (length > count) return 0;
+
+    for (i32 i = 1; i < length; i++) {
+        if ((data[i] & 0xC0) != 0x80) return 0;
+        value = (value << 6) | (data[i] & 0x3F);
+    }
+    if (value < min || value > 0x10FFFF) return 0;
+    if (value >= 0xD800 && value <= 0xDFFF) return 0;
+
+    *code_point = value;
+    return length;
+}
+
+internal bool string__utf8_validate_scalar(const u8 *data, i32 count) {
+    i32 i = 0;
+    while (i < count) {
+        // Skip over ASCII 8 bytes at a time
+        if (i + 8 <= count) {
+            u64 word;
+            MEMCPY(&word, data + i, sizeof(word));
+            if (!(word & 0x8080808080808080ull)) {
+                i += 8;
+                continue;
+            }
+        }
+
+        u32 code_point;
+        i32 length = string__utf8_decode(data + i, count - i, &code_point);
+        if (!length) return false;
+        i += length;
     }
-    return ord;
+    return true;
+}
+
+#if (defined(__GNUC__) || defined(__clang__)) &&                               \
+    (defined(__x86_64__) || defined(__i386__))
+#define STRING__UTF8_SSSE3
+#include <tmmintrin.h>
+
+// The error classes of a pair of bytes, from "Validating UTF-8 In Less Than
+// One Instruction Per Byte" by John Keiser and Daniel Lemire.
+#define STRING__UTF8_TOO_SHORT      (1 << 0)
+#define STRING__UTF8_TOO_LONG       (1 << 1)
+#define STRING__UTF8_OVERLONG_3     (1 << 2)
+#define STRING__UTF8_TOO_LARGE      (1 << 3)
+#define STRING__UTF8_SURROGATE      (1 << 4)
+#define STRING__UTF8_OVERLONG_2     (1 << 5)
+#define STRING__UTF8_TOO_LARGE_1000 (1 << 6)
+#define STRING__UTF8_OVERLONG_4     (1 << 6)
+#define STRING__UTF8_TWO_CONTS      (1 << 7)
+#define STRING__UTF8_CARRY                                                     \
+    (STRING__UTF8_TOO_SHORT | STRING__UTF8_TOO_LONG | STRING__UTF8_TWO_CONTS)
+
+__attribute__((target("ssse3"))) internal __m128i
+string__utf8_check_block(__m128i input, __m128i previous) {
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i byte_1_high_table = _mm_setr_epi8(
+        STRING__UTF8_TOO_LONG, STRING__UTF8_TOO_LONG, STRING__UTF8_TOO_LONG,
+        STRING__UTF8_TOO_LONG, STRING__UTF8_TOO_LONG, STRING__UTF8_TOO_LONG,
+        STRING__UTF8_TOO_LONG, STRING__UTF8_TOO_LONG, STRING__UTF8_TWO_CONTS,
+        STRING__UTF8_TWO_CONTS, STRING__UTF8_TWO_CONTS, STRING__UTF8_TWO_CONTS,
+        STRING__UTF8_TOO_SHORT | STRING__UTF8_OVERLONG_2,
+        STRING__UTF8_TOO_SHORT,
+        STRING__UTF8_TOO_SHORT | STRING__UTF8_OVERLONG_3 |
+            STRING__UTF8_SURROGATE,
+        (char)(STRING__UTF8_TOO_SHORT | STRING__UTF8_TOO_LARGE |
+               STRING__UTF8_TOO_LARGE_1000 | STRING__UTF8_OVERLONG_4));
+    const __m128i byte_1_low_table = _mm_setr_epi8(
+        (char)(STRING__UTF8_CARRY | STRING__UTF8_OVERLONG_3 |
+               STRING__UTF8_OVERLONG_2 | STRING__UTF8_OVERLONG_4),
+        (char)(STRING__UTF8_CARRY | STRING__UTF8_OVERLONG_2),
+        (char)STRING__UTF8_CARRY, (char)STRING__UTF8_CARRY,
+        (char)(STRING__UTF8_CARRY | STRING__UTF8_TOO_LARGE),
+        (char)(STRING__UTF8_CARRY | STRING__UTF8_TOO_LARGE |
+               STRING__UTF8_TOO_LARGE_1000),
+        (char)(STRING__UTF8_CARRY | STRING__UTF8_TOO_LARGE |
+               STRING__UTF8_TOO_LARGE_1000),
+        (char)(STRING__UTF8_CARRY | STRING__UTF8_TOO_LARGE |
+               STRING__UTF8_TOO_LARGE_1000),
+        (char)(STRING__UTF8_CARRY | STRING__UTF8_TOO_LARGE |
+               STRING__UTF8_TOO_LARGE_1000),
+        (char)(STRING__UTF8_CARRY | STRING__UTF8_TOO_LARGE |
+               STRING__UTF8_TOO_LARGE_1000),
+        (char)(STRING__UTF8_CARRY | STRING__UTF8_TOO_LARGE |
+               STRING__UTF8_TOO_LARGE_1000),
+        (char)(STRING__UTF8_CARRY | STRING__UTF8_TOO_LARGE |
+               STRING__UTF8_TOO_LARGE_1000),
+        (char)(STRING__UTF8_CARRY | STRING__UTF8_TOO_LARGE |
+               STRING__UTF8_TOO_LARGE_1000),
+        (char)(STRING__UTF8_CARRY | STRING__UTF8_TOO_LARGE |
+               STRING__UTF8_TOO_LARGE_1000 | STRING__UTF8_SURROGATE),
+        (char)(STRING__UTF8_CARRY | STRING__UTF8_TOO_LARGE |
+               STRING__UTF8_TOO_LARGE_1000),
+        (char)(STRING__UTF8_CARRY | STRING__UTF8_TOO_LARGE |
+               STRING__UTF8_TOO_LARGE_1000));
+    const __m128i byte_2_high_table = _mm_setr_epi8(
+        STRING__UTF8_TOO_SHORT, STRING__UTF8_TOO_SHORT, STRING__UTF8_TOO_SHORT,
+        STRING__UTF8_TOO_SHORT, STRING__UTF8_TOO_SHORT, STRING__UTF8_TOO_SHORT,
+        STRING__UTF8_TOO_SHORT, STRING__UTF8_TOO_SHORT,
+        (char)(STRING__UTF8_TOO_LONG | STRING__UTF8_OVERLONG_2 |
+               STRING__UTF8_TWO_CONTS | STRING__UTF8_OVERLONG_3 |
+               STRING__UTF8_TOO_LARGE_1000 | STRING__UTF8_OVERLONG_4),
+        (char)(STRING__UTF8_TOO_LONG | STRING__UTF8_OVERLONG_2 |
+               STRING__UTF8_TWO_CONTS | STRING__UTF8_OVERLONG_3 |
+               STRING__UTF8_TOO_LARGE),
+        (char)(STRING__UTF8_TOO_LONG | STRING__UTF8_OVERLONG_2 |
+               STRING__UTF8_TWO_CONTS | STRING__UTF8_SURROGATE |
+               STRING__UTF8_TOO_LARGE),
+        (char)(STRING__UTF8_TOO_LONG | STRING__UTF8_OVERLONG_2 |
+               STRING__UTF8_TWO_CONTS | STRING__UTF8_SURROGATE |
+               STRING__UTF8_TOO_LARGE),
+        STRING__UTF8_TOO_SHORT, STRING__UTF8_TOO_SHORT, STRING__UTF8_TOO_SHORT,
+        STRING__UTF8_TOO_SHORT);
+
+    // Classify every pair of adjacent bytes by looking up their nibbles
+    __m128i prev1 = _mm_alignr_epi8(input, previous, 15);
+    __m128i byte_1_high = _mm_shuffle_epi8(
+        byte_1_high_table, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+    __m128i byte_1_low =
+        _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(prev1, nibble));
+    __m128i byte_2_high = _mm_shuffle_epi8(
+        byte_2_high_table, _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    __m128i special_cases =
+        _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+    // The third and fourth bytes of 3 and 4 byte sequences must be
+    // continuations, which the pairs above can't see
+    __m128i prev2 = _mm_alignr_epi8(input, previous, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, previous, 13);
+    __m128i is_third = _mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80));
+    __m128i is_fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80));
+    __m128i must_be_continuation = _mm_and_si128(
+        _mm_or_si128(is_third, is_fourth), _mm_set1_epi8((char)0x80));
+
+    return _mm_xor_si128(must_be_continuation, special_cases);
+}
+
+__attribute__((target("ssse3"))) internal bool
+string__utf8_validate_ssse3(const u8 *data, i32 count) {
+    // Whether the last bytes of a block start a sequence that needs more bytes
+    const __m128i max_complete = _mm_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1),
+        (char)(0xE0 - 1), (char)(0xC0 - 1));
+
+    __m128i error = _mm_setzero_si128();
+    __m128i previous = _mm_setzero_si128();
+    __m128i incomplete = _mm_setzero_si128();
+
+    i32 i = 0;
+    for (;; i += 16) {
+        __m128i input;
+        if (i + 16 <= count) {
+            input = _mm_loadu_si128((const __m128i *)(data + i));
+        } else if (i < count) {
+            // Pad the last block with zeros, which are valid ASCII
+            u8 last[16] = {0};
+            MEMCPY(last, data + i, count - i);
+            input = _mm_loadu_si128((const __m128i *)last);
+        } else {
+            break;
+        }
+
+        if (!_mm_movemask_epi8(input)) {
+            // All ASCII, so only a sequence left over from before can be wrong
+            error = _mm_or_si128(error, incomplete);
+        } else {
+            error =
+                _mm_or_si128(error, string__utf8_check_block(input, previous));
+            incomplete = _mm_subs_epu8(input, max_complete);
+        }
+        previous = input;
+    }
+    error = _mm_or_si128(error, incomplete);
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) ==
+        0xFFFF;
+}
+#endif // STRING__UTF8_SSSE3
+
+bool sv_utf8_validate(StringView self) {
+    const u8 *data = (const u8 *)self.data;
+#ifdef STRING__UTF8_SSSE3
+    if (__builtin_cpu_supports("ssse3"))
+        return string__utf8_validate_ssse3(data, self.count);
+#endif // STRING__UTF8_SSSE3
+    return string__utf8_validate_scalar(data, self.count);
+}
+
+i32 sv_utf8_count(StringView self) {
+    i32 count = 0;
+    i32 i = 0;
+    // Count the continuation bytes (`10xxxxxx`) 8 bytes at a time
+    for (; i + 8 <= self.count; i += 8) {
+        u64 word;
+        MEMCPY(&word, self.data + i, sizeof(word));
+        u64 continuations = word & ~(word << 1) & 0x8080808080808080ull;
+        continuations >>= 7;
+        continuations *= 0x0101010101010101ull;
+        count += 8 - (i32)(continuations >> 56);
+    }
+    for (; i < self.count; i++) {
+        count += ((u8)self.data[i] & 0xC0) != 0x80;
+    }
+    return count;
+}
+
+// Get the byte offset of the code point `n` code points after `offset`.
+internal i32 string__utf8_advance(StringView self, i32 offset, i32 n) {
+    while (offset < self.count && n > 0) {
+        offset++;
+        while (offset < self.count && ((u8)self.data[offset] & 0xC0) == 0x80)
+            offset++;
+        n--;
+    }
+    return offset;
+}
+
+StringView sv_utf8_slice(StringView self, i32 start, i32 count) {
+    // Skip any continuation bytes at the very start, so the slice starts on a
+    // boundary even if `self` doesn't
+    i32 first = 0;
+    while (first < self.count && ((u8)self.data[first] & 0xC0) == 0x80)
+        first++;
+    first = string__utf8_advance(self, first, start);
+    i32 last = string__utf8_advance(self, first, count);
+    return sv_from_parts(self.data + first, last - first);
 }
 
 void sv_trim(StringView *self) {
@@ -225,13 +742,13 @@ void sv_trim(StringView *self) {
 }
 
 void sv_trim_start(StringView *self) {
-    while (isspace(sv_get(*self, 0))) {
+    while (self->count > 0 && isspace(sv_get(*self, 0))) {
         sv_shift(self);
     }
 }
 
 void sv_trim_end(StringView *self) {
-    while (isspace(sv_get(*self, -1))) {
+    while (self->count > 0 && isspace(sv_get(*self, -1))) {
         sv_pop(self);
     }
 }
@@ -306,14 +823,282 @@ void sv_trim_end(StringView *self) {
         if (negative) acc *= -1;                                               \
         return acc;                                                            \
     }
+// The maximum amount of significant digits handed to `strtod`/`strtof` when a
+// float can't be parsed using the fast path. A `double` needs at most 768
+// significant digits to be rounded correctly; any digits after the limit are
+// folded into a single "sticky" digit so that ties still round correctly.
+#define STRING__FLOAT_MAX_DIGITS 780
+// The size of the rendering handed to `strtod`/`strtof`: the significant
+// digits, the sticky digit, and the exponent.
+#define STRING__FLOAT_BUFFER_SIZE (STRING__FLOAT_MAX_DIGITS + 1 + 32)
+
+// The result of scanning a decimal number in a `StringView`.
+typedef struct {
+    // The first (up to) 19 significant digits of the number.
+    u64 mantissa;
+    // The power of ten by which `mantissa` should be multiplied.
+    i64 exponent;
+    // Whether the number has a leading `-`.
+    bool negative;
+    // Whether there were non-zero digits that didn't fit into `mantissa`.
+    bool truncated;
+    // Whether the number is `inf` (`mantissa == 0`) or `nan` (`mantissa != 0`).
+    bool special;
+} String__Decimal;
+
+// Exact powers of ten which can be represented as a `double`.
+global const double string__pow10_double[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+// Exact powers of ten which can be represented as a `float`.
+global const float string__pow10_float[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f,
+};
+
+internal bool string__starts_with_nocase(StringView self, i32 start,
+                                         const char *word) {
+    for (i32 i = 0; word[i]; i++) {
+        if (start + i >= self.count) return false;
+        if (tolower((u8)self.data[start + i]) != word[i]) return false;
+    }
+    return true;
+}
+
+// Scan the exponent (`e` or `E`, an optional sign and digits) at `*i` in
+// `self`, advancing `*i` past it. Leaves `*i` alone if there's no exponent.
+internal i64 string__scan_exponent(StringView self, i32 *i) {
+    i32 j = *i;
+    if (j >= self.count || (self.data[j] != 'e' && self.data[j] != 'E'))
+        return 0;
+    j++;
+
+    bool negative = false;
+    if (j < self.count && (self.data[j] == '-' || self.data[j] == '+')) {
+        negative = self.data[j] == '-';
+        j++;
+    }
+    if (j >= self.count || !string__is_digit(self.data[j])) return 0;
+
+    i64 exponent = 0;
+    for (; j < self.count && string__is_digit(self.data[j]); j++) {
+        // Anything this large is already zero or infinity anyway
+        if (exponent < 100000) exponent = exponent * 10 + self.data[j] - '0';
+    }
+    *i = j;
+    return negative ? -exponent : exponent;
+}
+
+// Scan a decimal number at the start of `self`, after any whitespace. Returns
+// the amount of characters making up the number (including the whitespace),
+// or `0` if `self` doesn't start with a number.
+internal i32 string__scan_decimal(StringView self, String__Decimal *out) {
+    *out = (String__Decimal){0};
+
+    i32 i = 0;
+    while (i < self.count && isspace((u8)self.data[i])) i++;
+    if (i < self.count && (self.data[i] == '-' || self.data[i] == '+')) {
+        out->negative = self.data[i] == '-';
+        i++;
+    }
+
+    if (string__starts_with_nocase(self, i, "infinity")) {
+        out->special = true;
+        return i + 8;
+    }
+    if (string__starts_with_nocase(self, i, "inf")) {
+        out->special = true;
+        return i + 3;
+    }
+    if (string__starts_with_nocase(self, i, "nan")) {
+        out->special = true;
+        out->mantissa = 1;
+        return i + 3;
+    }
+
+    bool any_digits = false;
+    bool fraction = false;
+    i32 significant = 0;
+    for (; i < self.count; i++) {
+        char c = self.data[i];
+        if (c == '.' && !fraction) {
+            fraction = true;
+            continue;
+        }
+        if (!string__is_digit(c)) break;
+
+        any_digits = true;
+        u8 digit = c - '0';
+        if (!significant && !digit) {
+            // Leading zeros only matter after the decimal point
+            if (fraction) out->exponent--;
+        } else if (significant < 19) {
+            out->mantissa = out->mantissa * 10 + digit;
+            significant++;
+            if (fraction) out->exponent--;
+        } else {
+            if (digit) out->truncated = true;
+            if (!fraction) out->exponent++;
+        }
+    }
+    if (!any_digits) return 0;
+
+    out->exponent += string__scan_exponent(self, &i);
+    return i;
+}
+
+// Render the number scanned by `string__scan_decimal` at the start of `self`
+// into `buf` as an unsigned integer mantissa and an exponent, with no decimal
+// point so the result doesn't depend on the locale. `buf` should have room for
+// `STRING__FLOAT_BUFFER_SIZE` characters.
+internal void string__render_decimal(StringView self, char *buf) {
+    i32 i = 0;
+    while (i < self.count && isspace((u8)self.data[i])) i++;
+    if (i < self.count && (self.data[i] == '-' || self.data[i] == '+')) i++;
+
+    i32 written = 0;
+    i64 exponent = 0;
+    bool fraction = false;
+    bool sticky = false;
+    for (; i < self.count; i++) {
+        char c = self.data[i];
+        if (c == '.' && !fraction) {
+            fraction = true;
+            continue;
+        }
+        if (!string__is_digit(c)) break;
+
+        if (!written && c == '0') {
+            if (fraction) exponent--;
+        } else if (written < STRING__FLOAT_MAX_DIGITS) {
+            buf[written++] = c;
+            if (fraction) exponent--;
+        } else {
+            if (c != '0') sticky = true;
+            if (!fraction) exponent++;
+        }
+    }
+    if (sticky) {
+        buf[written++] = '1';
+        exponent--;
+    }
+    if (!written) buf[written++] = '0';
+
+    exponent += string__scan_exponent(self, &i);
+    snprintf(buf + written, STRING__FLOAT_BUFFER_SIZE - written, "e%" PRIi64,
+             exponent);
+}
+
+internal bool string__decimal_to_double(String__Decimal d, double *out) {
+    if (d.special) {
+        *out = d.mantissa ? NAN : INFINITY;
+    } else if (!d.mantissa && !d.truncated) {
+        *out = 0.0;
+    } else {
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD != 0
+        // Excess precision breaks the exactness of the fast path
+        return false;
+#endif
+        const u64 max_mantissa = (u64)1 << 53;
+        if (d.truncated || d.mantissa > max_mantissa) return false;
+        if (d.exponent < -22) return false;
+
+        // Move powers of ten into the mantissa while it stays exact, which
+        // handles numbers like `1e30` and `12e25`.
+        u64 mantissa = d.mantissa;
+        i64 exponent = d.exponent;
+        while (exponent > 22) {
+            if (mantissa > max_mantissa / 10) return false;
+            mantissa *= 10;
+            exponent--;
+        }
+
+        double value = (double)mantissa;
+        if (exponent < 0) {
+            value /= string__pow10_double[-exponent];
+        } else {
+            value *= string__pow10_double[exponent];
+        }
+        *out = value;
+    }
+
+    if (d.negative) *out = -*out;
+    return true;
+}
+
+internal bool string__decimal_to_float(String__Decimal d, float *out) {
+    if (d.special) {
+        *out = d.mantissa ? NAN : INFINITY;
+    } else if (!d.mantissa && !d.truncated) {
+        *out = 0.0f;
+    } else {
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD != 0
+        // Excess precision breaks the exactness of the fast path
+        return false;
+#endif
+        const u64 max_mantissa = (u64)1 << 24;
+        if (d.truncated || d.mantissa > max_mantissa) return false;
+        if (d.exponent < -10) return false;
+
+        u64 mantissa = d.mantissa;
+        i64 exponent = d.exponent;
+        while (exponent > 10) {
+            if (mantissa > max_mantissa / 10) return false;
+            mantissa *= 10;
+            exponent--;
+        }
+
+        float value = (float)mantissa;
+        if (exponent < 0) {
+            value /= string__pow10_float[-exponent];
+        } else {
+            value *= string__pow10_float[exponent];
+        }
+        *out = value;
+    }
+
+    if (d.negative) *out = -*out;
+    return true;
+}
+
+// Parse a float with the fast path (exact whenever the mantissa and the power
+// of ten both fit in `T` exactly) and fall back to `fn` on a bounded,
+// NUL-terminated rendering of the digits otherwise.
 #define STRING__SV_PARSE_FLOAT_DEFINE(T, fn)                                   \
     T sv_parse_##T(StringView *sv) {                                           \
-        char *endptr;                                                          \
-        T ret = fn(sv->data, &endptr);                                         \
-        i32 count = endptr - sv->data;                                         \
+        String__Decimal d;                                                     \
+        i32 count = string__scan_decimal(*sv, &d);                             \
+        if (!count) return 0;                                                  \
+        T ret;                                                                 \
+        if (!string__decimal_to_##T(d, &ret)) {                                \
+            char buf[STRING__FLOAT_BUFFER_SIZE];                               \
+            string__render_decimal(*sv, buf);                                  \
+            ret = fn(buf, NULL);                                               \
+            if (d.negative) ret = -ret;                                        \
+        }                                                                      \
         sv->count -= count;                                                    \
         sv->data += count;                                                     \
         return ret;                                                            \
+    }                                                                          \
+    i32 sv_parse_##T##s(StringView *sv, char delimiter, T *out,                \
+                        i32 capacity) {                                        \
+        i32 parsed = 0;                                                        \
+        while (parsed < capacity && sv->count) {                               \
+            StringView rest = *sv;                                             \
+            T value = sv_parse_##T(&rest);                                     \
+            if (rest.count == sv->count) break;                                \
+            while (rest.count && rest.data[0] != delimiter &&                  \
+                   (rest.data[0] == ' ' || rest.data[0] == '\t' ||             \
+                    rest.data[0] == '\r'))                                     \
+                sv_shift(&rest);                                               \
+            if (rest.count) {                                                  \
+                if (rest.data[0] != delimiter) break;                          \
+                sv_shift(&rest);                                               \
+            }                                                                  \
+            out[parsed++] = value;                                             \
+            *sv = rest;                                                        \
+        }                                                                      \
+        return parsed;                                                         \
     }
 
 STRING__SV_PARSE_UINT_DEFINE(u32, UINT32_MAX)
@@ -323,23 +1108,30 @@ STRING__SV_PARSE_INT_DEFINE(i64, INT64_MAX)
 STRING__SV_PARSE_FLOAT_DEFINE(float, strtof)
 STRING__SV_PARSE_FLOAT_DEFINE(double, strtod)
 
+ARRAY_DEFINE_PREFIX(StringView, StringViews, svs)
 ARRAY_DEFINE_PREFIX(char, StringBuilder, sb)
 
 i32 sb_appendf(StringBuilder *self, const char *fmt, ...) {
-    va_list args;
-
+    va_list args, retry;
     va_start(args, fmt);
-    i32 n = vsnprintf(NULL, 0, fmt, args);
-    va_end(args);
+    va_copy(retry, args);
 
-    // NOTE: the new_capacity needs to be +1 because of the null terminator.
-    // However, further below we increase self->count by n, not n + 1.
-    // This is because we don't want the `StringBuilder` to include the null
-    // terminator. The user can always use `sb_push_null` if they want it.
-    sb_reserve(self, n);
-    char *dest = self->items + self->count;
-    va_start(args, fmt);
-    vsnprintf(dest, n + 1, fmt, args);
+    // Format straight into the spare capacity, and only reserve more memory
+    // and format again if the result didn't fit.
+    i32 capacity = self->capacity < 0 ? -self->capacity : self->capacity;
+    i32 available = capacity - self->count;
+    i32 n = vsnprintf(self->items + self->count, available, fmt, args);
+    if (n >= available) {
+        // NOTE: the reserved amount needs to be +1 because of the null
+        // terminator. However, further below we increase self->count by n, not
+        // n + 1. This is because we don't want the `StringBuilder` to include
+        // the null terminator. The user can always use `sb_push_null` if they
+        // want it.
+        sb_reserve(self, self->count + n + 1);
+        vsnprintf(self->items + self->count, n + 1, fmt, retry);
+    }
+
+    va_end(retry);
     va_end(args);
 
     self->count += n;
@@ -363,6 +1155,472 @@ StringView sb_to_sv(StringBuilder self) {
     return sv_from_parts(self.items, self.count);
 }
 
+bool sb_append_utf8_as_utf16(StringBuilder *self, StringView utf8) {
+    // There's never more than one UTF-16 code unit per byte of UTF-8
+    StringWriter w = sw_begin(self, utf8.count * 2);
+    const u8 *data = (const u8 *)utf8.data;
+    i32 i = 0;
+    while (i < utf8.count) {
+        if (data[i] < 0x80) {
+            u16 unit = data[i++];
+            sw_put_bytes(&w, (const char *)&unit, sizeof(unit));
+            continue;
+        }
+
+        u32 code_point;
+        i32 length = string__utf8_decode(data + i, utf8.count - i, &code_point);
+        if (!length) return false;
+        i += length;
+
+        if (code_point < 0x10000) {
+            u16 unit = (u16)code_point;
+            sw_put_bytes(&w, (const char *)&unit, sizeof(unit));
+        } else {
+            code_point -= 0x10000;
+            u16 units[2] = {
+                (u16)(0xD800 + (code_point >> 10)),
+                (u16)(0xDC00 + (code_point & 0x3FF)),
+            };
+            sw_put_bytes(&w, (const char *)units, sizeof(units));
+        }
+    }
+    sw_end(w);
+    return true;
+}
+
+bool sb_append_utf16_as_utf8(StringBuilder *self, const u16 *utf16,
+                             i32 count) {
+    // There's never more than three bytes of UTF-8 per UTF-16 code unit
+    StringWriter w = sw_begin(self, count * 3);
+    for (i32 i = 0; i < count; i++) {
+        u32 code_point = utf16[i];
+        if (code_point < 0x80) {
+            SW_PUT(&w, code_point);
+        } else if (code_point < 0x800) {
+            SW_PUT(&w, 0xC0 | (code_point >> 6));
+            SW_PUT(&w, 0x80 | (code_point & 0x3F));
+        } else if (code_point < 0xD800 || code_point > 0xDFFF) {
+            SW_PUT(&w, 0xE0 | (code_point >> 12));
+            SW_PUT(&w, 0x80 | ((code_point >> 6) & 0x3F));
+            SW_PUT(&w, 0x80 | (code_point & 0x3F));
+        } else {
+            if (code_point > 0xDBFF || i + 1 >= count) return false;
+            u32 low = utf16[++i];
+            if (low < 0xDC00 || low > 0xDFFF) return false;
+            code_point =
+                0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+            SW_PUT(&w, 0xF0 | (code_point >> 18));
+            SW_PUT(&w, 0x80 | ((code_point >> 12) & 0x3F));
+            SW_PUT(&w, 0x80 | ((code_point >> 6) & 0x3F));
+            SW_PUT(&w, 0x80 | (code_point & 0x3F));
+        }
+    }
+    sw_end(w);
+    return true;
+}
+
+// The two-digit strings "00" through "99", so integers can be formatted two
+// digits at a time.
+global const char string__digit_pairs[] = "00010203040506070809"
+                                          "10111213141516171819"
+                                          "20212223242526272829"
+                                          "30313233343536373839"
+                                          "40414243444546474849"
+                                          "50515253545556575859"
+                                          "60616263646566676869"
+                                          "70717273747576777879"
+                                          "80818283848586878889"
+                                          "90919293949596979899";
+
+internal i32 string__count_digits(u64 value) {
+    i32 digits = 1;
+    for (;;) {
+        if (value < 10) return digits;
+        if (value < 100) return digits + 1;
+        if (value < 1000) return digits + 2;
+        if (value < 10000) return digits + 3;
+        value /= 10000;
+        digits += 4;
+    }
+}
+
+// Format `value` into `dest`, which must have room for 20 characters,
+// returning the amount of characters written.
+internal i32 string__format_u64(char *dest, u64 value) {
+    i32 count = string__count_digits(value);
+    char *end = dest + count;
+    while (value >= 100) {
+        u32 pair = (u32)(value % 100) * 2;
+        value /= 100;
+        *--end = string__digit_pairs[pair + 1];
+        *--end = string__digit_pairs[pair];
+    }
+    if (value >= 10) {
+        u32 pair = (u32)value * 2;
+        *--end = string__digit_pairs[pair + 1];
+        *--end = string__digit_pairs[pair];
+    } else {
+        *--end = (char)('0' + value);
+    }
+    return count;
+}
+
+// Format `value` into `dest`, which must have room for 20 characters,
+// returning the amount of characters written.
+internal i32 string__format_i64(char *dest, i64 value) {
+    if (value < 0) {
+        *dest = '-';
+        return 1 + string__format_u64(dest + 1, (u64)0 - (u64)value);
+    }
+    return string__format_u64(dest, (u64)value);
+}
+
+// Format `value` into `dest`, which must have room for `MAX(16, width)`
+// characters, returning the amount of characters written.
+internal i32 string__format_hex(char *dest, u64 value, i32 width) {
+    i32 count = 1;
+    while (count < 16 && (value >> (count * 4))) count++;
+    if (count < width) count = width;
+    for (i32 i = count - 1, shift = 0; i >= 0; i--, shift += 4) {
+        dest[i] = shift < 64 ? "0123456789abcdef"[(value >> shift) & 0xF] : '0';
+    }
+    return count;
+}
+
+// A floating point number with a 64 bit significand: `f * 2^e`.
+typedef struct {
+    u64 f;
+    i32 e;
+} String__DiyFp;
+
+// Normalized approximations of the powers of ten from 10^-348 to 10^340, in
+// steps of 8, used by Grisu2.
+global const String__DiyFp string__cached_powers[] = {
+    {0xfa8fd5a0081c0288ull, -1220}, {0xbaaee17fa23ebf76ull, -1193},
+    {0x8b16fb203055ac76ull, -1166}, {0xcf42894a5dce35eaull, -1140},
+    {0x9a6bb0aa55653b2dull, -1113}, {0xe61acf033d1a45dfull, -1087},
+    {0xab70fe17c79ac6caull, -1060}, {0xff77b1fcbebcdc4full, -1034},
+    {0xbe5691ef416bd60cull, -1007}, {0x8dd01fad907ffc3cull, -980},
+    {0xd3515c2831559a83ull, -954}, {0x9d71ac8fada6c9b5ull, -927},
+    {0xea9c227723ee8bcbull, -901}, {0xaecc49914078536dull, -874},
+    {0x823c12795db6ce57ull, -847}, {0xc21094364dfb5637ull, -821},
+    {0x9096ea6f3848984full, -794}, {0xd77485cb25823ac7ull, -768},
+    {0xa086cfcd97bf97f4ull, -741}, {0xef340a98172aace5ull, -715},
+    {0xb23867fb2a35b28eull, -688}, {0x84c8d4dfd2c63f3bull, -661},
+    {0xc5dd44271ad3cdbaull, -635}, {0x936b9fcebb25c996ull, -608},
+    {0xdbac6c247d62a584ull, -582}, {0xa3ab66580d5fdaf6ull, -555},
+    {0xf3e2f893dec3f126ull, -529}, {0xb5b5ada8aaff80b8ull, -502},
+    {0x87625f056c7c4a8bull, -475}, {0xc9bcff6034c13053ull, -449},
+    {0x964e858c91ba2655ull, -422}, {0xdff9772470297ebdull, -396},
+    {0xa6dfbd9fb8e5b88full, -369}, {0xf8a95fcf88747d94ull, -343},
+    {0xb94470938fa89bcfull, -316}, {0x8a08f0f8bf0f156bull, -289},
+    {0xcdb02555653131b6ull, -263}, {0x993fe2c6d07b7facull, -236},
+    {0xe45c10c42a2b3b06ull, -210}, {0xaa242499697392d3ull, -183},
+    {0xfd87b5f28300ca0eull, -157}, {0xbce5086492111aebull, -130},
+    {0x8cbccc096f5088ccull, -103}, {0xd1b71758e219652cull, -77},
+    {0x9c40000000000000ull, -50}, {0xe8d4a51000000000ull, -24},
+    {0xad78ebc5ac620000ull, 3}, {0x813f3978f8940984ull, 30},
+    {0xc097ce7bc90715b3ull, 56}, {0x8f7e32ce7bea5c70ull, 83},
+    {0xd5d238a4abe98068ull, 109}, {0x9f4f2726179a2245ull, 136},
+    {0xed63a231d4c4fb27ull, 162}, {0xb0de65388cc8ada8ull, 189},
+    {0x83c7088e1aab65dbull, 216}, {0xc45d1df942711d9aull, 242},
+    {0x924d692ca61be758ull, 269}, {0xda01ee641a708deaull, 295},
+    {0xa26da3999aef774aull, 322}, {0xf209787bb47d6b85ull, 348},
+    {0xb454e4a179dd1877ull, 375}, {0x865b86925b9bc5c2ull, 402},
+    {0xc83553c5c8965d3dull, 428}, {0x952ab45cfa97a0b3ull, 455},
+    {0xde469fbd99a05fe3ull, 481}, {0xa59bc234db398c25ull, 508},
+    {0xf6c69a72a3989f5cull, 534}, {0xb7dcbf5354e9beceull, 561},
+    {0x88fcf317f22241e2ull, 588}, {0xcc20ce9bd35c78a5ull, 614},
+    {0x98165af37b2153dfull, 641}, {0xe2a0b5dc971f303aull, 667},
+    {0xa8d9d1535ce3b396ull, 694}, {0xfb9b7cd9a4a7443cull, 720},
+    {0xbb764c4ca7a44410ull, 747}, {0x8bab8eefb6409c1aull, 774},
+    {0xd01fef10a657842cull, 800}, {0x9b10a4e5e9913129ull, 827},
+    {0xe7109bfba19c0c9dull, 853}, {0xac2820d9623bf429ull, 880},
+    {0x80444b5e7aa7cf85ull, 907}, {0xbf21e44003acdd2dull, 933},
+    {0x8e679c2f5e44ff8full, 960}, {0xd433179d9c8cb841ull, 986},
+    {0x9e19db92b4e31ba9ull, 1013}, {0xeb96bf6ebadf77d9ull, 1039},
+    {0xaf87023b9bf0ee6bull, 1066},
+};
+
+// The powers of ten which fit in a `u64`.
+global const u64 string__pow10_u64[] = {
+    1ull,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+    1000000000000000000ull,
+    10000000000000000000ull,
+};
+
+internal String__DiyFp string__diy_fp_multiply(String__DiyFp a,
+                                               String__DiyFp b) {
+    const u64 mask = 0xFFFFFFFF;
+    u64 ah = a.f >> 32, al = a.f & mask, bh = b.f >> 32, bl = b.f & mask;
+    u64 hh = ah * bh, lh = al * bh, hl = ah * bl, ll = al * bl;
+    // Round the lower 64 bits into the result
+    u64 middle = (ll >> 32) + (hl & mask) + (lh & mask) + ((u64)1 << 31);
+    String__DiyFp result = {
+        .f = hh + (hl >> 32) + (lh >> 32) + (middle >> 32),
+        .e = a.e + b.e + 64,
+    };
+    return result;
+}
+
+internal String__DiyFp string__diy_fp_normalize(String__DiyFp x) {
+    while (!(x.f & ((u64)1 << 63))) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+internal void string__grisu2_round(char *digits, i32 count, u64 delta, u64 rest,
+                                   u64 ten_kappa, u64 wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        digits[count - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+// Generate the shortest digits for the positive, finite and non-zero `value`
+// into `digits`, which must have room for 18 characters, using Grisu2.
+// Returns the amount of digits, and sets `*exponent` such that `value` is
+// `digits * 10^exponent`.
+internal i32 string__grisu2(double value, char *digits, i32 *exponent) {
+    const u64 hidden_bit = (u64)1 << 52;
+    const u64 *pow10 = string__pow10_u64;
+
+    u64 bits;
+    MEMCPY(&bits, &value, sizeof(bits));
+    i32 biased_e = (i32)((bits >> 52) & 0x7FF);
+    String__DiyFp v = {.f = bits & (hidden_bit - 1), .e = -1074};
+    if (biased_e) {
+        v.f += hidden_bit;
+        v.e = biased_e - 1075;
+    }
+
+    // The boundaries halfway to the neighbouring doubles
+    String__DiyFp plus = {.f = (v.f << 1) + 1, .e = v.e - 1};
+    while (!(plus.f & (hidden_bit << 1))) {
+        plus.f <<= 1;
+        plus.e--;
+    }
+    plus.f <<= 64 - 52 - 2;
+    plus.e -= 64 - 52 - 2;
+    String__DiyFp minus = v.f == hidden_bit
+        ? (String__DiyFp){.f = (v.f << 2) - 1, .e = v.e - 2}
+        : (String__DiyFp){.f = (v.f << 1) - 1, .e = v.e - 1};
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    // Scale everything by a cached power of ten so that the exponent lands in
+    // the range where the digits can be generated with integer arithmetic
+    double dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+    i32 k = (i32)dk;
+    if (dk - k > 0.0) k++;
+    i32 index = (k >> 3) + 1;
+    *exponent = -(-348 + index * 8);
+    String__DiyFp c_mk = string__cached_powers[index];
+
+    String__DiyFp w =
+        string__diy_fp_multiply(string__diy_fp_normalize(v), c_mk);
+    String__DiyFp wp = string__diy_fp_multiply(plus, c_mk);
+    String__DiyFp wm = string__diy_fp_multiply(minus, c_mk);
+    wm.f++;
+    wp.f--;
+
+    u64 delta = wp.f - wm.f;
+    String__DiyFp one = {.f = (u64)1 << -wp.e, .e = wp.e};
+    u64 wp_w = wp.f - w.f;
+    u32 p1 = (u32)(wp.f >> -one.e);
+    u64 p2 = wp.f & (one.f - 1);
+
+    i32 kappa = string__count_digits(p1);
+    i32 count = 0;
+    while (kappa > 0) {
+        u32 d = p1 / (u32)pow10[kappa - 1];
+        p1 %= (u32)pow10[kappa - 1];
+        if (d || count) digits[count++] = (char)('0' + d);
+        kappa--;
+        u64 rest = ((u64)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *exponent += kappa;
+            string__grisu2_round(digits, count, delta, rest,
+                                 pow10[kappa] << -one.e, wp_w);
+            return count;
+        }
+    }
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)(p2 >> -one.e);
+        if (d || count) digits[count++] = (char)('0' + d);
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *exponent += kappa;
+            u64 unit = -kappa < 20 ? pow10[-kappa] : 0;
+            string__grisu2_round(digits, count, delta, p2, one.f, wp_w * unit);
+            return count;
+        }
+    }
+}
+
+// Format `value` into `dest`, which must have room for
+// `DOUBLE_FORMAT_MAX_LENGTH` characters, returning the amount of characters
+// written.
+internal i32 string__format_double(char *dest, double value,
+                                   DoubleFormat format) {
+    char *start = dest;
+
+    if (isnan(value)) {
+        MEMCPY(dest, "nan", 3);
+        return 3;
+    }
+    if (signbit(value)) {
+        *dest++ = '-';
+        value = -value;
+    }
+    if (isinf(value)) {
+        MEMCPY(dest, "inf", 3);
+        return dest - start + 3;
+    }
+
+    char digits[18];
+    i32 count = 1, exponent = 0;
+    if (value == 0.0) {
+        digits[0] = '0';
+    } else {
+        count = string__grisu2(value, digits, &exponent);
+    }
+
+    // The position of the decimal point relative to the first digit
+    i32 point = count + exponent;
+    if (format == DOUBLE_FORMAT_GENERAL) {
+        format = point > -6 && point <= 21 ? DOUBLE_FORMAT_FIXED
+                                           : DOUBLE_FORMAT_SCIENTIFIC;
+    }
+
+    if (format == DOUBLE_FORMAT_SCIENTIFIC) {
+        *dest++ = digits[0];
+        if (count > 1) {
+            *dest++ = '.';
+            MEMCPY(dest, digits + 1, count - 1);
+            dest += count - 1;
+        }
+        *dest++ = 'e';
+        dest += string__format_i64(dest, point - 1);
+    } else if (point <= 0) {
+        *dest++ = '0';
+        *dest++ = '.';
+        memset(dest, '0', -point);
+        dest += -point;
+        MEMCPY(dest, digits, count);
+        dest += count;
+    } else if (point >= count) {
+        MEMCPY(dest, digits, count);
+        dest += count;
+        memset(dest, '0', point - count);
+        dest += point - count;
+    } else {
+        MEMCPY(dest, digits, point);
+        dest += point;
+        *dest++ = '.';
+        MEMCPY(dest, digits + point, count - point);
+        dest += count - point;
+    }
+
+    return dest - start;
+}
+
+void sb_append_u64(StringBuilder *self, u64 value) {
+    char buf[20];
+    sb_append(self, buf, string__format_u64(buf, value));
+}
+
+void sb_append_i64(StringBuilder *self, i64 value) {
+    char buf[20];
+    sb_append(self, buf, string__format_i64(buf, value));
+}
+
+void sb_append_hex(StringBuilder *self, u64 value, i32 width) {
+    if (width > 16) {
+        sb_reserve(self, self->count + width);
+        self->count +=
+            string__format_hex(self->items + self->count, value, width);
+        return;
+    }
+    char buf[16];
+    sb_append(self, buf, string__format_hex(buf, value, width));
+}
+
+void sb_append_double(StringBuilder *self, double value, DoubleFormat format) {
+    char buf[DOUBLE_FORMAT_MAX_LENGTH];
+    i32 count = string__format_double(buf, value, format);
+    sb_append(self, buf, count);
+}
+
+StringWriter sw_begin(StringBuilder *self, i32 amount) {
+    sb_reserve(self, self->count + amount);
+    i32 capacity = self->capacity < 0 ? -self->capacity : self->capacity;
+    StringWriter writer = {
+        .sb = self,
+        .cursor = self->items + self->count,
+        .end = self->items + capacity,
+    };
+    return writer;
+}
+
+void sw_end(StringWriter self) {
+    self.sb->count = self.cursor - self.sb->items;
+}
+
+void sw_reserve(StringWriter *self, i32 amount) {
+    if (SW_REMAINING(self) >= amount) return;
+    sw_end(*self);
+    *self = sw_begin(self->sb, amount);
+}
+
+void sw_put_bytes(StringWriter *self, const char *data, i32 count) {
+    MEMCPY(self->cursor, data, count);
+    self->cursor += count;
+}
+
+void sw_put_sv(StringWriter *self, StringView sv) {
+    sw_put_bytes(self, sv.data, sv.count);
+}
+
+void sw_put_u64(StringWriter *self, u64 value) {
+    self->cursor += string__format_u64(self->cursor, value);
+}
+
+void sw_put_i64(StringWriter *self, i64 value) {
+    self->cursor += string__format_i64(self->cursor, value);
+}
+
+void sw_put_hex(StringWriter *self, u64 value, i32 width) {
+    self->cursor += string__format_hex(self->cursor, value, width);
+}
+
+void sw_put_double(StringWriter *self, double value, DoubleFormat format) {
+    self->cursor += string__format_double(self->cursor, value, format);
+}
+
 #endif // BOOKSTORE_IMPLEMENTATION
 
 #endif // STRING_H_
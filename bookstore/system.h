@@ -8,6 +8,7 @@
 
 #include "./arena.h"
 #include "./basic.h"
+#include "./glob.h"
 #include "./string.h"
 #include "array.h"
 #include <errno.h>
@@ -29,10 +30,24 @@
 #else
 #include <dirent.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#endif // __linux__
 #endif // _WIN32
 
+#include "./thread.h"
+
 // This is the typical maximum path length (without NUL character) for Linux,
 // though it may be longer and could possibly vary file-to-file; for Windows,
 // it's typically 260 bytes but this could be modified by Registry settings.
@@ -56,6 +71,45 @@ typedef enum {
     FILE_TYPE_OTHER,
 } FileType;
 
+// The metadata of a file, as returned by `get_file_stat`.
+typedef struct {
+    // The time the file was last modified, in nanoseconds since the Unix epoch.
+    i64 mtime_ns;
+    // The size of the file, in bytes.
+    i64 size;
+    // The filetype of the file.
+    FileType type;
+} FileStat;
+
+// An entry of a `StatCache`.
+typedef struct {
+    // The path of the file, allocated using `MALLOC`, or `NULL` if the slot is
+    // empty.
+    char *path;
+    u64 hash;
+    FileStat stat;
+    // Whether the file exists; `stat` is only valid if it does.
+    bool exists;
+} System__StatCacheEntry;
+
+// The amount of slots a `StatCache` starts out with; it doubles whenever it's
+// three quarters full.
+#ifndef STAT_CACHE_INITIAL_CAPACITY
+#define STAT_CACHE_INITIAL_CAPACITY 256
+#endif // STAT_CACHE_INITIAL_CAPACITY
+
+// A hash map from file paths to their metadata, so each file only needs to be
+// stat'd once, to be initialized with `stat_cache_init` and destroyed with
+// `stat_cache_destroy`. It can be shared between threads.
+typedef struct {
+    // The slots of the map, allocated using `MALLOC`; their amount is always a
+    // power of two.
+    System__StatCacheEntry *entries;
+    i32 count;
+    i32 capacity;
+    Mutex lock;
+} StatCache;
+
 // An action to take when walking a directory.
 typedef enum {
     // Continue walking the rest of the children of this directory.
@@ -102,6 +156,31 @@ typedef struct {
     // deepest nodes and then back up, instead of starting with the shallowest
     // nodes.
     bool post_order;
+    // A glob pattern to filter the entries with; only entries whose path,
+    // relative to the root directory, matches it are visited, and directories
+    // which can't contain any matching entries aren't read at all. The root
+    // itself is never visited when this is set.
+    const GlobPattern *glob;
+    // The amount of threads to walk with; when more than one, directories are
+    // handed out to a work-stealing pool of threads, which call `visit` for the
+    // entries they read concurrently. Each entry is still visited after its
+    // parent directory in pre-order, and before it in post-order, but entries
+    // of different directories are visited in no particular order, and
+    // `WALK_STOP` can't stop entries which are already being visited.
+    //
+    // The `arena` of each entry then belongs to the thread visiting it, and is
+    // reset after each visit, so nothing allocated in it outlives the visit;
+    // set `serialize_visits` to keep allocations like the serial walk does.
+    i32 threads;
+    // Whether `visit` should only be called by one thread at a time, when
+    // walking with multiple `threads`. The `arena` of each entry is then the
+    // one passed to `walk_directory_opt`, as it is when walking serially.
+    bool serialize_visits;
+    // A cache to record the metadata of every entry in, other than symlinks,
+    // so it doesn't need to be stat'd again later. The entries are stat'd
+    // relative to their directory where the platform doesn't report their
+    // metadata along with them.
+    StatCache *stat_cache;
 } WalkDirectoryOpt;
 
 // The type of the `visit` callback passed to `WALK_DIRECTORY`.
@@ -125,6 +204,146 @@ ARRAY_DECLARE_PREFIX(FilePath, FilePaths, file_paths);
 #define FILE_PATHS_APPEND(paths, ...)                                          \
     file_paths_append(paths, (FilePath[]){__VA_ARGS__},                        \
                       sizeof((FilePath[]){__VA_ARGS__}) / sizeof(FilePath))
+// Sort `paths` in place, comparing the paths byte by byte like `strcmp`.
+void file_paths_sort(FilePaths paths);
+
+// The amount of bytes a `FileReader` reads from its file at once. Its buffer
+// holds two chunks, so a partial record left over from one chunk still has a
+// whole chunk of room after it.
+#ifndef FILE_READER_CHUNK_SIZE
+#define FILE_READER_CHUNK_SIZE KiB(256)
+#endif // FILE_READER_CHUNK_SIZE
+
+// A reader which streams a file through a fixed-size buffer, handing out one
+// record (such as a line) at a time, so files of any size can be processed
+// with constant memory.
+typedef struct {
+    // The path of the file, for error messages.
+    const char *path;
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    i32 fd;
+#endif // _WIN32
+    // The buffer the file is read into, of `capacity` bytes.
+    char *buffer;
+    i32 capacity;
+    // The bytes of `buffer` which weren't handed out yet.
+    i32 start;
+    i32 end;
+    // How far the current record was already searched for its delimiter.
+    i32 scanned;
+    // The offset in the file that the next read starts at.
+    i64 offset;
+    // Whether the end of the file was reached.
+    bool eof;
+} FileReader;
+
+// The size of the buffer a `FileWriter` collects small chunks in, so they're
+// written to its file together.
+#ifndef FILE_WRITER_BUFFER_SIZE
+#define FILE_WRITER_BUFFER_SIZE KiB(64)
+#endif // FILE_WRITER_BUFFER_SIZE
+
+// Options for opening a `FileWriter`.
+typedef struct {
+    // Write into a temporary file next to the file, which replaces it only once
+    // the writer is closed successfully, so it's never seen half-written.
+    bool atomic;
+    // Flush the contents to the disk when the writer is closed, so they
+    // survive a crash of the whole system.
+    bool sync;
+} FileWriterOpt;
+
+// A writer which streams chunks into a file, so large outputs don't need to be
+// held in memory all at once. Small chunks are collected in a buffer, and a
+// chunk which doesn't fit in it is written along with the buffer in a single
+// call, straight from where it is.
+typedef struct {
+    // The path of the file, for error messages.
+    const char *path;
+    // The path of the file which is actually written, which is a temporary one
+    // if `opt.atomic` is set.
+    const char *write_path;
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    i32 fd;
+#endif // _WIN32
+    // The buffer the chunks are collected in, of `capacity` bytes, of which
+    // `count` are used.
+    char *buffer;
+    i32 capacity;
+    i32 count;
+    FileWriterOpt opt;
+    // Whether writing failed, after which nothing more is written.
+    bool failed;
+} FileWriter;
+
+// The capacity of the arena of each thread of a walk with multiple `threads`,
+// which is passed to `visit` along with each entry unless the visits are
+// serialized, and is reset after each visit.
+#ifndef SYSTEM_WALK_ARENA_SIZE
+#define SYSTEM_WALK_ARENA_SIZE MiB(1)
+#endif // SYSTEM_WALK_ARENA_SIZE
+
+// The maximum size of the buffer `copy_file` uses when the file can't be
+// copied within the kernel; it is capped to what's left in the arena.
+#ifndef SYSTEM_COPY_BUFFER_SIZE
+#define SYSTEM_COPY_BUFFER_SIZE MiB(1)
+#endif // SYSTEM_COPY_BUFFER_SIZE
+
+// The maximum amount of files `read_files` and `write_files` work on at once.
+#ifndef SYSTEM_IO_QUEUE_DEPTH
+#define SYSTEM_IO_QUEUE_DEPTH 64
+#endif // SYSTEM_IO_QUEUE_DEPTH
+
+// A file mapped into memory by `map_entire_file`, to be unmapped with
+// `unmap_file`.
+typedef struct {
+    // The mapped contents, or `NULL` if the file was copied instead.
+    void *data;
+    // The amount of mapped bytes.
+    i64 count;
+} MappedFile;
+
+// The amount of milliseconds a `DirectoryWatcher` keeps waiting for more
+// events once one arrives, so a burst of changes (like an editor saving through
+// a temporary file) is reported as a single change set.
+#ifndef DIRECTORY_WATCHER_SETTLE_MS
+#define DIRECTORY_WATCHER_SETTLE_MS 50
+#endif // DIRECTORY_WATCHER_SETTLE_MS
+
+// The size of the buffer each root of a `DirectoryWatcher` receives events
+// into, on Windows.
+#ifndef DIRECTORY_WATCHER_BUFFER_SIZE
+#define DIRECTORY_WATCHER_BUFFER_SIZE KiB(64)
+#endif // DIRECTORY_WATCHER_BUFFER_SIZE
+
+#ifdef _WIN32
+struct System__WatchedRoot;
+#endif // _WIN32
+
+// Watches directories and every directory inside them for changes to their
+// entries, to be opened with `directory_watcher_open` and closed with
+// `directory_watcher_close`.
+typedef struct {
+#ifdef _WIN32
+    // The watched roots, each allocated using `MALLOC`; every root is watched
+    // along with its subtree by the system.
+    struct System__WatchedRoot *roots[MAXIMUM_WAIT_OBJECTS];
+    i32 root_count;
+#else
+    // The watched roots, allocated using `MALLOC`.
+    FilePaths roots;
+    // The inotify instance, which holds a watch for every directory.
+    i32 fd;
+    // The path of the directory of each watch descriptor, indexed by it, or
+    // `NULL` for descriptors which aren't watched anymore. The array and the
+    // paths are allocated using `MALLOC`.
+    FilePaths directories;
+#endif // _WIN32
+} DirectoryWatcher;
 
 // Split a `StringView` of a filepath into the base-name (the section after the
 // last path separator) and directory name (the section before it). Returns the
@@ -145,6 +364,27 @@ const char *get_current_directory(Arena *arena);
 // Get the type of the file at `path`. Returns a negative number if the file
 // is invalid or doesn't exist.
 FileType get_file_type(const char *path);
+// Get the metadata of the file at `path` into `out`, following symlinks.
+//
+// Returns `1` if the file exists, `0` if it doesn't, or logs an error and
+// returns `-1` if some error occurs.
+i8 get_file_stat(const char *path, FileStat *out);
+// Initialize an empty `StatCache`.
+void stat_cache_init(StatCache *self);
+// Destroy a `StatCache`, freeing its memory.
+void stat_cache_destroy(StatCache *self);
+// Forget every file in the cache, such as after the files may have changed.
+void stat_cache_clear(StatCache *self);
+// Record the metadata of the file at `path` in the cache, replacing whatever
+// was recorded for it before.
+void stat_cache_put(StatCache *self, const char *path, FileStat stat);
+// Get the metadata of the file at `path` into `out` like `get_file_stat`,
+// stat'ing it only if it isn't in the cache yet. Files which don't exist are
+// cached as such as well.
+//
+// Returns `1` if the file exists, `0` if it doesn't, or logs an error and
+// returns `-1` if some error occurs.
+i8 stat_cache_get(StatCache *self, const char *path, FileStat *out);
 // Delete the file at `path`.
 //
 // Logs an error and returns `false` if some error occurs.
@@ -161,10 +401,114 @@ i64 get_file_position(FILE *f);
 // Logs an error and returns `SV_INVALID`, which has a negative count, in case
 // of an error.
 StringView read_entire_file(Arena *arena, const char *path);
-// Copy the file at `src` into `dest`. Uses `arena` to create a `Lifetime`,
-// which is then used to allocate a temporary buffer for reading chunks from
-// `src` and writing them to `dest`, when not on Windows.
+// Read the entirety of each of the files at `paths`, like `read_entire_file`,
+// appending their contents to `out` in the same order. Uses `arena` to allocate
+// the memory for the strings. On Linux, the files are opened, stat'd and read
+// through io_uring, with up to `SYSTEM_IO_QUEUE_DEPTH` files in flight at once;
+// elsewhere, or if io_uring isn't available, they're read on a thread pool.
+//
+// Logs an error and returns `false` if some error occurs, in which case the
+// files which couldn't be read are left as `SV_INVALID` in `out`.
+bool read_files(Arena *arena, FilePaths paths, StringViews *out);
+// Write each of `contents` into the file at the same index of `paths`, like
+// `write_file`, batched the same way as `read_files`.
+//
+// Logs an error and returns `false` if some error occurs.
+bool write_files(FilePaths paths, StringViews contents);
+// Map the entirety of the file at `path` into memory, read-only, without
+// copying it, and hint to the OS that it will be read soon and sequentially.
+// Files which can't be mapped, like pipes and special files, are copied into
+// memory allocated with `arena` instead. Either way, `mapping` is set up so
+// that `unmap_file` releases the contents once they're no longer needed.
+//
+// Logs an error and returns `SV_INVALID`, which has a negative count, in case
+// of an error.
+StringView map_entire_file(Arena *arena, const char *path, MappedFile *mapping);
+// Unmap the contents of a file mapped with `map_entire_file`; copied contents
+// are left to their arena.
+void unmap_file(MappedFile *mapping);
+// Open the file at `path` for reading it with `self` record by record, hinting
+// to the OS that it will be read sequentially. Uses `arena` to allocate a
+// buffer of `2 * FILE_READER_CHUNK_SIZE` bytes.
+//
+// Logs an error and returns `false` if some error occurs.
+bool file_reader_open(Arena *arena, const char *path, FileReader *self);
+// Close the file opened with `file_reader_open`.
+void file_reader_close(FileReader *self);
+// Read the next record, up until the next `delimiter` (which isn't included),
+// into `record`. The last record of the file doesn't need to end with
+// `delimiter`. Records longer than the buffer are handed out in pieces of the
+// buffer's size.
+//
+// `record` points into the buffer of `self`, so it's only valid until the next
+// record is read.
+//
+// Returns `1` if a record was read, `0` at the end of the file, or logs an
+// error and returns `-1` if some error occurs.
+i8 file_reader_next_record(FileReader *self, char delimiter,
+                           StringView *record);
+// Read the next line into `line`, like `file_reader_next_record` with a `\n`
+// delimiter, also stripping the `\r` of `\r\n` line endings.
+i8 file_reader_next_line(FileReader *self, StringView *line);
+// Open the file at `path` for writing it with `self` chunk by chunk, truncating
+// it, explicitly specifying the options for initialization as a struct. Uses
+// `arena` to allocate a buffer of `FILE_WRITER_BUFFER_SIZE` bytes, and the path
+// of the temporary file if `opt.atomic` is set.
+//
+// Logs an error and returns `false` if some error occurs.
+//
+// You may be looking for `FILE_WRITER_OPEN`, which allows you to specify only
+// the options you need as named optional arguments.
+bool file_writer_open_opt(Arena *arena, const char *path, FileWriter *self,
+                          FileWriterOpt opt);
+// Open the file at `path` for writing it with `self` chunk by chunk, truncating
+// it. Uses `arena` to allocate a buffer of `FILE_WRITER_BUFFER_SIZE` bytes.
+//
+// You can pass the `atomic` named optional argument to write into a temporary
+// file which only replaces the file once the writer is closed, and the `sync`
+// named optional argument to flush the contents to the disk when closing it.
+//
+// Logs an error and returns `false` if some error occurs.
+#define FILE_WRITER_OPEN(arena, path, self, ...)                               \
+    file_writer_open_opt(arena, path, self, (FileWriterOpt){__VA_ARGS__})
+// Write `chunk` into the file. `chunk` can be reused as soon as this returns.
+//
+// Logs an error and returns `false` if some error occurs.
+bool file_writer_write(FileWriter *self, StringView chunk);
+// Write the contents of `sb` into the file, like `file_writer_write`.
+bool file_writer_write_sb(FileWriter *self, StringBuilder sb);
+// Write whatever is left in the buffer into the file.
+//
+// Logs an error and returns `false` if some error occurs.
+bool file_writer_flush(FileWriter *self);
+// Flush and close the file opened with `file_writer_open_opt`, syncing it and
+// replacing the file with it depending on the options. If anything failed
+// since the writer was opened, a temporary file is deleted instead.
+//
+// Logs an error and returns `false` if some error occurs.
+bool file_writer_close(FileWriter *self);
+// Close the file opened with `file_writer_open_opt` without writing what's left
+// in the buffer, deleting it if it's a temporary file.
+void file_writer_discard(FileWriter *self);
+// Copy the file at `src` into `dest`. When not on Windows, tries to clone the
+// file with a reflink first, then to copy it within the kernel, and only reads
+// and writes it through a buffer as a last resort; holes in sparse files are
+// kept as holes. Uses `arena` to create a `Lifetime`, which is then used to
+// allocate that buffer, of up to `SYSTEM_COPY_BUFFER_SIZE` bytes.
+//
+// Logs an error and returns `false` if some error occurs.
 bool copy_file(Arena *arena, const char *src, const char *dest);
+// Create a hard link at `dest` to the file at `src`, so both paths share the
+// same contents; `dest` must not exist yet.
+//
+// Returns `1` if the link was created, `0` if the filesystem can't link these
+// paths (e.g. they're on different filesystems), or logs an error and returns
+// `-1` if some other error occurs.
+i8 link_file(const char *src, const char *dest);
+// Set the modification time of the file at `path` to the current time.
+//
+// Logs an error and returns `false` if some error occurs.
+bool touch_file(const char *path);
 // Rename the file at `path` to be at `new_path`.
 //
 // Logs an error and returns `false` if some error occurs.
@@ -204,7 +548,13 @@ bool walk_directory_opt(Arena *arena, const char *root, WalkVisitCallback visit,
 // You can pass a named optional argument `user_data` to specify the data passed
 // to the `visit` callback. You can also pass the `post_order` named optional
 // argument to traverse the entries in post-order instead of depth-first, going
-// to the deepest entries first and then back up the tree.
+// to the deepest entries first and then back up the tree, and the `glob` named
+// optional argument to only visit the entries matching a `GlobPattern`,
+// skipping the directories which can't contain any matches. Pass the `threads`
+// named optional argument to walk with that many threads, and the
+// `serialize_visits` named optional argument so that `visit` is still called
+// by only one of them at a time. Pass the `stat_cache` named optional argument
+// to record the metadata of the entries in a `StatCache` along the way.
 //
 // Logs an error and returns `false` if some error occurs, or if `visit` returns
 // `false` for any of the entries.
@@ -228,11 +578,70 @@ bool copy_directory_recursively(Arena *arena, const char *src,
 //
 // Logs an error and returns `false` if some error occurs.
 bool delete_directory_recursively(Arena *arena, const char *path);
+// Recursively copies the contents of the directory `src` to the directory
+// `dest` like `copy_directory_recursively`, but copies the files on a pool of
+// `threads` threads (or one per CPU, if `threads` is `0`) while the directories
+// are created, each one before any of its entries are copied. Every thread
+// allocates its own buffer for copying file contents.
+//
+// Logs an error and returns `false` if some error occurs.
+bool copy_directory_recursively_parallel(Arena *arena, const char *src,
+                                         const char *dest, i32 threads);
+// Deletes the directory `path` and all of its contents like
+// `delete_directory_recursively`, but walks and deletes them with `threads`
+// threads (or one per CPU, if `threads` is `0`). Every directory is deleted
+// once all of its entries are.
+//
+// Logs an error and returns `false` if some error occurs.
+bool delete_directory_recursively_parallel(Arena *arena, const char *path,
+                                           i32 threads);
+// Open a `DirectoryWatcher` on the directory `root`, watching it and every
+// directory inside it. Uses `arena` to allocate the memory for walking `root`.
+//
+// Only supported on Linux (with inotify) and Windows.
+//
+// Logs an error and returns `false` if some error occurs.
+bool directory_watcher_open(Arena *arena, const char *root,
+                            DirectoryWatcher *self);
+// Start watching the directory `root` as well, along with every directory
+// inside it. Uses `arena` to allocate the memory for walking `root`.
+//
+// Logs an error and returns `false` if some error occurs.
+bool directory_watcher_add(Arena *arena, DirectoryWatcher *self,
+                           const char *root);
+// Wait up to `timeout_ms` milliseconds (or forever, if it's negative) for
+// changes, and push the paths of every entry which was created, modified,
+// deleted or moved to `changes`, allocated using `arena`. Once a change
+// arrives, keep collecting until no more arrive for
+// `DIRECTORY_WATCHER_SETTLE_MS`; the pushed paths are sorted and deduplicated.
+//
+// New directories are watched as they're created, and the entries which were
+// created inside them before they were watched are reported as well. If the
+// system dropped events, the roots which may have lost them are reported
+// instead. With inotify, a root which is deleted or moved away is reported
+// itself, and a moved one stops being watched.
+//
+// Returns `1` if changes were pushed, `0` if none arrived in time, or logs an
+// error and returns `-1` if some error occurs.
+i8 directory_watcher_next(DirectoryWatcher *self, Arena *arena, i32 timeout_ms,
+                          FilePaths *changes);
+// Close a `DirectoryWatcher`, freeing its memory.
+void directory_watcher_close(DirectoryWatcher *self);
 
 #ifdef BOOKSTORE_IMPLEMENTATION
 
 ARRAY_DEFINE_PREFIX(FilePath, FilePaths, file_paths)
 
+int system__compare_paths(const void *a, const void *b) {
+    return strcmp(*(const FilePath *)a, *(const FilePath *)b);
+}
+
+void file_paths_sort(FilePaths paths) {
+    if (paths.count == 0) return;
+    qsort(paths.items, paths.count, sizeof(*paths.items),
+          system__compare_paths);
+}
+
 #ifdef _WIN32
 
 // Base on https://stackoverflow.com/a/75644008
@@ -326,6 +735,15 @@ const char *get_current_directory(Arena *arena) {
 #endif // _WIN32
 }
 
+#ifndef _WIN32
+FileType system__file_type_from_mode(mode_t mode) {
+    if (S_ISREG(mode)) return FILE_TYPE_REGULAR;
+    if (S_ISDIR(mode)) return FILE_TYPE_DIRECTORY;
+    if (S_ISLNK(mode)) return FILE_TYPE_SYMLINK;
+    return FILE_TYPE_OTHER;
+}
+#endif // _WIN32
+
 FileType get_file_type(const char *path) {
 #ifdef _WIN32
     DWORD attr = GetFileAttributesA(path);
@@ -345,11 +763,179 @@ FileType get_file_type(const char *path) {
         return -1;
     }
 
-    if (S_ISREG(statbuf.st_mode)) return FILE_TYPE_REGULAR;
-    if (S_ISDIR(statbuf.st_mode)) return FILE_TYPE_DIRECTORY;
-    if (S_ISLNK(statbuf.st_mode)) return FILE_TYPE_SYMLINK;
-    return FILE_TYPE_OTHER;
+    return system__file_type_from_mode(statbuf.st_mode);
+#endif // _WIN32
+}
+
+#ifdef _WIN32
+i64 system__filetime_to_ns(FILETIME time) {
+    // A `FILETIME` counts 100ns intervals since 1601
+    i64 ticks = ((i64)time.dwHighDateTime << 32) | time.dwLowDateTime;
+    return (ticks - 116444736000000000LL) * 100;
+}
+#else
+void system__file_stat_from(const struct stat *statbuf, FileStat *out) {
+#ifdef __APPLE__
+    struct timespec mtime = statbuf->st_mtimespec;
+#else
+    struct timespec mtime = statbuf->st_mtim;
+#endif // __APPLE__
+    out->mtime_ns = (i64)mtime.tv_sec * 1000000000 + mtime.tv_nsec;
+    out->size = statbuf->st_size;
+    out->type = system__file_type_from_mode(statbuf->st_mode);
+}
+#endif // _WIN32
+
+i8 get_file_stat(const char *path, FileStat *out) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) {
+        DWORD err = GetLastError();
+        if (err == ERROR_FILE_NOT_FOUND || err == ERROR_PATH_NOT_FOUND) {
+            return 0;
+        }
+        log_error("Failed to get attributes of '%s': %s", path,
+                  system__win32_error_message(err));
+        return -1;
+    }
+
+    out->mtime_ns = system__filetime_to_ns(data.ftLastWriteTime);
+    out->size = ((i64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    out->type = data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY
+                    ? FILE_TYPE_DIRECTORY
+                    : FILE_TYPE_REGULAR;
+#else
+    struct stat statbuf;
+    if (stat(path, &statbuf) < 0) {
+        if (errno == ENOENT || errno == ENOTDIR) {
+            errno = 0;
+            return 0;
+        }
+        log_error("Failed to stat '%s': %s", path, strerror(errno));
+        return -1;
+    }
+
+    system__file_stat_from(&statbuf, out);
 #endif // _WIN32
+    return 1;
+}
+
+// Hash a path with FNV-1a.
+u64 system__hash_path(const char *path) {
+    u64 hash = 0xcbf29ce484222325;
+    for (; *path; path++) {
+        hash ^= (u8)*path;
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+// Find the slot of `path`, or the empty slot where it belongs.
+System__StatCacheEntry *system__stat_cache_find(StatCache *self,
+                                                const char *path, u64 hash) {
+    u32 mask = self->capacity - 1;
+    for (u32 i = hash & mask;; i = (i + 1) & mask) {
+        System__StatCacheEntry *entry = &self->entries[i];
+        if (entry->path == NULL) return entry;
+        if (entry->hash == hash && strcmp(entry->path, path) == 0) {
+            return entry;
+        }
+    }
+}
+
+void system__stat_cache_grow(StatCache *self) {
+    System__StatCacheEntry *entries = self->entries;
+    i32 capacity = self->capacity;
+
+    self->capacity *= 2;
+    self->entries = MALLOC(self->capacity * sizeof(*self->entries));
+    ASSERT(self->entries != NULL, "unable to allocate memory for stat cache");
+    memset(self->entries, 0, self->capacity * sizeof(*self->entries));
+
+    for (i32 i = 0; i < capacity; i++) {
+        if (entries[i].path == NULL) continue;
+        *system__stat_cache_find(self, entries[i].path, entries[i].hash) =
+            entries[i];
+    }
+    FREE(entries);
+}
+
+// Get the slot of `path`, inserting it if it isn't in the cache yet. Must be
+// called with the lock held.
+System__StatCacheEntry *system__stat_cache_insert(StatCache *self,
+                                                  const char *path) {
+    u64 hash = system__hash_path(path);
+    System__StatCacheEntry *entry = system__stat_cache_find(self, path, hash);
+    if (entry->path) return entry;
+
+    // Keep the load factor under 3/4, so probes stay short
+    if ((self->count + 1) * 4 > self->capacity * 3) {
+        system__stat_cache_grow(self);
+        entry = system__stat_cache_find(self, path, hash);
+    }
+
+    i32 count = strlen(path) + 1;
+    entry->path = MALLOC(count);
+    ASSERT(entry->path != NULL, "unable to allocate memory for path");
+    MEMCPY(entry->path, path, count);
+    entry->hash = hash;
+    self->count++;
+    return entry;
+}
+
+void stat_cache_init(StatCache *self) {
+    self->count = 0;
+    self->capacity = STAT_CACHE_INITIAL_CAPACITY;
+    self->entries = MALLOC(self->capacity * sizeof(*self->entries));
+    ASSERT(self->entries != NULL, "unable to allocate memory for stat cache");
+    memset(self->entries, 0, self->capacity * sizeof(*self->entries));
+    mutex_init(&self->lock);
+}
+
+void stat_cache_destroy(StatCache *self) {
+    stat_cache_clear(self);
+    FREE(self->entries);
+    mutex_destroy(&self->lock);
+}
+
+void stat_cache_clear(StatCache *self) {
+    mutex_lock(&self->lock);
+    for (i32 i = 0; i < self->capacity; i++) {
+        FREE(self->entries[i].path);
+    }
+    memset(self->entries, 0, self->capacity * sizeof(*self->entries));
+    self->count = 0;
+    mutex_unlock(&self->lock);
+}
+
+void stat_cache_put(StatCache *self, const char *path, FileStat stat) {
+    mutex_lock(&self->lock);
+    System__StatCacheEntry *entry = system__stat_cache_insert(self, path);
+    entry->stat = stat;
+    entry->exists = true;
+    mutex_unlock(&self->lock);
+}
+
+i8 stat_cache_get(StatCache *self, const char *path, FileStat *out) {
+    mutex_lock(&self->lock);
+    System__StatCacheEntry *entry =
+        system__stat_cache_find(self, path, system__hash_path(path));
+    bool found = entry->path != NULL;
+    bool exists = entry->exists;
+    if (found && exists) *out = entry->stat;
+    mutex_unlock(&self->lock);
+    if (found) return exists;
+
+    // The lock isn't held while stat'ing, so other threads aren't held up
+    i8 result = get_file_stat(path, out);
+    if (result < 0) return -1;
+
+    mutex_lock(&self->lock);
+    entry = system__stat_cache_insert(self, path);
+    if (result) entry->stat = *out;
+    entry->exists = result;
+    mutex_unlock(&self->lock);
+    return result;
 }
 
 bool delete_file(const char *path) {
@@ -397,7 +983,11 @@ i64 get_file_position(FILE *f) {
 #endif // _WIN32
 }
 
-StringView read_entire_file(Arena *arena, const char *path) {
+// Read the entirety of the file at `path` like `read_entire_file`, holding
+// `lock` while allocating from `arena` if it isn't `NULL`, so multiple threads
+// can share the arena.
+StringView system__read_entire_file(Arena *arena, const char *path,
+                                    Mutex *lock) {
     DEFER_SETUP(StringView, SV_INVALID);
 
     FILE *f = fopen(path, "rb");
@@ -417,13 +1007,20 @@ StringView read_entire_file(Arena *arena, const char *path) {
         log_error("Failed to read '%s': %s", path, strerror(errno));
         DEFER_RETURN(SV_INVALID);
     }
+    if (file_size > INT32_MAX) {
+        log_error("Failed to read '%s': file is too large, use a `FileReader`",
+                  path);
+        DEFER_RETURN(SV_INVALID);
+    }
 
     if (fseek(f, 0, SEEK_SET) < 0) {
         log_error("Failed to read '%s': %s", path, strerror(errno));
         DEFER_RETURN(SV_INVALID);
     }
 
+    if (lock) mutex_lock(lock);
     StringBuilder sb = sb_new(arena, file_size);
+    if (lock) mutex_unlock(lock);
     fread(sb.items, file_size, 1, f);
     if (ferror(f)) {
         log_error("Failed to read '%s': %s", path, strerror(errno));
@@ -438,152 +1035,1537 @@ StringView read_entire_file(Arena *arena, const char *path) {
     });
 }
 
-bool copy_file(Arena *arena, const char *src, const char *dest) {
-#ifdef _WIN32
-    if (!CopyFile(src, dest, false)) {
-        log_error("Failed copy '%s' to '%s': %s", src, dest,
-                  system__win32_error_message(GetLastError()));
-        return false;
-    }
-    log_debug("Copied '%s' to '%s'", src, dest);
-    return true;
-#else
-    DEFER_SETUP(bool, false);
-
-    i32 src_fd = -1, dest_fd = -1;
-    Lifetime lt = lifetime_begin(arena);
+StringView read_entire_file(Arena *arena, const char *path) {
+    return system__read_entire_file(arena, path, NULL);
+}
 
-    src_fd = open(src, O_RDONLY);
-    if (src_fd < 0) {
-        log_error("Failed to open '%s' for reading: %s", src, strerror(errno));
-        DEFER_RETURN(false);
+#ifdef __linux__
+// An io_uring instance, with its submission and completion queues mapped into
+// memory.
+typedef struct {
+    i32 fd;
+    u32 *sq_tail;
+    u32 sq_mask;
+    u32 *sq_array;
+    struct io_uring_sqe *sqes;
+    // The amount of submissions which were queued but not submitted yet.
+    u32 queued;
+    // The amount of submissions whose completions weren't reaped yet.
+    u32 in_flight;
+    u32 *cq_head;
+    u32 *cq_tail;
+    u32 cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} System__Ring;
+
+void system__ring_destroy(System__Ring *self) {
+    if (self->sqes) munmap(self->sqes, self->sqes_size);
+    if (self->cq_ring && self->cq_ring != self->sq_ring) {
+        munmap(self->cq_ring, self->cq_ring_size);
     }
+    if (self->sq_ring) munmap(self->sq_ring, self->sq_ring_size);
+    close(self->fd);
+}
 
-    struct stat src_stat;
-    if (fstat(src_fd, &src_stat) < 0) {
-        log_error("Failed to stat '%s': %s", src, strerror(errno));
-        DEFER_RETURN(false);
+// Set up an io_uring with room for `entries` submissions at once. Returns
+// `false` if io_uring isn't available, so the caller can fall back to
+// something else.
+bool system__ring_init(System__Ring *self, u32 entries) {
+    memset(self, 0, sizeof(*self));
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    self->fd = syscall(SYS_io_uring_setup, entries, &params);
+    if (self->fd < 0) {
+        log_debug("io_uring is unavailable: %s", strerror(errno));
+        return false;
     }
-
-    dest_fd = open(dest, O_CREAT | O_TRUNC | O_WRONLY, src_stat.st_mode);
-    if (dest_fd < 0) {
-        log_error("Failed to open '%s' for writing: %s", dest, strerror(errno));
-        DEFER_RETURN(false);
+    // Opening, stat'ing and closing files came in the same version as this
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        log_debug("io_uring is too old to open files");
+        close(self->fd);
+        return false;
     }
 
-    size_t buf_size = KiB(32);
-    void *buf = arena_alloc(lt.arena, buf_size);
-    while (true) {
-        ssize_t n = read(src_fd, buf, buf_size);
-        if (n == 0) break;
-        if (n < 0) {
-            log_error("Failed to read from '%s': %s", src, strerror(errno));
-            DEFER_RETURN(false);
-        }
-        char *buf_temp = buf;
-        while (n > 0) {
-            ssize_t m = write(dest_fd, buf_temp, n);
-            if (m < 0) {
-                log_error("Failed to write to '%s': %s", dest, strerror(errno));
-                DEFER_RETURN(false);
-            }
-            n -= m;
-            buf_temp += m;
-        }
+    self->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+    self->cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        self->sq_ring_size = MAX(self->sq_ring_size, self->cq_ring_size);
+    }
+    self->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    i32 prot = PROT_READ | PROT_WRITE;
+    i32 flags = MAP_SHARED | MAP_POPULATE;
+    void *sq_ring = mmap(NULL, self->sq_ring_size, prot, flags, self->fd,
+                         IORING_OFF_SQ_RING);
+    void *cq_ring = single_mmap ? sq_ring
+                                : mmap(NULL, self->cq_ring_size, prot, flags,
+                                       self->fd, IORING_OFF_CQ_RING);
+    void *sqes =
+        mmap(NULL, self->sqes_size, prot, flags, self->fd, IORING_OFF_SQES);
+    self->sq_ring = sq_ring == MAP_FAILED ? NULL : sq_ring;
+    self->cq_ring = cq_ring == MAP_FAILED ? NULL : cq_ring;
+    self->sqes = sqes == MAP_FAILED ? NULL : sqes;
+    if (!self->sq_ring || !self->cq_ring || !self->sqes) {
+        log_debug("Failed to map io_uring: %s", strerror(errno));
+        system__ring_destroy(self);
+        return false;
     }
 
-    log_debug("Copied '%s' to '%s'", src, dest);
+    u8 *sq = self->sq_ring;
+    self->sq_tail = (u32 *)(sq + params.sq_off.tail);
+    self->sq_mask = *(u32 *)(sq + params.sq_off.ring_mask);
+    self->sq_array = (u32 *)(sq + params.sq_off.array);
 
-    DEFER_LABEL({
-        if (src_fd >= 0) close(src_fd);
-        if (dest_fd >= 0) close(dest_fd);
-        lifetime_end(lt);
-    });
-#endif // _WIN32
+    u8 *cq = self->cq_ring;
+    self->cq_head = (u32 *)(cq + params.cq_off.head);
+    self->cq_tail = (u32 *)(cq + params.cq_off.tail);
+    self->cq_mask = *(u32 *)(cq + params.cq_off.ring_mask);
+    self->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return true;
 }
 
-bool rename_file(const char *path, const char *new_path) {
-#ifdef _WIN32
-    if (!MoveFileEx(path, new_path, MOVEFILE_REPLACE_EXISTING)) {
-        log_error("Failed to rename '%s' to '%s': %s", path, new_path,
-                  system__win32_error_message(GetLastError()));
+// Queue a submission of `opcode` on `fd`, whose completion will carry
+// `user_data`. The submission is only read by the kernel once it's submitted,
+// so the caller can keep filling it in.
+struct io_uring_sqe *system__ring_push(System__Ring *self, u8 opcode, i32 fd,
+                                       u64 user_data) {
+    u32 tail = *self->sq_tail;
+    u32 index = tail & self->sq_mask;
+    struct io_uring_sqe *sqe = &self->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+
+    self->sq_array[index] = index;
+    __atomic_store_n(self->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    self->queued++;
+    self->in_flight++;
+    return sqe;
+}
+
+// Submit everything that was queued, and wait for at least one completion.
+//
+// Logs an error and returns `false` if some error occurs.
+bool system__ring_submit_and_wait(System__Ring *self) {
+    for (;;) {
+        long n = syscall(SYS_io_uring_enter, self->fd, self->queued, 1,
+                         IORING_ENTER_GETEVENTS, NULL, 0);
+        if (n >= 0) {
+            self->queued -= n;
+            return true;
+        }
+        if (errno == EINTR) continue;
+        // The completion queue is full, so it needs to be reaped first
+        if (errno == EAGAIN || errno == EBUSY) return true;
+
+        log_error("Failed to submit to io_uring: %s", strerror(errno));
         return false;
     }
-#else
-    if (rename(path, new_path) < 0) {
-        log_error("Failed to rename '%s' to '%s': %s", path, new_path,
-                  strerror(errno));
+}
+
+typedef enum {
+    SYSTEM__IO_OPEN,
+    SYSTEM__IO_STATX,
+    SYSTEM__IO_TRANSFER,
+    SYSTEM__IO_CLOSE,
+} System__IoOp;
+
+#define SYSTEM__IO_USER_DATA(slot, op) (((u64)(slot) << 2) | (op))
+
+// A file being read or written through io_uring.
+typedef struct {
+    // The index of the file in the batch.
+    i32 index;
+    i32 fd;
+    // The amount of operations to wait for before transferring the contents.
+    i32 waiting;
+    bool failed;
+    char *data;
+    i64 size;
+    // The amount of bytes which were already transferred.
+    i64 done;
+    struct statx statx;
+} System__IoSlot;
+
+// Queue whatever `slot` has to do next once it isn't waiting on anything: a
+// read or write of the rest of its contents, or closing the file once they're
+// all transferred. Returns `true` if the slot is finished.
+bool system__io_slot_advance(System__Ring *ring, Arena *arena,
+                             System__IoSlot *slot, i32 id, bool writing) {
+    if (slot->waiting > 0) return false;
+
+    if (slot->failed || slot->done == slot->size) {
+        if (slot->fd < 0) return true;
+        system__ring_push(ring, IORING_OP_CLOSE, slot->fd,
+                          SYSTEM__IO_USER_DATA(id, SYSTEM__IO_CLOSE));
+        slot->fd = -1;
         return false;
     }
-#endif // _WIN32
-    log_debug("Renamed '%s' to '%s'", path, new_path);
-    return true;
+
+    if (!slot->data) slot->data = arena_alloc(arena, slot->size);
+    struct io_uring_sqe *sqe = system__ring_push(
+        ring, writing ? IORING_OP_WRITE : IORING_OP_READ, slot->fd,
+        SYSTEM__IO_USER_DATA(id, SYSTEM__IO_TRANSFER));
+    sqe->addr = (u64)(uintptr_t)(slot->data + slot->done);
+    sqe->len = slot->size - slot->done;
+    sqe->off = slot->done;
+    slot->waiting = 1;
+    return false;
 }
 
-bool make_directory(const char *path, bool fail_if_exists) {
-#ifdef _WIN32
-    int result = _mkdir(path);
-#else
-    int result = mkdir(path, 0755);
-#endif // _WIN32
+#define SYSTEM__IO_CANCEL_USER_DATA UINT64_MAX
 
-    if (result < 0) {
-        if (errno == EEXIST && !fail_if_exists) {
-            log_debug("Directory '%s' already exists", path);
-            return true;
+// Cancel everything in flight on `ring` after an error, and reap all of its
+// completions so that the kernel is done with `slots`, closing every file they
+// still have open.
+//
+// Returns `false` if the completions couldn't be reaped, in which case the
+// kernel might still write into `slots` and they mustn't be freed.
+bool system__ring_drain(System__Ring *ring, System__IoSlot *slots) {
+    bool cancelled = false;
+    while (ring->in_flight > 0) {
+        // Requests which weren't submitted can't be cancelled yet
+        if (!cancelled && ring->queued == 0) {
+#ifdef IORING_ASYNC_CANCEL_ANY
+            // Older kernels reject this, in which case the requests are just
+            // waited for, as files are opened, read and written quickly
+            struct io_uring_sqe *sqe =
+                system__ring_push(ring, IORING_OP_ASYNC_CANCEL, -1,
+                                  SYSTEM__IO_CANCEL_USER_DATA);
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL |
+                                IORING_ASYNC_CANCEL_ANY;
+#endif // IORING_ASYNC_CANCEL_ANY
+            cancelled = true;
         }
-        log_error("Failed to create directory '%s': %s", path, strerror(errno));
-        return false;
+        if (!system__ring_submit_and_wait(ring)) return false;
+
+        u32 head = *ring->cq_head;
+        u32 tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+            ring->in_flight--;
+            if (cqe->user_data == SYSTEM__IO_CANCEL_USER_DATA) continue;
+            System__IoOp op = cqe->user_data & 3;
+            if (op == SYSTEM__IO_OPEN && cqe->res >= 0) {
+                slots[cqe->user_data >> 2].fd = cqe->res;
+            }
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
     }
 
-    log_debug("Created directory '%s'", path);
+    for (i32 i = 0; i < SYSTEM_IO_QUEUE_DEPTH; i++) {
+        if (slots[i].fd >= 0) close(slots[i].fd);
+    }
     return true;
 }
 
-bool make_directory_recursively(Arena *arena, const char *path) {
-    DEFER_SETUP(bool, true);
-
-    Lifetime lt = lifetime_begin(arena);
+// Read the files at `paths` into `views`, or write `views` into them, with up
+// to `SYSTEM_IO_QUEUE_DEPTH` files in flight on `ring`.
+bool system__ring_transfer_files(System__Ring *ring, Arena *arena,
+                                 FilePaths paths, StringView *views,
+                                 bool writing) {
+    System__IoSlot *slots =
+        MALLOC(SYSTEM_IO_QUEUE_DEPTH * sizeof(System__IoSlot));
+    ASSERT(slots != NULL, "unable to allocate memory for io_uring");
+    i32 free_slots[SYSTEM_IO_QUEUE_DEPTH];
+    i32 free_count = 0;
+    for (i32 i = SYSTEM_IO_QUEUE_DEPTH - 1; i >= 0; i--) {
+        slots[i].fd = -1;
+        free_slots[free_count++] = i;
+    }
 
-    StringView sv = sv_from_cstr(path);
-    StringBuilder sb = sb_new(lt.arena, sv.count + 1);
+    bool result = true;
+    i32 next = 0;
+    while (next < paths.count || free_count < SYSTEM_IO_QUEUE_DEPTH) {
+        while (next < paths.count && free_count > 0) {
+            i32 id = free_slots[--free_count];
+            System__IoSlot *slot = &slots[id];
+            slot->index = next++;
+            slot->fd = -1;
+            slot->failed = false;
+            slot->data = NULL;
+            slot->size = 0;
+            slot->done = 0;
+
+            const char *path = paths.items[slot->index];
+            struct io_uring_sqe *sqe =
+                system__ring_push(ring, IORING_OP_OPENAT, AT_FDCWD,
+                                  SYSTEM__IO_USER_DATA(id, SYSTEM__IO_OPEN));
+            sqe->addr = (u64)(uintptr_t)path;
+            if (writing) {
+                sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+                sqe->len = 0666;
+                slot->waiting = 1;
+                slot->data = (char *)views[slot->index].data;
+                slot->size = views[slot->index].count;
+                continue;
+            }
 
-    while (sv.count) {
-        StringView part = sv_cut_delimiter(&sv, SYSTEM_PATH_DELIMITER);
-        if (!part.count) continue;
+            // The file is stat'd alongside opening it, since the size is
+            // needed to allocate its memory before reading
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            sqe = system__ring_push(ring, IORING_OP_STATX, AT_FDCWD,
+                                    SYSTEM__IO_USER_DATA(id, SYSTEM__IO_STATX));
+            sqe->addr = (u64)(uintptr_t)path;
+            sqe->len = STATX_SIZE;
+            sqe->off = (u64)(uintptr_t)&slot->statx;
+            slot->waiting = 2;
+        }
 
-        if (sb.count) {
-            sb_pop(&sb);
-            sb_push(&sb, SYSTEM_PATH_DELIMITER);
-            sb_append_sv(&sb, part);
-            sb_push_null(&sb);
-        } else {
-            sb_append_sv(&sb, part);
-            sb_push_null(&sb);
+        if (!system__ring_submit_and_wait(ring)) {
+            // The slots are leaked rather than freed while the kernel might
+            // still be using them
+            if (system__ring_drain(ring, slots)) FREE(slots);
+            return false;
         }
 
-        if (!make_directory(sb.items, false)) DEFER_RETURN(false);
+        u32 head = *ring->cq_head;
+        u32 tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+            ring->in_flight--;
+            i32 id = cqe->user_data >> 2;
+            System__IoOp op = cqe->user_data & 3;
+            i32 res = cqe->res;
+            System__IoSlot *slot = &slots[id];
+            const char *path = paths.items[slot->index];
+
+            // Only the first error of each file is logged, as a missing file
+            // fails to be both opened and stat'd
+            switch (op) {
+            case SYSTEM__IO_OPEN:
+                slot->waiting--;
+                if (res >= 0) {
+                    slot->fd = res;
+                } else if (!slot->failed) {
+                    log_error("Failed to open '%s' for %s: %s", path,
+                              writing ? "writing" : "reading", strerror(-res));
+                    slot->failed = true;
+                }
+                break;
+            case SYSTEM__IO_STATX:
+                slot->waiting--;
+                if (slot->failed) break;
+                if (res < 0) {
+                    log_error("Failed to stat '%s': %s", path, strerror(-res));
+                    slot->failed = true;
+                } else if (slot->statx.stx_size > INT32_MAX) {
+                    log_error("Failed to read '%s': file is too large, use a "
+                              "`FileReader`",
+                              path);
+                    slot->failed = true;
+                } else {
+                    slot->size = slot->statx.stx_size;
+                }
+                break;
+            case SYSTEM__IO_TRANSFER:
+                slot->waiting--;
+                if (res == -EINTR || res == -EAGAIN) break;
+                if (res < 0) {
+                    log_error("Failed to %s '%s': %s",
+                              writing ? "write into" : "read", path,
+                              strerror(-res));
+                    slot->failed = true;
+                } else if (res == 0) {
+                    // The file was truncated after it was stat'd, or the disk
+                    // is full
+                    if (writing) {
+                        log_error("Failed to write into '%s': %s", path,
+                                  strerror(ENOSPC));
+                        slot->failed = true;
+                    }
+                    slot->size = slot->done;
+                } else {
+                    slot->done += res;
+                }
+                break;
+            case SYSTEM__IO_CLOSE:
+                if (res < 0 && writing) {
+                    log_error("Failed to write into '%s': %s", path,
+                              strerror(-res));
+                    slot->failed = true;
+                }
+                if (slot->failed) {
+                    result = false;
+                } else if (!writing) {
+                    views[slot->index] = sv_from_parts(slot->data, slot->done);
+                }
+                free_slots[free_count++] = id;
+                continue;
+            }
+
+            if (system__io_slot_advance(ring, arena, slot, id, writing)) {
+                // The file couldn't even be opened
+                result = false;
+                free_slots[free_count++] = id;
+            }
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
     }
 
-    DEFER_LABEL({ lifetime_end(lt); });
+    FREE(slots);
+    return result;
 }
+#endif // __linux__
 
-// NOTE: `path` here has a NUL character at the end of it, so `path->items` can
-// be used as a C-string.
-bool system__walk_directory_opt_impl(Arena *arena, StringBuilder *path,
-                                     WalkVisitCallback visit,
-                                     WalkDirectoryOpt opt, u32 level,
-                                     bool *stop, bool first_on_level) {
-    DEFER_SETUP(bool, true);
+// The files of a batch which is read or written on a thread pool.
+typedef struct {
+    Arena *arena;
+    // Held while allocating from `arena`.
+    Mutex lock;
+    FilePaths paths;
+    StringView *views;
+    bool writing;
+    volatile i64 failed;
+} System__FileBatch;
 
-#ifdef _WIN32
-    WIN32_FIND_DATA data;
-    HANDLE hFind = INVALID_HANDLE_VALUE;
-#else
-    DIR *dir = NULL;
+typedef struct {
+    System__FileBatch *batch;
+    i32 index;
+} System__FileJob;
+
+void system__file_job_run(ThreadPoolWorker *worker, void *data) {
+    UNUSED(worker);
+    System__FileJob *job = data;
+    System__FileBatch *batch = job->batch;
+    const char *path = batch->paths.items[job->index];
+    StringView *view = &batch->views[job->index];
+
+    bool ok;
+    if (batch->writing) {
+        ok = write_file(path, *view);
+    } else {
+        *view = system__read_entire_file(batch->arena, path, &batch->lock);
+        ok = view->count >= 0;
+    }
+    if (!ok) atomic_store_i64(&batch->failed, 1);
+}
+
+bool system__transfer_files(Arena *arena, FilePaths paths, StringView *views,
+                            bool writing) {
+    if (paths.count == 0) return true;
+
+#ifdef __linux__
+    System__Ring ring;
+    if (system__ring_init(&ring, 2 * SYSTEM_IO_QUEUE_DEPTH)) {
+        bool result =
+            system__ring_transfer_files(&ring, arena, paths, views, writing);
+        system__ring_destroy(&ring);
+        return result;
+    }
+#endif // __linux__
+
+    System__FileBatch batch = {
+        .arena = arena,
+        .paths = paths,
+        .views = views,
+        .writing = writing,
+    };
+    mutex_init(&batch.lock);
+    System__FileJob *jobs = MALLOC(paths.count * sizeof(System__FileJob));
+    ASSERT(jobs != NULL, "unable to allocate memory for files");
+
+    // Without a pool, the files are simply transferred one by one
+    ThreadPool *pool =
+        thread_pool_new(MIN(paths.count, processors_available()), 0);
+    for (i32 i = 0; i < paths.count; i++) {
+        jobs[i].batch = &batch;
+        jobs[i].index = i;
+        if (pool) {
+            thread_pool_submit(pool, NULL, system__file_job_run, &jobs[i]);
+        } else {
+            system__file_job_run(NULL, &jobs[i]);
+        }
+    }
+    if (pool) thread_pool_destroy(pool);
+
+    FREE(jobs);
+    mutex_destroy(&batch.lock);
+    return !batch.failed;
+}
+
+bool read_files(Arena *arena, FilePaths paths, StringViews *out) {
+    svs_reserve(out, out->count + paths.count);
+    StringView *views = out->items + out->count;
+    for (i32 i = 0; i < paths.count; i++) views[i] = SV_INVALID;
+    out->count += paths.count;
+
+    return system__transfer_files(arena, paths, views, false);
+}
+
+bool write_files(FilePaths paths, StringViews contents) {
+    ASSERT(paths.count == contents.count,
+           "write_files needs as many contents as paths");
+    return system__transfer_files(NULL, paths, contents.items, true);
+}
+
+#ifndef _WIN32
+// Read everything that's left of `fd` into the top of `arena`, claiming only
+// the memory which was used, for files whose size isn't known in advance.
+StringView system__read_fd_into_arena(Arena *arena, i32 fd, const char *path) {
+    char *data = (char *)ARENA_MEMORY(arena) + arena->allocated;
+    i32 count = 0;
+    for (;;) {
+        i32 available = arena->capacity - arena->allocated - count;
+        if (available == 0) {
+            log_error("Failed to read '%s': out of arena memory", path);
+            return SV_INVALID;
+        }
+
+        ssize_t n = read(fd, data + count, available);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_error("Failed to read '%s': %s", path, strerror(errno));
+            return SV_INVALID;
+        }
+        count += n;
+    }
+
+    arena_alloc(arena, count);
+    return sv_from_parts(data, count);
+}
+#endif // _WIN32
+
+StringView map_entire_file(Arena *arena, const char *path,
+                           MappedFile *mapping) {
+    mapping->data = NULL;
+    mapping->count = 0;
+
+#ifdef _WIN32
+    DEFER_SETUP(StringView, SV_INVALID);
+
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    HANDLE file_mapping = NULL;
+    if (file == INVALID_HANDLE_VALUE) {
+        log_error("Failed to open '%s' for reading: %s", path,
+                  system__win32_error_message(GetLastError()));
+        DEFER_RETURN(SV_INVALID);
+    }
+
+    LARGE_INTEGER size;
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        DEFER_RETURN(read_entire_file(arena, path));
+    }
+    // Empty files can't be mapped
+    if (size.QuadPart == 0) DEFER_RETURN(sv_from_parts("", 0));
+    if (size.QuadPart > INT32_MAX) {
+        log_error("Failed to map '%s': file is too large, use a `FileReader`",
+                  path);
+        DEFER_RETURN(SV_INVALID);
+    }
+
+    file_mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (file_mapping == NULL) {
+        log_error("Failed to map '%s': %s", path,
+                  system__win32_error_message(GetLastError()));
+        DEFER_RETURN(SV_INVALID);
+    }
+
+    void *data = MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL) {
+        log_error("Failed to map '%s': %s", path,
+                  system__win32_error_message(GetLastError()));
+        DEFER_RETURN(SV_INVALID);
+    }
+
+    // Let the OS start reading the file in while it's being processed
+    WIN32_MEMORY_RANGE_ENTRY range = {data, size.QuadPart};
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+
+    mapping->data = data;
+    mapping->count = size.QuadPart;
+    DEFER_RETURN(sv_from_parts(data, size.QuadPart));
+
+    // The view keeps the file mapped after its handles are closed
+    DEFER_LABEL({
+        if (file_mapping) CloseHandle(file_mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    });
+#else
+    DEFER_SETUP(StringView, SV_INVALID);
+
+    i32 fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        log_error("Failed to open '%s' for reading: %s", path, strerror(errno));
+        DEFER_RETURN(SV_INVALID);
+    }
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) < 0) {
+        log_error("Failed to stat '%s': %s", path, strerror(errno));
+        DEFER_RETURN(SV_INVALID);
+    }
+
+    // Pipes and special files can't be mapped, and files like those in `/proc`
+    // report a size of 0 even though they have contents, so copy them
+    if (!S_ISREG(statbuf.st_mode) || statbuf.st_size == 0) {
+        DEFER_RETURN(system__read_fd_into_arena(arena, fd, path));
+    }
+
+    if (statbuf.st_size > INT32_MAX) {
+        log_error("Failed to map '%s': file is too large, use a `FileReader`",
+                  path);
+        DEFER_RETURN(SV_INVALID);
+    }
+
+    void *data = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        log_error("Failed to map '%s': %s", path, strerror(errno));
+        DEFER_RETURN(SV_INVALID);
+    }
+
+    // Only hints, so it doesn't matter if they fail
+#ifdef MADV_SEQUENTIAL
+    madvise(data, statbuf.st_size, MADV_SEQUENTIAL);
+#endif // MADV_SEQUENTIAL
+#ifdef MADV_WILLNEED
+    madvise(data, statbuf.st_size, MADV_WILLNEED);
+#endif // MADV_WILLNEED
+
+    mapping->data = data;
+    mapping->count = statbuf.st_size;
+    DEFER_RETURN(sv_from_parts(data, statbuf.st_size));
+
+    // The mapping stays valid after the file is closed
+    DEFER_LABEL({
+        if (fd >= 0) close(fd);
+    });
+#endif // _WIN32
+}
+
+void unmap_file(MappedFile *mapping) {
+    if (mapping->data == NULL) return;
+#ifdef _WIN32
+    UnmapViewOfFile(mapping->data);
+#else
+    munmap(mapping->data, mapping->count);
+#endif // _WIN32
+    mapping->data = NULL;
+    mapping->count = 0;
+}
+
+bool file_reader_open(Arena *arena, const char *path, FileReader *self) {
+    memset(self, 0, sizeof(*self));
+    self->path = path;
+
+#ifdef _WIN32
+    self->handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (self->handle == INVALID_HANDLE_VALUE) {
+        log_error("Failed to open '%s' for reading: %s", path,
+                  system__win32_error_message(GetLastError()));
+        return false;
+    }
+#else
+    self->fd = open(path, O_RDONLY);
+    if (self->fd < 0) {
+        log_error("Failed to open '%s' for reading: %s", path, strerror(errno));
+        return false;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    // Only a hint, so it doesn't matter if it fails
+    posix_fadvise(self->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif // POSIX_FADV_SEQUENTIAL
+#endif // _WIN32
+
+    self->capacity = 2 * FILE_READER_CHUNK_SIZE;
+    self->buffer = arena_alloc(arena, self->capacity);
+    return true;
+}
+
+void file_reader_close(FileReader *self) {
+#ifdef _WIN32
+    if (self->handle != INVALID_HANDLE_VALUE) CloseHandle(self->handle);
+    self->handle = INVALID_HANDLE_VALUE;
+#else
+    if (self->fd >= 0) close(self->fd);
+    self->fd = -1;
+#endif // _WIN32
+}
+
+// Move the bytes which weren't handed out yet to the start of the buffer, and
+// read as much of the file as fits after them.
+bool system__file_reader_fill(FileReader *self) {
+    i32 leftover = self->end - self->start;
+    memmove(self->buffer, self->buffer + self->start, leftover);
+    self->scanned -= self->start;
+    self->start = 0;
+    self->end = leftover;
+
+    i32 available = self->capacity - self->end;
+#ifdef _WIN32
+    DWORD n = 0;
+    if (!ReadFile(self->handle, self->buffer + self->end, available, &n,
+                  NULL)) {
+        log_error("Failed to read from '%s': %s", self->path,
+                  system__win32_error_message(GetLastError()));
+        return false;
+    }
+#else
+    ssize_t n;
+    do {
+        n = read(self->fd, self->buffer + self->end, available);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        log_error("Failed to read from '%s': %s", self->path, strerror(errno));
+        return false;
+    }
+#endif // _WIN32
+
+    if (n == 0) self->eof = true;
+    self->end += n;
+    self->offset += n;
+
+#ifdef POSIX_FADV_WILLNEED
+    // Have the OS start reading the next chunk while this one is processed
+    if (n > 0) {
+        posix_fadvise(self->fd, self->offset, FILE_READER_CHUNK_SIZE,
+                      POSIX_FADV_WILLNEED);
+    }
+#endif // POSIX_FADV_WILLNEED
+    return true;
+}
+
+i8 file_reader_next_record(FileReader *self, char delimiter,
+                           StringView *record) {
+    for (;;) {
+        char *start = self->buffer + self->start;
+        char *found = memchr(self->buffer + self->scanned, delimiter,
+                             self->end - self->scanned);
+        if (found) {
+            *record = sv_from_parts(start, found - start);
+            self->start = self->scanned = found - self->buffer + 1;
+            return 1;
+        }
+        self->scanned = self->end;
+
+        bool is_full = self->start == 0 && self->end == self->capacity;
+        if (self->eof || is_full) {
+            if (self->start == self->end) return 0;
+            *record = sv_from_parts(start, self->end - self->start);
+            self->start = self->end;
+            return 1;
+        }
+
+        if (!system__file_reader_fill(self)) return -1;
+    }
+}
+
+i8 file_reader_next_line(FileReader *self, StringView *line) {
+    i8 result = file_reader_next_record(self, '\n', line);
+    if (result > 0 && line->count && line->data[line->count - 1] == '\r') {
+        line->count--;
+    }
+    return result;
+}
+
+// Get a path next to `path` to write it into before it's replaced, which is
+// unique to this process.
+char *system__temporary_path(Arena *arena, const char *path) {
+#ifdef _WIN32
+    return arena_sprintf(arena, "%s.%lu.tmp", path, GetCurrentProcessId());
+#else
+    return arena_sprintf(arena, "%s.%ld.tmp", path, (long)getpid());
+#endif // _WIN32
+}
+
+bool file_writer_open_opt(Arena *arena, const char *path, FileWriter *self,
+                          FileWriterOpt opt) {
+    memset(self, 0, sizeof(*self));
+    self->path = path;
+    self->write_path = path;
+    self->opt = opt;
+
+    if (opt.atomic) self->write_path = system__temporary_path(arena, path);
+
+#ifdef _WIN32
+    self->handle = CreateFileA(self->write_path, GENERIC_WRITE, 0, NULL,
+                               CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (self->handle == INVALID_HANDLE_VALUE) {
+        log_error("Failed to open '%s' for writing: %s", self->write_path,
+                  system__win32_error_message(GetLastError()));
+        return false;
+    }
+#else
+    self->fd =
+        open(self->write_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (self->fd < 0) {
+        log_error("Failed to open '%s' for writing: %s", self->write_path,
+                  strerror(errno));
+        return false;
+    }
+#endif // _WIN32
+
+    self->capacity = FILE_WRITER_BUFFER_SIZE;
+    self->buffer = arena_alloc(arena, self->capacity);
+    return true;
+}
+
+// Write all of `first` and then all of `second` into the file, with as few
+// calls as possible.
+bool system__file_writer_write_parts(FileWriter *self, StringView first,
+                                     StringView second) {
+#ifdef _WIN32
+    StringView parts[] = {first, second};
+    for (i32 i = 0; i < 2; i++) {
+        StringView part = parts[i];
+        while (part.count > 0) {
+            DWORD n;
+            if (!WriteFile(self->handle, part.data, part.count, &n, NULL)) {
+                log_error("Failed to write into '%s': %s", self->write_path,
+                          system__win32_error_message(GetLastError()));
+                return false;
+            }
+            part.data += n;
+            part.count -= n;
+        }
+    }
+#else
+    struct iovec parts[] = {
+        {.iov_base = (void *)first.data, .iov_len = first.count},
+        {.iov_base = (void *)second.data, .iov_len = second.count},
+    };
+    struct iovec *part = parts;
+    i32 part_count = 2;
+    while (part_count > 0) {
+        ssize_t n = writev(self->fd, part, part_count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_error("Failed to write into '%s': %s", self->write_path,
+                      strerror(errno));
+            return false;
+        }
+
+        // Skip past whatever was written, which may end in the middle of a part
+        while (part_count > 0 && (size_t)n >= part->iov_len) {
+            n -= part->iov_len;
+            part++;
+            part_count--;
+        }
+        if (part_count > 0) {
+            part->iov_base = (char *)part->iov_base + n;
+            part->iov_len -= n;
+        }
+    }
+#endif // _WIN32
+    return true;
+}
+
+bool file_writer_write(FileWriter *self, StringView chunk) {
+    if (self->failed) return false;
+
+    if (chunk.count <= self->capacity - self->count) {
+        MEMCPY(self->buffer + self->count, chunk.data, chunk.count);
+        self->count += chunk.count;
+        return true;
+    }
+
+    StringView buffered = sv_from_parts(self->buffer, self->count);
+    self->count = 0;
+    if (!system__file_writer_write_parts(self, buffered, chunk)) {
+        self->failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool file_writer_write_sb(FileWriter *self, StringBuilder sb) {
+    return file_writer_write(self, sb_to_sv(sb));
+}
+
+bool file_writer_flush(FileWriter *self) {
+    if (self->failed) return false;
+
+    StringView buffered = sv_from_parts(self->buffer, self->count);
+    self->count = 0;
+    if (!system__file_writer_write_parts(self, buffered, SV_EMPTY)) {
+        self->failed = true;
+        return false;
+    }
+    return true;
+}
+
+// Flush the contents of the file itself to the disk.
+bool system__file_writer_sync(FileWriter *self) {
+#ifdef _WIN32
+    if (!FlushFileBuffers(self->handle)) {
+        log_error("Failed to sync '%s': %s", self->write_path,
+                  system__win32_error_message(GetLastError()));
+        return false;
+    }
+#else
+#ifdef __APPLE__
+    i32 result = fsync(self->fd);
+#else
+    i32 result = fdatasync(self->fd);
+#endif // __APPLE__
+    if (result < 0) {
+        log_error("Failed to sync '%s': %s", self->write_path, strerror(errno));
+        return false;
+    }
+#endif // _WIN32
+    return true;
+}
+
+#ifndef _WIN32
+// Flush the directory containing `path` to the disk, so that a file which was
+// just renamed into it keeps its new name after a crash.
+void system__sync_parent_directory(const char *path) {
+    char parent[SYSTEM_PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    if (slash == NULL) {
+        snprintf(parent, sizeof(parent), ".");
+    } else {
+        snprintf(parent, sizeof(parent), "%.*s", (i32)(slash - path) + 1, path);
+    }
+
+    // The file itself was already synced, so this is only best effort
+    i32 fd = open(parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+    fsync(fd);
+    close(fd);
+}
+#endif // _WIN32
+
+bool file_writer_close(FileWriter *self) {
+    bool ok = file_writer_flush(self);
+    if (ok && self->opt.sync) ok = system__file_writer_sync(self);
+
+#ifdef _WIN32
+    if (self->handle != INVALID_HANDLE_VALUE) CloseHandle(self->handle);
+    self->handle = INVALID_HANDLE_VALUE;
+#else
+    // Some file systems only report write errors once the file is closed
+    if (self->fd >= 0 && close(self->fd) < 0 && ok) {
+        log_error("Failed to write into '%s': %s", self->write_path,
+                  strerror(errno));
+        ok = false;
+    }
+    self->fd = -1;
+#endif // _WIN32
+
+    if (self->opt.atomic) {
+        if (ok) ok = rename_file(self->write_path, self->path);
+        if (!ok) delete_file(self->write_path);
+#ifndef _WIN32
+        if (ok && self->opt.sync) system__sync_parent_directory(self->path);
+#endif // _WIN32
+    }
+    return ok;
+}
+
+void file_writer_discard(FileWriter *self) {
+#ifdef _WIN32
+    if (self->handle != INVALID_HANDLE_VALUE) CloseHandle(self->handle);
+    self->handle = INVALID_HANDLE_VALUE;
+#else
+    if (self->fd >= 0) close(self->fd);
+    self->fd = -1;
+#endif // _WIN32
+
+    if (self->opt.atomic) delete_file(self->write_path);
+    self->failed = true;
+}
+
+#ifndef _WIN32
+#ifdef __linux__
+// Linux has always supported these since 3.1, but they're only declared with
+// `_GNU_SOURCE`
+#ifndef SEEK_DATA
+#define SEEK_DATA 3
+#define SEEK_HOLE 4
+#endif // SEEK_DATA
+#endif // __linux__
+
+// The ways to copy data between files, from the fastest to the most portable.
+typedef enum {
+    SYSTEM__COPY_RANGE,
+    SYSTEM__COPY_SENDFILE,
+    SYSTEM__COPY_BUFFERED,
+} System__CopyMethod;
+
+typedef struct {
+    const char *src;
+    const char *dest;
+    i32 src_fd;
+    i32 dest_fd;
+    // The fastest method which wasn't found to be unsupported yet.
+    System__CopyMethod method;
+    // The arena to allocate `buffer` from, once it's needed.
+    Arena *arena;
+    char *buffer;
+    i32 buffer_size;
+    // Where the source ended, if it turned out shorter than its size, or `-1`.
+    i64 end;
+} System__FileCopy;
+
+// Check whether an error from an in-kernel copy means it isn't supported for
+// these files, and a slower method should be used.
+bool system__copy_unsupported(i32 error) {
+    return error == ENOSYS || error == EXDEV || error == EINVAL ||
+        error == EOPNOTSUPP || error == ENOTSUP;
+}
+
+// Read up to `count` bytes at `offset` (or from the current position, if it's
+// negative) into the copy's buffer, and write them into `dest_fd`.
+i64 system__copy_buffered(System__FileCopy *copy, i64 offset, i64 count) {
+    if (!copy->buffer) {
+        i32 available = copy->arena->capacity - copy->arena->allocated;
+        ASSERT(available > 0, "arena out of memory");
+        copy->buffer_size = MIN(SYSTEM_COPY_BUFFER_SIZE, available);
+        copy->buffer = arena_alloc(copy->arena, copy->buffer_size);
+    }
+
+    i64 size = MIN(count, copy->buffer_size);
+    i64 n = offset < 0 ? read(copy->src_fd, copy->buffer, size)
+                       : pread(copy->src_fd, copy->buffer, size, offset);
+    for (i64 written = 0; written < n;) {
+        i64 m = offset < 0 ? write(copy->dest_fd, copy->buffer + written,
+                                   n - written)
+                           : pwrite(copy->dest_fd, copy->buffer + written,
+                                    n - written, offset + written);
+        if (m < 0) {
+            if (errno == EINTR) continue;
+            log_error("Failed to write to '%s': %s", copy->dest,
+                      strerror(errno));
+            return -2;
+        }
+        written += m;
+    }
+    return n;
+}
+
+// Copy the `count` bytes at `offset` of the source into the same offset of the
+// destination, with the fastest method that works.
+bool system__copy_extent(System__FileCopy *copy, i64 offset, i64 count) {
+    while (count > 0) {
+        // Keep each call well within what the syscalls can return
+        i64 chunk = MIN(count, GiB(1));
+        i64 n = -1;
+
+#ifdef SYS_copy_file_range
+        if (copy->method == SYSTEM__COPY_RANGE) {
+            i64 in = offset, out = offset;
+            n = syscall(SYS_copy_file_range, copy->src_fd, &in, copy->dest_fd,
+                        &out, chunk, 0);
+            if (n < 0 && system__copy_unsupported(errno)) {
+                copy->method = SYSTEM__COPY_SENDFILE;
+                continue;
+            }
+        }
+#endif // SYS_copy_file_range
+#ifdef __linux__
+        if (copy->method == SYSTEM__COPY_SENDFILE) {
+            off_t in = offset;
+            n = lseek(copy->dest_fd, offset, SEEK_SET);
+            if (n >= 0) n = sendfile(copy->dest_fd, copy->src_fd, &in, chunk);
+            if (n < 0 && system__copy_unsupported(errno)) {
+                copy->method = SYSTEM__COPY_BUFFERED;
+                continue;
+            }
+        }
+#endif // __linux__
+        if (copy->method == SYSTEM__COPY_BUFFERED) {
+            n = system__copy_buffered(copy, offset, chunk);
+            if (n == -2) return false;
+        }
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_error("Failed to copy '%s' to '%s': %s", copy->src, copy->dest,
+                      strerror(errno));
+            return false;
+        }
+        if (n == 0) {
+            // Files like those in `/sys` and some FUSE ones can't be copied
+            // within the kernel, which copies nothing for them instead of
+            // failing
+            if (copy->method != SYSTEM__COPY_BUFFERED) {
+                copy->method = SYSTEM__COPY_BUFFERED;
+                continue;
+            }
+            // The file is shorter than its size; it was truncated while it
+            // was being copied, or its size is only an estimate
+            copy->end = offset;
+            break;
+        }
+        offset += n;
+        count -= n;
+    }
+    return true;
+}
+#endif // _WIN32
+
+bool copy_file(Arena *arena, const char *src, const char *dest) {
+#ifdef _WIN32
+    if (!CopyFile(src, dest, false)) {
+        log_error("Failed copy '%s' to '%s': %s", src, dest,
+                  system__win32_error_message(GetLastError()));
+        return false;
+    }
+    log_debug("Copied '%s' to '%s'", src, dest);
+    return true;
+#else
+    DEFER_SETUP(bool, true);
+
+    i32 src_fd = -1, dest_fd = -1;
+    Lifetime lt = lifetime_begin(arena);
+
+    src_fd = open(src, O_RDONLY);
+    if (src_fd < 0) {
+        log_error("Failed to open '%s' for reading: %s", src, strerror(errno));
+        DEFER_RETURN(false);
+    }
+
+    struct stat src_stat;
+    if (fstat(src_fd, &src_stat) < 0) {
+        log_error("Failed to stat '%s': %s", src, strerror(errno));
+        DEFER_RETURN(false);
+    }
+
+    dest_fd = open(dest, O_CREAT | O_TRUNC | O_WRONLY, src_stat.st_mode);
+    if (dest_fd < 0) {
+        log_error("Failed to open '%s' for writing: %s", dest, strerror(errno));
+        DEFER_RETURN(false);
+    }
+
+#ifdef FICLONE
+    // On copy-on-write filesystems, the copy can share the source's blocks
+    if (ioctl(dest_fd, FICLONE, src_fd) == 0) {
+        log_debug("Cloned '%s' to '%s'", src, dest);
+        DEFER_RETURN(true);
+    }
+#endif // FICLONE
+
+    System__FileCopy copy = {
+        .src = src,
+        .dest = dest,
+        .src_fd = src_fd,
+        .dest_fd = dest_fd,
+#if defined(SYS_copy_file_range)
+        .method = SYSTEM__COPY_RANGE,
+#elif defined(__linux__)
+        .method = SYSTEM__COPY_SENDFILE,
+#else
+        .method = SYSTEM__COPY_BUFFERED,
+#endif // defined(SYS_copy_file_range)
+        .arena = lt.arena,
+        .end = -1,
+    };
+
+    if (!S_ISREG(src_stat.st_mode) || src_stat.st_size == 0) {
+        // Pipes and special files have no size or holes, and files like those
+        // in `/proc` report a size of 0 even though they have contents, so
+        // just stream them
+        copy.method = SYSTEM__COPY_BUFFERED;
+        for (;;) {
+            i64 n = system__copy_buffered(&copy, -1, SYSTEM_COPY_BUFFER_SIZE);
+            if (n == 0) break;
+            if (n == -2) DEFER_RETURN(false);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                log_error("Failed to read from '%s': %s", src,
+                          strerror(errno));
+                DEFER_RETURN(false);
+            }
+        }
+        log_debug("Copied '%s' to '%s'", src, dest);
+        DEFER_RETURN(true);
+    }
+
+    // Copy only the extents which have data, leaving the holes between them
+    i64 size = src_stat.st_size;
+    for (i64 offset = 0; offset < size;) {
+        i64 data = offset, hole = size;
+#ifdef SEEK_DATA
+        data = lseek(src_fd, offset, SEEK_DATA);
+        if (data < 0) {
+            // The rest of the file is a hole
+            if (errno == ENXIO) break;
+            data = offset;
+        } else {
+            hole = lseek(src_fd, data, SEEK_HOLE);
+            if (hole < 0) hole = size;
+        }
+#endif // SEEK_DATA
+        if (!system__copy_extent(&copy, data, hole - data)) {
+            DEFER_RETURN(false);
+        }
+        if (copy.end >= 0) {
+            size = copy.end;
+            break;
+        }
+        offset = hole;
+    }
+
+    // Make up for a hole at the end of the file, which has no data to copy
+    if (ftruncate(dest_fd, size) < 0) {
+        log_error("Failed to write to '%s': %s", dest, strerror(errno));
+        DEFER_RETURN(false);
+    }
+
+    log_debug("Copied '%s' to '%s'", src, dest);
+
+    DEFER_LABEL({
+        if (src_fd >= 0) close(src_fd);
+        if (dest_fd >= 0) close(dest_fd);
+        lifetime_end(lt);
+    });
+#endif // _WIN32
+}
+
+i8 link_file(const char *src, const char *dest) {
+#ifdef _WIN32
+    if (!CreateHardLinkA(dest, src, NULL)) {
+        DWORD error = GetLastError();
+        if (error == ERROR_NOT_SAME_DEVICE || error == ERROR_NOT_SUPPORTED ||
+            error == ERROR_INVALID_FUNCTION || error == ERROR_TOO_MANY_LINKS)
+            return 0;
+        log_error("Failed to link '%s' to '%s': %s", dest, src,
+                  system__win32_error_message(error));
+        return -1;
+    }
+#else
+    if (link(src, dest) < 0) {
+        if (errno == EXDEV || errno == EPERM || errno == EMLINK ||
+            errno == EOPNOTSUPP)
+            return 0;
+        log_error("Failed to link '%s' to '%s': %s", dest, src,
+                  strerror(errno));
+        return -1;
+    }
+#endif // _WIN32
+    log_debug("Linked '%s' to '%s'", dest, src);
+    return 1;
+}
+
+bool touch_file(const char *path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, FILE_WRITE_ATTRIBUTES,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    if (file == INVALID_HANDLE_VALUE || !SetFileTime(file, NULL, NULL, &now)) {
+        log_error("Failed to touch '%s': %s", path,
+                  system__win32_error_message(GetLastError()));
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        return false;
+    }
+    CloseHandle(file);
+#else
+    if (utimensat(AT_FDCWD, path, NULL, 0) < 0) {
+        log_error("Failed to touch '%s': %s", path, strerror(errno));
+        return false;
+    }
+#endif // _WIN32
+    return true;
+}
+
+bool rename_file(const char *path, const char *new_path) {
+#ifdef _WIN32
+    if (!MoveFileEx(path, new_path, MOVEFILE_REPLACE_EXISTING)) {
+        log_error("Failed to rename '%s' to '%s': %s", path, new_path,
+                  system__win32_error_message(GetLastError()));
+        return false;
+    }
+#else
+    if (rename(path, new_path) < 0) {
+        log_error("Failed to rename '%s' to '%s': %s", path, new_path,
+                  strerror(errno));
+        return false;
+    }
+#endif // _WIN32
+    log_debug("Renamed '%s' to '%s'", path, new_path);
+    return true;
+}
+
+bool make_directory(const char *path, bool fail_if_exists) {
+#ifdef _WIN32
+    int result = _mkdir(path);
+#else
+    int result = mkdir(path, 0755);
+#endif // _WIN32
+
+    if (result < 0) {
+        if (errno == EEXIST && !fail_if_exists) {
+            log_debug("Directory '%s' already exists", path);
+            return true;
+        }
+        log_error("Failed to create directory '%s': %s", path, strerror(errno));
+        return false;
+    }
+
+    log_debug("Created directory '%s'", path);
+    return true;
+}
+
+bool make_directory_recursively(Arena *arena, const char *path) {
+    DEFER_SETUP(bool, true);
+
+    Lifetime lt = lifetime_begin(arena);
+
+    StringView sv = sv_from_cstr(path);
+    StringBuilder sb = sb_new(lt.arena, sv.count + 1);
+
+    // Absolute paths have to keep their root
+    if (sv.count && sv.data[0] == SYSTEM_PATH_DELIMITER) {
+        sb_push(&sb, SYSTEM_PATH_DELIMITER);
+    }
+
+    while (sv.count) {
+        StringView part = sv_cut_delimiter(&sv, SYSTEM_PATH_DELIMITER);
+        if (!part.count) continue;
+
+        // Replace the NUL character of the previous part with a delimiter
+        if (sb.count && sb.items[sb.count - 1] == '\0') sb_pop(&sb);
+        if (sb.count && sb.items[sb.count - 1] != SYSTEM_PATH_DELIMITER) {
+            sb_push(&sb, SYSTEM_PATH_DELIMITER);
+        }
+        sb_append_sv(&sb, part);
+        sb_push_null(&sb);
+
+        if (!make_directory(sb.items, false)) DEFER_RETURN(false);
+    }
+
+    DEFER_LABEL({ lifetime_end(lt); });
+}
+
+// Reads the entries of a directory one by one.
+typedef struct {
+    const char *path;
+    // The name of the last entry which was read.
+    const char *name;
+#ifdef _WIN32
+    HANDLE find;
+    WIN32_FIND_DATA data;
+    // Whether `data` holds an entry which wasn't returned yet.
+    bool has_data;
+#else
+    DIR *dir;
+    struct dirent *entry;
+#endif // _WIN32
+} System__DirectoryReader;
+
+// Open the directory at `path`. If `parent` isn't `NULL`, the directory is the
+// last entry read by `parent`, and it is opened relative to it, so the kernel
+// doesn't need to resolve the whole path again.
+bool system__directory_open(System__DirectoryReader *self, const char *path,
+                            const System__DirectoryReader *parent) {
+    self->path = path;
+    self->name = NULL;
+#ifdef _WIN32
+    UNUSED(parent);
+    char pattern[SYSTEM_PATH_MAX + 3];
+    snprintf(pattern, sizeof(pattern), "%s\\*", path);
+    self->find = FindFirstFile(pattern, &self->data);
+    if (self->find == INVALID_HANDLE_VALUE) {
+        log_error("Failed to open directory '%s': %s", path,
+                  system__win32_error_message(GetLastError()));
+        return false;
+    }
+    self->has_data = true;
+#else
+    i32 flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+    i32 fd = parent ? openat(dirfd(parent->dir), parent->name,
+                             flags | O_NOFOLLOW)
+                    : open(path, flags);
+    if (fd < 0) {
+        log_error("Failed to open directory '%s': %s", path, strerror(errno));
+        return false;
+    }
+
+    self->dir = fdopendir(fd);
+    if (self->dir == NULL) {
+        log_error("Failed to open directory '%s': %s", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+#endif // _WIN32
+    return true;
+}
+
+// Read the name of the next entry of the directory, skipping `.` and `..`.
+//
+// Returns `1` if an entry was read, `0` at the end of the directory, or logs an
+// error and returns `-1` if some error occurs.
+i8 system__directory_next(System__DirectoryReader *self, const char **name) {
+    for (;;) {
+#ifdef _WIN32
+        if (!self->has_data && !FindNextFile(self->find, &self->data)) {
+            if (GetLastError() == ERROR_NO_MORE_FILES) return 0;
+            log_error("Failed to read directory '%s': %s", self->path,
+                      system__win32_error_message(GetLastError()));
+            return -1;
+        }
+        self->has_data = false;
+        *name = self->data.cFileName;
+#else
+        errno = 0;
+        self->entry = readdir(self->dir);
+        if (self->entry == NULL) {
+            if (errno == 0) return 0;
+            log_error("Failed to read directory '%s': %s", self->path,
+                      strerror(errno));
+            return -1;
+        }
+        *name = self->entry->d_name;
+#endif // _WIN32
+
+        const char *n = *name;
+        bool is_default =
+            n[0] == '.' && (n[1] == '\0' || (n[1] == '.' && n[2] == '\0'));
+        if (!is_default) {
+            self->name = n;
+            return 1;
+        }
+    }
+}
+
+// Get the type of the last entry which was read, without following symlinks.
+//
+// The type comes with the entry itself wherever the platform and file system
+// report it, and otherwise the entry is stat'd relative to the directory.
+FileType system__directory_type(System__DirectoryReader *self) {
+#ifdef _WIN32
+    if (self->data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+        return FILE_TYPE_DIRECTORY;
+    }
+    return FILE_TYPE_REGULAR;
+#else
+#ifdef DT_UNKNOWN
+    switch (self->entry->d_type) {
+    case DT_REG: return FILE_TYPE_REGULAR;
+    case DT_DIR: return FILE_TYPE_DIRECTORY;
+    case DT_LNK: return FILE_TYPE_SYMLINK;
+    case DT_UNKNOWN: break;
+    default: return FILE_TYPE_OTHER;
+    }
+#endif // DT_UNKNOWN
+
+    struct stat statbuf;
+    if (fstatat(dirfd(self->dir), self->name, &statbuf, AT_SYMLINK_NOFOLLOW) <
+        0) {
+        log_error("Failed to stat '%s' in '%s': %s", self->name, self->path,
+                  strerror(errno));
+        return -1;
+    }
+    return system__file_type_from_mode(statbuf.st_mode);
+#endif // _WIN32
+}
+
+// Get the metadata of the last entry which was read into `out`, without
+// following symlinks.
+//
+// Logs an error and returns `false` if some error occurs.
+bool system__directory_stat(System__DirectoryReader *self, FileStat *out) {
+#ifdef _WIN32
+    out->mtime_ns = system__filetime_to_ns(self->data.ftLastWriteTime);
+    out->size = ((i64)self->data.nFileSizeHigh << 32) | self->data.nFileSizeLow;
+    out->type = system__directory_type(self);
+#else
+    struct stat statbuf;
+    if (fstatat(dirfd(self->dir), self->name, &statbuf, AT_SYMLINK_NOFOLLOW) <
+        0) {
+        log_error("Failed to stat '%s' in '%s': %s", self->name, self->path,
+                  strerror(errno));
+        return false;
+    }
+    system__file_stat_from(&statbuf, out);
+#endif // _WIN32
+    return true;
+}
+
+// Get the type of the entry at `path`, which is the last entry read by
+// `parent`, or the root if that's `NULL`; with a `cache`, the metadata of the
+// entry is recorded in it as well, unless it's the root or a symlink.
+FileType system__walk_entry_type(const char *path,
+                                 System__DirectoryReader *parent,
+                                 StatCache *cache) {
+    if (parent == NULL) return get_file_type(path);
+    if (cache == NULL) return system__directory_type(parent);
+
+    FileStat stat;
+    if (!system__directory_stat(parent, &stat)) return -1;
+    if (stat.type != FILE_TYPE_SYMLINK) stat_cache_put(cache, path, stat);
+    return stat.type;
+}
+
+void system__directory_close(System__DirectoryReader *self) {
+#ifdef _WIN32
+    FindClose(self->find);
+#else
+    closedir(self->dir);
 #endif // _WIN32
+}
+
+// Append the path of the entry `name` inside the directory at the first `mark`
+// bytes of `path`, with a NUL character at the end.
+void system__walk_entry_path(StringBuilder *path, i32 mark, const char *name) {
+    path->count = mark;
+    if (sb_get(*path, -1) != SYSTEM_PATH_DELIMITER)
+        sb_push(path, SYSTEM_PATH_DELIMITER);
+    sb_append_cstr(path, name);
+    sb_push_null(path);
+}
+
+// Check whether the entry at `path` matches `glob`, and whether any entries
+// inside it could, with `root_count` being the length of the root directory's
+// path.
+void system__walk_match(const GlobPattern *glob, const char *path,
+                        i32 path_count, i32 root_count, u32 level,
+                        bool *matches, bool *could_match_inside) {
+    *matches = true;
+    *could_match_inside = true;
+    if (!glob) return;
+
+    StringView relative =
+        sv_from_parts(path + root_count, path_count - root_count);
+    *matches = level > 0 && glob_match(glob, relative);
+    *could_match_inside = glob_could_match_inside(glob, relative);
+}
+
+// NOTE: `path` here has a NUL character at the end of it, so `path->items` can
+// be used as a C-string.
+//
+// `root_count` is the length of the root directory's path, which is skipped to
+// match the entries against `opt.glob`.
+//
+// `parent` is the reader of the directory containing the entry, whose last read
+// entry is the one at `path`, or `NULL` for the root.
+bool system__walk_directory_opt_impl(Arena *arena, StringBuilder *path,
+                                     WalkVisitCallback visit,
+                                     WalkDirectoryOpt opt, u32 level,
+                                     bool *stop, bool first_on_level,
+                                     i32 root_count,
+                                     System__DirectoryReader *parent) {
+    DEFER_SETUP(bool, true);
+
+    System__DirectoryReader reader = {0};
+    bool is_open = false;
+
+    // Check the pattern before anything else, so entries which can't match
+    // don't even need to be stat'd
+    bool matches, could_match_inside;
+    system__walk_match(opt.glob, path->items, path->count - 1, root_count,
+                       level, &matches, &could_match_inside);
+    if (!matches && !could_match_inside) DEFER_RETURN(true);
 
-    FileType type = get_file_type(path->items);
+    FileType type =
+        system__walk_entry_type(path->items, parent, opt.stat_cache);
     if (type < 0) DEFER_RETURN(false);
 
     WalkAction action = WALK_CONT;
@@ -597,7 +2579,7 @@ bool system__walk_directory_opt_impl(Arena *arena, StringBuilder *path,
         .first = first_on_level,
     };
 
-    if (!opt.post_order) {
+    if (!opt.post_order && matches) {
         if (!visit(entry)) DEFER_RETURN(false);
 
         switch (action) {
@@ -607,102 +2589,288 @@ bool system__walk_directory_opt_impl(Arena *arena, StringBuilder *path,
         }
     }
 
-    if (type != FILE_TYPE_DIRECTORY) {
-        if (opt.post_order && !visit(entry)) DEFER_RETURN(false);
+    if (type != FILE_TYPE_DIRECTORY || !could_match_inside) {
+        if (opt.post_order && matches && !visit(entry)) DEFER_RETURN(false);
+        if (action == WALK_STOP) *stop = true;
         DEFER_RETURN(true);
     }
 
-#ifdef _WIN32
-    Lifetime lt = lifetime_begin(arena);
-    char *buffer = arena_sprintf(lt.arena, "%s\\*", path->items);
-    hFind = FindFirstFile(buffer, &data);
-    lifetime_end(lt);
-
-    if (hFind == INVALID_HANDLE_VALUE) {
-        log_error("Failed to open directory '%s': %s", path->items,
-                  system__win32_error_message(GetLastError()));
-        DEFER_RETURN(false);
-    }
-#else
-    dir = opendir(path->items);
-    if (dir == NULL) {
-        log_error("Failed to open directory '%s': %s", path->items,
-                  strerror(errno));
+    if (!system__directory_open(&reader, path->items, parent)) {
         DEFER_RETURN(false);
     }
-#endif // _WIN32
+    is_open = true;
 
     // Mark before the NUL character
     i32 mark = path->count - 1;
 
     bool first = true;
-#ifdef _WIN32
-    for (;;) {
-        const char *name = data.cFileName;
-#else
-    errno = 0;
-    struct dirent *ent = readdir(dir);
-    while (ent != NULL) {
-        const char *name = ent->d_name;
-#endif // _WIN32
-        i32 name_length = strlen(name);
-        bool is_default = (name_length == 1 && name[0] == '.') ||
-            (name_length == 2 && name[0] == '.' && name[1] == '.');
-        if (!is_default) {
-            // Go back to the end of the directory's path
-            path->count = mark;
-            if (sb_get(*path, -1) != SYSTEM_PATH_DELIMITER)
-                sb_push(path, SYSTEM_PATH_DELIMITER);
-            sb_append(path, name, name_length);
-            sb_push_null(path);
-            if (!system__walk_directory_opt_impl(arena, path, visit, opt,
-                                                 level + 1, stop, first)) {
-                DEFER_RETURN(false);
-            }
-            if (*stop) DEFER_RETURN(true);
-            first = false;
-        }
-
-#ifdef _WIN32
-        if (!FindNextFile(hFind, &data)) {
-            if (GetLastError() == ERROR_NO_MORE_FILES) DEFER_RETURN(true);
-            log_error("Failed to read directory '%s': %s", path->items,
-                      system__win32_error_message(GetLastError()));
+    const char *name;
+    i8 result;
+    while ((result = system__directory_next(&reader, &name)) > 0) {
+        system__walk_entry_path(path, mark, name);
+        if (!system__walk_directory_opt_impl(arena, path, visit, opt,
+                                             level + 1, stop, first,
+                                             root_count, &reader)) {
             DEFER_RETURN(false);
         }
-#else
-        ent = readdir(dir);
-#endif // _WIN32
+        if (*stop) DEFER_RETURN(true);
+        first = false;
     }
     path->count = mark;
     sb_push_null(path);
+    if (result < 0) DEFER_RETURN(false);
 
-#ifdef _WIN32
-#else
-    if (errno != 0) {
-        log_error("Failed to read directory '%s': %s", path->items,
-                  strerror(errno));
-        DEFER_RETURN(false);
-    }
-#endif // _WIN32
-
-    if (opt.post_order) {
+    if (opt.post_order && matches) {
         if (!visit(entry)) DEFER_RETURN(false);
 
         if (action == WALK_STOP) *stop = true;
     }
 
-#ifdef _WIN32
-    DEFER_LABEL({ FindClose(hFind); });
-#else
     DEFER_LABEL({
-        if (dir) closedir(dir);
+        if (is_open) system__directory_close(&reader);
     });
-#endif // _WIN32
+}
+
+// The state shared by the threads of a parallel walk.
+typedef struct {
+    ThreadPool *pool;
+    WalkVisitCallback visit;
+    WalkDirectoryOpt opt;
+    i32 root_count;
+    // The arena passed to `walk_directory_opt`, which is only passed on to
+    // `visit` while holding `visit_lock`.
+    Arena *arena;
+    // Held while calling `visit`, if `opt.serialize_visits` is set.
+    Mutex visit_lock;
+    // Set once the walk should stop, because `visit` asked to or failed, or
+    // because some other error occurred.
+    volatile i64 stop;
+    volatile i64 failed;
+} System__ParallelWalk;
+
+// A directory being walked by a parallel walk, which lives until all of its
+// entries were walked, so it can be visited after them in post-order.
+typedef struct System__WalkNode {
+    System__ParallelWalk *walk;
+    struct System__WalkNode *parent;
+    // The amount of subdirectories which are still being walked, plus one while
+    // this directory is still being read.
+    volatile i64 pending;
+    u32 level;
+    bool first;
+    bool matches;
+    // The path of the directory, with a NUL character at the end of it.
+    i32 path_count;
+    char path[];
+} System__WalkNode;
+
+// Visit `entry` on `worker`, with the arena of the walk if the visits are
+// serialized, or with a `Lifetime` of the worker's arena otherwise.
+bool system__parallel_walk_visit(System__ParallelWalk *walk,
+                                 ThreadPoolWorker *worker, WalkEntry entry) {
+    bool result;
+    if (walk->opt.serialize_visits) {
+        mutex_lock(&walk->visit_lock);
+        entry.arena = walk->arena;
+        result = walk->visit(entry);
+        mutex_unlock(&walk->visit_lock);
+    } else {
+        Lifetime lt = lifetime_begin(worker->arena);
+        entry.arena = lt.arena;
+        result = walk->visit(entry);
+        lifetime_end(lt);
+    }
+
+    if (!result) atomic_store_i64(&walk->failed, 1);
+    if (!result || *entry.action == WALK_STOP) {
+        atomic_store_i64(&walk->stop, 1);
+        return false;
+    }
+    return true;
+}
+
+void system__parallel_walk_fail(System__ParallelWalk *walk) {
+    atomic_store_i64(&walk->failed, 1);
+    atomic_store_i64(&walk->stop, 1);
+}
+
+// Mark one of the things `node` was waiting for as finished; once nothing is
+// left, visit it in post-order and let its parent know in turn.
+void system__parallel_walk_finish(ThreadPoolWorker *worker,
+                                  System__WalkNode *node) {
+    while (node && atomic_add_i64(&node->pending, -1) == 0) {
+        System__ParallelWalk *walk = node->walk;
+        if (walk->opt.post_order && node->matches &&
+            !atomic_load_i64(&walk->stop)) {
+            WalkAction action = WALK_CONT;
+            WalkEntry entry = {
+                .user_data = walk->opt.user_data,
+                .path = node->path,
+                .type = FILE_TYPE_DIRECTORY,
+                .level = node->level,
+                .action = &action,
+                .first = node->first,
+            };
+            system__parallel_walk_visit(walk, worker, entry);
+        }
+
+        System__WalkNode *parent = node->parent;
+        FREE(node);
+        node = parent;
+    }
+}
+
+void system__parallel_walk_directory(ThreadPoolWorker *worker, void *data) {
+    System__WalkNode *node = data;
+    System__ParallelWalk *walk = node->walk;
+    WalkDirectoryOpt opt = walk->opt;
+
+    System__DirectoryReader reader;
+    if (atomic_load_i64(&walk->stop)) {
+        system__parallel_walk_finish(worker, node);
+        return;
+    }
+    if (!system__directory_open(&reader, node->path, NULL)) {
+        system__parallel_walk_fail(walk);
+        system__parallel_walk_finish(worker, node);
+        return;
+    }
+
+    char buffer[SYSTEM_PATH_MAX];
+    StringBuilder path = {.items = buffer, .capacity = SYSTEM_PATH_MAX};
+    sb_append(&path, node->path, node->path_count);
+    i32 mark = path.count;
+
+    bool first = true;
+    const char *name;
+    i8 result = 0;
+    while (!atomic_load_i64(&walk->stop) &&
+           (result = system__directory_next(&reader, &name)) > 0) {
+        bool first_on_level = first;
+        first = false;
+
+        system__walk_entry_path(&path, mark, name);
+        bool matches, could_match_inside;
+        system__walk_match(opt.glob, path.items, path.count - 1,
+                           walk->root_count, node->level + 1, &matches,
+                           &could_match_inside);
+        if (!matches && !could_match_inside) continue;
+
+        FileType type =
+            system__walk_entry_type(path.items, &reader, opt.stat_cache);
+        if (type < 0) {
+            system__parallel_walk_fail(walk);
+            break;
+        }
+
+        // Directories are visited by their own task in post-order, once all of
+        // their entries were
+        bool descend = type == FILE_TYPE_DIRECTORY && could_match_inside;
+        if (matches && !(descend && opt.post_order)) {
+            WalkAction action = WALK_CONT;
+            WalkEntry entry = {
+                .user_data = opt.user_data,
+                .path = path.items,
+                .type = type,
+                .level = node->level + 1,
+                .action = &action,
+                .first = first_on_level,
+            };
+            if (!system__parallel_walk_visit(walk, worker, entry)) break;
+            if (action == WALK_SKIP) continue;
+        }
+        if (!descend) continue;
+
+        System__WalkNode *child = MALLOC(sizeof(System__WalkNode) + path.count);
+        ASSERT(child != NULL, "unable to allocate memory for directory");
+        child->walk = walk;
+        child->parent = node;
+        child->pending = 1;
+        child->level = node->level + 1;
+        child->first = first_on_level;
+        child->matches = matches;
+        child->path_count = path.count - 1;
+        memcpy(child->path, path.items, path.count);
+
+        atomic_add_i64(&node->pending, 1);
+        thread_pool_submit(walk->pool, worker,
+                           system__parallel_walk_directory, child);
+    }
+    if (result < 0) system__parallel_walk_fail(walk);
+
+    system__directory_close(&reader);
+    system__parallel_walk_finish(worker, node);
+}
+
+bool system__walk_directory_parallel(Arena *arena, const char *root,
+                                     WalkVisitCallback visit,
+                                     WalkDirectoryOpt opt) {
+    i32 root_count = strlen(root);
+    FileType type = get_file_type(root);
+    if (type < 0) return false;
+
+    bool matches, could_match_inside;
+    system__walk_match(opt.glob, root, root_count, root_count, 0, &matches,
+                       &could_match_inside);
+
+    if (type != FILE_TYPE_DIRECTORY || !could_match_inside) {
+        // There's nothing to walk in parallel
+        opt.threads = 0;
+        return walk_directory_opt(arena, root, visit, opt);
+    }
+
+    if (!opt.post_order && matches) {
+        WalkAction action = WALK_CONT;
+        WalkEntry entry = {
+            .arena = arena,
+            .user_data = opt.user_data,
+            .path = root,
+            .type = type,
+            .level = 0,
+            .action = &action,
+            .first = true,
+        };
+        if (!visit(entry)) return false;
+        if (action != WALK_CONT) return true;
+    }
+
+    DEFER_SETUP(bool, true);
+
+    System__ParallelWalk walk = {
+        .visit = visit,
+        .opt = opt,
+        .root_count = root_count,
+        .arena = arena,
+    };
+    mutex_init(&walk.visit_lock);
+
+    walk.pool = thread_pool_new(opt.threads, SYSTEM_WALK_ARENA_SIZE);
+    if (walk.pool == NULL) DEFER_RETURN(false);
+
+    System__WalkNode *node = MALLOC(sizeof(System__WalkNode) + root_count + 1);
+    ASSERT(node != NULL, "unable to allocate memory for directory");
+    memset(node, 0, sizeof(*node));
+    node->walk = &walk;
+    node->pending = 1;
+    node->first = true;
+    node->matches = matches;
+    node->path_count = root_count;
+    memcpy(node->path, root, root_count + 1);
+
+    thread_pool_submit(walk.pool, NULL, system__parallel_walk_directory, node);
+    thread_pool_destroy(walk.pool);
+
+    DEFER_RETURN(!walk.failed);
+
+    DEFER_LABEL({ mutex_destroy(&walk.visit_lock); });
 }
 
 bool walk_directory_opt(Arena *arena, const char *root, WalkVisitCallback visit,
                         WalkDirectoryOpt opt) {
+    if (opt.threads > 1) {
+        return system__walk_directory_parallel(arena, root, visit, opt);
+    }
+
     bool stop = false;
 
     StringBuilder path = sb_new(arena, SYSTEM_PATH_MAX);
@@ -710,7 +2878,8 @@ bool walk_directory_opt(Arena *arena, const char *root, WalkVisitCallback visit,
     sb_push_null(&path);
 
     bool result = system__walk_directory_opt_impl(arena, &path, visit, opt, 0,
-                                                  &stop, true);
+                                                  &stop, true, path.count - 1,
+                                                  NULL);
 
     return result;
 }
@@ -719,8 +2888,7 @@ bool system__list_directory_visit(WalkEntry entry) {
     if (entry.level == 1) {
         FilePaths *paths = entry.user_data;
         file_paths_push(paths, arena_clone_cstr(entry.arena, entry.path));
-    } else if (entry.level > 1) {
-        *entry.action = WALK_STOP;
+        *entry.action = WALK_SKIP;
     }
     return true;
 }
@@ -733,12 +2901,47 @@ bool list_directory(Arena *arena, const char *path, FilePaths *out) {
 typedef struct {
     const char *src;
     const char *dest;
+    // The pool to copy the files on, if they're copied in parallel.
+    ThreadPool *pool;
+    volatile i64 failed;
 } System__CopyDirectoryRecursivelyData;
 
+// A file to copy on the pool of a parallel copy, with the source and the
+// destination paths stored right after it.
+typedef struct {
+    System__CopyDirectoryRecursivelyData *data;
+    char *dest;
+    char src[];
+} System__CopyJob;
+
+void system__copy_job_run(ThreadPoolWorker *worker, void *data) {
+    System__CopyJob *job = data;
+    if (!atomic_load_i64(&job->data->failed) &&
+        !copy_file(worker->arena, job->src, job->dest)) {
+        atomic_store_i64(&job->data->failed, 1);
+    }
+    FREE(job);
+}
+
+void system__copy_job_submit(System__CopyDirectoryRecursivelyData *data,
+                             const char *src, const char *dest) {
+    i32 src_count = strlen(src) + 1;
+    i32 dest_count = strlen(dest) + 1;
+    System__CopyJob *job =
+        MALLOC(sizeof(System__CopyJob) + src_count + dest_count);
+    ASSERT(job != NULL, "unable to allocate memory for copy");
+    job->data = data;
+    job->dest = job->src + src_count;
+    MEMCPY(job->src, src, src_count);
+    MEMCPY(job->dest, dest, dest_count);
+    thread_pool_submit(data->pool, NULL, system__copy_job_run, job);
+}
+
 bool system__copy_directory_recursively_visit(WalkEntry entry) {
     DEFER_SETUP(bool, true);
 
     System__CopyDirectoryRecursivelyData *data = entry.user_data;
+    if (atomic_load_i64(&data->failed)) return false;
 
     if (entry.level == 0) {
         return make_directory(data->dest, false);
@@ -761,6 +2964,10 @@ bool system__copy_directory_recursively_visit(WalkEntry entry) {
     switch (entry.type) {
     case FILE_TYPE_DIRECTORY: DEFER_RETURN(make_directory(path.items, false));
     case FILE_TYPE_REGULAR:
+        if (data->pool) {
+            system__copy_job_submit(data, entry.path, path.items);
+            DEFER_RETURN(true);
+        }
         DEFER_RETURN(copy_file(entry.arena, entry.path, path.items));
     case FILE_TYPE_SYMLINK: TODO("FILE_TYPE_SYMLINK"); DEFER_RETURN(false);
     case FILE_TYPE_OTHER:
@@ -782,6 +2989,26 @@ bool copy_directory_recursively(Arena *arena, const char *src,
     return result;
 }
 
+bool copy_directory_recursively_parallel(Arena *arena, const char *src,
+                                         const char *dest, i32 threads) {
+    System__CopyDirectoryRecursivelyData user_data = {.dest = dest, .src = src};
+    // The directories are created by walking serially, so each one exists by
+    // the time the files inside it are submitted
+    user_data.pool = thread_pool_new(threads, SYSTEM_COPY_BUFFER_SIZE);
+    if (user_data.pool == NULL) return false;
+
+    Lifetime lt = lifetime_begin(arena);
+    bool result =
+        WALK_DIRECTORY(lt.arena, src, system__copy_directory_recursively_visit,
+                       .user_data = &user_data);
+    lifetime_end(lt);
+
+    // Skip whatever is still queued if the walk itself failed
+    if (!result) atomic_store_i64(&user_data.failed, 1);
+    thread_pool_destroy(user_data.pool);
+    return result && !user_data.failed;
+}
+
 bool system__delete_directory_recursively_visit(WalkEntry entry) {
     return delete_file(entry.path);
 }
@@ -795,6 +3022,409 @@ bool delete_directory_recursively(Arena *arena, const char *path) {
     return result;
 }
 
+bool delete_directory_recursively_parallel(Arena *arena, const char *path,
+                                           i32 threads) {
+    if (threads <= 0) threads = processors_available();
+
+    Lifetime lt = lifetime_begin(arena);
+    bool result = WALK_DIRECTORY(lt.arena, path,
+                                 system__delete_directory_recursively_visit,
+                                 .post_order = true, .threads = threads);
+    lifetime_end(lt);
+    return result;
+}
+
+#if defined(_WIN32)
+#define SYSTEM__WATCH_FILTER                                                   \
+    (FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |              \
+     FILE_NOTIFY_CHANGE_ATTRIBUTES | FILE_NOTIFY_CHANGE_SIZE |                 \
+     FILE_NOTIFY_CHANGE_LAST_WRITE)
+
+// A root of a `DirectoryWatcher`, with a read of its changes always pending.
+struct System__WatchedRoot {
+    char *path;
+    HANDLE dir;
+    OVERLAPPED overlapped;
+    DWORD buffer[DIRECTORY_WATCHER_BUFFER_SIZE / sizeof(DWORD)];
+};
+
+bool system__watched_root_read(struct System__WatchedRoot *root) {
+    ResetEvent(root->overlapped.hEvent);
+    if (!ReadDirectoryChangesW(root->dir, root->buffer, sizeof(root->buffer),
+                               TRUE, SYSTEM__WATCH_FILTER, NULL,
+                               &root->overlapped, NULL)) {
+        log_error("Failed to watch directory '%s': %s", root->path,
+                  system__win32_error_message(GetLastError()));
+        return false;
+    }
+    return true;
+}
+
+void system__watched_root_close(struct System__WatchedRoot *root) {
+    if (root->dir != INVALID_HANDLE_VALUE) {
+        // The pending read has to be finished before its buffer is freed
+        DWORD bytes;
+        if (CancelIoEx(root->dir, &root->overlapped)) {
+            GetOverlappedResult(root->dir, &root->overlapped, &bytes, TRUE);
+        }
+        CloseHandle(root->dir);
+    }
+    if (root->overlapped.hEvent) CloseHandle(root->overlapped.hEvent);
+    FREE(root->path);
+    FREE(root);
+}
+
+// Push the changes the finished read of `root` received, and read again.
+bool system__watched_root_collect(struct System__WatchedRoot *root,
+                                  Arena *arena, FilePaths *changes) {
+    DWORD bytes;
+    if (!GetOverlappedResult(root->dir, &root->overlapped, &bytes, FALSE)) {
+        log_error("Failed to read changes of '%s': %s", root->path,
+                  system__win32_error_message(GetLastError()));
+        return false;
+    }
+
+    // No bytes means the changes didn't fit in the buffer
+    if (bytes == 0) {
+        file_paths_push(changes, arena_clone_cstr(arena, root->path));
+        return system__watched_root_read(root);
+    }
+
+    FILE_NOTIFY_INFORMATION *info = (FILE_NOTIFY_INFORMATION *)root->buffer;
+    for (;;) {
+        char name[SYSTEM_PATH_MAX];
+        i32 count = WideCharToMultiByte(
+            CP_ACP, 0, info->FileName, info->FileNameLength / sizeof(WCHAR),
+            name, sizeof(name) - 1, NULL, NULL);
+        name[count] = '\0';
+        file_paths_push(changes,
+                        arena_sprintf(arena, "%s\\%s", root->path, name));
+
+        if (!info->NextEntryOffset) break;
+        info = (FILE_NOTIFY_INFORMATION *)((u8 *)info + info->NextEntryOffset);
+    }
+
+    return system__watched_root_read(root);
+}
+#elif defined(__linux__)
+#define SYSTEM__WATCH_MASK                                                     \
+    (IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_DELETE_SELF |     \
+     IN_MOVED_FROM | IN_MOVED_TO | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW)
+
+char *system__clone_path(const char *path) {
+    i32 count = strlen(path) + 1;
+    char *clone = MALLOC(count);
+    ASSERT(clone != NULL, "unable to allocate memory for path");
+    MEMCPY(clone, path, count);
+    return clone;
+}
+
+bool system__directory_watcher_watch(DirectoryWatcher *self,
+                                     const char *path) {
+    i32 wd = inotify_add_watch(self->fd, path, SYSTEM__WATCH_MASK);
+    if (wd < 0) {
+        // The directory was already removed or replaced again, which is
+        // reported by its parent anyway
+        if (errno == ENOENT || errno == ENOTDIR) return true;
+        log_error("Failed to watch directory '%s': %s", path, strerror(errno));
+        return false;
+    }
+
+    while (self->directories.count <= wd) {
+        file_paths_push(&self->directories, NULL);
+    }
+    FREE((char *)self->directories.items[wd]);
+    self->directories.items[wd] = system__clone_path(path);
+    return true;
+}
+
+// Stop watching the directory `path`, which was moved away, and every
+// directory inside it; they're forgotten once their `IN_IGNORED` arrives.
+void system__directory_watcher_forget(DirectoryWatcher *self,
+                                      const char *path) {
+    StringView prefix = sv_from_cstr(path);
+    for (i32 wd = 0; wd < self->directories.count; wd++) {
+        const char *directory = self->directories.items[wd];
+        if (directory == NULL) continue;
+
+        StringView rest = sv_from_cstr(directory);
+        if (!sv_strip_prefix(&rest, prefix)) continue;
+        if (rest.count && rest.data[0] != SYSTEM_PATH_DELIMITER) continue;
+        inotify_rm_watch(self->fd, wd);
+    }
+}
+#endif // defined(_WIN32)
+
+typedef struct {
+    DirectoryWatcher *watcher;
+    // Where to push the entries which are found, if they're new.
+    FilePaths *changes;
+} System__WatchWalk;
+
+bool system__directory_watcher_visit(WalkEntry entry) {
+    System__WatchWalk *walk = entry.user_data;
+    if (walk->changes && entry.level > 0) {
+        file_paths_push(walk->changes,
+                        arena_clone_cstr(entry.arena, entry.path));
+    }
+#ifdef __linux__
+    if (entry.type == FILE_TYPE_DIRECTORY) {
+        return system__directory_watcher_watch(walk->watcher, entry.path);
+    }
+#endif // __linux__
+    return true;
+}
+
+#ifdef __linux__
+// Push the changes of every event which is currently queued.
+bool system__directory_watcher_read(DirectoryWatcher *self, Arena *arena,
+                                    FilePaths *changes) {
+    union {
+        struct inotify_event event;
+        char bytes[KiB(4)];
+    } buffer;
+
+    for (;;) {
+        ssize_t count = read(self->fd, buffer.bytes, sizeof(buffer.bytes));
+        if (count < 0) {
+            if (errno == EAGAIN) return true;
+            if (errno == EINTR) continue;
+            log_error("Failed to read directory changes: %s", strerror(errno));
+            return false;
+        }
+
+        for (i32 i = 0; i < count;) {
+            struct inotify_event *event =
+                (struct inotify_event *)(buffer.bytes + i);
+            i += sizeof(*event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                for (i32 j = 0; j < self->roots.count; j++) {
+                    file_paths_push(changes, arena_clone_cstr(
+                                                 arena, self->roots.items[j]));
+                }
+                continue;
+            }
+            if (event->wd < 0 || event->wd >= self->directories.count) continue;
+
+            if (event->mask & IN_IGNORED) {
+                FREE((char *)self->directories.items[event->wd]);
+                self->directories.items[event->wd] = NULL;
+                continue;
+            }
+
+            const char *directory = self->directories.items[event->wd];
+            if (directory == NULL) continue;
+
+            // The directory itself was deleted or moved away; its parent
+            // reports that too, but roots have no watched parent. A moved
+            // directory isn't at its path anymore, so it's forgotten
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                file_paths_push(changes, arena_clone_cstr(arena, directory));
+                if (event->mask & IN_MOVE_SELF) {
+                    system__directory_watcher_forget(self, directory);
+                }
+                continue;
+            }
+            if (event->len == 0) continue;
+
+            char *path = arena_sprintf(
+                arena, "%s" SYSTEM_PATH_DELIMITER_STRING "%s", directory,
+                event->name);
+            file_paths_push(changes, path);
+
+            if (!(event->mask & IN_ISDIR)) continue;
+            if (event->mask & IN_MOVED_FROM) {
+                system__directory_watcher_forget(self, path);
+            } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                // Entries may have been created before the watch was added, so
+                // they're all reported as changes
+                System__WatchWalk walk = {.watcher = self, .changes = changes};
+                if (!WALK_DIRECTORY(arena, path,
+                                    system__directory_watcher_visit,
+                                    .user_data = &walk))
+                    return false;
+            }
+        }
+    }
+}
+#endif // __linux__
+
+// Sort and deduplicate the changes pushed from `start` onwards.
+i8 system__directory_watcher_finish(FilePaths *changes, i32 start) {
+    i32 count = changes->count - start;
+    if (count == 0) return 0;
+
+    FilePath *items = changes->items + start;
+    qsort(items, count, sizeof(*items), system__compare_paths);
+    i32 unique = 1;
+    for (i32 i = 1; i < count; i++) {
+        if (strcmp(items[i], items[unique - 1]) == 0) continue;
+        items[unique++] = items[i];
+    }
+    changes->count = start + unique;
+    return 1;
+}
+
+bool directory_watcher_open(Arena *arena, const char *root,
+                            DirectoryWatcher *self) {
+    *self = (DirectoryWatcher){0};
+#if defined(_WIN32)
+#elif defined(__linux__)
+    self->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (self->fd < 0) {
+        log_error("Failed to watch directory '%s': %s", root, strerror(errno));
+        return false;
+    }
+    self->roots = file_paths_new(NULL, 4);
+    self->directories = file_paths_new(NULL, 64);
+#else
+    UNUSED(arena);
+    log_error("Failed to watch directory '%s': not supported on this platform",
+              root);
+    return false;
+#endif // defined(_WIN32)
+
+    if (!directory_watcher_add(arena, self, root)) {
+        directory_watcher_close(self);
+        return false;
+    }
+    return true;
+}
+
+bool directory_watcher_add(Arena *arena, DirectoryWatcher *self,
+                           const char *root) {
+#if defined(_WIN32)
+    UNUSED(arena);
+    if (self->root_count == MAXIMUM_WAIT_OBJECTS) {
+        log_error("Failed to watch directory '%s': too many roots", root);
+        return false;
+    }
+
+    struct System__WatchedRoot *watched = MALLOC(sizeof(*watched));
+    ASSERT(watched != NULL, "unable to allocate memory for watched root");
+    *watched = (struct System__WatchedRoot){0};
+    watched->path = MALLOC(strlen(root) + 1);
+    ASSERT(watched->path != NULL, "unable to allocate memory for path");
+    MEMCPY(watched->path, root, strlen(root) + 1);
+
+    watched->dir = CreateFile(
+        root, FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+        OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (watched->dir == INVALID_HANDLE_VALUE) {
+        log_error("Failed to open directory '%s': %s", root,
+                  system__win32_error_message(GetLastError()));
+        system__watched_root_close(watched);
+        return false;
+    }
+
+    watched->overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (watched->overlapped.hEvent == NULL) {
+        log_error("Failed to watch directory '%s': %s", root,
+                  system__win32_error_message(GetLastError()));
+        system__watched_root_close(watched);
+        return false;
+    }
+
+    if (!system__watched_root_read(watched)) {
+        system__watched_root_close(watched);
+        return false;
+    }
+    self->roots[self->root_count++] = watched;
+    return true;
+#elif defined(__linux__)
+    file_paths_push(&self->roots, system__clone_path(root));
+
+    Lifetime lt = lifetime_begin(arena);
+    System__WatchWalk walk = {.watcher = self};
+    bool result =
+        WALK_DIRECTORY(lt.arena, root, system__directory_watcher_visit,
+                       .user_data = &walk);
+    lifetime_end(lt);
+    return result;
+#else
+    UNUSED(arena);
+    UNUSED(self);
+    log_error("Failed to watch directory '%s': not supported on this platform",
+              root);
+    return false;
+#endif // defined(_WIN32)
+}
+
+i8 directory_watcher_next(DirectoryWatcher *self, Arena *arena, i32 timeout_ms,
+                          FilePaths *changes) {
+    i32 start = changes->count;
+#if defined(_WIN32)
+    HANDLE events[MAXIMUM_WAIT_OBJECTS];
+    for (i32 i = 0; i < self->root_count; i++) {
+        events[i] = self->roots[i]->overlapped.hEvent;
+    }
+
+    DWORD timeout = timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms;
+    for (;;) {
+        DWORD result =
+            WaitForMultipleObjects(self->root_count, events, FALSE, timeout);
+        if (result == WAIT_TIMEOUT) break;
+        if (result >= WAIT_OBJECT_0 + self->root_count) {
+            log_error("Failed to wait for directory changes: %s",
+                      system__win32_error_message(GetLastError()));
+            return -1;
+        }
+
+        if (!system__watched_root_collect(self->roots[result - WAIT_OBJECT_0],
+                                          arena, changes))
+            return -1;
+        timeout = DIRECTORY_WATCHER_SETTLE_MS;
+    }
+#elif defined(__linux__)
+    struct pollfd pfd = {.fd = self->fd, .events = POLLIN};
+    i32 timeout = timeout_ms;
+    for (;;) {
+        i32 ready = poll(&pfd, 1, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            log_error("Failed to wait for directory changes: %s",
+                      strerror(errno));
+            return -1;
+        }
+        if (ready == 0) break;
+
+        if (!system__directory_watcher_read(self, arena, changes)) return -1;
+        timeout = DIRECTORY_WATCHER_SETTLE_MS;
+    }
+#else
+    UNUSED(self);
+    UNUSED(arena);
+    UNUSED(timeout_ms);
+    UNREACHABLE("directory watchers can't be opened on this platform");
+#endif // defined(_WIN32)
+
+    return system__directory_watcher_finish(changes, start);
+}
+
+void directory_watcher_close(DirectoryWatcher *self) {
+#if defined(_WIN32)
+    for (i32 i = 0; i < self->root_count; i++) {
+        system__watched_root_close(self->roots[i]);
+    }
+    self->root_count = 0;
+#elif defined(__linux__)
+    if (self->fd >= 0) close(self->fd);
+    for (i32 i = 0; i < self->roots.count; i++) {
+        FREE((char *)self->roots.items[i]);
+    }
+    for (i32 i = 0; i < self->directories.count; i++) {
+        FREE((char *)self->directories.items[i]);
+    }
+    FREE(self->roots.items);
+    FREE(self->directories.items);
+    *self = (DirectoryWatcher){.fd = -1};
+#else
+    UNUSED(self);
+#endif // defined(_WIN32)
+}
+
 #endif // BOOKSTORE_IMPLEMENTATION
 
 #endif // SYSTEM_H_
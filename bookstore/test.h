@@ -84,10 +84,11 @@ void test__expect(bool cond, const char *message);
         assert(strlen((message)) < TEST_MAX_LABEL_LENGTH &&                    \
                "DESCRIBE message too long - you can manually increase "        \
                "TEST_MAX_LABEL_LENGTH");                                       \
-        test__context.start_fails = test__context.fails;                       \
-        test__context.start_oks = test__context.oks;                           \
-        test__context.start_before_hooks = test__context.before_hooks.count;   \
-        test__context.start_after_hooks = test__context.after_hooks.count;     \
+        /* Nested suites restore these as they end, so they can't be shared */ \
+        i32 test__start_fails = test__context.fails;                           \
+        i32 test__start_oks = test__context.oks;                               \
+        i32 test__start_before_hooks = test__context.before_hooks.count;       \
+        i32 test__start_after_hooks = test__context.after_hooks.count;         \
         test__labels_push(&test__context.describe_labels, message);            \
         {                                                                      \
             Lifetime test__lt = lifetime_begin(test__arena);                   \
@@ -98,10 +99,10 @@ void test__expect(bool cond, const char *message);
             lifetime_end(test__lt);                                            \
         }                                                                      \
         do block while (0);                                                    \
-        test__context.before_hooks.count = test__context.start_before_hooks;   \
-        test__context.after_hooks.count = test__context.start_after_hooks;     \
+        test__context.before_hooks.count = test__start_before_hooks;           \
+        test__context.after_hooks.count = test__start_after_hooks;             \
         LogLevel level;                                                        \
-        if (test__context.fails > test__context.start_fails) {                 \
+        if (test__context.fails > test__start_fails) {                         \
             level = LOG_ERROR;                                                 \
         } else {                                                               \
             level = LOG_INFO;                                                  \
@@ -113,15 +114,13 @@ void test__expect(bool cond, const char *message);
             test__labels_render(&test__sb, test__context.describe_labels);     \
             log_with_level(level, "%s:%d: " SB_FMT ": %d failed, %d ok",       \
                            __FILE__, __LINE__, SB_ARG(test__sb),               \
-                           test__context.fails - test__context.start_fails,    \
-                           test__context.oks - test__context.start_oks);       \
+                           test__context.fails - test__start_fails,            \
+                           test__context.oks - test__start_oks);               \
             lifetime_end(test__lt);                                            \
         }                                                                      \
         test__labels_pop(&test__context.describe_labels);                      \
         if (test__context.describe_labels.count == 0) {                        \
             fprintf(stderr, "\n");                                             \
-            test__context.fails = test__context.start_fails;                   \
-            test__context.oks = test__context.start_oks;                       \
         }                                                                      \
     } while (0)
 // Define a test to run.
@@ -339,8 +338,7 @@ typedef struct {
     Test__Hooks after_hooks;
     Test__Labels describe_labels;
     Test__Label it_label;
-    i32 start_before_hooks, start_after_hooks;
-    i32 fails, start_fails, oks, start_oks;
+    i32 fails, oks;
     bool should_fail;
 } Test__InternalContext;
 
@@ -348,10 +346,12 @@ void test__labels_render(StringBuilder *test__sb, Test__Labels labels);
 void test__labels_render_with_it(StringBuilder *test__sb, Test__Labels labels,
                                  Test__Label it_label);
 
-global Test__InternalContext test__context = {0};
+extern Test__InternalContext test__context;
 
 #ifdef BOOKSTORE_IMPLEMENTATION
 
+Test__InternalContext test__context = {0};
+
 ARRAY_DEFINE_PREFIX(Test__Label, Test__Labels, test__labels)
 
 void test__expect(bool cond, const char *message) {
@@ -0,0 +1,503 @@
+/* thread.h */
+/* Threads, locks and a work-stealing thread pool on Windows and POSIX */
+
+#ifndef THREAD_H_
+#define THREAD_H_
+
+#include "./arena.h"
+#include "./basic.h"
+#include <stdbool.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif // WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#ifdef _WIN32
+// A thread of execution.
+typedef HANDLE Thread;
+// A mutual exclusion lock.
+typedef SRWLOCK Mutex;
+// A condition variable, to wait on while holding a `Mutex`.
+typedef CONDITION_VARIABLE Condition;
+#else
+// A thread of execution.
+typedef pthread_t Thread;
+// A mutual exclusion lock.
+typedef pthread_mutex_t Mutex;
+// A condition variable, to wait on while holding a `Mutex`.
+typedef pthread_cond_t Condition;
+#endif // _WIN32
+
+// The function a `Thread` runs, with the `data` it was started with.
+typedef void (*ThreadFunction)(void *data);
+
+// Start a new thread running `function` with `data`.
+//
+// Logs an error and returns `false` if some error occurs.
+bool thread_start(Thread *self, ThreadFunction function, void *data);
+// Wait for a thread to finish running.
+void thread_join(Thread self);
+// Return the number of processors available on the current machine, and so
+// how many threads can run at once.
+i32 processors_available(void);
+
+// Initialize a mutex.
+void mutex_init(Mutex *self);
+// Destroy a mutex which was initialized with `mutex_init`.
+void mutex_destroy(Mutex *self);
+// Lock a mutex, waiting for the thread holding it to unlock it first.
+void mutex_lock(Mutex *self);
+// Unlock a mutex locked with `mutex_lock`.
+void mutex_unlock(Mutex *self);
+
+// Initialize a condition variable.
+void condition_init(Condition *self);
+// Destroy a condition variable which was initialized with `condition_init`.
+void condition_destroy(Condition *self);
+// Unlock `mutex` and wait for the condition to be signalled, locking `mutex`
+// again before returning. Waits may also end spuriously, so the awaited state
+// should always be checked again in a loop.
+void condition_wait(Condition *self, Mutex *mutex);
+// Wake up one of the threads waiting on the condition.
+void condition_signal(Condition *self);
+// Wake up all of the threads waiting on the condition.
+void condition_broadcast(Condition *self);
+
+// Atomically add `amount` to `*value`, returning the result.
+i64 atomic_add_i64(volatile i64 *value, i64 amount);
+// Atomically load `*value`.
+i64 atomic_load_i64(volatile i64 *value);
+// Atomically store `amount` into `*value`.
+void atomic_store_i64(volatile i64 *value, i64 amount);
+
+typedef struct ThreadPool ThreadPool;
+typedef struct ThreadPoolWorker ThreadPoolWorker;
+
+// A task run by a `ThreadPool`, on one of its workers, with the `data` it was
+// submitted with.
+typedef void (*ThreadPoolTask)(ThreadPoolWorker *worker, void *data);
+
+// A task submitted to a `ThreadPool`, along with its data.
+typedef struct {
+    ThreadPoolTask task;
+    void *data;
+} ThreadPool__Job;
+
+// A worker thread of a `ThreadPool`.
+struct ThreadPoolWorker {
+    // The pool this worker belongs to.
+    ThreadPool *pool;
+    // The index of this worker in the pool.
+    i32 index;
+    // An arena which only this worker uses, so its tasks can allocate from it
+    // without any locking. It lives as long as the pool does.
+    Arena *arena;
+    // The jobs of this worker, as a ring buffer; the worker takes the newest
+    // job from the back, and other workers steal the oldest from the front.
+    ThreadPool__Job *jobs;
+    i32 head;
+    i32 count;
+    i32 capacity;
+    Mutex lock;
+    Thread thread;
+    // The state for choosing which worker to steal from.
+    u32 random;
+};
+
+// A pool of worker threads which run tasks, where each worker has its own
+// queue of jobs and steals jobs from the others once it runs out.
+struct ThreadPool {
+    ThreadPoolWorker *workers;
+    i32 worker_count;
+    // Protects the state below, and is used with the conditions.
+    Mutex lock;
+    // Signalled when jobs are submitted, or when the pool is destroyed.
+    Condition wake;
+    // Signalled when all the jobs are finished.
+    Condition done;
+    // The amount of jobs which were submitted but haven't finished yet.
+    volatile i64 pending;
+    // The amount of jobs which are in the workers' queues.
+    volatile i64 queued;
+    // The amount of workers waiting for jobs.
+    volatile i64 sleeping;
+    // The worker to submit the next job from outside the pool to.
+    volatile i64 next;
+    bool quit;
+};
+
+// Create a pool of `count` worker threads (or one for each CPU if `count` is
+// `0`), each with an arena of `arena_capacity` bytes. The pool itself is
+// allocated with `MALLOC`, since its locks need to be aligned.
+//
+// Logs an error and returns `NULL` if some error occurs.
+ThreadPool *thread_pool_new(i32 count, i32 arena_capacity);
+// Submit `task` to run on the pool with `data`. Tasks running on the pool
+// should pass their own `worker`, so the job goes to the back of its queue;
+// otherwise, pass `NULL`.
+void thread_pool_submit(ThreadPool *self, ThreadPoolWorker *worker,
+                        ThreadPoolTask task, void *data);
+// Wait until all the jobs submitted to the pool are finished, including the
+// jobs submitted by those jobs.
+void thread_pool_wait(ThreadPool *self);
+// Wait for the jobs of the pool to finish, and then stop its workers and free
+// the pool's memory.
+void thread_pool_destroy(ThreadPool *self);
+
+#ifdef BOOKSTORE_IMPLEMENTATION
+
+#include <errno.h>
+#include <string.h>
+
+typedef struct {
+    ThreadFunction function;
+    void *data;
+} Thread__Start;
+
+#ifdef _WIN32
+DWORD WINAPI thread__run(LPVOID parameter) {
+#else
+void *thread__run(void *parameter) {
+#endif // _WIN32
+    Thread__Start start = *(Thread__Start *)parameter;
+    FREE(parameter);
+    start.function(start.data);
+    return 0;
+}
+
+bool thread_start(Thread *self, ThreadFunction function, void *data) {
+    Thread__Start *start = MALLOC(sizeof(Thread__Start));
+    ASSERT(start != NULL, "unable to allocate memory for thread");
+    start->function = function;
+    start->data = data;
+
+#ifdef _WIN32
+    *self = CreateThread(NULL, 0, thread__run, start, 0, NULL);
+    if (*self == NULL) {
+        log_error("Failed to start thread: error %lu", GetLastError());
+        FREE(start);
+        return false;
+    }
+#else
+    i32 error = pthread_create(self, NULL, thread__run, start);
+    if (error != 0) {
+        log_error("Failed to start thread: %s", strerror(error));
+        FREE(start);
+        return false;
+    }
+#endif // _WIN32
+    return true;
+}
+
+void thread_join(Thread self) {
+#ifdef _WIN32
+    WaitForSingleObject(self, INFINITE);
+    CloseHandle(self);
+#else
+    pthread_join(self, NULL);
+#endif // _WIN32
+}
+
+i32 processors_available(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return MAX((i32)info.dwNumberOfProcessors, 1);
+#else
+    return MAX((i32)sysconf(_SC_NPROCESSORS_ONLN), 1);
+#endif // _WIN32
+}
+
+void mutex_init(Mutex *self) {
+#ifdef _WIN32
+    InitializeSRWLock(self);
+#else
+    pthread_mutex_init(self, NULL);
+#endif // _WIN32
+}
+
+void mutex_destroy(Mutex *self) {
+#ifdef _WIN32
+    UNUSED(self);
+#else
+    pthread_mutex_destroy(self);
+#endif // _WIN32
+}
+
+void mutex_lock(Mutex *self) {
+#ifdef _WIN32
+    AcquireSRWLockExclusive(self);
+#else
+    pthread_mutex_lock(self);
+#endif // _WIN32
+}
+
+void mutex_unlock(Mutex *self) {
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(self);
+#else
+    pthread_mutex_unlock(self);
+#endif // _WIN32
+}
+
+void condition_init(Condition *self) {
+#ifdef _WIN32
+    InitializeConditionVariable(self);
+#else
+    pthread_cond_init(self, NULL);
+#endif // _WIN32
+}
+
+void condition_destroy(Condition *self) {
+#ifdef _WIN32
+    UNUSED(self);
+#else
+    pthread_cond_destroy(self);
+#endif // _WIN32
+}
+
+void condition_wait(Condition *self, Mutex *mutex) {
+#ifdef _WIN32
+    SleepConditionVariableSRW(self, mutex, INFINITE, 0);
+#else
+    pthread_cond_wait(self, mutex);
+#endif // _WIN32
+}
+
+void condition_signal(Condition *self) {
+#ifdef _WIN32
+    WakeConditionVariable(self);
+#else
+    pthread_cond_signal(self);
+#endif // _WIN32
+}
+
+void condition_broadcast(Condition *self) {
+#ifdef _WIN32
+    WakeAllConditionVariable(self);
+#else
+    pthread_cond_broadcast(self);
+#endif // _WIN32
+}
+
+i64 atomic_add_i64(volatile i64 *value, i64 amount) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return InterlockedAdd64(value, amount);
+#else
+    return __atomic_add_fetch(value, amount, __ATOMIC_SEQ_CST);
+#endif // defined(_MSC_VER) && !defined(__clang__)
+}
+
+i64 atomic_load_i64(volatile i64 *value) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return InterlockedCompareExchange64(value, 0, 0);
+#else
+    return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+#endif // defined(_MSC_VER) && !defined(__clang__)
+}
+
+void atomic_store_i64(volatile i64 *value, i64 amount) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    InterlockedExchange64(value, amount);
+#else
+    __atomic_store_n(value, amount, __ATOMIC_SEQ_CST);
+#endif // defined(_MSC_VER) && !defined(__clang__)
+}
+
+// Take the newest job from the back of the worker's own queue.
+bool thread__pool_pop(ThreadPoolWorker *worker, ThreadPool__Job *job) {
+    bool found = false;
+    mutex_lock(&worker->lock);
+    if (worker->count > 0) {
+        worker->count--;
+        *job = worker->jobs[(worker->head + worker->count) % worker->capacity];
+        found = true;
+    }
+    mutex_unlock(&worker->lock);
+    return found;
+}
+
+// Take the oldest job from the front of another worker's queue, which is
+// usually the one which leads to the most work.
+bool thread__pool_steal(ThreadPoolWorker *victim, ThreadPool__Job *job) {
+    bool found = false;
+    mutex_lock(&victim->lock);
+    if (victim->count > 0) {
+        *job = victim->jobs[victim->head];
+        victim->head = (victim->head + 1) % victim->capacity;
+        victim->count--;
+        found = true;
+    }
+    mutex_unlock(&victim->lock);
+    return found;
+}
+
+bool thread__pool_find_job(ThreadPoolWorker *worker, ThreadPool__Job *job) {
+    if (thread__pool_pop(worker, job)) return true;
+
+    ThreadPool *pool = worker->pool;
+    // Start stealing from a random worker, so thieves don't all pile up on
+    // the same victim
+    worker->random ^= worker->random << 13;
+    worker->random ^= worker->random >> 17;
+    worker->random ^= worker->random << 5;
+    i32 start = worker->random % pool->worker_count;
+    for (i32 i = 0; i < pool->worker_count; i++) {
+        ThreadPoolWorker *victim =
+            &pool->workers[(start + i) % pool->worker_count];
+        if (victim != worker && thread__pool_steal(victim, job)) return true;
+    }
+    return false;
+}
+
+void thread__pool_work(void *data) {
+    ThreadPoolWorker *worker = data;
+    ThreadPool *pool = worker->pool;
+
+    for (;;) {
+        ThreadPool__Job job;
+        if (thread__pool_find_job(worker, &job)) {
+            atomic_add_i64(&pool->queued, -1);
+            job.task(worker, job.data);
+
+            if (atomic_add_i64(&pool->pending, -1) == 0) {
+                mutex_lock(&pool->lock);
+                condition_broadcast(&pool->done);
+                mutex_unlock(&pool->lock);
+            }
+            continue;
+        }
+
+        // Announce that this worker is going to sleep before checking for new
+        // jobs, so either it sees the job, or the submitter sees it sleeping
+        mutex_lock(&pool->lock);
+        atomic_add_i64(&pool->sleeping, 1);
+        while (!pool->quit && atomic_load_i64(&pool->queued) == 0) {
+            condition_wait(&pool->wake, &pool->lock);
+        }
+        atomic_add_i64(&pool->sleeping, -1);
+        bool quit = pool->quit;
+        mutex_unlock(&pool->lock);
+        if (quit) return;
+    }
+}
+
+// Stop the first `started` workers of the pool, and free the memory of all of
+// them.
+void thread__pool_free(ThreadPool *self, i32 started) {
+    mutex_lock(&self->lock);
+    self->quit = true;
+    condition_broadcast(&self->wake);
+    mutex_unlock(&self->lock);
+
+    for (i32 i = 0; i < started; i++) thread_join(self->workers[i].thread);
+
+    for (i32 i = 0; i < self->worker_count; i++) {
+        ThreadPoolWorker *worker = &self->workers[i];
+        FREE(worker->jobs);
+        arena_destroy(worker->arena);
+        mutex_destroy(&worker->lock);
+    }
+
+    condition_destroy(&self->done);
+    condition_destroy(&self->wake);
+    mutex_destroy(&self->lock);
+    FREE(self->workers);
+    FREE(self);
+}
+
+ThreadPool *thread_pool_new(i32 count, i32 arena_capacity) {
+    if (count <= 0) count = processors_available();
+
+    ThreadPool *self = MALLOC(sizeof(ThreadPool));
+    ASSERT(self != NULL, "unable to allocate memory for thread pool");
+    memset(self, 0, sizeof(*self));
+    self->workers = MALLOC(count * sizeof(ThreadPoolWorker));
+    ASSERT(self->workers != NULL, "unable to allocate memory for thread pool");
+    memset(self->workers, 0, count * sizeof(ThreadPoolWorker));
+    mutex_init(&self->lock);
+    condition_init(&self->wake);
+    condition_init(&self->done);
+
+    for (i32 i = 0; i < count; i++) {
+        ThreadPoolWorker *worker = &self->workers[i];
+        worker->pool = self;
+        worker->index = i;
+        worker->arena = arena_new(arena_capacity);
+        worker->capacity = 64;
+        worker->jobs = MALLOC(worker->capacity * sizeof(ThreadPool__Job));
+        ASSERT(worker->jobs != NULL, "unable to allocate memory for jobs");
+        worker->random = 0x9E3779B9u * (i + 1);
+        mutex_init(&worker->lock);
+    }
+
+    self->worker_count = count;
+    for (i32 i = 0; i < count; i++) {
+        if (!thread_start(&self->workers[i].thread, thread__pool_work,
+                          &self->workers[i])) {
+            thread__pool_free(self, i);
+            return NULL;
+        }
+    }
+
+    return self;
+}
+
+void thread_pool_submit(ThreadPool *self, ThreadPoolWorker *worker,
+                        ThreadPoolTask task, void *data) {
+    if (worker == NULL) {
+        i64 next = atomic_add_i64(&self->next, 1);
+        worker = &self->workers[next % self->worker_count];
+    }
+
+    atomic_add_i64(&self->pending, 1);
+
+    mutex_lock(&worker->lock);
+    if (worker->count == worker->capacity) {
+        // Grow the ring buffer, moving the jobs to the start of it in order
+        i32 capacity = worker->capacity * 2;
+        ThreadPool__Job *jobs = MALLOC(capacity * sizeof(ThreadPool__Job));
+        ASSERT(jobs != NULL, "unable to allocate memory for jobs");
+        for (i32 i = 0; i < worker->count; i++) {
+            jobs[i] = worker->jobs[(worker->head + i) % worker->capacity];
+        }
+        FREE(worker->jobs);
+        worker->jobs = jobs;
+        worker->head = 0;
+        worker->capacity = capacity;
+    }
+    worker->jobs[(worker->head + worker->count) % worker->capacity] =
+        (ThreadPool__Job){task, data};
+    worker->count++;
+    mutex_unlock(&worker->lock);
+
+    atomic_add_i64(&self->queued, 1);
+    if (atomic_load_i64(&self->sleeping) > 0) {
+        mutex_lock(&self->lock);
+        condition_signal(&self->wake);
+        mutex_unlock(&self->lock);
+    }
+}
+
+void thread_pool_wait(ThreadPool *self) {
+    mutex_lock(&self->lock);
+    while (atomic_load_i64(&self->pending) > 0) {
+        condition_wait(&self->done, &self->lock);
+    }
+    mutex_unlock(&self->lock);
+}
+
+void thread_pool_destroy(ThreadPool *self) {
+    thread_pool_wait(self);
+    thread__pool_free(self, self->worker_count);
+}
+
+#endif // BOOKSTORE_IMPLEMENTATION
+
+#endif // THREAD_H_
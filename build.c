@@ -5,16 +5,90 @@
 #include "./bookstore/basic.h"
 #include "./bookstore/command.h"
 #include "./bookstore/flag.h"
+#include "./bookstore/glob.h"
 #include "./bookstore/string.h"
 #include "./bookstore/system.h"
+#include "./bookstore/thread.h"
 
 #define BIN_DIR         "bin"
 #define BOOKSTORE_DIR   "bookstore"
 #define TEST_OUTPUT_DIR BIN_DIR SYSTEM_PATH_DELIMITER_STRING "test"
 #define TEST_INPUT_DIR  "test"
-
-bool build_tests(Arena *arena, FilePaths tests, FilePaths dependencies);
-bool run_tests(Arena *arena, FilePaths tests);
+#define BUILD_DB_PATH   BIN_DIR SYSTEM_PATH_DELIMITER_STRING "build.db"
+#define IMPL_DIR        BIN_DIR SYSTEM_PATH_DELIMITER_STRING "impl"
+#define IMPL_HEADER     IMPL_DIR SYSTEM_PATH_DELIMITER_STRING "bookstore.h"
+#define IMPL_SOURCE     IMPL_DIR SYSTEM_PATH_DELIMITER_STRING "bookstore.c"
+#define IMPL_OBJECT                                                            \
+    IMPL_DIR SYSTEM_PATH_DELIMITER_STRING                                      \
+        "bookstore" COMMAND_CC_OBJECT_EXTENSION
+#ifdef COMMAND_CC_PCH
+#define IMPL_PCH IMPL_HEADER COMMAND_CC_PCH_EXTENSION
+#endif // COMMAND_CC_PCH
+
+// The most inputs a step of the build has besides those in its depfile.
+#define BUILD_STEP_MAX_INPUTS 3
+
+// What's known about the files of the build, shared by every step of it.
+typedef struct {
+    // Every file is stat'd once, while it's walked or checked for rebuilding
+    StatCache stat_cache;
+    // The hashes every output was last built from
+    BuildDb db;
+    // The cache of compiled tests, or `NULL` if it isn't used
+    CompileCache *compile_cache;
+    // The headers of the library
+    FilePaths headers;
+    // Whether every test is compiled together with the implementation as one
+    // translation unit, instead of being linked against its object
+    bool unity;
+    // Whether every test includes the precompiled declarations of the headers
+    bool pch;
+} BuildState;
+
+// An output which is being built, to be recorded in the build database once
+// it was written.
+typedef struct {
+    const char *output;
+    Hash command;
+    // The inputs of the output besides the headers listed in its depfile,
+    // starting with the source which is compiled
+    FilePath inputs[BUILD_STEP_MAX_INPUTS];
+    i32 input_count;
+    // The key of the output in the compile cache, if it's used and the output
+    // wasn't restored from it.
+    Hash cache_key;
+    // The modification time of the output before the build, or `-1` if it
+    // didn't exist.
+    i64 mtime_ns;
+} BuildStep;
+
+ARRAY_TYPEDEF(BuildStep, BuildSteps);
+ARRAY_DEFINE_PREFIX(BuildStep, BuildSteps, build_steps)
+
+// How the tests are run.
+typedef struct {
+    // The most tests which run at once
+    i32 jobs;
+    // Whether the tests which are still running are killed once one fails,
+    // instead of reporting every failure
+    bool fail_fast;
+} TestRunOpt;
+
+// A test which is running, with its output captured into `log`.
+typedef struct {
+    const char *path;
+    const char *log;
+} RunningTest;
+
+ARRAY_TYPEDEF(RunningTest, RunningTests);
+ARRAY_DEFINE_PREFIX(RunningTest, RunningTests, running_tests)
+
+bool collect_path(WalkEntry entry);
+bool collect_files(Arena *arena, const char *dir, const char *pattern,
+                   StatCache *cache, FilePaths *out);
+bool build_tests(Arena *arena, BuildState *state, FilePaths tests);
+bool run_tests(Arena *arena, FilePaths tests, TestRunOpt opt);
+bool watch_tests(Arena *arena, BuildState *state, bool test, TestRunOpt opt);
 
 void usage(FILE *stream) {
     // clang-format off
@@ -46,6 +120,34 @@ int main(int argc, const char **argv) {
                   .description = "Print this help information and exit.");
     bool *debug = FLAG_BOOL("-debug", .alias = "d",
                             .description = "Print debug information.");
+    StringView *cache_dir = FLAG_STRING(
+        "-cache", .description = "Restore the tests from the compile cache in "
+                                 "this directory, and store them there.");
+    u64 *cache_size = FLAG_U64(
+        "-cache-size", ._default = COMPILE_CACHE_MAX_SIZE >> 20,
+        .description = "The maximum size of the compile cache, in MiB.");
+    bool *unity = FLAG_BOOL(
+        "-unity",
+        .description = "Compile every test together with the implementation "
+                       "as one translation unit, instead of linking every "
+                       "test against one object with it.");
+    bool *pch = FLAG_BOOL(
+        "-pch", .description = "Precompile the declarations of the headers "
+                               "once, and include them into every test.");
+    u64 *jobs = FLAG_U64(
+        "-jobs", .alias = "j",
+        .description = "The most tests which run at once. If 0, runs as many "
+                       "as there are processors.");
+    StringView *shard = FLAG_STRING(
+        "-shard", .description = "Only build and run the i-th of n shards of "
+                                 "the tests, given as i/n.");
+    bool *fail_fast = FLAG_BOOL(
+        "-fail-fast", .description = "Stop running the tests, and kill those "
+                                     "still running, once one fails.");
+    bool *watch = FLAG_BOOL(
+        "-watch", .alias = "w",
+        .description = "Keep watching the sources, and rebuild and rerun "
+                       "the affected tests whenever they change.");
 
     if (!FLAG_PARSE_MAIN(arena, argc, argv, .parse_all = true)) {
         usage(stderr);
@@ -57,11 +159,16 @@ int main(int argc, const char **argv) {
         min_log_level = LOG_DEBUG;
     }
 
-    FilePaths dependencies = file_paths_new(arena, 256);
-    list_directory(arena, BOOKSTORE_DIR, &dependencies);
+    BuildState state = {.unity = *unity, .pch = *pch};
+    stat_cache_init(&state.stat_cache);
+
+    state.headers = file_paths_new(arena, 256);
+    if (!collect_files(arena, BOOKSTORE_DIR, "*.h", &state.stat_cache,
+                       &state.headers))
+        return 1;
 
     Lifetime lt = lifetime_begin(arena);
-    SELF_REBUILD_DEPENDENCIES(lt.arena, argc, argv, dependencies);
+    SELF_REBUILD_DEPENDENCIES(lt.arena, argc, argv, state.headers);
     lifetime_end(lt);
 
     if (*help) {
@@ -78,52 +185,121 @@ int main(int argc, const char **argv) {
     }
 
     if (args_index_of(args, sv_from_cstr("clean")) >= 0) {
-        if (!delete_directory_recursively(arena, BIN_DIR)) return 1;
+        if (!delete_directory_recursively_parallel(arena, BIN_DIR, 0)) return 1;
+    }
+
+    bool build = args_index_of(args, sv_from_cstr("build")) >= 0;
+    bool test = args_index_of(args, sv_from_cstr("test")) >= 0;
+    if (*watch && !build && !test) {
+        usage(stderr);
+        fprintf(stderr, "ERROR: --watch needs the build or test command\n");
+        return 1;
+    }
+    // Watching reruns the tests which changed, which have to be rebuilt first
+    if (*watch) build = true;
+    if (*unity && *pch) {
+        usage(stderr);
+        fprintf(stderr, "ERROR: --pch can't be used with --unity\n");
+        return 1;
+    }
+    i32 shard_index = 1, shard_count = 1;
+    if (shard->count > 0) {
+        if (*watch) {
+            usage(stderr);
+            fprintf(stderr, "ERROR: --shard can't be used with --watch\n");
+            return 1;
+        }
+        if (!build_parse_shard(*shard, &shard_index, &shard_count)) {
+            usage(stderr);
+            fprintf(stderr, "ERROR: invalid shard '" SV_FMT "'\n",
+                    SV_ARG(*shard));
+            return 1;
+        }
+    }
+    TestRunOpt run_opt = {
+        .jobs = *jobs > 0 ? (i32)*jobs : processors_available(),
+        .fail_fast = *fail_fast,
+    };
+#ifndef COMMAND_CC_PCH
+    if (*pch) {
+        log_warn("This compiler can't precompile headers, ignoring --pch");
+        state.pch = false;
+    }
+#endif // COMMAND_CC_PCH
+
+    if (!build_db_open(arena, BUILD_DB_PATH, &state.db)) return 1;
+
+    CompileCache compile_cache;
+    state.compile_cache = NULL;
+    if (cache_dir->count > 0) {
+        const char *dir = arena_sprintf(arena, SV_FMT, SV_ARG(*cache_dir));
+        if (!compile_cache_open(arena, dir, (i64)*cache_size << 20,
+                                &compile_cache))
+            return 1;
+        state.compile_cache = &compile_cache;
     }
 
     FilePaths tests = file_paths_new(arena, 64);
-    list_directory(arena, TEST_INPUT_DIR, &tests);
+    if (!collect_files(arena, TEST_INPUT_DIR, "*.c", &state.stat_cache,
+                       &tests))
+        return 1;
 
-    if (args_index_of(args, sv_from_cstr("build")) >= 0) {
-        if (!build_tests(arena, tests, dependencies)) return 1;
-    }
-    if (args_index_of(args, sv_from_cstr("test")) >= 0) {
-        if (!run_tests(arena, tests)) return 1;
+    // Every shard has to agree on the order of the tests
+    file_paths_sort(tests);
+    i32 count = 0;
+    for (i32 i = 0; i < tests.count; i++) {
+        if (i % shard_count == shard_index - 1) {
+            tests.items[count++] = tests.items[i];
+        }
     }
+    tests.count = count;
 
-    return 0;
-}
+    bool ok = true;
+    if (build) ok = build_tests(arena, &state, tests);
+    if (ok && test) ok = run_tests(arena, tests, run_opt);
 
-bool build_test(Arena *arena, const char *path, FilePaths dependencies,
-                ProcessList *procs, i32 concurrency) {
-    DEFER_SETUP(bool, true);
+    // Failing tests are reported, and then fixed while watching
+    if (*watch) ok = watch_tests(arena, &state, test, run_opt);
 
-    Lifetime lt = lifetime_begin(arena);
+    if (state.compile_cache && !compile_cache_close(arena, &compile_cache)) {
+        ok = false;
+    }
+    build_db_close(&state.db);
+    stat_cache_destroy(&state.stat_cache);
+    return ok ? 0 : 1;
+}
+
+bool collect_files(Arena *arena, const char *dir, const char *pattern,
+                   StatCache *cache, FilePaths *out) {
+    GlobPattern glob;
+    if (!glob_compile(arena, sv_from_cstr(pattern), &glob)) return false;
+    return WALK_DIRECTORY(arena, dir, collect_path, .user_data = out,
+                          .glob = &glob, .stat_cache = cache);
+}
 
-    FilePaths all_dependencies =
-        file_paths_new(lt.arena, dependencies.count + 1);
-    file_paths_push(&all_dependencies, path);
-    file_paths_append_other(&all_dependencies, dependencies);
+bool collect_path(WalkEntry entry) {
+    FilePaths *paths = entry.user_data;
+    file_paths_push(paths, arena_clone_cstr(entry.arena, entry.path));
+    return true;
+}
 
+const char *test_output_path(Arena *arena, const char *path) {
     StringView output_dir = sv_from_cstr(TEST_OUTPUT_DIR);
 
     StringView basename = get_basename(sv_from_cstr(path));
     sv_strip_suffix(&basename, sv_from_cstr(".c"));
 
-    StringBuilder output =
-        sb_new(lt.arena, basename.count + output_dir.count + 2);
+    StringBuilder output = sb_new(arena, basename.count + output_dir.count + 2);
     sb_appendf(&output, SV_FMT SYSTEM_PATH_DELIMITER_STRING SV_FMT,
                SV_ARG(output_dir), SV_ARG(basename));
     sb_push_null(&output);
+    return output.items;
+}
 
-    i8 needs_rebuild = build_needs_rebuild(output.items, all_dependencies);
-    if (needs_rebuild < 0) DEFER_RETURN(false);
-    if (!needs_rebuild) {
-        log_debug("Nothing to do for '%s'", output.items);
-        DEFER_RETURN(true);
-    }
-
-    Command command = command_new(lt.arena, 32);
+// Start a command with the flags everything the tests are built from is
+// compiled with.
+Command cc_command(Arena *arena) {
+    Command command = command_new(arena, 32);
 
     COMMAND_CC(&command);
 
@@ -133,67 +309,511 @@ bool build_test(Arena *arena, const char *path, FilePaths dependencies,
     COMMAND_CC_DEBUG_INFO(&command);
     COMMAND_CC_ADDRESS_SANITIZE(&command);
 
-    COMMAND_CC_DEFINE(lt.arena, &command, "BOOKSTORE_IMPLEMENTATION");
-    COMMAND_CC_OUTPUT(lt.arena, &command, output.items);
+    COMMAND_CC_THREADS(&command);
+
+    return command;
+}
+
+// Get the command which compiles the test at `path`, without its output and
+// depfile.
+Command test_command(Arena *arena, BuildState *state, const char *path) {
+    Command command = cc_command(arena);
+
+    if (state->unity) {
+        COMMAND_CC_DEFINE(arena, &command, "BOOKSTORE_IMPLEMENTATION");
+    } else if (state->pch) {
+        COMMAND_CC_INCLUDE(arena, &command, IMPL_HEADER);
+    }
     COMMAND_CC_INPUTS(&command, path);
+    if (!state->unity) COMMAND_CC_INPUTS(&command, IMPL_OBJECT);
+    return command;
+}
 
-    if (!COMMAND_RUN(lt.arena, &command, .async = procs,
-                     .concurrency = concurrency))
-        DEFER_RETURN(false);
+// Get the inputs of the test at `path` besides the headers it includes.
+BuildStep test_step(BuildState *state, const char *path) {
+    BuildStep step = {.inputs = {path}, .input_count = 1};
+    if (!state->unity) step.inputs[step.input_count++] = IMPL_OBJECT;
+#ifdef IMPL_PCH
+    // The precompiled header isn't listed in the depfile
+    if (state->pch) step.inputs[step.input_count++] = IMPL_PCH;
+#endif // IMPL_PCH
+    return step;
+}
 
-    DEFER_LABEL({ lifetime_end(lt); });
+// Check whether the test at `path` needs to be rebuilt, going by the contents
+// of the headers its last build included.
+i8 test_needs_rebuild(Arena *arena, BuildState *state, const char *path) {
+    Lifetime lt = lifetime_begin(arena);
+    const char *output = test_output_path(lt.arena, path);
+    Command command = test_command(lt.arena, state, path);
+    BuildStep step = test_step(state, path);
+    FilePaths inputs = {.items = step.inputs, .count = step.input_count};
+    i8 result = build_db_needs_rebuild(&state->db, lt.arena, &state->stat_cache,
+                                       output, build_command_hash(command),
+                                       inputs);
+    lifetime_end(lt);
+    return result;
 }
 
-bool build_tests(Arena *arena, FilePaths tests, FilePaths dependencies) {
-    if (!make_directory_recursively(arena, TEST_OUTPUT_DIR)) return false;
+// Check whether `step.output` needs to be built with `command`, filling in
+// the hash of the command and the modification time of the output.
+i8 prepare_step(Arena *arena, BuildState *state, Command command,
+                BuildStep *step) {
+    Lifetime lt = lifetime_begin(arena);
+    FilePaths inputs = {.items = step->inputs, .count = step->input_count};
+    step->command = build_command_hash(command);
+    step->mtime_ns = -1;
 
-    i32 concurrency = 64;
-    ProcessList procs = process_list_new(arena, concurrency);
+    i8 needs_rebuild =
+        build_db_needs_rebuild(&state->db, lt.arena, &state->stat_cache,
+                               step->output, step->command, inputs);
+    lifetime_end(lt);
+    if (needs_rebuild <= 0) {
+        if (!needs_rebuild) log_debug("Nothing to do for '%s'", step->output);
+        return needs_rebuild;
+    }
 
-    for (i32 i = 0; i < tests.count; i++) {
-        if (!build_test(arena, file_paths_get(tests, i), dependencies, &procs,
-                        concurrency))
-            return false;
+    // A failed build may leave the previous output behind, so it's only
+    // recorded if the output was written
+    FileStat stat;
+    i8 exists = get_file_stat(step->output, &stat);
+    if (exists < 0) return -1;
+    if (exists) step->mtime_ns = stat.mtime_ns;
+    return 1;
+}
+
+// Restore `step.output` from the compile cache, if it's used, or fill in the
+// key to store it with once it's built otherwise. Can be called from multiple
+// threads at once.
+//
+// Returns `1` if the output was restored, `0` if it needs to be built, or
+// `-1` if some error occurs.
+i8 restore_step(Arena *arena, BuildState *state, Command command,
+                BuildStep *step) {
+    if (!state->compile_cache) return 0;
+
+    Lifetime lt = lifetime_begin(arena);
+    const char *depfile = arena_sprintf(lt.arena, "%s.d", step->output);
+    // Everything besides the source is read as is by the compiler
+    FilePaths others = {
+        .items = step->inputs + 1,
+        .count = step->input_count - 1,
+    };
+    i8 restored = compile_cache_restore(state->compile_cache, lt.arena,
+                                        command, others, step->output, depfile,
+                                        &step->cache_key);
+    // Restored outputs are still recorded, but aren't stored again
+    if (restored > 0) step->cache_key.count = 0;
+    lifetime_end(lt);
+    return restored;
+}
+
+// Start building `step.output` with `command`, which compiles `step.inputs` and
+// lacks only the output and depfile. Unless `link` is set, the output is an
+// object file or precompiled header instead of an executable.
+bool start_step(Arena *arena, Command command, bool link, BuildStep step,
+                ProcessList *procs, i32 concurrency) {
+    Lifetime lt = lifetime_begin(arena);
+    const char *depfile = arena_sprintf(lt.arena, "%s.d", step.output);
+    COMMAND_CC_DEPFILE(&command, depfile);
+    if (link) {
+        COMMAND_CC_OUTPUT(lt.arena, &command, step.output);
+    } else {
+        COMMAND_CC_OBJECT_OUTPUT(lt.arena, &command, step.output);
     }
 
-    return process_list_wait(procs);
+    const char *stdout_path = COMMAND_CC_DEPFILE_STDOUT(depfile);
+    bool result = COMMAND_RUN(lt.arena, &command, .async = procs,
+                              .concurrency = concurrency,
+                              .stdout_path = stdout_path);
+    lifetime_end(lt);
+    return result;
 }
 
-bool run_test(Arena *arena, const char *path) {
+// Build `step.output` with `command` like `start_step`, unless it's up to date
+// or can be restored from the compile cache.
+//
+// Steps which were started are appended to `steps`, to be recorded with
+// `record_step` once `procs` are finished.
+bool build_step(Arena *arena, BuildState *state, Command command, bool link,
+                BuildStep step, ProcessList *procs, i32 concurrency,
+                BuildSteps *steps) {
+    i8 needs_rebuild = prepare_step(arena, state, command, &step);
+    if (needs_rebuild <= 0) return needs_rebuild == 0;
+
+    i8 restored = restore_step(arena, state, command, &step);
+    if (restored < 0) return false;
+    build_steps_push(steps, step);
+    if (restored) return true;
+
+    return start_step(arena, command, link, step, procs, concurrency);
+}
+
+// Record a step which was built in the build database, with the headers it
+// included as its inputs alongside its own.
+bool record_step(Arena *arena, BuildState *state, BuildStep step) {
+    FilePaths inputs = file_paths_new(NULL, 64);
     DEFER_SETUP(bool, true);
 
     Lifetime lt = lifetime_begin(arena);
 
-    StringView output_dir = sv_from_cstr(TEST_OUTPUT_DIR);
+    FileStat stat;
+    i8 exists = get_file_stat(step.output, &stat);
+    if (exists < 0) DEFER_RETURN(false);
+    if (!exists || stat.mtime_ns == step.mtime_ns) DEFER_RETURN(true);
 
-    StringView basename = get_basename(sv_from_cstr(path));
-    sv_strip_suffix(&basename, sv_from_cstr(".c"));
+    const char *depfile = arena_sprintf(lt.arena, "%s.d", step.output);
+    file_paths_append(&inputs, step.inputs, step.input_count);
+    exists = build_read_depfile(lt.arena, depfile, &inputs);
+    if (exists <= 0) {
+        if (!exists) log_error("Failed to read '%s': no such file", depfile);
+        DEFER_RETURN(false);
+    }
 
-#ifdef _WIN32
-    i32 executable_length = basename.count + output_dir.count + 6;
-#else
-    i32 executable_length = basename.count + output_dir.count + 2;
-#endif // _WIN32
+    if (!build_db_record(&state->db, lt.arena, &state->stat_cache,
+                         step.output, step.command, inputs))
+        DEFER_RETURN(false);
 
-    StringBuilder executable = sb_new(lt.arena, executable_length);
-    sb_appendf(&executable, SV_FMT SYSTEM_PATH_DELIMITER_STRING SV_FMT,
-               SV_ARG(output_dir), SV_ARG(basename));
-#ifdef _WIN32
-    sb_append_cstr(&executable, ".exe");
-#endif // _WIN32
-    sb_push_null(&executable);
+    if (state->compile_cache && step.cache_key.count > 0 &&
+        !compile_cache_store(state->compile_cache, lt.arena, step.cache_key,
+                             step.output, depfile))
+        DEFER_RETURN(false);
+
+    DEFER_LABEL({
+        lifetime_end(lt);
+        FREE(inputs.items);
+    });
+}
+
+// Wait for the steps which were started, recording whatever was built in the
+// build database even if other steps failed, so it isn't built again.
+bool finish_steps(Arena *arena, BuildState *state, ProcessList procs,
+                  BuildSteps steps, bool ok) {
+    if (!process_list_wait(procs)) ok = false;
+    for (i32 i = 0; i < steps.count; i++) {
+        // Compilers which print the included files print their errors along
+        // with them, so those are printed once they're finished
+        Lifetime lt = lifetime_begin(arena);
+        const char *output = COMMAND_CC_DEPFILE_STDOUT(
+            arena_sprintf(lt.arena, "%s.d", steps.items[i].output));
+        if (output && !build_print_depfile_output(lt.arena, output, stdout)) {
+            ok = false;
+        }
+        lifetime_end(lt);
+
+        if (!record_step(arena, state, steps.items[i])) ok = false;
+    }
+    if (!build_db_save(arena, &state->db)) ok = false;
+    return ok;
+}
+
+// Write `contents` into the file at `path`, unless it already has them.
+bool write_file_if_changed(Arena *arena, const char *path,
+                           StringView contents) {
+    Lifetime lt = lifetime_begin(arena);
+    FileStat stat;
+    i8 exists = get_file_stat(path, &stat);
+    bool changed = exists <= 0 || stat.size != contents.count ||
+                   !sv_eq(read_entire_file(lt.arena, path), contents);
+    lifetime_end(lt);
+    if (exists < 0) return false;
+    return !changed || write_file(path, contents);
+}
+
+// Generate the header which includes the declarations of every header of the
+// library, and the source which compiles their implementation.
+bool write_implementation_sources(Arena *arena, BuildState *state) {
+    Lifetime lt = lifetime_begin(arena);
+    StringBuilder header = sb_new(NULL, 1024);
+
+    // `test.h` overrides `ASSERT` for the rest, so it has to come first
+    sb_append_cstr(&header, "// Generated by build.c\n"
+                            "#include \"../../" BOOKSTORE_DIR "/test.h\"\n");
+    FilePaths headers = state->headers;
+    file_paths_sort(headers);
+    for (i32 i = 0; i < headers.count; i++) {
+        StringView name = get_basename(sv_from_cstr(headers.items[i]));
+        if (sv_eq(name, sv_from_cstr("test.h"))) continue;
+        sb_appendf(&header, "#include \"../../" BOOKSTORE_DIR "/" SV_FMT "\"\n",
+                   SV_ARG(name));
+    }
+
+    bool result =
+        make_directory_recursively(lt.arena, IMPL_DIR) &&
+        write_file_if_changed(lt.arena, IMPL_HEADER, sb_to_sv(header)) &&
+        write_file_if_changed(lt.arena, IMPL_SOURCE,
+                              sv_from_cstr("// Generated by build.c\n"
+                                           "#define BOOKSTORE_IMPLEMENTATION\n"
+                                           "#include \"bookstore.h\"\n"));
 
+    FREE(header.items);
+    lifetime_end(lt);
+    return result;
+}
+
+// Build the object with the implementation of the library, and the
+// precompiled header with its declarations, unless every test compiles its own
+// implementation.
+bool build_implementation(Arena *arena, BuildState *state) {
+    if (state->unity) return true;
+    if (!write_implementation_sources(arena, state)) return false;
+
+    Lifetime lt = lifetime_begin(arena);
+    ProcessList procs = process_list_new(lt.arena, 2);
+    BuildSteps steps = build_steps_new(NULL, 2);
+
+    Command command = cc_command(lt.arena);
+    COMMAND_CC_COMPILE_ONLY(&command);
+    COMMAND_CC_INPUTS(&command, IMPL_SOURCE);
+    BuildStep step = {
+        .output = IMPL_OBJECT,
+        .inputs = {IMPL_SOURCE},
+        .input_count = 1,
+    };
+    bool ok = build_step(lt.arena, state, command, false, step, &procs, 0,
+                         &steps);
+
+#ifdef IMPL_PCH
+    if (ok && state->pch) {
+        command = cc_command(lt.arena);
+        COMMAND_CC_PCH(&command, IMPL_HEADER);
+        step = (BuildStep){
+            .output = IMPL_PCH,
+            .inputs = {IMPL_HEADER},
+            .input_count = 1,
+        };
+        ok = build_step(lt.arena, state, command, false, step, &procs, 0,
+                        &steps);
+    }
+#endif // IMPL_PCH
+
+    ok = finish_steps(lt.arena, state, procs, steps, ok);
+    FREE(steps.items);
+    lifetime_end(lt);
+    return ok;
+}
+
+// A test which needs to be built, along with the command to build it with.
+typedef struct {
+    BuildState *state;
+    Command command;
+    BuildStep step;
+    // What `restore_step` returned for it.
+    i8 restored;
+} PendingTest;
+
+void restore_pending_test(ThreadPoolWorker *worker, void *data) {
+    PendingTest *test = data;
+    test->restored =
+        restore_step(worker->arena, test->state, test->command, &test->step);
+}
+
+bool build_tests(Arena *arena, BuildState *state, FilePaths tests) {
+    if (!build_implementation(arena, state)) return false;
+    if (!make_directory_recursively(arena, TEST_OUTPUT_DIR)) return false;
+
+    i32 concurrency = 64;
+    ProcessList procs = process_list_new(arena, concurrency);
+    BuildSteps steps = build_steps_new(NULL, tests.count);
+    Lifetime lt = lifetime_begin(arena);
+    PendingTest *pending =
+        arena_alloc(lt.arena, tests.count * sizeof(*pending));
+    i32 pending_count = 0;
+
+    bool ok = true;
+    for (i32 i = 0; i < tests.count && ok; i++) {
+        const char *path = file_paths_get(tests, i);
+        PendingTest *test = &pending[pending_count];
+        *test = (PendingTest){
+            .state = state,
+            .command = test_command(lt.arena, state, path),
+            .step = test_step(state, path),
+        };
+        test->step.output = test_output_path(arena, path);
+        i8 needs_rebuild = prepare_step(lt.arena, state, test->command,
+                                        &test->step);
+        if (needs_rebuild < 0) ok = false;
+        if (needs_rebuild > 0) pending_count++;
+    }
+
+    // Looking a test up in the compile cache preprocesses it, which takes about
+    // as long as compiling it, so the tests are looked up in parallel
+    if (ok && state->compile_cache && pending_count > 0) {
+        i32 threads = MIN(pending_count, processors_available());
+        ThreadPool *pool = thread_pool_new(threads, MiB(1));
+        if (pool == NULL) ok = false;
+        for (i32 i = 0; i < pending_count && ok; i++) {
+            thread_pool_submit(pool, NULL, restore_pending_test, &pending[i]);
+        }
+        if (pool) thread_pool_destroy(pool);
+    }
+
+    for (i32 i = 0; i < pending_count && ok; i++) {
+        PendingTest *test = &pending[i];
+        if (test->restored < 0) {
+            ok = false;
+            break;
+        }
+        build_steps_push(&steps, test->step);
+        if (!test->restored) {
+            ok = start_step(lt.arena, test->command, true, test->step, &procs,
+                            concurrency);
+        }
+    }
+
+    ok = finish_steps(arena, state, procs, steps, ok);
+    FREE(steps.items);
+    lifetime_end(lt);
+    return ok;
+}
+
+// Start running the test at `path` in the background, capturing its output.
+bool start_test(Arena *arena, const char *path, ProcessList *procs,
+                RunningTests *running) {
+    const char *executable = test_output_path(arena, path);
+    RunningTest test = {
+        .path = path,
+        .log = arena_sprintf(arena, "%s.log", executable),
+    };
+
+    Lifetime lt = lifetime_begin(arena);
     Command command = command_new(lt.arena, 1);
-    command_push(&command, executable.items);
+    command_push(&command, executable);
+    // The concurrency is already limited by the caller
+    bool ok = COMMAND_RUN(lt.arena, &command, .async = procs,
+                          .concurrency = procs->count + 1,
+                          .stdout_path = test.log, .merge_stderr = true);
+    lifetime_end(lt);
 
-    if (!COMMAND_RUN(lt.arena, &command)) DEFER_RETURN(false);
+    if (ok) running_tests_push(running, test);
+    return ok;
+}
 
-    DEFER_LABEL({ lifetime_end(lt); });
+// Print the output the test captured, all at once so the output of other tests
+// isn't interleaved with it.
+void print_test_output(Arena *arena, RunningTest test) {
+    Lifetime lt = lifetime_begin(arena);
+    StringView output = read_entire_file(lt.arena, test.log);
+    fwrite(output.data, 1, output.count, stderr);
+    fflush(stderr);
+    lifetime_end(lt);
 }
 
-bool run_tests(Arena *arena, FilePaths tests) {
+bool run_tests(Arena *arena, FilePaths tests, TestRunOpt opt) {
+    ProcessList procs = process_list_new(NULL, opt.jobs);
+    RunningTests running = running_tests_new(NULL, opt.jobs);
+
+    i32 next = 0;
+    i32 failed = 0;
+    // Set once no more tests should be started
+    bool stop = false;
+    while (running.count > 0 || (!stop && next < tests.count)) {
+        while (!stop && next < tests.count && running.count < opt.jobs) {
+            const char *path = file_paths_get(tests, next++);
+            if (!start_test(arena, path, &procs, &running)) {
+                log_error("Test '%s' failed to start", path);
+                failed++;
+                if (opt.fail_fast) stop = true;
+            }
+        }
+
+        bool finished = false;
+        for (i32 i = 0; i < running.count;) {
+            i8 status = process_poll(procs.items[i], 0);
+            if (status == 0) {
+                i++;
+                continue;
+            }
+            finished = true;
+
+            RunningTest test = running.items[i];
+            process_list_remove_swapback(&procs, i);
+            running_tests_remove_swapback(&running, i);
+            print_test_output(arena, test);
+            if (status < 0) {
+                log_error("Test '%s' failed", test.path);
+                failed++;
+                if (opt.fail_fast) stop = true;
+            }
+        }
+
+        if (stop) {
+            for (i32 i = 0; i < running.count; i++) {
+                process_kill(procs.items[i]);
+            }
+            procs.count = 0;
+            running.count = 0;
+        }
+
+        // Sleep until one of the tests finishes, instead of spinning
+        if (!finished && running.count > 0) process_list_wait_any(procs, -1);
+    }
+
+    if (failed > 0) {
+        log_error("%d of %d tests failed", failed, tests.count);
+    } else {
+        log_info("all %d tests passed", tests.count);
+    }
+
+    FREE(procs.items);
+    FREE(running.items);
+    return failed == 0;
+}
+
+// Collect the tests which need to be rebuilt into `out`.
+bool collect_affected_tests(Arena *arena, BuildState *state, FilePaths *out) {
+    FilePaths tests = file_paths_new(arena, 64);
+    if (!collect_files(arena, TEST_INPUT_DIR, "*.c", &state->stat_cache,
+                       &tests)) {
+        return false;
+    }
+
     for (i32 i = 0; i < tests.count; i++) {
-        if (!run_test(arena, file_paths_get(tests, i))) return false;
+        i8 needs_rebuild = test_needs_rebuild(arena, state, tests.items[i]);
+        if (needs_rebuild < 0) return false;
+        if (needs_rebuild) file_paths_push(out, tests.items[i]);
     }
     return true;
 }
+
+bool watch_tests(Arena *arena, BuildState *state, bool test, TestRunOpt opt) {
+    DirectoryWatcher watcher;
+    if (!directory_watcher_open(arena, BOOKSTORE_DIR, &watcher)) return false;
+    if (!directory_watcher_add(arena, &watcher, TEST_INPUT_DIR)) {
+        directory_watcher_close(&watcher);
+        return false;
+    }
+
+    bool ok = true;
+    FilePaths changes = file_paths_new(NULL, 64);
+    while (ok) {
+        changes.count = 0;
+        Lifetime lt = lifetime_begin(arena);
+        log_info("Watching for changes...");
+
+        i8 changed = directory_watcher_next(&watcher, lt.arena, -1, &changes);
+        if (changed < 0) ok = false;
+        if (changed > 0) {
+            // Anything may have changed since the files were last stat'd
+            stat_cache_clear(&state->stat_cache);
+            build_db_invalidate(&state->db);
+
+            // Failures are only reported, since the next change may fix them,
+            // but the tests which link against the implementation are only
+            // affected by its changes once it's rebuilt
+            bool passed = build_implementation(lt.arena, state);
+
+            FilePaths tests = file_paths_new(lt.arena, 64);
+            ok = collect_affected_tests(lt.arena, state, &tests);
+
+            passed = passed && ok && build_tests(lt.arena, state, tests);
+            if (passed && test) run_tests(lt.arena, tests, opt);
+        }
+
+        lifetime_end(lt);
+    }
+
+    FREE(changes.items);
+    directory_watcher_close(&watcher);
+    return ok;
+}
@@ -0,0 +1,149 @@
+#include "../bookstore/test.h"
+
+#include "../bookstore/ahocorasick.h"
+#include "../bookstore/random.h"
+
+#include <time.h>
+
+#define EXPECT_EQ_D(a, b) EXPECT_EQ(a, b, "%d")
+
+const char *classic_patterns[] = {"he", "she", "his", "hers"};
+
+const char *random_patterns[] = {"a", "ab", "bab", "bc", "bca", "c", "caa",
+                                 "abcab", "ab", ""};
+
+typedef struct {
+    i32 count;
+    AhoCorasickMatch items[256];
+} Matches;
+
+bool collect_match(AhoCorasickMatch match) {
+    Matches *matches = match.user_data;
+    if (matches->count < 256) matches->items[matches->count] = match;
+    matches->count++;
+    return true;
+}
+
+bool stop_at_first(AhoCorasickMatch match) {
+    i32 *count = match.user_data;
+    (*count)++;
+    return false;
+}
+
+StringViews patterns_from(Arena *arena, const char **cstrs, i32 count) {
+    StringViews patterns = svs_new(arena, count);
+    for (i32 i = 0; i < count; i++) {
+        svs_push(&patterns, sv_from_cstr(cstrs[i]));
+    }
+    return patterns;
+}
+
+#define COUNT(array) (i32)(sizeof(array) / sizeof(*(array)))
+
+TEST_MAIN({
+    Arena *arena = arena_new(KiB(64));
+
+    BEFORE_EACH({
+        arena_clear(arena);
+
+        int rounds = 5;
+        random_seed(time(NULL) ^ (intptr_t)&printf, (intptr_t)&rounds);
+    });
+
+    DESCRIBE("aho_corasick_search", {
+        IT("should report overlapping matches in order of their end", {
+            StringViews patterns =
+                patterns_from(arena, classic_patterns, COUNT(classic_patterns));
+            AhoCorasick ac = aho_corasick_new(arena, patterns);
+
+            Matches matches = {0};
+            EXPECT(aho_corasick_search(ac, sv_from_cstr("ushers"),
+                                       collect_match, &matches),
+                   "search should finish");
+            EXPECT_EQ_D(matches.count, 3);
+            EXPECT_EQ_D(matches.items[0].pattern, 1);
+            EXPECT_EQ_D((i32)matches.items[0].start, 1);
+            EXPECT_EQ_D(matches.items[1].pattern, 0);
+            EXPECT_EQ_D((i32)matches.items[1].start, 2);
+            EXPECT_EQ_D(matches.items[2].pattern, 3);
+            EXPECT_EQ_D((i32)matches.items[2].end, 6);
+        });
+
+        IT("should stop when the callback returns false", {
+            StringViews patterns =
+                patterns_from(arena, classic_patterns, COUNT(classic_patterns));
+            AhoCorasick ac = aho_corasick_new(arena, patterns);
+
+            i32 count = 0;
+            EXPECT(!aho_corasick_search(ac, sv_from_cstr("ushers"),
+                                        stop_at_first, &count),
+                   "search should be stopped");
+            EXPECT_EQ_D(count, 1);
+        });
+
+        IT("should find the same matches as a naive search", {
+            StringViews patterns =
+                patterns_from(arena, random_patterns, COUNT(random_patterns));
+            AhoCorasick ac = aho_corasick_new(arena, patterns);
+
+            for (i32 round = 0; round < 100; round++) {
+                char text[24];
+                for (i32 i = 0; i < COUNT(text); i++) {
+                    text[i] = "abcd"[random_next_bounded(4)];
+                }
+
+                Matches matches = {0};
+                aho_corasick_search(ac, sv_from_parts(text, COUNT(text)),
+                                    collect_match, &matches);
+
+                i32 expected = 0;
+                for (i32 end = 1; end <= COUNT(text); end++) {
+                    // Matches with the same end come from longest to shortest
+                    for (i32 length = MIN(end, 5); length > 0; length--) {
+                        for (i32 p = 0; p < patterns.count; p++) {
+                            StringView pattern = patterns.items[p];
+                            if (pattern.count != length) continue;
+                            StringView at =
+                                sv_from_parts(text + end - length, length);
+                            if (!sv_eq(at, pattern)) continue;
+
+                            AhoCorasickMatch match = matches.items[expected++];
+                            EXPECT_EQ_D(match.pattern, p);
+                            EXPECT_EQ_D((i32)match.end, end);
+                        }
+                    }
+                }
+                EXPECT_EQ_D(matches.count, expected);
+            }
+        });
+    });
+
+    DESCRIBE("aho_corasick_search_stream", {
+        IT("should find matches across chunks", {
+            StringViews patterns =
+                patterns_from(arena, classic_patterns, COUNT(classic_patterns));
+            AhoCorasick ac = aho_corasick_new(arena, patterns);
+
+            const char *text = "ushers and his hers";
+            Matches whole = {0};
+            aho_corasick_search(ac, sv_from_cstr(text), collect_match, &whole);
+
+            Matches chunked = {0};
+            AhoCorasickStream stream = {0};
+            for (i32 i = 0; text[i]; i++) {
+                aho_corasick_search_stream(ac, &stream,
+                                           sv_from_parts(text + i, 1),
+                                           collect_match, &chunked);
+            }
+
+            EXPECT_EQ_D(chunked.count, whole.count);
+            for (i32 i = 0; i < whole.count; i++) {
+                EXPECT_EQ_D(chunked.items[i].pattern, whole.items[i].pattern);
+                EXPECT_EQ_D((i32)chunked.items[i].start,
+                            (i32)whole.items[i].start);
+            }
+        });
+    });
+
+    arena_destroy(arena);
+})
@@ -2,6 +2,10 @@
 
 #include "../bookstore/arena.h"
 
+#include <string.h>
+
+#define CSTR_EQ(a, b) (strcmp(a, b) == 0)
+
 TEST_MAIN({
     i32 size = 4 * sizeof(i32);
     Arena *arena = NULL;
@@ -47,6 +51,17 @@ TEST_MAIN({
         });
     });
 
+    DESCRIBE("arena_sprintf", {
+        IT("should format into the arena", {
+            char *s = arena_sprintf(arena, "%d-%s", 12, "ab");
+            EXPECT_EQ_FN(s, "12-ab", CSTR_EQ, "\"%s\"", IDENTITY);
+            EXPECT_EQ(arena->allocated, 6, "%d");
+        });
+
+        IT_FAIL("asserts that the capacity isn't bypassed",
+                { arena_sprintf(arena, "%0*d", size, 0); });
+    });
+
     DESCRIBE("lifetime_begin/lifetime_end", {
         IT("should provide users with a temporary lifetime to allocate with", {
             arena_alloc(arena, 1);
@@ -0,0 +1,365 @@
+#include "../bookstore/test.h"
+
+#include "../bookstore/build.h"
+
+#define EXPECT_EQ_D(a, b) EXPECT_EQ(a, b, "%d")
+
+#define COUNT(array) (i32)(sizeof(array) / sizeof(*(array)))
+
+// Every file the tests write is inside this directory, which is created anew
+// for each test
+#define TEST_DIR "bin/test/build-files"
+
+const char *test_path(Arena *arena, const char *name) {
+    return arena_sprintf(arena, TEST_DIR "/%s", name);
+}
+
+// Check that `paths` are exactly `expected`, in order
+#define EXPECT_PATHS(paths, expected)                                          \
+    do {                                                                       \
+        EXPECT_EQ_D((paths).count, COUNT(expected));                           \
+        for (i32 i = 0; i < (paths).count; i++) {                              \
+            EXPECTF(strcmp((paths).items[i], (expected)[i]) == 0,              \
+                    "expected '%s', got '%s'", (expected)[i],                  \
+                    (paths).items[i]);                                         \
+        }                                                                      \
+    } while (0)
+
+const char *escaped_paths[] = {"src/a b.c", "inc/x#y.h", "lib/$z.h"};
+const char *continued_paths[] = {"a.c", "b.h", "c.h", "d.h"};
+const char *phony_paths[] = {"a.c", "b.h"};
+const char *drive_paths[] = {"C:/src/a.c", "C:/inc/b.h"};
+const char *show_includes_paths[] = {"C:\\inc\\b.h", "C:\\inc\\c h.h"};
+const char *invalid_shards[] = {
+    "", "1", "0/2", "3/2", "1/", "/2", "1/2x", "a/2", "1-2", "1/ ",
+};
+
+// Hash the command which compiles `a.c` into `out.o` with `flag`
+Hash compile_command(Arena *arena, const char *flag) {
+    Command command = command_new(arena, 6);
+    COMMAND_APPEND(&command, "cc", flag, "-c", "a.c", "-o", "out.o");
+    return build_command_hash(command);
+}
+
+// Write the files of a build whose output `out.o` was built from `a.c` and
+// `b.h` with `command`, and record it in a new database at `db_path`
+void record_build(Arena *arena, const char *db_path, Hash command) {
+    FilePaths inputs = file_paths_new(arena, 2);
+    file_paths_push(&inputs, test_path(arena, "a.c"));
+    file_paths_push(&inputs, test_path(arena, "b.h"));
+    write_file(inputs.items[0], sv_from_cstr("#include \"b.h\"\n"));
+    write_file(inputs.items[1], sv_from_cstr("int b;\n"));
+    write_file(test_path(arena, "out.o"), sv_from_cstr("object"));
+
+    BuildDb db;
+    build_db_open(arena, db_path, &db);
+    build_db_record(&db, arena, NULL, test_path(arena, "out.o"), command,
+                    inputs);
+    build_db_save(arena, &db);
+    build_db_close(&db);
+}
+
+// Reopen the database at `db_path`, and check whether `out.o` needs to be
+// rebuilt from `a.c` with `command`
+i8 needs_rebuild(Arena *arena, const char *db_path, Hash command) {
+    FilePaths inputs = file_paths_new(arena, 1);
+    file_paths_push(&inputs, test_path(arena, "a.c"));
+
+    BuildDb db;
+    if (!build_db_open(arena, db_path, &db)) return -1;
+    i8 result = build_db_needs_rebuild(&db, arena, NULL,
+                                       test_path(arena, "out.o"), command,
+                                       inputs);
+    build_db_close(&db);
+    return result;
+}
+
+// Look up the output of compiling `a.c` and linking `lib.o` into `out` in
+// `cache`, restoring it on a hit
+i8 restore_output(Arena *arena, CompileCache *cache, Hash *key) {
+    Command command = command_new(arena, 4);
+    COMMAND_CC(&command);
+    COMMAND_CC_INPUTS(&command, test_path(arena, "a.c"),
+                      test_path(arena, "lib.o"));
+    FilePaths inputs = file_paths_new(arena, 1);
+    file_paths_push(&inputs, test_path(arena, "lib.o"));
+    return compile_cache_restore(cache, arena, command, inputs,
+                                 test_path(arena, "out"), NULL, key);
+}
+
+// Write the inputs of `out`, and open `cache` with the output `linked` stored
+// for them
+void store_output(Arena *arena, CompileCache *cache) {
+    write_file(test_path(arena, "a.c"), sv_from_cstr("int a;\n"));
+    write_file(test_path(arena, "lib.o"), sv_from_cstr("v1"));
+    compile_cache_open(arena, TEST_DIR "/cache", COMPILE_CACHE_MAX_SIZE,
+                       cache);
+
+    Hash key;
+    restore_output(arena, cache, &key);
+    write_file(test_path(arena, "out"), sv_from_cstr("linked"));
+    compile_cache_store(cache, arena, key, test_path(arena, "out"), NULL);
+    delete_file(test_path(arena, "out"));
+}
+
+TEST_MAIN({
+    Arena *arena = arena_new(MiB(1));
+
+    BEFORE_EACH({
+        arena_clear(arena);
+        FileStat stat;
+        if (get_file_stat(TEST_DIR, &stat) > 0) {
+            delete_directory_recursively(arena, TEST_DIR);
+        }
+        make_directory_recursively(arena, TEST_DIR);
+    });
+
+    DESCRIBE("build_parse_depfile", {
+        IT("should unescape spaces, # and $ in paths", {
+            FilePaths paths = file_paths_new(arena, 8);
+            build_parse_depfile(
+                arena,
+                sv_from_cstr("out.o: src/a\\ b.c inc/x\\#y.h lib/$$z.h\n"),
+                &paths);
+            EXPECT_PATHS(paths, escaped_paths);
+        });
+
+        IT("should follow escaped newlines onto the next line", {
+            FilePaths paths = file_paths_new(arena, 8);
+            build_parse_depfile(arena,
+                                sv_from_cstr("out.o: a.c \\\n"
+                                             "  b.h \\\r\n"
+                                             "  c.h\\\n"
+                                             "  d.h\n"),
+                                &paths);
+            EXPECT_PATHS(paths, continued_paths);
+        });
+
+        IT("should skip the targets of phony rules", {
+            FilePaths paths = file_paths_new(arena, 8);
+            build_parse_depfile(arena,
+                                sv_from_cstr("out.o: a.c b.h\n"
+                                             "\n"
+                                             "b.h:\n"),
+                                &paths);
+            EXPECT_PATHS(paths, phony_paths);
+        });
+
+        IT("should keep the colons of drive letters", {
+            FilePaths paths = file_paths_new(arena, 8);
+            build_parse_depfile(
+                arena, sv_from_cstr("C:/out.obj: C:/src/a.c C:/inc/b.h\n"),
+                &paths);
+            EXPECT_PATHS(paths, drive_paths);
+        });
+
+        IT("should parse the output of /showIncludes", {
+            FilePaths paths = file_paths_new(arena, 8);
+            build_parse_depfile(arena,
+                                sv_from_cstr("a.c\r\n"
+                                             "Note: including file: "
+                                             "C:\\inc\\b.h\r\n"
+                                             "Note: including file:  "
+                                             "C:\\inc\\c h.h\r\n"),
+                                &paths);
+            EXPECT_PATHS(paths, show_includes_paths);
+        });
+    });
+
+    DESCRIBE("build_print_depfile_output", {
+        IT("should print every line besides the included files", {
+            const char *path = test_path(arena, "out.d");
+            EXPECT(write_file(path, sv_from_cstr("a.c\r\n"
+                                                 "Note: including file: "
+                                                 "C:\\inc\\b.h\r\n"
+                                                 "a.c(3): error C2065\r\n")),
+                   "failed to write file");
+
+            FILE *stream = tmpfile();
+            EXPECT(stream != NULL, "failed to open temporary file");
+            EXPECT(build_print_depfile_output(arena, path, stream),
+                   "failed to print output");
+            char printed[64] = {0};
+            rewind(stream);
+            fread(printed, 1, sizeof(printed) - 1, stream);
+            fclose(stream);
+            EXPECT_SV_EQ_CSTR(sv_from_cstr(printed),
+                              "a.c\na.c(3): error C2065\n");
+        });
+    });
+
+    DESCRIBE("build_read_depfile", {
+        IT("should return 0 for depfiles which don't exist", {
+            FilePaths paths = file_paths_new(arena, 8);
+            i8 result = build_read_depfile(
+                arena, test_path(arena, "missing.d"), &paths);
+            EXPECT_EQ_D(result, 0);
+            EXPECT_EQ_D(paths.count, 0);
+        });
+
+        IT("should read the prerequisites of the depfile", {
+            const char *path = test_path(arena, "out.d");
+            EXPECT(write_file(path, sv_from_cstr("out.o: a.c \\\n  b.h\n")),
+                   "failed to write file");
+            FilePaths paths = file_paths_new(arena, 8);
+            EXPECT_EQ_D(build_read_depfile(arena, path, &paths), 1);
+            EXPECT_PATHS(paths, phony_paths);
+        });
+    });
+
+    DESCRIBE("build_parse_shard", {
+        IT("should parse the shard and the shard count", {
+            i32 shard = 0;
+            i32 shard_count = 0;
+            EXPECT(build_parse_shard(sv_from_cstr("2/3"), &shard,
+                                     &shard_count),
+                   "expected a valid shard");
+            EXPECT_EQ_D(shard, 2);
+            EXPECT_EQ_D(shard_count, 3);
+
+            EXPECT(build_parse_shard(sv_from_cstr("1/1"), &shard,
+                                     &shard_count),
+                   "expected a valid shard");
+            EXPECT_EQ_D(shard, 1);
+            EXPECT_EQ_D(shard_count, 1);
+        });
+
+        IT("should reject invalid shards", {
+            for (i32 i = 0; i < COUNT(invalid_shards); i++) {
+                i32 shard = -1;
+                i32 shard_count = -1;
+                EXPECTF(!build_parse_shard(sv_from_cstr(invalid_shards[i]),
+                                           &shard, &shard_count),
+                        "parsed '%s'", invalid_shards[i]);
+                EXPECT_EQ_D(shard, -1);
+            }
+        });
+    });
+
+    DESCRIBE("build_db_needs_rebuild", {
+        const char *db_path = TEST_DIR "/build.db";
+
+        IT("should rebuild outputs which weren't recorded", {
+            Hash command = compile_command(arena, "-O0");
+            EXPECT(write_file(test_path(arena, "a.c"), SV_EMPTY),
+                   "failed to write file");
+            EXPECT_EQ_D(needs_rebuild(arena, db_path, command), 1);
+        });
+
+        IT("should skip outputs whose inputs are the same after reopening", {
+            Hash command = compile_command(arena, "-O0");
+            record_build(arena, db_path, command);
+            EXPECT_EQ_D(needs_rebuild(arena, db_path, command), 0);
+        });
+
+        IT("should skip outputs whose inputs were only rewritten", {
+            Hash command = compile_command(arena, "-O0");
+            record_build(arena, db_path, command);
+            EXPECT(write_file(test_path(arena, "b.h"),
+                              sv_from_cstr("int b;\n")),
+                   "failed to write file");
+            EXPECT_EQ_D(needs_rebuild(arena, db_path, command), 0);
+        });
+
+        IT("should rebuild outputs whose inputs changed", {
+            Hash command = compile_command(arena, "-O0");
+            record_build(arena, db_path, command);
+            EXPECT(write_file(test_path(arena, "b.h"),
+                              sv_from_cstr("int b = 1;\n")),
+                   "failed to write file");
+            EXPECT_EQ_D(needs_rebuild(arena, db_path, command), 1);
+        });
+
+        IT("should rebuild outputs whose command changed", {
+            record_build(arena, db_path, compile_command(arena, "-O0"));
+            Hash changed = compile_command(arena, "-O2");
+            EXPECT_EQ_D(needs_rebuild(arena, db_path, changed), 1);
+        });
+
+        IT("should rebuild outputs which were modified", {
+            Hash command = compile_command(arena, "-O0");
+            record_build(arena, db_path, command);
+            EXPECT(write_file(test_path(arena, "out.o"),
+                              sv_from_cstr("modified")),
+                   "failed to write file");
+            EXPECT_EQ_D(needs_rebuild(arena, db_path, command), 1);
+        });
+    });
+
+    DESCRIBE("compile_cache_restore", {
+        IT("should miss outputs which weren't stored", {
+            EXPECT(write_file(test_path(arena, "a.c"), SV_EMPTY),
+                   "failed to write file");
+            EXPECT(write_file(test_path(arena, "lib.o"), SV_EMPTY),
+                   "failed to write file");
+            CompileCache cache;
+            EXPECT(compile_cache_open(arena, TEST_DIR "/cache",
+                                      COMPILE_CACHE_MAX_SIZE, &cache),
+                   "failed to open cache");
+
+            Hash key;
+            EXPECT_EQ_D(restore_output(arena, &cache, &key), 0);
+            FileStat stat;
+            EXPECT_EQ_D(get_file_stat(test_path(arena, "out"), &stat), 0);
+            compile_cache_close(arena, &cache);
+        });
+
+        IT("should restore outputs which were stored", {
+            CompileCache cache;
+            store_output(arena, &cache);
+
+            Hash key;
+            EXPECT_EQ_D(restore_output(arena, &cache, &key), 1);
+            EXPECT_SV_EQ_CSTR(read_entire_file(arena, test_path(arena, "out")),
+                              "linked");
+            compile_cache_close(arena, &cache);
+        });
+
+        IT("should keep entries when restored outputs are written in place", {
+            CompileCache cache;
+            store_output(arena, &cache);
+
+            Hash key;
+            EXPECT_EQ_D(restore_output(arena, &cache, &key), 1);
+            // Like GCC rewriting a precompiled header
+            FILE *f = fopen(test_path(arena, "out"), "r+b");
+            EXPECT(f != NULL, "failed to open output");
+            fputs("in place", f);
+            fclose(f);
+
+            EXPECT_EQ_D(restore_output(arena, &cache, &key), 1);
+            EXPECT_SV_EQ_CSTR(read_entire_file(arena, test_path(arena, "out")),
+                              "linked");
+            compile_cache_close(arena, &cache);
+        });
+
+        IT("should miss once an input besides the source changes", {
+            CompileCache cache;
+            store_output(arena, &cache);
+
+            Hash key;
+            EXPECT(write_file(test_path(arena, "lib.o"), sv_from_cstr("v2")),
+                   "failed to write file");
+            EXPECT_EQ_D(restore_output(arena, &cache, &key), 0);
+            EXPECT(write_file(test_path(arena, "lib.o"), sv_from_cstr("v1")),
+                   "failed to write file");
+            EXPECT_EQ_D(restore_output(arena, &cache, &key), 1);
+            compile_cache_close(arena, &cache);
+        });
+
+        IT("should miss once the source changes", {
+            CompileCache cache;
+            store_output(arena, &cache);
+
+            Hash key;
+            EXPECT(write_file(test_path(arena, "a.c"),
+                              sv_from_cstr("int b;\n")),
+                   "failed to write file");
+            EXPECT_EQ_D(restore_output(arena, &cache, &key), 0);
+            compile_cache_close(arena, &cache);
+        });
+    });
+
+    delete_directory_recursively(arena, TEST_DIR);
+    arena_destroy(arena);
+});
@@ -0,0 +1,121 @@
+#include "../bookstore/test.h"
+
+#include "../bookstore/command.h"
+#include "../bookstore/system.h"
+
+#define EXPECT_EQ_D(a, b) EXPECT_EQ(a, b, "%d")
+
+// Every file the tests write is inside this directory, which is created anew
+// for each test
+#define TEST_DIR "bin/test/command-files"
+
+// The scripts the tests run through the shell
+#ifdef _WIN32
+#define SHELL_ARGS          "cmd.exe", "/c"
+#define SCRIPT_SLEEP        "ping -n 30 127.0.0.1 >nul"
+#define SCRIPT_BOTH_STREAMS "echo out& echo err 1>&2"
+#else
+#define SHELL_ARGS          "sh", "-c"
+#define SCRIPT_SLEEP        "sleep 30"
+#define SCRIPT_BOTH_STREAMS "echo out; echo err >&2"
+#endif // _WIN32
+
+// Start running `script` through the shell, appending its process to `procs`
+bool start_script(Arena *arena, ProcessList *procs, const char *script) {
+    Command command = command_new(arena, 3);
+    COMMAND_APPEND(&command, SHELL_ARGS, script);
+    return COMMAND_RUN(arena, &command, .async = procs,
+                       .concurrency = procs->count + 1);
+}
+
+// Poll `proc` until it finishes, returning its status
+i8 poll_until_finished(Process proc) {
+    i8 status;
+    while ((status = process_poll(proc, 10)) == 0) {}
+    return status;
+}
+
+TEST_MAIN({
+    Arena *arena = arena_new(MiB(1));
+
+    BEFORE_EACH({
+        arena_clear(arena);
+        FileStat stat;
+        if (get_file_stat(TEST_DIR, &stat) > 0) {
+            delete_directory_recursively(arena, TEST_DIR);
+        }
+        make_directory_recursively(arena, TEST_DIR);
+    });
+
+    DESCRIBE("process_poll", {
+        IT("should report whether the process succeeded", {
+            ProcessList procs = process_list_new(arena, 2);
+            EXPECT(start_script(arena, &procs, "exit 0"), "failed to start");
+            EXPECT(start_script(arena, &procs, "exit 3"), "failed to start");
+            EXPECT_EQ_D(poll_until_finished(procs.items[0]), 1);
+            EXPECT_EQ_D(poll_until_finished(procs.items[1]), -1);
+        });
+
+        IT("should return 0 while the process is running", {
+            ProcessList procs = process_list_new(arena, 1);
+            EXPECT(start_script(arena, &procs, SCRIPT_SLEEP),
+                   "failed to start");
+            EXPECT_EQ_D(process_poll(procs.items[0], 10), 0);
+            EXPECT(process_kill(procs.items[0]), "failed to kill");
+        });
+    });
+
+    DESCRIBE("process_kill", {
+        IT("should terminate the process without waiting for it", {
+            ProcessList procs = process_list_new(arena, 1);
+            EXPECT(start_script(arena, &procs, SCRIPT_SLEEP),
+                   "failed to start");
+            time_t start = time(NULL);
+            EXPECT(process_kill(procs.items[0]), "failed to kill");
+            EXPECT(time(NULL) - start < 10, "expected no wait");
+        });
+    });
+
+    DESCRIBE("process_list_wait_any", {
+        IT("should return once any of the processes finishes", {
+            ProcessList procs = process_list_new(arena, 2);
+            EXPECT(start_script(arena, &procs, SCRIPT_SLEEP),
+                   "failed to start");
+            EXPECT(start_script(arena, &procs, "exit 0"), "failed to start");
+            EXPECT(process_list_wait_any(procs, -1), "expected a process");
+            // The process isn't reaped until it's polled
+            EXPECT_EQ_D(process_poll(procs.items[1], 0), 1);
+            EXPECT(process_kill(procs.items[0]), "failed to kill");
+        });
+
+        IT("should time out while every process is running", {
+            ProcessList procs = process_list_new(arena, 1);
+            EXPECT(start_script(arena, &procs, SCRIPT_SLEEP),
+                   "failed to start");
+            EXPECT(!process_list_wait_any(procs, 20), "expected a timeout");
+            EXPECT(process_kill(procs.items[0]), "failed to kill");
+        });
+    });
+
+    DESCRIBE("command_run_opt", {
+        IT("should merge standard error into standard output", {
+            const char *path = TEST_DIR "/out.txt";
+            Command command = command_new(arena, 3);
+            COMMAND_APPEND(&command, SHELL_ARGS, SCRIPT_BOTH_STREAMS);
+            EXPECT(COMMAND_RUN(arena, &command, .stdout_path = path,
+                               .merge_stderr = true),
+                   "failed to run");
+
+            StringView output = read_entire_file(arena, path);
+            EXPECTF(sv_find(output, sv_from_cstr("out")) >= 0,
+                    "missing standard output in '" SV_FMT "'",
+                    SV_ARG(output));
+            EXPECTF(sv_find(output, sv_from_cstr("err")) >= 0,
+                    "missing standard error in '" SV_FMT "'",
+                    SV_ARG(output));
+        });
+    });
+
+    delete_directory_recursively(arena, TEST_DIR);
+    arena_destroy(arena);
+});
@@ -0,0 +1,125 @@
+#include "../bookstore/test.h"
+
+#include "../bookstore/glob.h"
+
+typedef struct {
+    const char *pattern;
+    const char *path;
+    bool matches;
+} GlobCase;
+
+const char *invalid_patterns[] = {"[ab", "a/[b/c]", "{a,b", "a}", "{a,{b}"};
+
+const GlobCase match_cases[] = {
+    {"*.c", "glob.c", true},
+    {"*.c", ".c", true},
+    {"*.c", "glob.h", false},
+    {"*.c", "test/glob.c", false},
+    {"test/*.c", "test/glob.c", true},
+    {"test/*.c", "test//glob.c/", true},
+    {"?ob.c", "gob.c", true},
+    {"?ob.c", "ob.c", false},
+    {"a*b*c", "abc", true},
+    {"a*b*c", "axxbyybzc", true},
+    {"a*b*c", "axxcyyb", false},
+    {"a/?", "a/b/c", false},
+    {"[a-c]x", "bx", true},
+    {"[a-c]x", "dx", false},
+    {"[!a-c]x", "dx", true},
+    {"[^a-c]x", "ax", false},
+    {"[]x]y", "]y", true},
+    {"[*]", "*", true},
+    {"[*]", "a", false},
+    {"**", "a/b/c", true},
+    {"**/*.c", "glob.c", true},
+    {"**/*.c", "a/b/glob.c", true},
+    {"**/*.c", "a/b/glob.h", false},
+    {"a/**/b", "a/b", true},
+    {"a/**/b", "a/x/y/b", true},
+    {"a/**/b", "a/x/y/c", false},
+    {"a/**/b/**/c", "a/b/x/b/c", true},
+    {"a/**", "a/x/y", true},
+    {"a/**", "b/x", false},
+    {"*.{c,h}", "glob.h", true},
+    {"*.{c,h}", "glob.o", false},
+    {"{src,test}/*.c", "test/glob.c", true},
+    {"{src,test}/*.c", "bin/glob.c", false},
+    {"{a,b{c,d}}e", "bde", true},
+    {"{a,b{c,d}}e", "be", false},
+    {"{a,b{c,d}}{x,y}", "bdx", true},
+    {"{a,b{c,d}}{x,y}", "bdy", true},
+    {"{a,b{c,d}}{x,y}", "ax", true},
+    {"src/{a,b{c,d}}/**/*.{c,h}", "src/bd/w.c", true},
+    {"src/{a,b{c,d}}/**/*.{c,h}", "src/bd/y/z/w.h", true},
+    {"src/{a,b{c,d}}/**/*.{c,h}", "src/b/w.c", false},
+    {"x{,y}", "x", true},
+    {"[{]a,b[}]", "{a,b}", true},
+};
+
+const GlobCase inside_cases[] = {
+    {"test/*.c", "test", true},
+    {"test/*.c", "src", false},
+    {"test/*.c", "test/sub", false},
+    {"*.c", "test", false},
+    {"**/*.c", "a/b/c", true},
+    {"a/**/b", "a/x/y", true},
+    {"{src,test}/x/*.c", "test/x", true},
+    {"{src,test}/x/*.c", "test/y", false},
+};
+
+#define COUNT(array) (i32)(sizeof(array) / sizeof(*(array)))
+
+TEST_MAIN({
+    Arena *arena = arena_new(KiB(64));
+
+    BEFORE_EACH({ arena_clear(arena); });
+
+    DESCRIBE("glob_compile", {
+        IT("should reject invalid patterns", {
+            for (i32 i = 0; i < COUNT(invalid_patterns); i++) {
+                GlobPattern glob;
+                StringView pattern = sv_from_cstr(invalid_patterns[i]);
+                EXPECTF(!glob_compile(arena, pattern, &glob), "compiled %s",
+                        invalid_patterns[i]);
+            }
+        });
+
+        IT("should reject patterns with too many alternatives", {
+            GlobPattern glob;
+            StringView pattern = sv_from_cstr("{a,b}{a,b}{a,b}{a,b}{a,b}{a,b}"
+                                              "{a,b}{a,b}{a,b}{a,b}{a,b}");
+            EXPECT(!glob_compile(arena, pattern, &glob), "expected failure");
+        });
+    });
+
+    DESCRIBE("glob_match", {
+        IT("should match whole paths", {
+            for (i32 i = 0; i < COUNT(match_cases); i++) {
+                GlobCase c = match_cases[i];
+                GlobPattern glob;
+                EXPECTF(glob_compile(arena, sv_from_cstr(c.pattern), &glob),
+                        "failed to compile %s", c.pattern);
+                EXPECTF(glob_match(&glob, sv_from_cstr(c.path)) == c.matches,
+                        "expected %s %sto match %s", c.path,
+                        c.matches ? "" : "not ", c.pattern);
+            }
+        });
+    });
+
+    DESCRIBE("glob_could_match_inside", {
+        IT("should only allow directories which can contain matches", {
+            for (i32 i = 0; i < COUNT(inside_cases); i++) {
+                GlobCase c = inside_cases[i];
+                GlobPattern glob;
+                EXPECTF(glob_compile(arena, sv_from_cstr(c.pattern), &glob),
+                        "failed to compile %s", c.pattern);
+                EXPECTF(glob_could_match_inside(
+                            &glob, sv_from_cstr(c.path)) == c.matches,
+                        "expected %s %sto contain matches of %s", c.path,
+                        c.matches ? "" : "not ", c.pattern);
+            }
+        });
+    });
+
+    arena_destroy(arena);
+});
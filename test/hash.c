@@ -0,0 +1,126 @@
+#include "../bookstore/test.h"
+
+#include "../bookstore/hash.h"
+
+typedef struct {
+    i32 count;
+    const char *fast;
+    const char *secure;
+} HashCase;
+
+// The hashes of the first `count` bytes of the input `i % 251`, as used by the
+// reference test vectors
+const HashCase cases[] = {
+    {0, "99aa06d3014798d86001c324468d497f",
+     "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262"},
+    {1, "a6cd5e9392000f6ac44bdff4074eecdb",
+     "2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213"},
+    {3, "e3b55f57945a17cf5f4299fc161c9cbb",
+     "e1be4d7a8ab5560aa4199eea339849ba8e293d55ca0a81006726d184519e647f"},
+    {4, "eb70bf5fc779e9e6a6111d53e80a3db5",
+     "f30f5ab28fe047904037f77b6da4fea1e27241c5d132638d8bedce9d40494f32"},
+    {8, "e1e4432a62217fe4cfd50c61c8bb98c1",
+     "2351207d04fc16ade43ccab08600939c7c1fa70a5c0aaca76063d04c3228eaeb"},
+    {9, "16c769d83e4aebce907931979dca3746",
+     "a0fc27e5d7318b723207637bdeeba4f7dcb22f7f9ec3e8b6f3588ddcd4fdf861"},
+    {16, "72950631827607e2842812cc870dcae2",
+     "a6a492965517a830cb75fdb713465aa465f2f098233896fea44c1d98268bf9e3"},
+    {17, "685bc458b37d057fc06e233df7729217",
+     "8462aa7be93b09fda7b93cf9f9cddb703f6dd2cc0c8edd5f9eee092edf8abf0c"},
+    {128, "14792fc3af88dc6c05321a0b64d67b41",
+     "f17e570564b26578c33bb7f44643f539624b05df1a76c81f30acd548c44b45ef"},
+    {129, "dd5e74ac6b45f54ebc30b63382b09a3b",
+     "683aaae9f3c5ba37eaaf072aed0f9e30bac0865137bae68b1fde4ca2aebdcb12"},
+    {240, "65b5be86da5540e7c92b68e16f83bbb6",
+     "45e1a0dc23dbe51733d7269a3c0f519c2a63b0718835b2b537677eba734db0d8"},
+    {241, "1da1cb61bcb8a2a102e8cd95421c6d02",
+     "749b36ae651c22e8567db692a6876e0ca4fd3daeb7aa8fa3ab2f642ccc69a8f6"},
+    {1024, "d0ac1f7b93bf57b9e5d78bafa45b2aa5",
+     "42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7"},
+    {1025, "2882ebca04ec915ce95c42288f28186e",
+     "d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444"},
+    {2048, "a5141efedfefc1af25339063db861586",
+     "e776b6028c7cd22a4d0ba182a8bf62205d2ef576467e838ed6f2529b85fba24a"},
+    {4096, "e12cd72144990fe57135ffa504f1bc71",
+     "015094013f57a5277b59d8475c0501042c0b642e531b0a1c8f58d2163229e969"},
+    {8193, "eaa446aa30f78391d6735a2b792cf505",
+     "bab6c09cb8ce8cf459261398d2e7aef35700bf488116ceb94a36d0f5f1b7bc3b"},
+    {102400, "ecd387d36185351b1428e17f1cac2837",
+     "bc3e3d41a1146b069abffad3c0d44860cf664390afce4d9661f7902e7943e085"},
+};
+
+#define COUNT(array) (i32)(sizeof(array) / sizeof(*(array)))
+
+#define LARGE_COUNT (MiB(3) + 1)
+#define LARGE_SECURE                                                           \
+    "fd984eaa20053d346cc7c79a175338f91556e68b871d877b23568a4587d9875b"
+
+Hash secure_hash(StringView sv, i32 threads) {
+    return HASH_SV(sv, .mode = HASH_SECURE, .threads = threads);
+}
+
+TEST_MAIN({
+    Arena *arena = arena_new(MiB(8));
+
+    char *input = arena_alloc(arena, LARGE_COUNT);
+    for (i32 i = 0; i < LARGE_COUNT; i++) input[i] = i % 251;
+
+    DESCRIBE("hash_sv_opt", {
+        IT("should match the reference fast hashes", {
+            for (i32 i = 0; i < COUNT(cases); i++) {
+                Lifetime lt = lifetime_begin(arena);
+                Hash hash = HASH_SV(sv_from_parts(input, cases[i].count));
+                char *hex = hash_to_hex(lt.arena, hash);
+                EXPECTF(strcmp(hex, cases[i].fast) == 0, "%d bytes: %s != %s",
+                        cases[i].count, hex, cases[i].fast);
+                lifetime_end(lt);
+            }
+        });
+
+        IT("should match the reference secure hashes", {
+            for (i32 i = 0; i < COUNT(cases); i++) {
+                Lifetime lt = lifetime_begin(arena);
+                Hash hash = HASH_SV(sv_from_parts(input, cases[i].count),
+                                    .mode = HASH_SECURE);
+                char *hex = hash_to_hex(lt.arena, hash);
+                EXPECTF(strcmp(hex, cases[i].secure) == 0,
+                        "%d bytes: %s != %s", cases[i].count, hex,
+                        cases[i].secure);
+                lifetime_end(lt);
+            }
+        });
+
+        IT("should hash the same across threads", {
+            Lifetime lt = lifetime_begin(arena);
+            StringView large = sv_from_parts(input, LARGE_COUNT);
+            Hash serial = secure_hash(large, 1);
+            Hash parallel = secure_hash(large, 4);
+            char *hex = hash_to_hex(lt.arena, parallel);
+            EXPECTF(strcmp(hex, LARGE_SECURE) == 0, "%s != %s", hex,
+                    LARGE_SECURE);
+            EXPECT(hash_eq(serial, parallel), "serial hash differs");
+            lifetime_end(lt);
+        });
+    });
+
+    DESCRIBE("hash_file_opt", {
+        IT("should hash the contents of the file", {
+            Lifetime lt = lifetime_begin(arena);
+            StringView contents = read_entire_file(lt.arena, __FILE__);
+            Hash expected = HASH_SV(contents, .mode = HASH_SECURE);
+            Hash hash;
+            EXPECT(HASH_FILE(lt.arena, __FILE__, &hash, .mode = HASH_SECURE),
+                   "failed to hash file");
+            EXPECT(hash_eq(hash, expected), "file hash differs");
+            lifetime_end(lt);
+        });
+
+        IT("should fail for missing files", {
+            Hash hash;
+            EXPECT(!HASH_FILE(arena, "test/missing.c", &hash),
+                   "hashed a missing file");
+        });
+    });
+
+    arena_destroy(arena);
+});
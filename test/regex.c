@@ -0,0 +1,174 @@
+#include "../bookstore/test.h"
+
+#include "../bookstore/regex.h"
+
+#define EXPECT_EQ_D(a, b) EXPECT_EQ(a, b, "%d")
+
+const char *invalid_patterns[] = {
+    "(ab", "ab)", "*a", "a{2", "a{3,2}", "[ab", "a\\", "\\q", "[b-a]",
+};
+
+#define COUNT(array) (i32)(sizeof(array) / sizeof(*(array)))
+
+TEST_MAIN({
+    Arena *arena = arena_new(MiB(4));
+
+    BEFORE_EACH({ arena_clear(arena); });
+
+    DESCRIBE("regex_compile", {
+        IT("should reject invalid patterns", {
+            for (i32 i = 0; i < COUNT(invalid_patterns); i++) {
+                Regex re;
+                StringView pattern = sv_from_cstr(invalid_patterns[i]);
+                EXPECTF(!regex_compile(arena, pattern, &re), "compiled %s",
+                        invalid_patterns[i]);
+            }
+        });
+
+        IT("should reject patterns that expand too far", {
+            Regex re;
+            StringView pattern = sv_from_cstr("((a{100}){100}){100}");
+            EXPECT(!regex_compile(arena, pattern, &re), "expected failure");
+        });
+    });
+
+    DESCRIBE("regex_match", {
+        IT("should match the whole text", {
+            Regex re;
+            EXPECT(regex_compile(arena, sv_from_cstr("a(b|c)*d"), &re),
+                   "expected a valid regex");
+            EXPECT(regex_match(&re, sv_from_cstr("ad")), "ad");
+            EXPECT(regex_match(&re, sv_from_cstr("abcbd")), "abcbd");
+            EXPECT(!regex_match(&re, sv_from_cstr("abcbdx")), "abcbdx");
+            EXPECT(!regex_match(&re, sv_from_cstr("xabd")), "xabd");
+            EXPECT(!regex_match(&re, sv_from_cstr("")), "empty");
+        });
+
+        IT("should support classes, escapes and counted repetition", {
+            Regex re;
+            EXPECT(regex_compile(arena,
+                                 sv_from_cstr("[A-Z_][\\w]{0,3}\\.\\d+[^\\s]?"),
+                                 &re),
+                   "expected a valid regex");
+            EXPECT(regex_match(&re, sv_from_cstr("_ab1.42")), "_ab1.42");
+            EXPECT(regex_match(&re, sv_from_cstr("X.0!")), "X.0!");
+            EXPECT(!regex_match(&re, sv_from_cstr("x.0")), "lowercase start");
+            EXPECT(!regex_match(&re, sv_from_cstr("Xabcd.0")), "too long");
+            EXPECT(!regex_match(&re, sv_from_cstr("X.0 ")), "trailing space");
+        });
+    });
+
+    DESCRIBE("regex_search", {
+        IT("should find the leftmost-longest match", {
+            Regex re;
+            EXPECT(regex_compile(arena, sv_from_cstr("abcd|cdxyz|b+"), &re),
+                   "expected a valid regex");
+
+            RegexMatch match;
+            EXPECT(regex_search(&re, sv_from_cstr("xabcdxyz"), &match),
+                   "expected a match");
+            EXPECT_EQ_D(match.start, 1);
+            EXPECT_EQ_D(match.end, 5);
+
+            EXPECT(regex_search(&re, sv_from_cstr("cdxyzbbb"), &match),
+                   "expected a match");
+            EXPECT_EQ_D(match.start, 0);
+            EXPECT_EQ_D(match.end, 5);
+
+            EXPECT(!regex_search(&re, sv_from_cstr("acdxy"), NULL),
+                   "expected no match");
+        });
+
+        IT("should respect anchors", {
+            Regex re;
+            EXPECT(regex_compile(arena, sv_from_cstr("^ab|cd$"), &re),
+                   "expected a valid regex");
+
+            RegexMatch match;
+            EXPECT(regex_search(&re, sv_from_cstr("xxcd"), &match),
+                   "expected a match");
+            EXPECT_EQ_D(match.start, 2);
+            EXPECT(regex_search(&re, sv_from_cstr("abcd"), &match),
+                   "expected a match");
+            EXPECT_EQ_D(match.start, 0);
+            EXPECT_EQ_D(match.end, 2);
+            EXPECT(!regex_search(&re, sv_from_cstr("xab cdx"), NULL),
+                   "expected no match");
+        });
+
+        IT("should find matches after a literal prefix", {
+            Regex re;
+            EXPECT(regex_compile(arena, sv_from_cstr("error: \\w+"), &re),
+                   "expected a valid regex");
+            EXPECT_SV_EQ_CSTR(re.prefix, "error: ");
+
+            const char *log = "warning: a\n"
+                              "error - b\n"
+                              "error: disk_full (retrying)\n";
+            RegexMatch match;
+            EXPECT(regex_search(&re, sv_from_cstr(log), &match),
+                   "expected a match");
+            EXPECT_SV_EQ_CSTR(sv_from_parts(log + match.start,
+                                            match.end - match.start),
+                              "error: disk_full");
+        });
+
+        IT("should find empty matches", {
+            Regex re;
+            EXPECT(regex_compile(arena, sv_from_cstr("x*"), &re),
+                   "expected a valid regex");
+
+            RegexMatch match;
+            EXPECT(regex_search(&re, sv_from_cstr("yxx"), &match),
+                   "expected a match");
+            EXPECT_EQ_D(match.start, 0);
+            EXPECT_EQ_D(match.end, 0);
+        });
+
+        IT("should fit states larger than the default cache", {
+            Regex re;
+            EXPECT(regex_compile(arena, sv_from_cstr("(.{1000}){8}c"), &re),
+                   "expected a valid regex");
+
+            // Every position is still in progress by the end of the text, so
+            // its states hold most of the instructions
+            i32 count = 9000;
+            char *text = arena_alloc(arena, count);
+            memset(text, 'a', count);
+            text[count - 1] = 'c';
+            RegexMatch match;
+            EXPECT(regex_search(&re, sv_from_parts(text, count), &match),
+                   "expected a match");
+            EXPECT_EQ_D(match.start, count - 8001);
+            EXPECT_EQ_D(match.end, count);
+        });
+
+        IT("should keep skipping to the prefix after clearing the cache", {
+            Regex re;
+            EXPECT(regex_compile(arena, sv_from_cstr("ab(a|b)*a(a|b){12}c"),
+                                 &re),
+                   "expected a valid regex");
+            EXPECT((uintptr_t)re.forward.cache % _Alignof(Arena) == 0,
+                   "expected an aligned cache");
+
+            // Every combination of the last 13 bytes is a different state, so
+            // the cache is cleared many times over
+            i32 count = 20000;
+            char *text = arena_alloc(arena, count);
+            u32 seed = 1;
+            for (i32 i = 0; i < count - 2; i++) {
+                seed = seed * 1103515245 + 12345;
+                text[i] = (seed >> 16) & 1 ? 'a' : 'b';
+            }
+            text[count - 2] = 'z';
+            text[count - 1] = 'z';
+            EXPECT(!regex_search(&re, sv_from_parts(text, count), NULL),
+                   "expected no match");
+            EXPECT(re.forward.resets > 0, "expected the cache to be cleared");
+            EXPECT(re.forward.search_start != NULL,
+                   "expected the start of the search to be found again");
+        });
+    });
+
+    arena_destroy(arena);
+})
@@ -0,0 +1,507 @@
+#include "../bookstore/test.h"
+
+#include "../bookstore/string.h"
+
+#include <errno.h>
+#include <math.h>
+
+#define EXPECT_EQ_D(a, b) EXPECT_EQ(a, b, "%d")
+#define EXPECT_EQ_F(a, b) EXPECT_EQ(a, b, "%.17g")
+
+const char *double_cases[] = {
+    "0",
+    "1",
+    "-1",
+    "3.14159",
+    "0.1",
+    "1e22",
+    "1e23",
+    "12e25",
+    "123456.789e-3",
+    "0.30000000000000004",
+    "2.2250738585072014e-308",
+    "4.9406564584124654e-324",
+    "1.7976931348623157e308",
+    "9007199254740993",
+    "0.000000000000000000000000000000000001",
+    ".5",
+    "5.",
+    "+7.25E+2",
+};
+
+const char *float_cases[] = {
+    "123.123", "0.1", "16777217", "3.4028235e38", "1e-45", "1e10", "7e12",
+};
+
+const char *invalid_utf8_cases[] = {
+    "\x80",                 // lone continuation
+    "\xC0\xAF",             // overlong 2 bytes
+    "\xE0\x80\xAF",         // overlong 3 bytes
+    "\xF0\x80\x80\xAF",     // overlong 4 bytes
+    "\xED\xA0\x80",         // surrogate
+    "\xF4\x90\x80\x80",     // above U+10FFFF
+    "\xF8\x88\x80\x80\x80", // 5 byte sequence
+    "\xE2\x82",             // truncated
+    "a\xE2\x82x",           // truncated before ASCII
+};
+
+const u16 utf16_text[] = {'h', 0xE9, 0x20AC, 0xD83D, 0xDE00};
+
+const char *natural_order[] = {
+    "", "01", "1", "2", "10", "a", "file", "file1", "file02", "file2",
+    "file10", "file10a", "file10b", "file100", "fileA",
+};
+
+#define COUNT(array) (i32)(sizeof(array) / sizeof(*(array)))
+
+TEST_MAIN({
+    Arena *arena = arena_new(KiB(1));
+
+    BEFORE_EACH({ arena_clear(arena); });
+
+    DESCRIBE("sv_parse_double", {
+        IT("should parse decimal numbers exactly", {
+            for (i32 i = 0; i < COUNT(double_cases); i++) {
+                StringView sv = sv_from_cstr(double_cases[i]);
+                double parsed = sv_parse_double(&sv);
+                EXPECT_EQ_F(parsed, strtod(double_cases[i], NULL));
+                EXPECT_EQ_D(sv.count, 0);
+            }
+        });
+
+        IT("should round long mantissas correctly", {
+            // Halfway between 1 and the next double, plus a tiny bit
+            const char *cstr = "1.00000000000000011102230246251565404236316680908"
+                               "2031250000000000000000000000000000000000000001";
+            StringView sv = sv_from_cstr(cstr);
+            EXPECT_EQ_F(sv_parse_double(&sv), strtod(cstr, NULL));
+        });
+
+        IT("should round more digits than are handed to strtod", {
+            // Every digit after the limit is folded into the sticky digit
+            i32 digits = 900;
+            char *cstr = arena_alloc(arena, digits + 32);
+            memset(cstr, '7', digits);
+            snprintf(cstr + digits, 32, "e-%d", digits + 300);
+            StringView sv = sv_from_cstr(cstr);
+            EXPECT_EQ_F(sv_parse_double(&sv), strtod(cstr, NULL));
+            EXPECT_EQ_D(sv.count, 0);
+        });
+
+        IT("should not read past the end of the view", {
+            const char *cstr = "1.5e3";
+            StringView sv = sv_from_parts(cstr, 3);
+            EXPECT_EQ_F(sv_parse_double(&sv), 1.5);
+            EXPECT_EQ_D(sv.count, 0);
+
+            sv = sv_from_parts("12345", 2);
+            EXPECT_EQ_F(sv_parse_double(&sv), 12.0);
+        });
+
+        IT("should only consume the number", {
+            StringView sv = sv_from_cstr("  -2.5e-1x");
+            EXPECT_EQ_F(sv_parse_double(&sv), -0.25);
+            EXPECT_SV_EQ_CSTR(sv, "x");
+
+            sv = sv_from_cstr("1e+");
+            EXPECT_EQ_F(sv_parse_double(&sv), 1.0);
+            EXPECT_SV_EQ_CSTR(sv, "e+");
+        });
+
+        IT("should leave the view alone when there is no number", {
+            StringView sv = sv_from_cstr(" abc");
+            sv_parse_double(&sv);
+            EXPECT_SV_EQ_CSTR(sv, " abc");
+
+            sv = sv_from_cstr("-.");
+            sv_parse_double(&sv);
+            EXPECT_SV_EQ_CSTR(sv, "-.");
+        });
+
+        IT("should parse infinities and NaNs", {
+            StringView sv = sv_from_cstr("-Infinity");
+            EXPECT_EQ_F(sv_parse_double(&sv), -INFINITY);
+            EXPECT_EQ_D(sv.count, 0);
+
+            sv = sv_from_cstr("nan");
+            EXPECT_TRUE(isnan(sv_parse_double(&sv)));
+        });
+
+        IT("should set errno on overflow", {
+            errno = 0;
+            StringView sv = sv_from_cstr("1e400");
+            sv_parse_double(&sv);
+            EXPECT_EQ(errno, ERANGE, "%d");
+        });
+    });
+
+    DESCRIBE("sv_parse_float", {
+        IT("should parse decimal numbers exactly", {
+            for (i32 i = 0; i < COUNT(float_cases); i++) {
+                StringView sv = sv_from_cstr(float_cases[i]);
+                EXPECT_EQ(sv_parse_float(&sv), strtof(float_cases[i], NULL),
+                          "%.9g");
+            }
+        });
+
+        IT("should set errno on overflow", {
+            errno = 0;
+            StringView sv = sv_from_cstr("1e40");
+            sv_parse_float(&sv);
+            EXPECT_EQ(errno, ERANGE, "%d");
+        });
+    });
+
+    DESCRIBE("sv_parse_doubles", {
+        IT("should parse delimited values", {
+            double out[8];
+            StringView sv = sv_from_cstr("1, 2.5 ,-3e2,4");
+            EXPECT_EQ_D(sv_parse_doubles(&sv, ',', out, 8), 4);
+            EXPECT_EQ_F(out[0], 1.0);
+            EXPECT_EQ_F(out[1], 2.5);
+            EXPECT_EQ_F(out[2], -300.0);
+            EXPECT_EQ_F(out[3], 4.0);
+            EXPECT_EQ_D(sv.count, 0);
+        });
+
+        IT("should parse a column of lines", {
+            double out[8];
+            StringView sv = sv_from_cstr("0.5\r\n1.5\n2.5\n");
+            EXPECT_EQ_D(sv_parse_doubles(&sv, '\n', out, 8), 3);
+            EXPECT_EQ_F(out[2], 2.5);
+        });
+
+        IT("should stop at the first invalid field", {
+            double out[8];
+            StringView sv = sv_from_cstr("1,2x,3");
+            EXPECT_EQ_D(sv_parse_doubles(&sv, ',', out, 8), 1);
+            EXPECT_SV_EQ_CSTR(sv, "2x,3");
+        });
+
+        IT("should respect the capacity", {
+            double out[2];
+            StringView sv = sv_from_cstr("1\t2\t3");
+            EXPECT_EQ_D(sv_parse_doubles(&sv, '\t', out, 2), 2);
+            EXPECT_SV_EQ_CSTR(sv, "3");
+        });
+    });
+
+    DESCRIBE("sb_appendf", {
+        IT("should append formatted text", {
+            StringBuilder sb = sb_new(arena, 16);
+            EXPECT_EQ_D(sb_appendf(&sb, "%s=%d", "a", 1), 3);
+            EXPECT_EQ_D(sb_appendf(&sb, ",%s=%d", "b", 22), 5);
+            EXPECT_SV_EQ_CSTR(sb_to_sv(sb), "a=1,b=22");
+        });
+
+        IT("should grow dynamic builders when the output doesn't fit", {
+            StringBuilder sb = sb_new(NULL, 4);
+            sb_append_cstr(&sb, "abc");
+            sb_appendf(&sb, "%0300d", 7);
+            EXPECT_EQ_D(sb.count, 303);
+            EXPECT_EQ(sb.items[302], '7', "%c");
+            free(sb.items);
+        });
+
+        IT_FAIL("should respect the capacity if using an arena", {
+            StringBuilder sb = sb_new(arena, 4);
+            sb_appendf(&sb, "%s", "abcd");
+        });
+    });
+
+    DESCRIBE("sv_printf", {
+        IT("should format into the arena", {
+            StringView sv = sv_printf(arena, "%s:%d", "x", 42);
+            EXPECT_SV_EQ_CSTR(sv, "x:42");
+        });
+    });
+
+    DESCRIBE("sb_append_u64/sb_append_i64/sb_append_hex", {
+        IT("should append integers", {
+            StringBuilder sb = sb_new(arena, 128);
+            sb_append_u64(&sb, 0);
+            sb_push(&sb, ' ');
+            sb_append_u64(&sb, UINT64_MAX);
+            sb_push(&sb, ' ');
+            sb_append_i64(&sb, INT64_MIN);
+            sb_push(&sb, ' ');
+            sb_append_i64(&sb, 1234567);
+            EXPECT_SV_EQ_CSTR(sb_to_sv(sb), "0 18446744073709551615 "
+                                            "-9223372036854775808 1234567");
+        });
+
+        IT("should append hexadecimal with padding", {
+            StringBuilder sb = sb_new(arena, 128);
+            sb_append_hex(&sb, 0xbeef, 0);
+            sb_push(&sb, ' ');
+            sb_append_hex(&sb, 0xbeef, 8);
+            sb_push(&sb, ' ');
+            sb_append_hex(&sb, 0, 0);
+            EXPECT_SV_EQ_CSTR(sb_to_sv(sb), "beef 0000beef 0");
+        });
+
+        IT("should only use the capacity it needs", {
+            StringBuilder sb = sb_new(arena, 3);
+            sb_append_u64(&sb, 123);
+            EXPECT_SV_EQ_CSTR(sb_to_sv(sb), "123");
+        });
+    });
+
+    DESCRIBE("sb_append_double", {
+        IT("should append the shortest round-trip digits", {
+            StringBuilder sb = sb_new(arena, 128);
+            sb_append_double(&sb, 0.1, DOUBLE_FORMAT_GENERAL);
+            sb_push(&sb, ' ');
+            sb_append_double(&sb, 0.1 + 0.2, DOUBLE_FORMAT_GENERAL);
+            sb_push(&sb, ' ');
+            sb_append_double(&sb, -1.5e300, DOUBLE_FORMAT_GENERAL);
+            sb_push(&sb, ' ');
+            sb_append_double(&sb, 5e-324, DOUBLE_FORMAT_GENERAL);
+            sb_push(&sb, ' ');
+            sb_append_double(&sb, 100, DOUBLE_FORMAT_GENERAL);
+            EXPECT_SV_EQ_CSTR(sb_to_sv(sb),
+                              "0.1 0.30000000000000004 -1.5e300 5e-324 100");
+        });
+
+        IT("should respect the notation", {
+            StringBuilder sb = sb_new(arena, 128);
+            sb_append_double(&sb, 1.25e-5, DOUBLE_FORMAT_FIXED);
+            sb_push(&sb, ' ');
+            sb_append_double(&sb, 1250, DOUBLE_FORMAT_SCIENTIFIC);
+            sb_push(&sb, ' ');
+            sb_append_double(&sb, 12.5, DOUBLE_FORMAT_SCIENTIFIC);
+            EXPECT_SV_EQ_CSTR(sb_to_sv(sb), "0.0000125 1.25e3 1.25e1");
+        });
+
+        IT("should append special values", {
+            StringBuilder sb = sb_new(arena, 128);
+            sb_append_double(&sb, -INFINITY, DOUBLE_FORMAT_GENERAL);
+            sb_push(&sb, ' ');
+            sb_append_double(&sb, NAN, DOUBLE_FORMAT_GENERAL);
+            sb_push(&sb, ' ');
+            sb_append_double(&sb, -0.0, DOUBLE_FORMAT_GENERAL);
+            EXPECT_SV_EQ_CSTR(sb_to_sv(sb), "-inf nan -0");
+        });
+
+        IT("should round-trip through sv_parse_double", {
+            for (i32 i = 0; i < COUNT(double_cases); i++) {
+                StringView sv = sv_from_cstr(double_cases[i]);
+                double value = sv_parse_double(&sv);
+
+                Lifetime lt = lifetime_begin(arena);
+                StringBuilder sb = sb_new(lt.arena, DOUBLE_FORMAT_MAX_LENGTH);
+                sb_append_double(&sb, value, DOUBLE_FORMAT_GENERAL);
+                StringView formatted = sb_to_sv(sb);
+                EXPECT_EQ_F(sv_parse_double(&formatted), value);
+                lifetime_end(lt);
+            }
+        });
+    });
+
+    DESCRIBE("sw_begin/sw_end", {
+        IT("should commit everything that was written", {
+            StringBuilder sb = sb_new(arena, 64);
+            sb_append_cstr(&sb, "x=");
+
+            StringWriter w = sw_begin(&sb, 32);
+            SW_PUT(&w, '[');
+            sw_put_sv(&w, sv_from_cstr("ab"));
+            SW_PUT(&w, ',');
+            sw_put_i64(&w, -12);
+            SW_PUT(&w, ',');
+            sw_put_hex(&w, 255, 4);
+            SW_PUT(&w, ',');
+            sw_put_double(&w, 0.5, DOUBLE_FORMAT_GENERAL);
+            SW_PUT(&w, ']');
+            EXPECT_SV_EQ_CSTR(sb_to_sv(sb), "x=");
+            sw_end(w);
+
+            EXPECT_SV_EQ_CSTR(sb_to_sv(sb), "x=[ab,-12,00ff,0.5]");
+        });
+
+        IT("should grow dynamic builders when reserving", {
+            StringBuilder sb = sb_new(NULL, 4);
+            StringWriter w = sw_begin(&sb, 4);
+            for (i32 i = 0; i < 100; i++) {
+                sw_reserve(&w, 20);
+                sw_put_u64(&w, i % 10);
+            }
+            sw_end(w);
+            EXPECT_EQ_D(sb.count, 100);
+            EXPECT_EQ(sb.items[99], '9', "%c");
+            free(sb.items);
+        });
+
+        IT_FAIL("should respect the capacity if using an arena", {
+            StringBuilder sb = sb_new(arena, 4);
+            sw_begin(&sb, 5);
+        });
+    });
+
+    DESCRIBE("sv_utf8_validate", {
+        IT("should accept valid UTF-8", {
+            EXPECT(sv_utf8_validate(sv_from_cstr("")), "empty is valid");
+            EXPECT(sv_utf8_validate(sv_from_cstr("h\xC3\xA9\xE2\x82\xAC"
+                                                 "\xF0\x9F\x98\x80")),
+                   "mixed lengths are valid");
+            EXPECT(sv_utf8_validate(sv_from_cstr("\xF4\x8F\xBF\xBF")),
+                   "U+10FFFF is valid");
+        });
+
+        IT("should reject invalid UTF-8", {
+            for (i32 i = 0; i < COUNT(invalid_utf8_cases); i++) {
+                const char *c = invalid_utf8_cases[i];
+                EXPECTF(!sv_utf8_validate(sv_from_cstr(c)), "case %d", i);
+            }
+        });
+
+        IT("should find errors anywhere in long strings", {
+            char text[100];
+            for (i32 at = 0; at < 96; at++) {
+                memset(text, 'a', sizeof(text));
+                text[at] = '\xE2';
+                text[at + 1] = '\x82';
+                text[at + 2] = '\xAC';
+                StringView sv = sv_from_parts(text, sizeof(text));
+                EXPECTF(sv_utf8_validate(sv), "valid at %d", at);
+                EXPECTF(!sv_utf8_validate(sv_from_parts(text, at + 2)),
+                        "truncated at %d", at);
+                text[at + 2] = 'a';
+                EXPECTF(!sv_utf8_validate(sv), "invalid at %d", at);
+            }
+        });
+    });
+
+    DESCRIBE("sv_utf8_count/sv_utf8_slice", {
+        IT("should count code points", {
+            StringView sv = sv_from_cstr("h\xC3\xA9\xE2\x82\xAC"
+                                         "\xF0\x9F\x98\x80 and some ASCII");
+            EXPECT_EQ_D(sv_utf8_count(sv), 19);
+        });
+
+        IT("should slice on code point boundaries", {
+            StringView sv = sv_from_cstr("h\xC3\xA9\xE2\x82\xAC!");
+            EXPECT_SV_EQ_CSTR(sv_utf8_slice(sv, 1, 2), "\xC3\xA9\xE2\x82\xAC");
+            EXPECT_SV_EQ_CSTR(sv_utf8_slice(sv, 3, 10), "!");
+            EXPECT_SV_EQ_CSTR(sv_utf8_slice(sv, 10, 1), "");
+            StringView broken = sv_from_cstr("\x82\xAC"
+                                             "ab");
+            EXPECT_SV_EQ_CSTR(sv_utf8_slice(broken, 0, 1), "a");
+        });
+    });
+
+    DESCRIBE("sb_append_utf8_as_utf16/sb_append_utf16_as_utf8", {
+        IT("should transcode in both directions", {
+            StringView text = sv_from_cstr("h\xC3\xA9\xE2\x82\xAC"
+                                           "\xF0\x9F\x98\x80");
+            StringBuilder utf16 = sb_new(arena, 64);
+            EXPECT(sb_append_utf8_as_utf16(&utf16, text), "valid UTF-8");
+            EXPECT_EQ_D(utf16.count, (i32)sizeof(utf16_text));
+            EXPECT(!memcmp(utf16.items, utf16_text, sizeof(utf16_text)),
+                   "expected the same code units");
+
+            StringBuilder utf8 = sb_new(arena, 64);
+            EXPECT(sb_append_utf16_as_utf8(&utf8, utf16_text,
+                                           COUNT(utf16_text)),
+                   "valid UTF-16");
+            EXPECT(sv_eq(sb_to_sv(utf8), text), "expected the same text");
+        });
+
+        IT("should append nothing for invalid input", {
+            StringBuilder sb = sb_new(arena, 64);
+            EXPECT(!sb_append_utf8_as_utf16(&sb, sv_from_cstr("ab\xC0\xAF")),
+                   "overlong");
+            EXPECT(!sb_append_utf16_as_utf8(&sb, utf16_text, 4),
+                   "unpaired surrogate");
+            EXPECT_EQ_D(sb.count, 0);
+        });
+    });
+
+    DESCRIBE("sv_compare", {
+        IT("should compare using lexicographic order", {
+            EXPECT_EQ_D(sv_compare(sv_from_cstr("abc"), sv_from_cstr("abd")),
+                        ORDER_LT);
+            EXPECT_EQ_D(sv_compare(sv_from_cstr("abc"), sv_from_cstr("abc")),
+                        ORDER_EQ);
+            EXPECT_EQ_D(sv_compare(sv_from_cstr("b"), sv_from_cstr("abc")),
+                        ORDER_GT);
+        });
+
+        IT("should order prefixes first", {
+            EXPECT_EQ_D(sv_compare(sv_from_cstr("ab"), sv_from_cstr("abc")),
+                        ORDER_LT);
+            EXPECT_EQ_D(sv_compare(sv_from_cstr("abc"), sv_from_cstr("ab")),
+                        ORDER_GT);
+            EXPECT_EQ_D(sv_compare(sv_from_cstr(""), sv_from_cstr("")),
+                        ORDER_EQ);
+        });
+
+        IT("should compare bytes as unsigned characters", {
+            EXPECT_EQ_D(sv_compare(sv_from_cstr("a"), sv_from_cstr("\xC3")),
+                        ORDER_LT);
+        });
+    });
+
+    DESCRIBE("sv_compare_nocase", {
+        IT("should ignore the case of ASCII letters", {
+            StringView a = sv_from_cstr("The Quick Brown Fox Jumps Over");
+            StringView b = sv_from_cstr("the quick brown fox jumps over");
+            EXPECT_EQ_D(sv_compare_nocase(a, b), ORDER_EQ);
+            EXPECT_EQ_D(sv_compare_nocase(sv_from_cstr("abc"),
+                                          sv_from_cstr("ABD")),
+                        ORDER_LT);
+            EXPECT_EQ_D(sv_compare_nocase(sv_from_cstr("["),
+                                          sv_from_cstr("a")),
+                        ORDER_LT);
+        });
+
+        IT("should find differences past the first block", {
+            StringView a = sv_from_cstr("0123456789abcdefghijklmnopqrstuvwxyz");
+            StringView b = sv_from_cstr("0123456789ABCDEFGHIJKLMNOPQRSTUVWXYy");
+            EXPECT_EQ_D(sv_compare_nocase(a, b), ORDER_GT);
+            EXPECT_EQ_D(sv_compare_nocase(b, a), ORDER_LT);
+            StringView prefix = sv_from_parts(a.data, 20);
+            EXPECT_EQ_D(sv_compare_nocase(a, prefix), ORDER_GT);
+        });
+    });
+
+    DESCRIBE("sv_compare_natural", {
+        IT("should compare runs of digits by their value", {
+            for (i32 i = 0; i < COUNT(natural_order); i++) {
+                for (i32 j = 0; j < COUNT(natural_order); j++) {
+                    StringView a = sv_from_cstr(natural_order[i]);
+                    StringView b = sv_from_cstr(natural_order[j]);
+                    EXPECTF(sv_compare_natural(a, b) == COMPARE_BASIC(i, j),
+                            "comparing %s and %s", natural_order[i],
+                            natural_order[j]);
+                }
+            }
+        });
+    });
+
+    DESCRIBE("sv_find", {
+        IT("should find the first occurrence", {
+            StringView text =
+                sv_from_cstr("a needle in a haystack, and another needle");
+            EXPECT_EQ_D(sv_find(text, sv_from_cstr("needle")), 2);
+            EXPECT_EQ_D(sv_find(text, sv_from_cstr("needles")), -1);
+            EXPECT_EQ_D(sv_find(text, sv_from_cstr("r needle")), 34);
+            EXPECT_EQ_D(sv_find(text, sv_from_cstr("")), 0);
+            EXPECT_EQ_D(sv_find(sv_from_cstr("ab"), sv_from_cstr("abc")), -1);
+        });
+
+        IT("should find needles at every offset", {
+            char text[40];
+            memset(text, 'a', sizeof(text));
+            for (i32 at = 0; at + 3 <= COUNT(text); at++) {
+                MEMCPY(text + at, "aba", 3);
+                StringView sv = sv_from_parts(text, sizeof(text));
+                EXPECT_EQ_D(sv_find(sv, sv_from_cstr("ab")), at);
+                EXPECT_EQ_D(sv_find(sv, sv_from_cstr("aba")), at);
+                MEMCPY(text + at, "aaa", 3);
+            }
+        });
+    });
+
+    arena_destroy(arena);
+})
@@ -0,0 +1,732 @@
+#include "../bookstore/test.h"
+
+#include "../bookstore/system.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+#ifdef __linux__
+#include <dlfcn.h>
+#endif // __linux__
+
+#define EXPECT_EQ_D(a, b)  EXPECT_EQ(a, b, "%d")
+#define EXPECT_EQ_LD(a, b) EXPECT_EQ(a, b, "%" PRIi64)
+
+#define COUNT(array) (i32)(sizeof(array) / sizeof(*(array)))
+
+// Every file the tests write is inside this directory, which is created anew
+// for each test
+#define TEST_DIR "bin/test/system-files"
+
+const char *test_path(Arena *arena, const char *name) {
+    return arena_sprintf(arena, TEST_DIR "/%s", name);
+}
+
+// Render the `i`th line of a file which is larger than the buffer of a
+// `FileReader`, with lines of varying length
+StringView numbered_line(Arena *arena, i32 i) {
+    return sv_printf(arena, "line %d %.*s", i, i % 97,
+                     "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+                     "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx");
+}
+
+const char *crlf_lines[] = {"a", "b", "", "c"};
+
+// Get the amount of 512-byte blocks which are allocated on the disk for the
+// file at `path`, or `-1` if it can't be told
+i64 allocated_blocks(const char *path) {
+#ifdef _WIN32
+    (void)path;
+    return -1;
+#else
+    struct stat statbuf;
+    if (stat(path, &statbuf) < 0) return -1;
+    return statbuf.st_blocks;
+#endif // _WIN32
+}
+
+const char *batch_names[] = {"first.txt", "empty.txt", "third.txt"};
+const char *batch_contents[] = {"first", "", "third\n"};
+
+// `DirectoryWatcher` is only implemented with inotify and on Windows
+#if defined(__linux__) || defined(_WIN32)
+#define WATCHER_SUPPORTED true
+#else
+#define WATCHER_SUPPORTED false
+#endif // defined(__linux__) || defined(_WIN32)
+
+// Only inotify reports the roots themselves being deleted or moved away
+#ifdef __linux__
+#define WATCHER_REPORTS_ROOTS true
+#else
+#define WATCHER_REPORTS_ROOTS false
+#endif // __linux__
+
+// Check whether one of `changes` is a path to a file named `name`
+bool has_change(FilePaths changes, const char *name) {
+    for (i32 i = 0; i < changes.count; i++) {
+        StringView path = sv_from_cstr(changes.items[i]);
+        if (sv_eq_cstr(get_basename(path), name)) return true;
+    }
+    return false;
+}
+
+// The files of the tree which the walking tests walk, relative to `TEST_DIR`,
+// which contain their own paths
+const char *tree_files[] = {
+    "tree/5.txt", "tree/a/1.txt", "tree/a/b/2.txt", "tree/a/b/3.txt",
+    "tree/c/4.txt",
+};
+// Every path of the tree, sorted
+const char *tree_paths[] = {
+    "tree",     "tree/5.txt",     "tree/a",         "tree/a/1.txt",
+    "tree/a/b", "tree/a/b/2.txt", "tree/a/b/3.txt", "tree/c",
+    "tree/c/4.txt",
+};
+
+// Write the tree of `tree_files` into `TEST_DIR`
+bool make_tree(Arena *arena) {
+    for (i32 i = 0; i < COUNT(tree_files); i++) {
+        const char *path = test_path(arena, tree_files[i]);
+        StringView dir = get_dirname(sv_from_cstr(path));
+        if (!make_directory_recursively(arena, sv_to_cstr(arena, dir)) ||
+            !write_file(path, sv_from_cstr(tree_files[i])))
+            return false;
+    }
+    return true;
+}
+
+// Check whether the contents of every file of the tree were copied into the
+// directory `dest` in `TEST_DIR`
+bool tree_copied(Arena *arena, const char *dest) {
+    for (i32 i = 0; i < COUNT(tree_files); i++) {
+        StringView name = sv_from_cstr(tree_files[i]);
+        sv_strip_prefix(&name, sv_from_cstr("tree"));
+        const char *path = arena_sprintf(arena, TEST_DIR "/%s" SV_FMT, dest,
+                                         SV_ARG(name));
+        StringView contents = read_entire_file(arena, path);
+        if (!sv_eq_cstr(contents, tree_files[i])) return false;
+    }
+    return true;
+}
+
+// Whether deleting files can be denied by the permissions of their directory,
+// which root bypasses
+bool permissions_enforced(void) {
+#ifdef _WIN32
+    return false;
+#else
+    return geteuid() != 0;
+#endif // _WIN32
+}
+
+// Allow or deny creating and deleting entries in the directory `path`
+bool set_writable(const char *path, bool writable) {
+#ifdef _WIN32
+    (void)path;
+    (void)writable;
+    return false;
+#else
+    return chmod(path, writable ? 0755 : 0555) == 0;
+#endif // _WIN32
+}
+
+// Whether `readdir` reports the type of every entry as unknown, like some file
+// systems do, so the walker has to stat them itself
+bool hide_entry_types = false;
+
+#ifdef __linux__
+// Only declared with `_GNU_SOURCE`
+#ifndef RTLD_NEXT
+#define RTLD_NEXT ((void *)-1l)
+#endif // RTLD_NEXT
+
+// Takes the place of the `readdir` of libc, which the walker reads directories
+// with, to hide the types of entries when `hide_entry_types` is set
+struct dirent *readdir(DIR *dir) {
+    static struct dirent *(*next)(DIR *);
+    if (next == NULL) *(void **)&next = dlsym(RTLD_NEXT, "readdir");
+
+    struct dirent *entry = next(dir);
+    if (entry != NULL && hide_entry_types) entry->d_type = DT_UNKNOWN;
+    return entry;
+}
+
+#define CAN_HIDE_ENTRY_TYPES true
+#else
+#define CAN_HIDE_ENTRY_TYPES false
+#endif // __linux__
+
+// Create a symlink at `path` pointing to `target`, or return `false` if it
+// can't be created
+bool make_symlink(const char *target, const char *path) {
+#ifdef _WIN32
+    (void)target;
+    (void)path;
+    return false;
+#else
+    return symlink(target, path) == 0;
+#endif // _WIN32
+}
+
+// Push the path of each entry into the `FilePaths` in the `user_data`
+bool collect_visit(WalkEntry entry) {
+    FilePaths *paths = entry.user_data;
+    file_paths_push(paths, arena_clone_cstr(entry.arena, entry.path));
+    return true;
+}
+
+// Collect each regular file like `collect_visit`
+bool collect_file_visit(WalkEntry entry) {
+    if (entry.type != FILE_TYPE_REGULAR) return true;
+    return collect_visit(entry);
+}
+
+// Collect each symlink like `collect_visit`
+bool collect_symlink_visit(WalkEntry entry) {
+    if (entry.type != FILE_TYPE_SYMLINK) return true;
+    return collect_visit(entry);
+}
+
+// Collect each entry like `collect_visit`, skipping the contents of directories
+// named `a` and stopping at the first regular file
+bool skip_visit(WalkEntry entry) {
+    if (sv_eq_cstr(get_basename(sv_from_cstr(entry.path)), "a")) {
+        *entry.action = WALK_SKIP;
+    } else if (entry.type == FILE_TYPE_REGULAR) {
+        *entry.action = WALK_STOP;
+    }
+    return collect_visit(entry);
+}
+
+// Find where the directory containing the `i`th of `paths` is in them, or `-1`
+// if it isn't
+i32 parent_index(FilePaths paths, i32 i) {
+    StringView dir = get_dirname(sv_from_cstr(paths.items[i]));
+    for (i32 j = 0; j < paths.count; j++) {
+        if (sv_eq_cstr(dir, paths.items[j])) return j;
+    }
+    return -1;
+}
+
+// Allocate half of a walking thread's arena on each visit
+bool allocate_visit(WalkEntry entry) {
+    arena_alloc(entry.arena, SYSTEM_WALK_ARENA_SIZE / 2);
+    return true;
+}
+
+TEST_MAIN({
+    Arena *arena = arena_new(MiB(8));
+
+    BEFORE_EACH({
+        arena_clear(arena);
+        FileStat stat;
+        if (get_file_stat(TEST_DIR, &stat) > 0) {
+            delete_directory_recursively(arena, TEST_DIR);
+        }
+        make_directory_recursively(arena, TEST_DIR);
+    });
+
+    DESCRIBE("file_reader_next_line", {
+        IT("should hand out lines split across refills of the buffer", {
+            i32 count = 20000;
+            StringBuilder sb = sb_new(arena, MiB(2));
+            for (i32 i = 0; i < count; i++) {
+                Lifetime lt = lifetime_begin(arena);
+                StringView line = numbered_line(lt.arena, i);
+                sb_appendf(&sb, SV_FMT "\n", SV_ARG(line));
+                lifetime_end(lt);
+            }
+            const char *path = test_path(arena, "lines.txt");
+            EXPECT(write_file(path, sb_to_sv(sb)), "failed to write file");
+            EXPECT(sb.count > 2 * FILE_READER_CHUNK_SIZE,
+                   "file fits in the buffer");
+
+            FileReader reader;
+            EXPECT(file_reader_open(arena, path, &reader),
+                   "failed to open reader");
+            i32 read = 0;
+            StringView line;
+            while (file_reader_next_line(&reader, &line) > 0) {
+                Lifetime lt = lifetime_begin(arena);
+                StringView expected = numbered_line(lt.arena, read);
+                EXPECTF(sv_eq(line, expected), "line %d: " SV_FMT, read,
+                        SV_ARG(line));
+                lifetime_end(lt);
+                read++;
+            }
+            EXPECT_EQ_D(read, count);
+            file_reader_close(&reader);
+        });
+
+        IT("should strip \\r\\n line endings", {
+            const char *path = test_path(arena, "crlf.txt");
+            EXPECT(write_file(path, sv_from_cstr("a\r\nb\r\n\r\nc")),
+                   "failed to write file");
+
+            FileReader reader;
+            EXPECT(file_reader_open(arena, path, &reader),
+                   "failed to open reader");
+            StringView line;
+            for (i32 i = 0; i < COUNT(crlf_lines); i++) {
+                EXPECT_EQ_D(file_reader_next_line(&reader, &line), 1);
+                EXPECT_SV_EQ_CSTR(line, crlf_lines[i]);
+            }
+            EXPECT_EQ_D(file_reader_next_line(&reader, &line), 0);
+            file_reader_close(&reader);
+        });
+    });
+
+    DESCRIBE("map_entire_file", {
+        IT("should map the same contents as read_entire_file", {
+            const char *path = test_path(arena, "mapped.txt");
+            EXPECT(write_file(path, sv_from_cstr("mapped\ncontents\n")),
+                   "failed to write file");
+
+            MappedFile mapping;
+            StringView mapped = map_entire_file(arena, path, &mapping);
+            EXPECT(mapping.data != NULL, "regular file wasn't mapped");
+            EXPECT_EQ_LD(mapping.count, (i64)mapped.count);
+            EXPECT(sv_eq(mapped, read_entire_file(arena, path)),
+                   "mapped contents differ");
+            unmap_file(&mapping);
+            EXPECT(mapping.data == NULL, "mapping wasn't released");
+        });
+
+        IT("should return empty files without mapping them", {
+            const char *path = test_path(arena, "empty.txt");
+            EXPECT(write_file(path, SV_EMPTY), "failed to write file");
+
+            MappedFile mapping;
+            StringView mapped = map_entire_file(arena, path, &mapping);
+            EXPECT_EQ_D(mapped.count, 0);
+            EXPECT(mapping.data == NULL, "empty file was mapped");
+            unmap_file(&mapping);
+        });
+    });
+
+    DESCRIBE("copy_file", {
+        IT("should copy the contents and replace the destination", {
+            const char *src = test_path(arena, "src.txt");
+            const char *dest = test_path(arena, "dest.txt");
+            EXPECT(write_file(src, sv_from_cstr("copied")),
+                   "failed to write file");
+            EXPECT(write_file(dest, sv_from_cstr("longer old contents")),
+                   "failed to write file");
+
+            EXPECT(copy_file(arena, src, dest), "failed to copy file");
+            EXPECT_SV_EQ_CSTR(read_entire_file(arena, dest), "copied");
+        });
+
+        IT("should keep holes in sparse files", {
+            const char *src = test_path(arena, "sparse.bin");
+            const char *dest = test_path(arena, "sparse-copy.bin");
+            i64 hole = MiB(1);
+            FILE *f = fopen(src, "wb");
+            EXPECT(f != NULL, "failed to open file");
+            fputs("head", f);
+            fseek(f, hole, SEEK_SET);
+            fputs("tail", f);
+            fclose(f);
+
+            EXPECT(copy_file(arena, src, dest), "failed to copy file");
+            StringView copied = read_entire_file(arena, dest);
+            EXPECT_EQ_LD((i64)copied.count, hole + 4);
+            EXPECT(sv_eq(copied, read_entire_file(arena, src)),
+                   "copied contents differ");
+
+            // Not every file system supports sparse files
+            i64 blocks = allocated_blocks(src);
+            if (blocks < 0 || blocks * 512 >= hole) break;
+            EXPECTF(allocated_blocks(dest) * 512 < hole,
+                    "copy allocated %" PRIi64 " blocks for %" PRIi64,
+                    allocated_blocks(dest), blocks);
+        });
+
+        IT("should copy files which are shorter than their size", {
+            // Files in `/sys` report a size of a page, whatever their contents
+            const char *src = "/sys/devices/system/cpu/online";
+            FileStat stat;
+            if (get_file_stat(src, &stat) <= 0) break;
+
+            const char *dest = test_path(arena, "online");
+            EXPECT(copy_file(arena, src, dest), "failed to copy file");
+            StringView copied = read_entire_file(arena, dest);
+            EXPECTF(copied.count > 0 && copied.count < stat.size,
+                    "copied %d bytes", copied.count);
+            EXPECT(sv_get(copied, -1) == '\n', "copy was padded");
+        });
+
+        IT("should copy files which report a size of 0", {
+            const char *src = "/proc/self/status";
+            FileStat stat;
+            if (get_file_stat(src, &stat) <= 0) break;
+
+            const char *dest = test_path(arena, "status");
+            EXPECT(copy_file(arena, src, dest), "failed to copy file");
+            StringView copied = read_entire_file(arena, dest);
+            EXPECTF(copied.count > 0, "copied %d bytes", copied.count);
+        });
+    });
+
+    DESCRIBE("read_files", {
+        IT("should read back what write_files wrote", {
+            FilePaths paths = file_paths_new(arena, COUNT(batch_names));
+            StringViews contents = svs_new(arena, COUNT(batch_names));
+            for (i32 i = 0; i < COUNT(batch_names); i++) {
+                file_paths_push(&paths, test_path(arena, batch_names[i]));
+                svs_push(&contents, sv_from_cstr(batch_contents[i]));
+            }
+            EXPECT(write_files(paths, contents), "failed to write files");
+
+            StringViews read = svs_new(arena, COUNT(batch_names));
+            EXPECT(read_files(arena, paths, &read), "failed to read files");
+            EXPECT_EQ_D(read.count, COUNT(batch_names));
+            for (i32 i = 0; i < read.count; i++) {
+                EXPECT_SV_EQ_CSTR(read.items[i], batch_contents[i]);
+            }
+        });
+
+        IT("should leave files which couldn't be read as SV_INVALID", {
+            const char *path = test_path(arena, "first.txt");
+            EXPECT(write_file(path, sv_from_cstr("first")),
+                   "failed to write file");
+            FilePaths paths = file_paths_new(arena, 2);
+            file_paths_push(&paths, test_path(arena, "missing.txt"));
+            file_paths_push(&paths, path);
+
+            StringViews read = svs_new(arena, 2);
+            EXPECT(!read_files(arena, paths, &read), "missing file was read");
+            EXPECT_EQ_D(read.count, 2);
+            EXPECT(read.items[0].count < 0, "missing file isn't invalid");
+            EXPECT_SV_EQ_CSTR(read.items[1], "first");
+        });
+    });
+
+    DESCRIBE("file_writer", {
+        IT("should write chunks larger and smaller than its buffer", {
+            const char *path = test_path(arena, "written.txt");
+            StringBuilder sb = sb_new(arena, 3 * FILE_WRITER_BUFFER_SIZE);
+            for (i32 i = 0; i < sb.capacity; i++) sb_push(&sb, 'a' + i % 26);
+            StringView contents = sb_to_sv(sb);
+
+            FileWriter writer;
+            EXPECT(FILE_WRITER_OPEN(arena, path, &writer),
+                   "failed to open writer");
+            StringView small = sv_from_parts(contents.data, 10);
+            StringView large =
+                sv_from_parts(contents.data + 10, contents.count - 10);
+            EXPECT(file_writer_write(&writer, small), "failed to write");
+            EXPECT(file_writer_write(&writer, large), "failed to write");
+            EXPECT(file_writer_close(&writer), "failed to close writer");
+            EXPECT(sv_eq(read_entire_file(arena, path), contents),
+                   "written contents differ");
+        });
+
+        IT("should leave the old contents until an atomic writer is closed", {
+            const char *path = test_path(arena, "atomic.txt");
+            EXPECT(write_file(path, sv_from_cstr("old")),
+                   "failed to write file");
+
+            FileWriter writer;
+            EXPECT(FILE_WRITER_OPEN(arena, path, &writer, .atomic = true),
+                   "failed to open writer");
+            EXPECT(file_writer_write(&writer, sv_from_cstr("new")),
+                   "failed to write");
+            EXPECT(file_writer_flush(&writer), "failed to flush");
+            EXPECT_SV_EQ_CSTR(read_entire_file(arena, path), "old");
+            EXPECT(file_writer_close(&writer), "failed to close writer");
+            EXPECT_SV_EQ_CSTR(read_entire_file(arena, path), "new");
+        });
+
+        IT("should keep the old contents if an atomic writer is discarded", {
+            const char *path = test_path(arena, "atomic.txt");
+            EXPECT(write_file(path, sv_from_cstr("old")),
+                   "failed to write file");
+
+            FileWriter writer;
+            EXPECT(FILE_WRITER_OPEN(arena, path, &writer, .atomic = true),
+                   "failed to open writer");
+            EXPECT(file_writer_write(&writer, sv_from_cstr("new")),
+                   "failed to write");
+            file_writer_discard(&writer);
+            EXPECT_SV_EQ_CSTR(read_entire_file(arena, path), "old");
+            FileStat stat;
+            EXPECT_EQ_D(get_file_stat(writer.write_path, &stat), 0);
+        });
+    });
+
+    DESCRIBE("directory_watcher_next", {
+        IT("should report files created inside the watched directories", {
+            if (!WATCHER_SUPPORTED) break;
+            EXPECT(make_directory_recursively(arena, TEST_DIR "/nested"),
+                   "failed to create directory");
+
+            DirectoryWatcher watcher;
+            EXPECT(directory_watcher_open(arena, TEST_DIR, &watcher),
+                   "failed to open watcher");
+            EXPECT(write_file(test_path(arena, "nested/created.txt"),
+                              sv_from_cstr("created")),
+                   "failed to write file");
+
+            FilePaths changes = file_paths_new(arena, 64);
+            i8 result = directory_watcher_next(&watcher, arena, 1000, &changes);
+            EXPECT_EQ_D(result, 1);
+            EXPECT(has_change(changes, "created.txt"), "change is missing");
+            directory_watcher_close(&watcher);
+        });
+
+        IT("should report roots which are deleted or moved away", {
+            if (!WATCHER_REPORTS_ROOTS) break;
+            const char *root = test_path(arena, "root");
+            const char *moved = test_path(arena, "moved");
+            EXPECT(make_directory(root, true), "failed to create directory");
+
+            DirectoryWatcher watcher;
+            EXPECT(directory_watcher_open(arena, root, &watcher),
+                   "failed to open watcher");
+            EXPECT(rename(root, moved) == 0, "failed to move directory");
+            FilePaths changes = file_paths_new(arena, 64);
+            i8 result = directory_watcher_next(&watcher, arena, 1000, &changes);
+            EXPECT_EQ_D(result, 1);
+            EXPECT(has_change(changes, "root"), "move is missing");
+
+            // The moved root isn't watched anymore
+            EXPECT(make_directory(root, true), "failed to create directory");
+            EXPECT(directory_watcher_add(arena, &watcher, root),
+                   "failed to watch directory");
+            EXPECT(write_file(test_path(arena, "moved/file.txt"),
+                              sv_from_cstr("moved")),
+                   "failed to write file");
+            EXPECT(delete_file(root), "failed to delete directory");
+            changes.count = 0;
+            result = directory_watcher_next(&watcher, arena, 1000, &changes);
+            EXPECT_EQ_D(result, 1);
+            EXPECT(has_change(changes, "root"), "deletion is missing");
+            EXPECT(!has_change(changes, "file.txt"), "moved root is watched");
+            directory_watcher_close(&watcher);
+        });
+
+        IT("should time out when nothing changes", {
+            if (!WATCHER_SUPPORTED) break;
+            DirectoryWatcher watcher;
+            EXPECT(directory_watcher_open(arena, TEST_DIR, &watcher),
+                   "failed to open watcher");
+
+            FilePaths changes = file_paths_new(arena, 64);
+            i8 result = directory_watcher_next(&watcher, arena, 50, &changes);
+            EXPECT_EQ_D(result, 0);
+            EXPECT_EQ_D(changes.count, 0);
+            directory_watcher_close(&watcher);
+        });
+    });
+
+    DESCRIBE("stat_cache_get", {
+        IT("should cache files which don't exist until it's cleared", {
+            const char *path = test_path(arena, "later.txt");
+            StatCache cache;
+            stat_cache_init(&cache);
+
+            FileStat stat;
+            EXPECT_EQ_D(stat_cache_get(&cache, path, &stat), 0);
+            EXPECT(write_file(path, sv_from_cstr("contents")),
+                   "failed to write file");
+            EXPECT_EQ_D(stat_cache_get(&cache, path, &stat), 0);
+
+            stat_cache_clear(&cache);
+            EXPECT_EQ_D(stat_cache_get(&cache, path, &stat), 1);
+            EXPECT_EQ_LD(stat.size, (i64)8);
+            EXPECT_EQ_D(stat.type, FILE_TYPE_REGULAR);
+            stat_cache_destroy(&cache);
+        });
+
+        IT("should return what was put for a path", {
+            const char *path = test_path(arena, "put.txt");
+            StatCache cache;
+            stat_cache_init(&cache);
+
+            stat_cache_put(&cache, path,
+                           (FileStat){.size = 42, .type = FILE_TYPE_REGULAR});
+            FileStat stat;
+            EXPECT_EQ_D(stat_cache_get(&cache, path, &stat), 1);
+            EXPECT_EQ_LD(stat.size, (i64)42);
+            stat_cache_destroy(&cache);
+        });
+    });
+
+    DESCRIBE("walk_directory_opt", {
+        IT("should keep what serialized parallel visits allocate", {
+            EXPECT(make_tree(arena), "failed to make tree");
+            FilePaths paths = file_paths_new(arena, COUNT(tree_paths));
+            EXPECT(WALK_DIRECTORY(arena, test_path(arena, "tree"),
+                                  collect_visit, .user_data = &paths,
+                                  .threads = 4, .serialize_visits = true),
+                   "failed to walk");
+
+            file_paths_sort(paths);
+            EXPECT_EQ_D(paths.count, COUNT(tree_paths));
+            for (i32 i = 0; i < paths.count; i++) {
+                EXPECT_SV_EQ_CSTR(sv_from_cstr(paths.items[i]),
+                                  test_path(arena, tree_paths[i]));
+            }
+        });
+
+        IT("should reset the arena of parallel visits after each one", {
+            EXPECT(make_tree(arena), "failed to make tree");
+            EXPECT(WALK_DIRECTORY(arena, test_path(arena, "tree"),
+                                  allocate_visit, .threads = 2),
+                   "failed to walk");
+        });
+
+        IT("should stat entries whose type isn't reported", {
+            if (!CAN_HIDE_ENTRY_TYPES) break;
+            EXPECT(make_tree(arena), "failed to make tree");
+            for (i32 threads = 1; threads <= 4; threads *= 4) {
+                FilePaths files = file_paths_new(arena, COUNT(tree_files));
+                hide_entry_types = true;
+                bool walked = WALK_DIRECTORY(
+                    arena, test_path(arena, "tree"), collect_file_visit,
+                    .user_data = &files, .threads = threads,
+                    .serialize_visits = true);
+                hide_entry_types = false;
+                EXPECT(walked, "failed to walk");
+
+                file_paths_sort(files);
+                EXPECT_EQ_D(files.count, COUNT(tree_files));
+                for (i32 i = 0; i < files.count; i++) {
+                    EXPECT_SV_EQ_CSTR(sv_from_cstr(files.items[i]),
+                                      test_path(arena, tree_files[i]));
+                }
+            }
+        });
+
+        IT("should not follow symlinks", {
+            EXPECT(make_tree(arena), "failed to make tree");
+            const char *link = test_path(arena, "tree/link");
+            if (!make_symlink("a", link)) break;
+            for (i32 threads = 1; threads <= 4; threads *= 4) {
+                FilePaths paths =
+                    file_paths_new(arena, COUNT(tree_paths) + 1);
+                EXPECT(WALK_DIRECTORY(arena, test_path(arena, "tree"),
+                                      collect_visit, .user_data = &paths,
+                                      .threads = threads,
+                                      .serialize_visits = true),
+                       "failed to walk");
+                EXPECT_EQ_D(paths.count, COUNT(tree_paths) + 1);
+
+                FilePaths links = file_paths_new(arena, 1);
+                EXPECT(WALK_DIRECTORY(arena, test_path(arena, "tree"),
+                                      collect_symlink_visit,
+                                      .user_data = &links, .threads = threads,
+                                      .serialize_visits = true),
+                       "failed to walk");
+                EXPECT_EQ_D(links.count, 1);
+                EXPECT_SV_EQ_CSTR(sv_from_cstr(links.items[0]), link);
+            }
+        });
+
+        IT("should visit directories before their entries, or after them in "
+           "post-order",
+           {
+               EXPECT(make_tree(arena), "failed to make tree");
+               for (i32 post_order = 0; post_order < 2; post_order++) {
+                   FilePaths paths = file_paths_new(arena, COUNT(tree_paths));
+                   EXPECT(WALK_DIRECTORY(arena, test_path(arena, "tree"),
+                                         collect_visit, .user_data = &paths,
+                                         .post_order = post_order,
+                                         .threads = 4,
+                                         .serialize_visits = true),
+                          "failed to walk");
+                   EXPECT_EQ_D(paths.count, COUNT(tree_paths));
+                   for (i32 i = 1; i < paths.count; i++) {
+                       i32 parent = parent_index(paths, i);
+                       if (parent < 0) continue;
+                       EXPECTF(post_order ? parent > i : parent < i,
+                               "visited '%s' out of order", paths.items[i]);
+                   }
+               }
+           });
+
+        IT("should skip directories and stop when asked to", {
+            EXPECT(make_tree(arena), "failed to make tree");
+            FilePaths paths = file_paths_new(arena, COUNT(tree_paths));
+            EXPECT(WALK_DIRECTORY(arena, test_path(arena, "tree"), skip_visit,
+                                  .user_data = &paths),
+                   "failed to walk");
+
+            // Only the last entry is a file, and nothing inside `a` is visited
+            const char *a = test_path(arena, "tree/a");
+            for (i32 i = 0; i < paths.count; i++) {
+                StringView path = sv_from_cstr(paths.items[i]);
+                bool is_file = get_file_type(paths.items[i]) ==
+                               FILE_TYPE_REGULAR;
+                EXPECTF(is_file == (i == paths.count - 1),
+                        "visited '%s' after stopping", paths.items[i]);
+                EXPECTF(sv_eq_cstr(path, a) ||
+                            !sv_eq_cstr(get_dirname(path), a),
+                        "visited '%s' after skipping", paths.items[i]);
+            }
+        });
+    });
+
+    DESCRIBE("copy_directory_recursively_parallel", {
+        IT("should copy every directory and file of the tree", {
+            EXPECT(make_tree(arena), "failed to make tree");
+            EXPECT(copy_directory_recursively_parallel(
+                       arena, test_path(arena, "tree"),
+                       test_path(arena, "copy"), 4),
+                   "failed to copy");
+
+            FilePaths paths = file_paths_new(arena, COUNT(tree_paths));
+            EXPECT(WALK_DIRECTORY(arena, test_path(arena, "copy"),
+                                  collect_visit, .user_data = &paths),
+                   "failed to walk");
+            EXPECT_EQ_D(paths.count, COUNT(tree_paths));
+            EXPECT(tree_copied(arena, "copy"), "expected the same contents");
+        });
+
+        IT("should report a file which fails to be copied", {
+            EXPECT(make_tree(arena), "failed to make tree");
+            // A directory in the way of a file deep in the tree
+            EXPECT(make_directory_recursively(
+                       arena, test_path(arena, "copy/a/b/2.txt")),
+                   "failed to make directory");
+            EXPECT(!copy_directory_recursively_parallel(
+                       arena, test_path(arena, "tree"),
+                       test_path(arena, "copy"), 4),
+                   "expected failure");
+        });
+    });
+
+    DESCRIBE("delete_directory_recursively_parallel", {
+        IT("should delete every directory and file of the tree", {
+            EXPECT(make_tree(arena), "failed to make tree");
+            EXPECT(delete_directory_recursively_parallel(
+                       arena, test_path(arena, "tree"), 4),
+                   "failed to delete");
+
+            FileStat stat;
+            EXPECT_EQ_D(get_file_stat(test_path(arena, "tree"), &stat), 0);
+        });
+
+        IT("should report an entry which fails to be deleted", {
+            if (!permissions_enforced()) break;
+            EXPECT(make_tree(arena), "failed to make tree");
+            const char *locked = test_path(arena, "tree/a/b");
+            EXPECT(set_writable(locked, false), "failed to lock directory");
+            bool deleted = delete_directory_recursively_parallel(
+                arena, test_path(arena, "tree"), 4);
+            set_writable(locked, true);
+            EXPECT(!deleted, "expected failure");
+
+            FileStat stat;
+            EXPECT_EQ_D(get_file_stat(test_path(arena, "tree/a/b/2.txt"),
+                                      &stat),
+                        1);
+        });
+    });
+
+    delete_directory_recursively(arena, TEST_DIR);
+    arena_destroy(arena);
+});
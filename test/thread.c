@@ -0,0 +1,108 @@
+#include "../bookstore/test.h"
+
+#include "../bookstore/thread.h"
+
+#define EXPECT_EQ_LD(a, b) EXPECT_EQ(a, b, "%" PRIi64)
+
+typedef struct {
+    Mutex lock;
+    i64 locked_count;
+    volatile i64 atomic_count;
+} Counter;
+
+void increment(void *data) {
+    Counter *counter = data;
+    for (i32 i = 0; i < 10000; i++) {
+        mutex_lock(&counter->lock);
+        counter->locked_count++;
+        mutex_unlock(&counter->lock);
+        atomic_add_i64(&counter->atomic_count, 1);
+    }
+}
+
+typedef struct {
+    volatile i64 *leaves;
+    i32 depth;
+} Tree;
+
+// Submit two children for every node until `depth` reaches 0, like walking a
+// directory tree
+void split(ThreadPoolWorker *worker, void *data) {
+    Tree *tree = data;
+    if (tree->depth == 0) {
+        atomic_add_i64(tree->leaves, 1);
+        return;
+    }
+
+    Tree *children = arena_alloc(worker->arena, 2 * sizeof(Tree));
+    for (i32 i = 0; i < 2; i++) {
+        children[i] = (Tree){tree->leaves, tree->depth - 1};
+        thread_pool_submit(worker->pool, worker, split, &children[i]);
+    }
+}
+
+void add_index(ThreadPoolWorker *worker, void *data) {
+    UNUSED(worker);
+    i64 *values = data;
+    atomic_add_i64(&values[0], 1);
+}
+
+TEST_MAIN({
+    Arena *arena = arena_new(KiB(64));
+
+    BEFORE_EACH({ arena_clear(arena); });
+
+    DESCRIBE("thread_start", {
+        IT("should run threads concurrently with locks and atomics", {
+            Counter counter = {0};
+            mutex_init(&counter.lock);
+
+            Thread threads[4];
+            for (i32 i = 0; i < 4; i++) {
+                EXPECT(thread_start(&threads[i], increment, &counter),
+                       "expected the thread to start");
+            }
+            for (i32 i = 0; i < 4; i++) thread_join(threads[i]);
+
+            EXPECT_EQ_LD(counter.locked_count, (i64)40000);
+            EXPECT_EQ_LD(atomic_load_i64(&counter.atomic_count), (i64)40000);
+            mutex_destroy(&counter.lock);
+        });
+    });
+
+    DESCRIBE("thread_pool", {
+        IT("should run jobs submitted from outside the pool", {
+            ThreadPool *pool = thread_pool_new(4, KiB(4));
+            EXPECT(pool != NULL, "expected the pool to start");
+
+            volatile i64 count = 0;
+            for (i32 i = 0; i < 1000; i++) {
+                thread_pool_submit(pool, NULL, add_index, (i64 *)&count);
+            }
+            thread_pool_wait(pool);
+            EXPECT_EQ_LD(atomic_load_i64(&count), (i64)1000);
+
+            thread_pool_destroy(pool);
+        });
+
+        IT("should wait for jobs submitted by other jobs", {
+            ThreadPool *pool = thread_pool_new(0, MiB(1));
+            EXPECT(pool != NULL, "expected the pool to start");
+
+            volatile i64 leaves = 0;
+            Tree root = {.leaves = &leaves};
+            root.depth = 12;
+            thread_pool_submit(pool, NULL, split, &root);
+            thread_pool_wait(pool);
+            EXPECT_EQ_LD(atomic_load_i64(&leaves), (i64)4096);
+
+            // The pool can be reused once it's idle
+            root.depth = 4;
+            thread_pool_submit(pool, NULL, split, &root);
+            thread_pool_destroy(pool);
+            EXPECT_EQ_LD(atomic_load_i64(&leaves), (i64)4112);
+        });
+    });
+
+    arena_destroy(arena);
+});